@@ -0,0 +1,103 @@
+#include "hash.h"
+#include "list.h"
+#include "util.h"
+
+#define N_BUCKETS 64
+
+typedef struct
+{
+  char *key;
+  int   value;
+} hash_entry;
+
+struct hash_table
+{
+  list_node *buckets[N_BUCKETS];
+  size_t     size;
+};
+
+static void
+hash_entry_free (void *data)
+{
+  hash_entry *entry = data;
+
+  free (entry->key);
+  free (entry);
+}
+
+static hash_entry *
+hash_table_find (hash_table *table, const char *key)
+{
+  list_node *node;
+
+  for (node = table->buckets[str_hash (key) % N_BUCKETS]; node != NULL; node = node->next)
+    {
+      hash_entry *entry = node->data;
+
+      if (strcmp (entry->key, key) == 0)
+        return entry;
+    }
+
+  return NULL;
+}
+
+hash_table *
+hash_table_new (void)
+{
+  hash_table *table = xmalloc (sizeof *table);
+
+  memset (table, 0, sizeof *table);
+
+  return table;
+}
+
+void
+hash_table_free (hash_table *table)
+{
+  size_t i;
+
+  for (i = 0; i < N_BUCKETS; i++)
+    list_free (table->buckets[i], hash_entry_free);
+  free (table);
+}
+
+void
+hash_table_insert (hash_table *table, const char *key, int value)
+{
+  hash_entry *entry = hash_table_find (table, key);
+  unsigned int bucket;
+
+  if (entry != NULL)
+    {
+      entry->value = value;
+      return;
+    }
+
+  entry = xmalloc (sizeof *entry);
+  entry->key = xstrdup (key);
+  entry->value = value;
+
+  bucket = str_hash (key) % N_BUCKETS;
+  table->buckets[bucket] = list_prepend (table->buckets[bucket], entry);
+  table->size++;
+}
+
+int
+hash_table_lookup (hash_table *table, const char *key, int *value)
+{
+  hash_entry *entry = hash_table_find (table, key);
+
+  if (entry == NULL)
+    return 0;
+
+  if (value != NULL)
+    *value = entry->value;
+
+  return 1;
+}
+
+size_t
+hash_table_size (hash_table *table)
+{
+  return table->size;
+}
@@ -0,0 +1,14 @@
+#ifndef FIXTURE_HASH_H
+#define FIXTURE_HASH_H
+
+#include <stddef.h>
+
+typedef struct hash_table hash_table;
+
+hash_table *hash_table_new     (void);
+void        hash_table_free    (hash_table *table);
+void        hash_table_insert  (hash_table *table, const char *key, int value);
+int         hash_table_lookup  (hash_table *table, const char *key, int *value);
+size_t      hash_table_size    (hash_table *table);
+
+#endif
@@ -0,0 +1,57 @@
+#include <stdlib.h>
+
+#include "list.h"
+#include "util.h"
+
+list_node *
+list_prepend (list_node *list, void *data)
+{
+  list_node *node = xmalloc (sizeof *node);
+
+  node->next = list;
+  node->data = data;
+
+  return node;
+}
+
+list_node *
+list_reverse (list_node *list)
+{
+  list_node *prev = NULL;
+
+  while (list != NULL)
+    {
+      list_node *next = list->next;
+
+      list->next = prev;
+      prev = list;
+      list = next;
+    }
+
+  return prev;
+}
+
+size_t
+list_length (const list_node *list)
+{
+  size_t n = 0;
+
+  for (; list != NULL; list = list->next)
+    n++;
+
+  return n;
+}
+
+void
+list_free (list_node *list, void (*free_func) (void *))
+{
+  while (list != NULL)
+    {
+      list_node *next = list->next;
+
+      if (free_func != NULL)
+        free_func (list->data);
+      free (list);
+      list = next;
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef FIXTURE_LIST_H
+#define FIXTURE_LIST_H
+
+#include <stddef.h>
+
+typedef struct list_node
+{
+  struct list_node *next;
+  void             *data;
+} list_node;
+
+list_node *list_prepend (list_node *list, void *data);
+list_node *list_reverse (list_node *list);
+size_t     list_length  (const list_node *list);
+void       list_free    (list_node *list, void (*free_func) (void *));
+
+#endif
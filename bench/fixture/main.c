@@ -0,0 +1,38 @@
+#include "hash.h"
+#include "list.h"
+#include "util.h"
+
+static list_node *
+read_words (FILE *stream)
+{
+  list_node *words = NULL;
+  char word[256];
+
+  while (fscanf (stream, "%255s", word) == 1)
+    words = list_prepend (words, xstrdup (word));
+
+  return list_reverse (words);
+}
+
+int
+main (int argc, char *argv[])
+{
+  hash_table *counts = hash_table_new ();
+  list_node *words = read_words (stdin);
+  list_node *node;
+
+  for (node = words; node != NULL; node = node->next)
+    {
+      int count = 0;
+
+      hash_table_lookup (counts, node->data, &count);
+      hash_table_insert (counts, node->data, count + 1);
+    }
+
+  printf ("%zu words, %zu distinct\n", list_length (words), hash_table_size (counts));
+
+  list_free (words, free);
+  hash_table_free (counts);
+
+  return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef FIXTURE_UTIL_H
+#define FIXTURE_UTIL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline void *
+xmalloc (size_t size)
+{
+  void *ret = malloc (size);
+
+  if (ret == NULL && size != 0)
+    {
+      fprintf (stderr, "out of memory\n");
+      abort ();
+    }
+
+  return ret;
+}
+
+static inline char *
+xstrdup (const char *str)
+{
+  size_t len = strlen (str) + 1;
+
+  return memcpy (xmalloc (len), str, len);
+}
+
+static inline unsigned int
+str_hash (const char *str)
+{
+  unsigned int h = 5381;
+
+  for (; *str != '\0'; str++)
+    h = (h << 5) + h + (unsigned char)*str;
+
+  return h;
+}
+
+#endif
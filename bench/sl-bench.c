@@ -0,0 +1,587 @@
+/* sl-bench.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gio/gio.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sl-call-table.h"
+#include "sl-line-reader.h"
+#include "sl-log-reader.h"
+#include "sl-scanner.h"
+#include "sl-synth-log.h"
+#include "sl-tokenizer.h"
+
+/* Each benchmark repeats until it has run for at least this long */
+#define MIN_DURATION (G_USEC_PER_SEC / 2)
+
+/* Distinct callees and calls per translation unit for the call table benchmark */
+#define N_CALLEES     20000
+#define CALLS_PER_TU  2000
+#define N_TUS         500
+
+typedef void (*BenchFunc) (gpointer data);
+
+typedef struct
+{
+  /* The work done by one iteration, for the rates reported */
+  gdouble      bytes;
+  gdouble      lines;
+  gdouble      items;
+  const gchar *items_unit;
+} BenchSize;
+
+typedef struct
+{
+  GString    *log;
+  gchar      *log_path;
+  GPtrArray  *commands;
+  guint       n_extracted;
+  SlLogReader *reader;
+
+  /* Call table benchmark */
+  gchar     **callees;
+  guint32    *hashes;
+  guint      *calls;
+
+  /* End to end benchmark */
+  gchar      *fixture_log;
+  guint       n_fixture_units;
+  gint        n_threads;
+} Bench;
+
+static gint n_lines = 200000;
+static gint n_threads;
+static gchar *sightline;
+static gchar *fixture;
+static gchar **only;
+static GOptionEntry entries[] = {
+  { "lines", 'n', 0, G_OPTION_ARG_INT, &n_lines,
+    N_("Number of lines in the synthetic log"),
+    N_("N") },
+  { "threads", 'j', 0, G_OPTION_ARG_INT, &n_threads,
+    N_("Number of threads for the threaded benchmarks (0 for one per CPU)"),
+    N_("N") },
+  { "sightline", 0, 0, G_OPTION_ARG_FILENAME, &sightline,
+    N_("Run PROGRAM on the fixture project to benchmark parsing end to end"),
+    N_("PROGRAM") },
+  { "fixture", 0, 0, G_OPTION_ARG_FILENAME, &fixture,
+    N_("The fixture project to parse end to end"),
+    N_("DIR") },
+  { "only", 0, 0, G_OPTION_ARG_STRING_ARRAY, &only,
+    N_("Only run the benchmarks whose name starts with PREFIX"),
+    N_("PREFIX") },
+  { NULL }
+};
+
+/*
+ * Allocations are counted by wrapping the allocator. This relies on glibc
+ * exporting its implementation under another name; elsewhere the count is
+ * simply not reported.
+ */
+#ifdef __GLIBC__
+# define HAVE_ALLOCATION_COUNT 1
+
+extern void *__libc_malloc  (size_t size);
+extern void *__libc_calloc  (size_t n_members, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static gint n_allocations;
+
+void *
+malloc (size_t size)
+{
+  g_atomic_int_inc (&n_allocations);
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n_members,
+        size_t size)
+{
+  g_atomic_int_inc (&n_allocations);
+  return __libc_calloc (n_members, size);
+}
+
+void *
+realloc (void   *ptr,
+         size_t  size)
+{
+  g_atomic_int_inc (&n_allocations);
+  return __libc_realloc (ptr, size);
+}
+#endif
+
+static gboolean
+bench_enabled (const gchar *name)
+{
+  guint i;
+
+  if (only == NULL)
+    return TRUE;
+
+  for (i = 0; only[i] != NULL; i++)
+    {
+      if (g_str_has_prefix (name, only[i]))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+bench_run (const gchar     *name,
+           BenchFunc        func,
+           gpointer         data,
+           const BenchSize *size)
+{
+  g_autoptr(GString) report = NULL;
+  gint64 begin;
+  gint64 elapsed;
+  gdouble seconds;
+  guint iterations = 0;
+#ifdef HAVE_ALLOCATION_COUNT
+  gint allocations;
+#endif
+
+  g_assert (name != NULL);
+  g_assert (func != NULL);
+  g_assert (size != NULL);
+
+  if (!bench_enabled (name))
+    return;
+
+  /* Warm up caches, lazily built tables and the allocator */
+  func (data);
+
+#ifdef HAVE_ALLOCATION_COUNT
+  allocations = g_atomic_int_get (&n_allocations);
+#endif
+  begin = g_get_monotonic_time ();
+
+  do
+    {
+      func (data);
+      iterations++;
+      elapsed = g_get_monotonic_time () - begin;
+    }
+  while (elapsed < MIN_DURATION);
+
+#ifdef HAVE_ALLOCATION_COUNT
+  allocations = g_atomic_int_get (&n_allocations) - allocations;
+#endif
+
+  seconds = (gdouble)elapsed / G_USEC_PER_SEC / iterations;
+  report = g_string_new (NULL);
+  g_string_append_printf (report, "%-28s %9.3f ms", name, seconds * 1000.0);
+
+  if (size->bytes > 0)
+    g_string_append_printf (report, "  %9.1f MB/s", size->bytes / seconds / (1024.0 * 1024.0));
+
+  if (size->lines > 0)
+    g_string_append_printf (report, "  %12.0f lines/s", size->lines / seconds);
+
+  if (size->items > 0)
+    g_string_append_printf (report, "  %10.0f %s/s", size->items / seconds, size->items_unit);
+
+#ifdef HAVE_ALLOCATION_COUNT
+  g_string_append_printf (report, "  %10.1f allocs", (gdouble)allocations / iterations);
+#endif
+
+  g_print ("%s\n", report->str);
+}
+
+static void
+bench_line_reader (gpointer data)
+{
+  Bench *bench = data;
+  g_autoptr(SlLineReader) reader = NULL;
+  gsize len;
+  guint n = 0;
+
+  reader = sl_line_reader_new (bench->log->str, bench->log->len);
+  while (sl_line_reader_next (reader, &len) != NULL)
+    n++;
+
+  g_assert (n > 0);
+}
+
+static void
+bench_scanner (gpointer data)
+{
+  Bench *bench = data;
+  SlScanner scanner;
+  SlScanMatch match;
+  guint n = 0;
+
+  sl_scanner_init (&scanner, bench->log->str, bench->log->len);
+  while (sl_scanner_next (&scanner, &match))
+    n++;
+
+  g_assert (n > 0);
+}
+
+static void
+flags_extracted (SlLogReader *reader,
+                 const gchar *subdir,
+                 const gchar *filename,
+                 guint        flags,
+                 gpointer     user_data)
+{
+  Bench *bench = user_data;
+
+  bench->n_extracted++;
+}
+
+static void
+bench_ingest (gpointer data)
+{
+  Bench *bench = data;
+  g_autoptr(GError) error = NULL;
+
+  bench->n_extracted = 0;
+
+  if (!sl_log_reader_ingest (bench->reader, bench->log_path, &error))
+    g_error ("%s", error->message);
+
+  g_assert (bench->n_extracted > 0);
+}
+
+static void
+bench_parse_commands (gpointer data)
+{
+  Bench *bench = data;
+  guint i;
+
+  for (i = 0; i < bench->commands->len; i++)
+    {
+      const gchar *command = g_ptr_array_index (bench->commands, i);
+
+      sl_log_reader_ingest_command (bench->reader, "/builddir/build/BUILD/bench/src", command, -1);
+    }
+}
+
+static void
+bench_tokenize_commands (gpointer data)
+{
+  Bench *bench = data;
+  guint n = 0;
+  guint i;
+
+  for (i = 0; i < bench->commands->len; i++)
+    {
+      const gchar *command = g_ptr_array_index (bench->commands, i);
+      SlTokenizer tokenizer;
+      SlToken token;
+
+      sl_tokenizer_init (&tokenizer, command, strlen (command));
+      while (sl_tokenizer_next (&tokenizer, &token))
+        n++;
+      sl_tokenizer_clear (&tokenizer);
+    }
+
+  g_assert (n > 0);
+}
+
+/*
+ * Counts calls as the workers do: a table per translation unit, merged into
+ * the totals once the unit is done, which are ranked at the end.
+ */
+static void
+bench_call_table (gpointer data)
+{
+  Bench *bench = data;
+  g_autoptr(SlCallTable) total = sl_call_table_new ();
+  g_autoptr(SlCallTable) unit = sl_call_table_new ();
+  guint i;
+
+  for (i = 0; i < N_TUS * CALLS_PER_TU; i++)
+    {
+      guint callee = bench->calls[i];
+
+      sl_call_table_add (unit,
+                         bench->callees[callee],
+                         strlen (bench->callees[callee]),
+                         bench->hashes[callee],
+                         NULL,
+                         1);
+
+      if ((i + 1) % CALLS_PER_TU == 0)
+        {
+          sl_call_table_merge (total, unit);
+          sl_call_table_clear (unit);
+        }
+    }
+
+  g_free (sl_call_table_rank (total));
+}
+
+static void
+bench_sightline (gpointer data)
+{
+  Bench *bench = data;
+  g_autoptr(GSubprocess) subprocess = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *jobs = g_strdup_printf ("%d", bench->n_threads);
+  const gchar *argv[] = { sightline, "-j", jobs, bench->fixture_log, NULL };
+
+  subprocess = g_subprocess_newv (argv,
+                                  G_SUBPROCESS_FLAGS_STDOUT_SILENCE | G_SUBPROCESS_FLAGS_STDERR_SILENCE,
+                                  &error);
+
+  if (subprocess == NULL || !g_subprocess_wait_check (subprocess, NULL, &error))
+    g_error ("%s: %s", sightline, error->message);
+}
+
+static void
+collect_commands (Bench *bench)
+{
+  SlScanner scanner;
+  SlScanMatch match;
+
+  bench->commands = g_ptr_array_new_with_free_func (g_free);
+
+  sl_scanner_init (&scanner, bench->log->str, bench->log->len);
+
+  while (sl_scanner_next (&scanner, &match))
+    {
+      if (match.kind == SL_SCAN_COMMAND)
+        g_ptr_array_add (bench->commands, g_strndup (match.match, match.match_len));
+    }
+}
+
+/*
+ * Call counts in real code are heavily skewed towards a few functions such
+ * as g_free(), so callees are drawn from a Zipf distribution.
+ */
+static void
+generate_calls (Bench *bench)
+{
+  g_autoptr(GRand) rand = g_rand_new_with_seed (1);
+  g_autofree gdouble *cdf = g_new (gdouble, N_CALLEES);
+  gdouble sum = 0.0;
+  guint i;
+
+  bench->callees = g_new0 (gchar *, N_CALLEES + 1);
+  bench->hashes = g_new (guint32, N_CALLEES);
+
+  for (i = 0; i < N_CALLEES; i++)
+    {
+      bench->callees[i] = g_strdup_printf ("bench_function_%u", i);
+      bench->hashes[i] = sl_call_table_hash (bench->callees[i], strlen (bench->callees[i]));
+      sum += 1.0 / (i + 1);
+      cdf[i] = sum;
+    }
+
+  bench->calls = g_new (guint, N_TUS * CALLS_PER_TU);
+
+  for (i = 0; i < N_TUS * CALLS_PER_TU; i++)
+    {
+      gdouble target = g_rand_double (rand) * sum;
+      guint lo = 0;
+      guint hi = N_CALLEES - 1;
+
+      while (lo < hi)
+        {
+          guint mid = (lo + hi) / 2;
+
+          if (cdf[mid] < target)
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+
+      bench->calls[i] = lo;
+    }
+}
+
+static gboolean
+write_temporary (const gchar  *tmpl,
+                 const gchar  *contents,
+                 gsize         len,
+                 gchar       **path,
+                 GError      **error)
+{
+  gint fd;
+
+  if (-1 == (fd = g_file_open_tmp (tmpl, path, error)))
+    return FALSE;
+
+  close (fd);
+
+  return g_file_set_contents (*path, contents, len, error);
+}
+
+static gboolean
+write_fixture_log (Bench   *bench,
+                   GError **error)
+{
+  g_autoptr(GDir) dir = NULL;
+  g_autoptr(GString) log = NULL;
+  g_autofree gchar *directory = NULL;
+  const gchar *name;
+
+  if (fixture == NULL)
+    fixture = g_strdup ("../bench/fixture");
+
+  if (g_path_is_absolute (fixture))
+    directory = g_strdup (fixture);
+  else
+    {
+      g_autofree gchar *cwd = g_get_current_dir ();
+
+      directory = g_build_filename (cwd, fixture, NULL);
+    }
+
+  if (NULL == (dir = g_dir_open (directory, 0, error)))
+    return FALSE;
+
+  log = g_string_new (NULL);
+  g_string_append_printf (log, "make[1]: Entering directory '%s'\n", directory);
+
+  while (NULL != (name = g_dir_read_name (dir)))
+    {
+      g_autofree gchar *base = NULL;
+
+      if (!g_str_has_suffix (name, ".c"))
+        continue;
+
+      base = g_strndup (name, strlen (name) - 2);
+      g_string_append_printf (log, "gcc -DHAVE_CONFIG_H -I. -Wall -g -O2 -c -o %s.o %s\n", base, name);
+      bench->n_fixture_units++;
+    }
+
+  g_string_append_printf (log, "make[1]: Leaving directory '%s'\n", directory);
+
+  return write_temporary ("sl-bench-fixture-XXXXXX.log", log->str, log->len, &bench->fixture_log, error);
+}
+
+gint
+main (gint argc,
+      gchar *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  SlSynthLogOptions options;
+  SlSynthLogStats stats;
+  Bench bench = { 0 };
+  BenchSize size = { 0 };
+
+  context = g_option_context_new (_("- Benchmark sightline"));
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (n_threads <= 0)
+    n_threads = g_get_num_processors ();
+
+  sl_synth_log_options_init (&options);
+  options.n_lines = MAX (n_lines, 1);
+  bench.log = sl_synth_log_generate (&options, &stats);
+
+  if (!write_temporary ("sl-bench-XXXXXX.log", bench.log->str, bench.log->len, &bench.log_path, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  collect_commands (&bench);
+  generate_calls (&bench);
+
+  g_print ("Synthetic log: %u lines, %u compiles, %.1f MB\n\n",
+           stats.n_lines, stats.n_jobs, bench.log->len / (1024.0 * 1024.0));
+
+  size.bytes = bench.log->len;
+  size.lines = stats.n_lines;
+  bench_run ("line-reader", bench_line_reader, &bench, &size);
+  bench_run ("scanner", bench_scanner, &bench, &size);
+
+  /* The reader spawns clang to find its headers, which is kept out of the timings */
+  bench.reader = sl_log_reader_new ();
+  g_signal_connect (bench.reader, "flags-extracted", G_CALLBACK (flags_extracted), &bench);
+
+  size.items = stats.n_jobs;
+  size.items_unit = "jobs";
+  bench_run ("ingest", bench_ingest, &bench, &size);
+
+  if (n_threads > 1)
+    {
+      g_autofree gchar *name = g_strdup_printf ("ingest-threads-%d", n_threads);
+
+      sl_log_reader_set_n_threads (bench.reader, n_threads);
+      bench_run (name, bench_ingest, &bench, &size);
+      sl_log_reader_set_n_threads (bench.reader, 1);
+    }
+
+  memset (&size, 0, sizeof size);
+  size.items = bench.commands->len;
+  size.items_unit = "commands";
+  bench_run ("parse-commands", bench_parse_commands, &bench, &size);
+  bench_run ("tokenize-commands", bench_tokenize_commands, &bench, &size);
+
+  memset (&size, 0, sizeof size);
+  size.items = N_TUS * CALLS_PER_TU;
+  size.items_unit = "calls";
+  bench_run ("call-table", bench_call_table, &bench, &size);
+
+  if (sightline != NULL)
+    {
+      if (!write_fixture_log (&bench, &error))
+        {
+          g_printerr ("%s\n", error->message);
+          return EXIT_FAILURE;
+        }
+
+      memset (&size, 0, sizeof size);
+      size.items = bench.n_fixture_units;
+      size.items_unit = "units";
+
+      bench.n_threads = 1;
+      bench_run ("sightline", bench_sightline, &bench, &size);
+
+      if (n_threads > 1)
+        {
+          g_autofree gchar *name = g_strdup_printf ("sightline-threads-%d", n_threads);
+
+          bench.n_threads = n_threads;
+          bench_run (name, bench_sightline, &bench, &size);
+        }
+
+      g_unlink (bench.fixture_log);
+    }
+
+  g_unlink (bench.log_path);
+
+  g_clear_object (&bench.reader);
+  g_clear_pointer (&bench.commands, g_ptr_array_unref);
+  g_strfreev (bench.callees);
+  g_free (bench.hashes);
+  g_free (bench.calls);
+  g_free (bench.log_path);
+  g_free (bench.fixture_log);
+  g_string_free (bench.log, TRUE);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+/* sl-gen-log.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib/gi18n.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sl-synth-log.h"
+
+static gint n_lines = 1000000;
+static gint n_parallel = 16;
+static gint libtool_percent = 30;
+static gint seed = 1;
+static GOptionEntry entries[] = {
+  { "lines", 'n', 0, G_OPTION_ARG_INT, &n_lines,
+    N_("Number of lines to generate"),
+    N_("N") },
+  { "jobs", 'j', 0, G_OPTION_ARG_INT, &n_parallel,
+    N_("Number of recipes whose output interleaves, as with make -jN"),
+    N_("N") },
+  { "libtool", 0, 0, G_OPTION_ARG_INT, &libtool_percent,
+    N_("Percentage of compiles going through libtool"),
+    N_("PERCENT") },
+  { "seed", 0, 0, G_OPTION_ARG_INT, &seed,
+    N_("Seed for the generator, the same seed giving the same log"),
+    N_("SEED") },
+  { NULL }
+};
+
+gint
+main (gint argc,
+      gchar *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  SlSynthLogOptions options;
+  SlSynthLogStats stats;
+  GString *log;
+
+  context = g_option_context_new (_("- Generate a synthetic build log"));
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  sl_synth_log_options_init (&options);
+  options.n_lines = MAX (n_lines, 0);
+  options.n_parallel = MAX (n_parallel, 1);
+  options.libtool_percent = CLAMP (libtool_percent, 0, 100);
+  options.seed = seed;
+
+  log = sl_synth_log_generate (&options, &stats);
+
+  if (fwrite (log->str, 1, log->len, stdout) != log->len || fflush (stdout) != 0)
+    {
+      g_printerr ("%s\n", g_strerror (errno));
+      g_string_free (log, TRUE);
+      return EXIT_FAILURE;
+    }
+
+  g_printerr (_("%u lines, %u compiles\n"), stats.n_lines, stats.n_jobs);
+  g_string_free (log, TRUE);
+
+  return EXIT_SUCCESS;
+}
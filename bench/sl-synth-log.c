@@ -0,0 +1,350 @@
+/* sl-synth-log.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "sl-synth-log.h"
+
+/*
+ * Generates build logs resembling those of large autotools projects built
+ * with "make -jN V=1": nested and interleaved directory messages, compiles
+ * with long flag lists (some through libtool, some continued across lines),
+ * diagnostics with source excerpts, links and the usual noise between
+ * them. The output only depends on the options, so results are comparable
+ * between runs and machines.
+ */
+
+static const gchar *words[] = {
+  "buffer", "channel", "closure", "context", "cursor", "engine", "index",
+  "layout", "list", "loader", "manager", "model", "monitor", "object",
+  "parser", "pool", "queue", "reader", "scanner", "source", "stream",
+  "table", "task", "thread", "token", "tree", "value", "view", "widget",
+  "writer",
+};
+
+/* Side by side and cross installs, which must still be recognized */
+static const gchar *compilers[] = {
+  "gcc-12", "g++-13", "clang-15", "clang++-17", "/usr/bin/gcc",
+  "x86_64-linux-gnu-gcc", "aarch64-linux-gnu-g++-12",
+};
+
+static const gchar *warnings[] = {
+  "-Wall", "-Wextra", "-Wno-unused-parameter", "-Wno-missing-field-initializers",
+  "-Wdeclaration-after-statement", "-Wformat=2", "-Wformat-nonliteral",
+  "-Wformat-security", "-Wignored-qualifiers", "-Wimplicit-function-declaration",
+  "-Wmissing-include-dirs", "-Wnested-externs", "-Wpointer-arith", "-Wredundant-decls",
+  "-Wreturn-type", "-Wshadow", "-Wstrict-prototypes", "-Wswitch-default",
+  "-Wswitch-enum", "-Wundef", "-Wuninitialized", "-Wunused", "-Werror=format-security",
+};
+
+typedef struct
+{
+  const SlSynthLogOptions *options;
+  GString                 *log;
+  GRand                   *rand;
+  SlSynthLogStats         *stats;
+} Generator;
+
+/* A recipe make is running, which emits a line at a time */
+typedef struct
+{
+  gchar **lines;
+  guint   pos;
+} Recipe;
+
+static inline const gchar *
+pick (Generator    *gen,
+      const gchar **items,
+      guint         n_items)
+{
+  return items[g_rand_int_range (gen->rand, 0, n_items)];
+}
+
+static gchar *
+make_name (Generator *gen)
+{
+  return g_strdup_printf ("%s-%s",
+                          pick (gen, words, G_N_ELEMENTS (words)),
+                          pick (gen, words, G_N_ELEMENTS (words)));
+}
+
+static void
+append_flags (Generator *gen,
+              GString   *str,
+              gboolean   continued)
+{
+  guint n_includes = g_rand_int_range (gen->rand, 4, 24);
+  guint n_defines = g_rand_int_range (gen->rand, 2, 12);
+  guint i;
+
+  g_string_append_printf (str, " -DHAVE_CONFIG_H -I. -I.. -I../include -DG_LOG_DOMAIN=\\\"%s\\\"",
+                          pick (gen, words, G_N_ELEMENTS (words)));
+
+  for (i = 0; i < n_includes; i++)
+    {
+      if (continued && i == n_includes / 2)
+        g_string_append (str, " \\\n\t");
+
+      g_string_append_printf (str, " -I/usr/include/%s-%u.0",
+                              pick (gen, words, G_N_ELEMENTS (words)),
+                              g_rand_int_range (gen->rand, 1, 4));
+    }
+
+  for (i = 0; i < n_defines; i++)
+    g_string_append_printf (str, " -D%s_COMPILATION",
+                            pick (gen, words, G_N_ELEMENTS (words)));
+
+  g_string_append (str, " -pthread -fno-strict-aliasing -fstack-protector-strong");
+
+  for (i = 0; i < G_N_ELEMENTS (warnings); i++)
+    {
+      if (g_rand_boolean (gen->rand))
+        g_string_append_printf (str, " %s", warnings[i]);
+    }
+
+  g_string_append (str, " -g -O2 -std=gnu11");
+}
+
+static Recipe *
+make_compile (Generator   *gen)
+{
+  g_autoptr(GPtrArray) lines = g_ptr_array_new ();
+  g_autofree gchar *name = make_name (gen);
+  g_autoptr(GString) str = g_string_new (NULL);
+  Recipe *recipe;
+
+  if (g_rand_int_range (gen->rand, 0, 100) < (gint)gen->options->libtool_percent)
+    {
+      g_string_printf (str, "/bin/bash ../libtool  --tag=CC   --mode=compile gcc");
+      append_flags (gen, str, FALSE);
+      g_string_append_printf (str, " -MT lib%s_la-%s.lo -MD -MP -MF .deps/lib%s_la-%s.Tpo"
+                                   " -c -o lib%s_la-%s.lo `test -f '%s.c' || echo './'`%s.c",
+                              name, name, name, name, name, name, name, name);
+      g_ptr_array_add (lines, g_strdup (str->str));
+
+      /* What libtool echoes back, which must not count as another job */
+      g_string_printf (str, "libtool: compile:  gcc");
+      append_flags (gen, str, FALSE);
+      g_string_append_printf (str, " -c %s.c  -fPIC -DPIC -o .libs/lib%s_la-%s.o", name, name, name);
+      g_ptr_array_add (lines, g_strdup (str->str));
+    }
+  else
+    {
+      if (g_rand_int_range (gen->rand, 0, 4) == 0)
+        g_string_printf (str, "%s", pick (gen, compilers, G_N_ELEMENTS (compilers)));
+      else
+        g_string_printf (str, "gcc");
+      append_flags (gen, str, g_rand_int_range (gen->rand, 0, 10) == 0);
+      g_string_append_printf (str, " -MT %s.o -MD -MP -MF .deps/%s.Tpo -c -o %s.o %s.c",
+                              name, name, name, name);
+      g_ptr_array_add (lines, g_strdup (str->str));
+    }
+
+  gen->stats->n_jobs++;
+
+  if (g_rand_int_range (gen->rand, 0, 8) == 0)
+    {
+      guint line = g_rand_int_range (gen->rand, 10, 4000);
+
+      g_ptr_array_add (lines, g_strdup_printf ("%s.c: In function '%s_%s_new':", name, name,
+                                               pick (gen, words, G_N_ELEMENTS (words))));
+      g_ptr_array_add (lines, g_strdup_printf ("%s.c:%u:%u: warning: unused variable 'ret' [-Wunused-variable]",
+                                               name, line, g_rand_int_range (gen->rand, 3, 40)));
+      g_ptr_array_add (lines, g_strdup_printf (" %5u |   gint ret;", line));
+      g_ptr_array_add (lines, g_strdup ("       |        ^~~"));
+    }
+
+  g_ptr_array_add (lines, g_strdup_printf ("mv -f .deps/%s.Tpo .deps/%s.Po", name, name));
+  g_ptr_array_add (lines, NULL);
+
+  recipe = g_slice_new0 (Recipe);
+  recipe->lines = (gchar **)g_ptr_array_free (g_steal_pointer (&lines), FALSE);
+
+  return recipe;
+}
+
+static Recipe *
+make_noise (Generator   *gen)
+{
+  g_autoptr(GPtrArray) lines = g_ptr_array_new ();
+  g_autofree gchar *name = make_name (gen);
+  Recipe *recipe;
+
+  switch (g_rand_int_range (gen->rand, 0, 4))
+    {
+    case 0:
+      g_ptr_array_add (lines, g_strdup_printf ("/bin/bash ../libtool  --tag=CC   --mode=link gcc -g -O2"
+                                               " -o lib%s.la -rpath /usr/lib64 lib%s_la-a.lo lib%s_la-b.lo"
+                                               " -lglib-2.0 -lgobject-2.0 -lgio-2.0",
+                                               name, name, name));
+      g_ptr_array_add (lines, g_strdup_printf ("libtool: link: ( cd \".libs\" && rm -f \"lib%s.la\""
+                                               " && ln -s \"../lib%s.la\" \"lib%s.la\" )",
+                                               name, name, name));
+      break;
+
+    case 1:
+      g_ptr_array_add (lines, g_strdup_printf ("  GEN      %s-resources.c", name));
+      g_ptr_array_add (lines, g_strdup_printf ("/usr/bin/glib-compile-resources --target=%s-resources.c"
+                                               " --sourcedir=. --generate-source %s.gresource.xml",
+                                               name, name));
+      break;
+
+    case 2:
+      g_ptr_array_add (lines, g_strdup ("make[2]: Nothing to be done for 'all-am'."));
+      break;
+
+    default:
+      g_ptr_array_add (lines, g_strdup_printf ("echo timestamp > stamp-%s.h", name));
+      break;
+    }
+
+  g_ptr_array_add (lines, NULL);
+
+  recipe = g_slice_new0 (Recipe);
+  recipe->lines = (gchar **)g_ptr_array_free (g_steal_pointer (&lines), FALSE);
+
+  return recipe;
+}
+
+static void
+recipe_free (Recipe *recipe)
+{
+  g_strfreev (recipe->lines);
+  g_slice_free (Recipe, recipe);
+}
+
+static void
+emit_line (Generator   *gen,
+           const gchar *line)
+{
+  const gchar *p;
+
+  g_string_append (gen->log, line);
+  g_string_append_c (gen->log, '\n');
+
+  gen->stats->n_lines++;
+  for (p = strchr (line, '\n'); p != NULL; p = strchr (p + 1, '\n'))
+    gen->stats->n_lines++;
+}
+
+/**
+ * sl_synth_log_options_init:
+ * @options: the options to initialize
+ *
+ * Sets @options to the defaults, a log of about a million lines from
+ * "make -j16".
+ */
+void
+sl_synth_log_options_init (SlSynthLogOptions *options)
+{
+  g_return_if_fail (options != NULL);
+
+  options->n_lines = 1000000;
+  options->n_parallel = 16;
+  options->libtool_percent = 30;
+  options->seed = 1;
+}
+
+/**
+ * sl_synth_log_generate:
+ * @options: the options for the log
+ * @stats: (out) (optional): a location for what the log contains
+ *
+ * Generates a synthetic build log.
+ *
+ * Returns: (transfer full): the contents of the log
+ */
+GString *
+sl_synth_log_generate (const SlSynthLogOptions *options,
+                       SlSynthLogStats         *stats)
+{
+  g_autoptr(GPtrArray) running = NULL;
+  SlSynthLogStats local_stats = { 0 };
+  g_autofree gchar *directory = NULL;
+  Generator gen;
+  guint level = 1;
+
+  g_return_val_if_fail (options != NULL, NULL);
+
+  gen.options = options;
+  gen.log = g_string_sized_new (options->n_lines * 200);
+  gen.rand = g_rand_new_with_seed (options->seed);
+  gen.stats = stats ? stats : &local_stats;
+  memset (gen.stats, 0, sizeof *gen.stats);
+
+  running = g_ptr_array_new_with_free_func ((GDestroyNotify)recipe_free);
+
+  emit_line (&gen, "make  all-recursive");
+
+  while (gen.stats->n_lines < options->n_lines || running->len > 0)
+    {
+      Recipe *recipe;
+      guint i;
+
+      /* Descend into another directory once in a while, as recursive make does */
+      if (directory == NULL || g_rand_int_range (gen.rand, 0, 200) == 0)
+        {
+          g_autofree gchar *line = NULL;
+
+          if (directory != NULL)
+            {
+              line = g_strdup_printf ("make[%u]: Leaving directory '%s'", level, directory);
+              emit_line (&gen, line);
+              g_clear_pointer (&line, g_free);
+              g_free (directory);
+            }
+
+          level = g_rand_int_range (gen.rand, 1, 4);
+          directory = g_strdup_printf ("/builddir/build/BUILD/%s/src/%s",
+                                       pick (&gen, words, G_N_ELEMENTS (words)),
+                                       pick (&gen, words, G_N_ELEMENTS (words)));
+          line = g_strdup_printf ("make[%u]: Entering directory '%s'", level, directory);
+          emit_line (&gen, line);
+        }
+
+      /* Keep the configured number of recipes running, unless winding down */
+      while (gen.stats->n_lines < options->n_lines && running->len < MAX (1, options->n_parallel))
+        {
+          if (g_rand_int_range (gen.rand, 0, 10) < 8)
+            g_ptr_array_add (running, make_compile (&gen));
+          else
+            g_ptr_array_add (running, make_noise (&gen));
+        }
+
+      if (running->len == 0)
+        break;
+
+      /* Output of concurrent recipes interleaves a line at a time */
+      i = g_rand_int_range (gen.rand, 0, running->len);
+      recipe = g_ptr_array_index (running, i);
+      emit_line (&gen, recipe->lines[recipe->pos++]);
+
+      if (recipe->lines[recipe->pos] == NULL)
+        g_ptr_array_remove_index_fast (running, i);
+    }
+
+  if (directory != NULL)
+    {
+      g_autofree gchar *line = g_strdup_printf ("make[%u]: Leaving directory '%s'", level, directory);
+      emit_line (&gen, line);
+    }
+
+  g_rand_free (gen.rand);
+
+  return gen.log;
+}
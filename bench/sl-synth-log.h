@@ -0,0 +1,52 @@
+/* sl-synth-log.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_SYNTH_LOG_H
+#define SL_SYNTH_LOG_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct
+{
+  /* Stop once the log has at least this many lines */
+  guint   n_lines;
+
+  /* The number of recipes make runs at once, whose output interleaves */
+  guint   n_parallel;
+
+  /* The percentage of compiles going through libtool */
+  guint   libtool_percent;
+
+  guint32 seed;
+} SlSynthLogOptions;
+
+typedef struct
+{
+  guint n_lines;
+  guint n_jobs;
+} SlSynthLogStats;
+
+void     sl_synth_log_options_init (SlSynthLogOptions       *options);
+GString *sl_synth_log_generate     (const SlSynthLogOptions *options,
+                                    SlSynthLogStats         *stats);
+
+G_END_DECLS
+
+#endif /* SL_SYNTH_LOG_H */
@@ -20,121 +20,3269 @@
 
 #include <clang-c/Index.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <signal.h>
 #include <stdlib.h>
+#include <unistd.h>
 
+#include "sl-call-lexer.h"
+#include "sl-call-table.h"
+#include "sl-compile-db.h"
+#include "sl-cost-model.h"
+#include "sl-daemon.h"
+#include "sl-flag-table.h"
+#include "sl-include-graph.h"
 #include "sl-log-reader.h"
+#include "sl-pass-registry.h"
+#include "sl-pch.h"
+#include "sl-result-cache.h"
+#include "sl-space-saving.h"
+#include "sl-state.h"
+#include "sl-stats.h"
+#include "sl-worker-process.h"
+#include "sl-xref.h"
 
+/* Groups smaller than this are not worth building a PCH for */
+#define PCH_MIN_GROUP_SIZE 2
+
+/* How long a file must be left alone after changing before it is reparsed */
+#define REPARSE_DELAY_MSEC 200
+
+/* Callees listed by the top request of --daemon without a number */
+#define DEFAULT_DAEMON_TOP 20
+
+/* Headers listed by --header-costs without a number */
+#define DEFAULT_HEADER_COSTS 20
+
+/* Types and macros listed by --type-usage and --macro-expansions without a number */
+#define DEFAULT_USAGE_REPORT 20
+
+/* Counters per callee printed with --approximate, and at least this many */
+#define APPROXIMATE_COUNTERS_PER_TOP 16
+#define APPROXIMATE_MIN_COUNTERS     1024
+
+/*
+ * What a worker process replies for a unit: whether it parsed, the parse
+ * and visit times, the memory libclang needed, the headers it includes,
+ * which file includes each of them (with --include-graph or --header-costs),
+ * its results and the results of each header it counted separately.
+ */
+#define WORKER_REPLY_TYPE "(bxxxxtaayaay(ayay)a(ay(ayay)))"
+
+typedef struct
+{
+  gchar *filename;
+  guint  flags;
+
+  /* The flags to parse with, which differ from @flags with a PCH */
+  guint  parse_flags;
+
+  /* The estimated parse time, or -1 until it is needed for scheduling */
+  gint64  cost;
+  guint64 memory;
+
+  /* Whether to reparse the resident unit of @filename, with --daemon */
+  gboolean reparse;
+} Job;
+
+/*
+ * Maps a callee declaration to its entry in the unit's call table, so the
+ * spelling (and USR) of a callee is only fetched the first time it is seen
+ * within a translation unit.
+ */
+typedef struct
+{
+  CXCursor     decl;
+  SlCallTable *table;
+  guint        hash;
+  guint        index; /* entry index + 1, or 0 if unused */
+} DeclSlot;
+
+/*
+ * What is collected for a file, cross-references only with --xref and
+ * call graph edges only with --call-graph. Edges are counted in a call
+ * table, keyed by the caller and the callee separated by a tab. Uses of
+ * types and expansions of macros are counted the same way as calls, with
+ * --type-usage and --macro-expansions.
+ */
+typedef struct
+{
+  SlCallTable   *calls;
+  SlXrefBuilder *xref;
+  SlCallTable   *edges;
+  SlCallTable   *types;
+  SlCallTable   *macros;
+} Results;
+
+typedef struct
+{
+  CXIndex      index;
+  Results     *results;
+  Results     *unit;
+  DeclSlot    *decls;
+  guint        decls_mask;
+  guint        n_decls;
+
+  /* Headers claimed by the current translation unit, path to Results */
+  GHashTable  *unit_headers;
+
+  /* The child process parsing for this worker, with --isolate */
+  SlWorkerProcess *process;
+
+  /* The calls of the units parsed, instead of results, with --approximate */
+  SlSpaceSaving   *sketch;
+
+  /* Where the key of a call graph edge is built, with --call-graph */
+  GString         *edge;
+} Worker;
+
+typedef struct
+{
+  GPtrArray *jobs;
+  gchar     *header;
+  gchar     *pch;
+} PchGroup;
+
+/*
+ * A translation unit kept parsed with --daemon, to be reparsed when its
+ * file changes, and the calls it adds to the totals. @argv is interned in
+ * the default flag table.
+ */
+typedef struct
+{
+  gchar               *filename;
+  const gchar * const *argv;
+  CXTranslationUnit    unit;
+  SlCallTable         *calls;
+
+  /* If the file changed again while it was being reparsed */
+  guint                dirty : 1;
+} Resident;
+
+typedef struct
+{
+  Results     *results;
+  GHashTable  *parsed;
+  GThreadPool *pool;
+  GMutex       workers_mutex;
+  GPtrArray   *workers;
+  GPtrArray   *pending;
+  GPtrArray   *pch_groups;
+  gchar       *pch_dir;
+  SlResultCache *cache;
+
+  /* Every job found, when exporting a compilation database */
+  SlCompileDb *db;
+
+  /* Headers whose code has been counted, by flag set and path */
+  GMutex       headers_mutex;
+  GHashTable  *headers;
+
+  /* The previous run, with --state, and the headers it no longer counts */
+  SlState     *state;
+  GPtrArray   *released;
+
+  /* Timings and counters, with --stats */
+  SlStats     *stats;
+
+  /* What each file cost to parse before, to start the longest first */
+  SlCostModel *costs;
+
+  /* The calls of every worker, with --approximate */
+  SlSpaceSaving *sketch;
+
+  /* The includes of every unit parsed, with --include-graph or --header-costs */
+  SlIncludeGraph *includes;
+
+  /*
+   * With --daemon, the units kept parsed by filename, whose calls make up
+   * the totals of @results, and the jobs queued or running. Logs are
+   * ingested one at a time.
+   */
+  SlDaemon    *daemon;
+  GMutex       residents_mutex;
+  GHashTable  *residents;
+  GHashTable  *reparsing;
+  GMutex       ingest_mutex;
+  GMutex       jobs_mutex;
+  GCond        jobs_cond;
+  guint        n_outstanding;
+
+  /* Only used from the main loop: file monitors and the files changed */
+  GHashTable  *monitors;
+  GHashTable  *changed;
+  guint        changed_source;
+
+  /* The logs given on the command line, read once the daemon listens */
+  gchar      **daemon_logs;
+
+  /* The memory estimated for the units being parsed, with --memory-budget */
+  GMutex       memory_mutex;
+  GCond        memory_cond;
+  guint64      memory_in_use;
+} Sightline;
+
+/* A header released by a translation unit which changed or was removed */
+typedef struct
+{
+  const gchar * const *argv;
+  gchar               *path;
+} Release;
+
+/* State while visiting a single translation unit */
+typedef struct
+{
+  Sightline           *self;
+  Worker              *worker;
+  const gchar * const *argv;
+
+  /* The results for the current top-level cursor, or NULL to skip it */
+  Results             *target;
+  CXFile               target_file;
+
+  /* The USR and name of the function being visited, with --xref or --call-graph */
+  const gchar         *caller;
+  const gchar         *caller_name;
+
+  /* The last call recorded, so the reference to its callee is not */
+  CXCursor             callee;
+  CXSourceLocation     call_location;
+
+  /* The file of the last cross-reference */
+  CXFile               xref_file;
+  CXString             xref_path;
+} Visit;
+
+/* Asks the main loop to watch the file of a resident unit */
+typedef struct
+{
+  Sightline *self;
+  gchar     *filename;
+} WatchRequest;
+
+/* What is collected about the files a translation unit includes */
 typedef struct
 {
-  guint count;
-  gchar name[0];
-} CallCount;
+  GPtrArray *dependencies;
+
+  /* Pairs of the including file and the file included */
+  GPtrArray *inclusions;
+} Inclusions;
+
+static gint n_jobs = 1;
+static gboolean use_pch;
+static gchar *cache_dir;
+static gboolean key_by_usr;
+static gboolean headers_once;
+static gchar *export_json;
+static gchar *export_db;
+static gchar *xref_index;
+static gchar *state_file;
+static gboolean show_stats;
+static SlStatsFormat stats_format;
+static gboolean isolate;
+static gint timeout;
+static gint recycle_after = 100;
+static gboolean worker_mode;
+static gchar **worker_argv;
+static guint64 memory_budget;
+static gint top_k;
+static gboolean approximate;
+static gchar *call_graph;
+static gchar *include_graph;
+static gint header_costs;
+static gint type_usage;
+static gint macro_expansions;
+static gboolean collect_inclusions;
+static gboolean lexical;
+static gchar *daemon_socket;
+static gchar *connect_socket;
+static SlPassRegistry *passes;
+static gboolean track_callers;
+static GPrivate current_worker = G_PRIVATE_INIT (NULL);
+
+static gboolean
+parse_stats_option (const gchar  *option_name,
+                    const gchar  *value,
+                    gpointer      data,
+                    GError      **error)
+{
+  if (value == NULL || g_str_equal (value, "text"))
+    stats_format = SL_STATS_FORMAT_TEXT;
+  else if (g_str_equal (value, "json"))
+    stats_format = SL_STATS_FORMAT_JSON;
+  else
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   _("Unknown format for %s: %s"), option_name, value);
+      return FALSE;
+    }
+
+  show_stats = TRUE;
+
+  return TRUE;
+}
+
+static gboolean
+parse_memory_budget (const gchar  *option_name,
+                     const gchar  *value,
+                     gpointer      data,
+                     GError      **error)
+{
+  guint64 size;
+  gchar *end;
+
+  size = g_ascii_strtoull (value, &end, 10);
+
+  switch (g_ascii_toupper (*end))
+    {
+    case 'G': size <<= 10; /* fall through */
+    case 'M': size <<= 10; /* fall through */
+    case 'K': size <<= 10; end++; break;
+    default: break;
+    }
+
+  if (end == value || *end != '\0' || size == 0)
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   _("Invalid size for %s: %s"), option_name, value);
+      return FALSE;
+    }
+
+  memory_budget = size;
+
+  return TRUE;
+}
+
+static gboolean
+parse_header_costs (const gchar  *option_name,
+                    const gchar  *value,
+                    gpointer      data,
+                    GError      **error)
+{
+  gchar *end = NULL;
+
+  if (value == NULL)
+    header_costs = DEFAULT_HEADER_COSTS;
+  else
+    header_costs = g_ascii_strtoll (value, &end, 10);
+
+  if (header_costs <= 0 || (end != NULL && *end != '\0'))
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   _("Invalid number for %s: %s"), option_name, value);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+parse_usage_report (const gchar  *option_name,
+                    const gchar  *value,
+                    gpointer      data,
+                    GError      **error)
+{
+  gint *size = g_str_equal (option_name, "--type-usage") ? &type_usage : &macro_expansions;
+  gchar *end = NULL;
+
+  if (value == NULL)
+    *size = DEFAULT_USAGE_REPORT;
+  else
+    *size = g_ascii_strtoll (value, &end, 10);
+
+  if (*size <= 0 || (end != NULL && *end != '\0'))
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   _("Invalid number for %s: %s"), option_name, value);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static GOptionEntry entries[] = {
+  { "jobs", 'j', 0, G_OPTION_ARG_INT, &n_jobs,
+    N_("Number of translation units to parse in parallel (0 for one per CPU)"),
+    N_("N") },
+  { "pch", 0, 0, G_OPTION_ARG_NONE, &use_pch,
+    N_("Share a precompiled header between translation units with identical flags"),
+    NULL },
+  { "cache-dir", 0, 0, G_OPTION_ARG_FILENAME, &cache_dir,
+    N_("Reuse results for unchanged translation units from DIR"),
+    N_("DIR") },
+  { "usr", 0, 0, G_OPTION_ARG_NONE, &key_by_usr,
+    N_("Count callees by USR, keeping static functions with the same name apart"),
+    NULL },
+  { "headers-once", 0, 0, G_OPTION_ARG_NONE, &headers_once,
+    N_("Count the code in each header once rather than in every file including it"),
+    NULL },
+  { "export-json", 0, 0, G_OPTION_ARG_FILENAME, &export_json,
+    N_("Write the flags of the commands found to FILE as a compile_commands.json for sightline"),
+    N_("FILE") },
+  { "export-db", 0, 0, G_OPTION_ARG_FILENAME, &export_db,
+    N_("Write the compile commands found to FILE as a binary compilation database"),
+    N_("FILE") },
+  { "xref", 0, 0, G_OPTION_ARG_FILENAME, &xref_index,
+    N_("Write a cross-reference index to FILE, or the index to query"),
+    N_("FILE") },
+  { "call-graph", 0, 0, G_OPTION_ARG_FILENAME, &call_graph,
+    N_("Write the number of calls from each function to each callee to FILE, as a dot graph"),
+    N_("FILE") },
+  { "include-graph", 0, 0, G_OPTION_ARG_FILENAME, &include_graph,
+    N_("Write which file includes which to FILE, as JSON if it ends with .json or a dot graph"),
+    N_("FILE") },
+  { "header-costs", 0, G_OPTION_FLAG_OPTIONAL_ARG, G_OPTION_ARG_CALLBACK, parse_header_costs,
+    N_("Print the N headers costing the most parse time to stderr (20 by default)"),
+    N_("N") },
+  { "type-usage", 0, G_OPTION_FLAG_OPTIONAL_ARG, G_OPTION_ARG_CALLBACK, parse_usage_report,
+    N_("Print the N most used types to stderr (20 by default)"),
+    N_("N") },
+  { "macro-expansions", 0, G_OPTION_FLAG_OPTIONAL_ARG, G_OPTION_ARG_CALLBACK, parse_usage_report,
+    N_("Print the N most expanded macros to stderr (20 by default)"),
+    N_("N") },
+  { "state", 0, 0, G_OPTION_ARG_FILENAME, &state_file,
+    N_("Only parse what changed since the run which saved FILE, then update it"),
+    N_("FILE") },
+  { "stats", 0, G_OPTION_FLAG_OPTIONAL_ARG, G_OPTION_ARG_CALLBACK, parse_stats_option,
+    N_("Print timings and counters to stderr, as text (the default) or json"),
+    N_("FORMAT") },
+  { "isolate", 0, 0, G_OPTION_ARG_NONE, &isolate,
+    N_("Parse in worker processes, so a unit crashing libclang only loses that unit"),
+    NULL },
+  { "timeout", 0, 0, G_OPTION_ARG_INT, &timeout,
+    N_("Give up on translation units taking longer than SECONDS (implies --isolate)"),
+    N_("SECONDS") },
+  { "recycle", 0, 0, G_OPTION_ARG_INT, &recycle_after,
+    N_("Replace worker processes after N translation units (100 by default, 0 for never)"),
+    N_("N") },
+  { "memory-budget", 0, 0, G_OPTION_ARG_CALLBACK, parse_memory_budget,
+    N_("Only parse as many translation units at once as fit in SIZE, such as 8G"),
+    N_("SIZE") },
+  { "top", 0, 0, G_OPTION_ARG_INT, &top_k,
+    N_("Only print the K most called functions"),
+    N_("K") },
+  { "approximate", 0, 0, G_OPTION_ARG_NONE, &approximate,
+    N_("Count calls approximately with --top, in a fixed amount of memory"),
+    NULL },
+  { "lexical", 0, 0, G_OPTION_ARG_NONE, &lexical,
+    N_("Count calls from the text of each file without parsing it, faster but less accurately"),
+    NULL },
+  { "daemon", 0, 0, G_OPTION_ARG_FILENAME, &daemon_socket,
+    N_("Keep translation units parsed, reparsing them as they change, and answer requests on SOCKET"),
+    N_("SOCKET") },
+  { "connect", 0, 0, G_OPTION_ARG_FILENAME, &connect_socket,
+    N_("Send a request to the daemon listening on SOCKET"),
+    N_("SOCKET") },
+  { "worker", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &worker_mode,
+    NULL,
+    NULL },
+  { NULL }
+};
+
+static Job *
+job_new (const gchar *filename,
+         guint        flags)
+{
+  Job *job;
+
+  job = g_slice_new (Job);
+  job->filename = g_strdup (filename);
+  job->flags = flags;
+  job->parse_flags = flags;
+  job->cost = -1;
+  job->memory = 0;
+  job->reparse = FALSE;
+
+  return job;
+}
+
+static void
+job_free (Job *job)
+{
+  g_free (job->filename);
+  g_slice_free (Job, job);
+}
+
+/*
+ * Orders the queue of the thread pool longest first, so the units that
+ * would otherwise dominate the tail of the run start early and the small
+ * ones fill in around them as workers become idle.
+ */
+static gint
+job_compare_cost (gconstpointer a,
+                  gconstpointer b,
+                  gpointer      user_data)
+{
+  const Job *job_a = a;
+  const Job *job_b = b;
+
+  if (job_a->cost > job_b->cost)
+    return -1;
+  else if (job_a->cost < job_b->cost)
+    return 1;
+  else
+    return 0;
+}
+
+static gint
+job_compare_cost_ptr (gconstpointer a,
+                      gconstpointer b)
+{
+  return job_compare_cost (*(const Job * const *)a, *(const Job * const *)b, NULL);
+}
+
+static inline const gchar * const *
+job_get_argv (Job *job)
+{
+  return sl_flag_table_lookup (sl_flag_table_get_default (), job->flags);
+}
+
+static inline const gchar * const *
+job_get_parse_argv (Job *job)
+{
+  return sl_flag_table_lookup (sl_flag_table_get_default (), job->parse_flags);
+}
+
+static void
+release_free (Release *release)
+{
+  g_free (release->path);
+  g_slice_free (Release, release);
+}
+
+static Results *
+results_new (void)
+{
+  Results *results;
+
+  results = g_slice_new0 (Results);
+  results->calls = sl_call_table_new ();
+  if (xref_index != NULL)
+    results->xref = sl_xref_builder_new ();
+  if (call_graph != NULL)
+    results->edges = sl_call_table_new ();
+  if (type_usage > 0)
+    results->types = sl_call_table_new ();
+  if (macro_expansions > 0)
+    results->macros = sl_call_table_new ();
+
+  return results;
+}
+
+static void
+results_free (Results *results)
+{
+  sl_call_table_free (results->calls);
+  g_clear_pointer (&results->xref, sl_xref_builder_free);
+  g_clear_pointer (&results->edges, sl_call_table_free);
+  g_clear_pointer (&results->types, sl_call_table_free);
+  g_clear_pointer (&results->macros, sl_call_table_free);
+  g_slice_free (Results, results);
+}
+
+static void
+results_clear (Results *results)
+{
+  sl_call_table_clear (results->calls);
+  if (results->xref != NULL)
+    sl_xref_builder_clear (results->xref);
+  if (results->edges != NULL)
+    sl_call_table_clear (results->edges);
+  if (results->types != NULL)
+    sl_call_table_clear (results->types);
+  if (results->macros != NULL)
+    sl_call_table_clear (results->macros);
+}
+
+/* Moves everything in @other to @results */
+static void
+results_merge (Results *results,
+               Results *other)
+{
+  sl_call_table_merge (results->calls, other->calls);
+  if (results->xref != NULL)
+    sl_xref_builder_merge (results->xref, other->xref);
+  if (results->edges != NULL)
+    sl_call_table_merge (results->edges, other->edges);
+  if (results->types != NULL)
+    sl_call_table_merge (results->types, other->types);
+  if (results->macros != NULL)
+    sl_call_table_merge (results->macros, other->macros);
+}
+
+/* Whether anything but the calls is collected, alone in a blob of its own */
+static inline gboolean
+results_has_tables (Results *results)
+{
+  return results->edges != NULL || results->types != NULL || results->macros != NULL;
+}
+
+static inline gboolean
+results_has_extra (Results *results)
+{
+  return results->xref != NULL || results_has_tables (results);
+}
+
+static GVariant *
+bytes_to_variant (GBytes *bytes)
+{
+  return g_variant_new_from_bytes (G_VARIANT_TYPE_BYTESTRING, bytes, TRUE);
+}
+
+/* Copied, since the blobs need to be aligned */
+static GBytes *
+variant_to_bytes (GVariant *variant)
+{
+  return g_bytes_new (g_variant_get_data (variant), g_variant_get_size (variant));
+}
+
+/* An empty blob stands for a table which is not collected */
+static GVariant *
+table_to_variant (SlCallTable *table)
+{
+  g_autoptr(GBytes) bytes = NULL;
+
+  if (table != NULL)
+    bytes = sl_call_table_serialize (table);
+  else
+    bytes = g_bytes_new (NULL, 0);
+
+  return bytes_to_variant (bytes);
+}
+
+static gboolean
+table_from_variant (SlCallTable *table,
+                    GVariant    *variant)
+{
+  g_autoptr(GBytes) bytes = NULL;
+
+  if (table == NULL)
+    return TRUE;
+
+  bytes = variant_to_bytes (variant);
+
+  return sl_call_table_deserialize (table, bytes);
+}
+
+/*
+ * What is stored next to the calls: the cross-references alone, or them
+ * followed by the call graph edges, the types and the macros when any of
+ * --call-graph, --type-usage or --macro-expansions is given. These are
+ * part of the cache salt, so the two layouts are never mixed up.
+ */
+static GBytes *
+results_serialize_extra (Results *results)
+{
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GBytes) xref = NULL;
+
+  if (results->xref != NULL)
+    xref = sl_xref_builder_serialize (results->xref);
+
+  if (!results_has_tables (results))
+    return g_steal_pointer (&xref);
+
+  if (xref == NULL)
+    xref = g_bytes_new (NULL, 0);
+
+  variant = g_variant_ref_sink (g_variant_new ("(@ay@ay@ay@ay)",
+                                               bytes_to_variant (xref),
+                                               table_to_variant (results->edges),
+                                               table_to_variant (results->types),
+                                               table_to_variant (results->macros)));
+
+  return g_variant_get_data_as_bytes (variant);
+}
+
+static gboolean
+results_deserialize_extra (Results *results,
+                           GBytes  *extra)
+{
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GVariant) xref = NULL;
+  g_autoptr(GVariant) edges = NULL;
+  g_autoptr(GVariant) types = NULL;
+  g_autoptr(GVariant) macros = NULL;
+  g_autoptr(GBytes) xref_bytes = NULL;
+
+  if (!results_has_tables (results))
+    return results->xref == NULL || sl_xref_builder_deserialize (results->xref, extra);
+
+  variant = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE ("(ayayayay)"), extra, FALSE));
+  g_variant_get (variant, "(@ay@ay@ay@ay)", &xref, &edges, &types, &macros);
+
+  xref_bytes = variant_to_bytes (xref);
+
+  if (results->xref != NULL && !sl_xref_builder_deserialize (results->xref, xref_bytes))
+    return FALSE;
+
+  return table_from_variant (results->edges, edges) &&
+         table_from_variant (results->types, types) &&
+         table_from_variant (results->macros, macros);
+}
+
+static PchGroup *
+pch_group_new (const gchar *pch_dir,
+               guint        id)
+{
+  PchGroup *group;
+
+  group = g_slice_new0 (PchGroup);
+  group->jobs = g_ptr_array_new ();
+  group->header = g_strdup_printf ("%s/prefix-%u.h", pch_dir, id);
+  group->pch = g_strdup_printf ("%s/prefix-%u.h.pch", pch_dir, id);
+
+  return group;
+}
+
+static void
+pch_group_free (PchGroup *group)
+{
+  g_unlink (group->pch);
+  g_unlink (group->header);
+
+  g_ptr_array_unref (group->jobs);
+  g_free (group->header);
+  g_free (group->pch);
+  g_slice_free (PchGroup, group);
+}
+
+static guint
+get_approximate_capacity (void)
+{
+  return MAX (top_k * APPROXIMATE_COUNTERS_PER_TOP, APPROXIMATE_MIN_COUNTERS);
+}
+
+static Worker *
+worker_new (void)
+{
+  Worker *worker;
+
+  worker = g_slice_new0 (Worker);
+  worker->index = clang_createIndex (0, 0);
+  worker->results = results_new ();
+  worker->unit = results_new ();
+  worker->decls_mask = 255;
+  worker->decls = g_new0 (DeclSlot, worker->decls_mask + 1);
+  worker->unit_headers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                (GDestroyNotify)results_free);
+  if (approximate)
+    worker->sketch = sl_space_saving_new (get_approximate_capacity ());
+  if (call_graph != NULL)
+    worker->edge = g_string_new (NULL);
+
+  return worker;
+}
+
+static void
+worker_free (Worker *worker)
+{
+  clang_disposeIndex (worker->index);
+  results_free (worker->results);
+  results_free (worker->unit);
+  g_free (worker->decls);
+  g_hash_table_unref (worker->unit_headers);
+  g_clear_pointer (&worker->process, sl_worker_process_free);
+  g_clear_pointer (&worker->sketch, sl_space_saving_free);
+  if (worker->edge != NULL)
+    g_string_free (worker->edge, TRUE);
+  g_slice_free (Worker, worker);
+}
+
+/*
+ * Each thread gets its own Worker (and therefore its own CXIndex and call
+ * count table) so that parsing never needs to take a lock. The workers are
+ * tracked so their tables can be merged once all jobs have completed.
+ */
+static Worker *
+sightline_get_worker (Sightline *self)
+{
+  Worker *worker;
+
+  if (NULL == (worker = g_private_get (&current_worker)))
+    {
+      worker = worker_new ();
+      g_private_set (&current_worker, worker);
+
+      g_mutex_lock (&self->workers_mutex);
+      g_ptr_array_add (self->workers, worker);
+      g_mutex_unlock (&self->workers_mutex);
+    }
+
+  return worker;
+}
+
+/* Cursors are only valid for the lifetime of their translation unit */
+static void
+worker_clear_decls (Worker *worker)
+{
+  if (worker->n_decls > 0)
+    {
+      memset (worker->decls, 0, sizeof (DeclSlot) * (worker->decls_mask + 1));
+      worker->n_decls = 0;
+    }
+}
+
+static void
+worker_grow_decls (Worker *worker)
+{
+  guint mask = (worker->decls_mask << 1) | 1;
+  DeclSlot *decls = g_new0 (DeclSlot, mask + 1);
+  guint i;
+
+  for (i = 0; i <= worker->decls_mask; i++)
+    {
+      const DeclSlot *slot = &worker->decls[i];
+      guint pos;
+
+      if (slot->index == 0)
+        continue;
+
+      for (pos = slot->hash & mask; decls[pos].index != 0; pos = (pos + 1) & mask) { }
+
+      decls[pos] = *slot;
+    }
+
+  g_free (worker->decls);
+  worker->decls = decls;
+  worker->decls_mask = mask;
+}
+
+/*
+ * Adds a call to the unit's call table by name (or USR), returning the
+ * index of the entry or G_MAXUINT if the callee has no name.
+ */
+static guint
+worker_add_call (Worker      *worker,
+                 SlCallTable *table,
+                 CXCursor     cursor,
+                 CXCursor     decl)
+{
+  CXString name;
+  CXString usr = { 0 };
+  const gchar *cname;
+  const gchar *ckey;
+  guint index = G_MAXUINT;
+  gsize len;
+
+  name = clang_getCursorSpelling (cursor);
+  cname = clang_getCString (name);
+
+  if (cname == NULL || *cname == '\0')
+    goto cleanup;
+
+  ckey = cname;
+
+  if (key_by_usr && !clang_Cursor_isNull (decl))
+    {
+      const gchar *cusr;
+
+      usr = clang_getCursorUSR (decl);
+      cusr = clang_getCString (usr);
+
+      if (cusr != NULL && *cusr != '\0')
+        ckey = cusr;
+    }
+
+  len = strlen (ckey);
+  index = sl_call_table_add (table,
+                             ckey,
+                             len,
+                             sl_call_table_hash (ckey, len),
+                             ckey != cname ? cname : NULL,
+                             1);
+
+cleanup:
+  if (usr.data != NULL)
+    clang_disposeString (usr);
+  clang_disposeString (name);
+
+  return index;
+}
+
+static void
+worker_inc_call_count (Worker      *worker,
+                       SlCallTable *table,
+                       CXCursor     cursor)
+{
+  CXCursor decl = clang_getCursorReferenced (cursor);
+  DeclSlot *slot = NULL;
+  guint index;
+
+  if (!clang_Cursor_isNull (decl))
+    {
+      guint hash = clang_hashCursor (decl);
+      guint pos;
+
+      for (pos = hash & worker->decls_mask;
+           worker->decls[pos].index != 0;
+           pos = (pos + 1) & worker->decls_mask)
+        {
+          slot = &worker->decls[pos];
+
+          if (slot->hash == hash && slot->table == table && clang_equalCursors (slot->decl, decl))
+            {
+              sl_call_table_increment (table, slot->index - 1, 1);
+              return;
+            }
+        }
+
+      slot = &worker->decls[pos];
+      slot->hash = hash;
+    }
+
+  index = worker_add_call (worker, table, cursor, decl);
+
+  if (slot == NULL || index == G_MAXUINT)
+    return;
+
+  slot->decl = decl;
+  slot->table = table;
+  slot->index = index + 1;
+
+  if (++worker->n_decls * 2 > worker->decls_mask + 1)
+    worker_grow_decls (worker);
+}
+
+static void
+add_cached (const gchar *key,
+            const gchar *name,
+            guint        count,
+            gpointer     user_data)
+{
+  Results *results = user_data;
+  gsize len = strlen (key);
+
+  sl_call_table_add (results->calls,
+                     key,
+                     len,
+                     sl_call_table_hash (key, len),
+                     name != key ? name : NULL,
+                     count);
+}
+
+/* Looks up a cache entry, including the cross-references and edges stored with it */
+static gboolean
+sightline_lookup_cached (Sightline   *self,
+                         const gchar *key,
+                         GPtrArray   *dependencies,
+                         Results     *results)
+{
+  g_autoptr(GBytes) extra = NULL;
+
+  if (!sl_result_cache_lookup (self->cache,
+                               key,
+                               dependencies,
+                               add_cached,
+                               results,
+                               results_has_extra (results) ? &extra : NULL))
+    return FALSE;
+
+  if (results_has_extra (results) &&
+      (extra == NULL || !results_deserialize_extra (results, extra)))
+    {
+      results_clear (results);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+sightline_store_cached (Sightline   *self,
+                        const gchar *key,
+                        GPtrArray   *dependencies,
+                        Results     *results)
+{
+  g_autoptr(GBytes) extra = NULL;
+
+  extra = results_serialize_extra (results);
+
+  sl_result_cache_store (self->cache, key, dependencies, results->calls, extra);
+}
+
+static void
+inclusion_visitor (CXFile             included_file,
+                   CXSourceLocation  *inclusion_stack,
+                   unsigned           include_len,
+                   CXClientData       client_data)
+{
+  Inclusions *inclusions = client_data;
+  CXString str;
+
+  /* The main file is already part of the cache key */
+  if (include_len == 0)
+    return;
+
+  str = clang_getFileName (included_file);
+
+  if (inclusions->dependencies != NULL)
+    g_ptr_array_add (inclusions->dependencies, g_strdup (clang_getCString (str)));
+
+  /* The innermost location is the #include directive */
+  if (inclusions->inclusions != NULL)
+    {
+      CXString includer_str;
+      CXFile includer;
+
+      clang_getFileLocation (inclusion_stack[0], &includer, NULL, NULL, NULL);
+      includer_str = clang_getFileName (includer);
+
+      if (clang_getCString (includer_str) != NULL && clang_getCString (str) != NULL)
+        {
+          g_ptr_array_add (inclusions->inclusions, g_strdup (clang_getCString (includer_str)));
+          g_ptr_array_add (inclusions->inclusions, g_strdup (clang_getCString (str)));
+        }
+
+      clang_disposeString (includer_str);
+    }
+
+  clang_disposeString (str);
+}
+
+static void sightline_dispatch (Sightline *self,
+                                Job       *job);
+
+static void
+resident_free (Resident *resident)
+{
+  g_free (resident->filename);
+  clang_disposeTranslationUnit (resident->unit);
+  sl_call_table_free (resident->calls);
+  g_slice_free (Resident, resident);
+}
+
+static gboolean
+sightline_is_resident (Sightline           *self,
+                       const gchar         *filename,
+                       const gchar * const *argv)
+{
+  Resident *resident;
+  gboolean ret;
+
+  g_mutex_lock (&self->residents_mutex);
+  resident = g_hash_table_lookup (self->residents, filename);
+  ret = resident != NULL && resident->argv == argv;
+  g_mutex_unlock (&self->residents_mutex);
+
+  return ret;
+}
+
+/* Replaces what the resident unit of @filename adds to the totals with @calls */
+static void
+sightline_count_resident (Sightline   *self,
+                          const gchar *filename,
+                          SlCallTable *calls)
+{
+  Resident *resident;
+
+  g_mutex_lock (&self->residents_mutex);
+
+  if (NULL != (resident = g_hash_table_lookup (self->residents, filename)))
+    {
+      /* Both clear their source, the resident keeps its counts to subtract later */
+      sl_call_table_subtract (self->results->calls, resident->calls);
+      sl_call_table_merge (resident->calls, calls);
+      sl_call_table_add_table (self->results->calls, resident->calls);
+    }
+
+  g_mutex_unlock (&self->residents_mutex);
+}
+
+static gboolean
+sightline_reparse_changed (gpointer data)
+{
+  Sightline *self = data;
+  GHashTableIter iter;
+  gpointer key;
+
+  g_hash_table_iter_init (&iter, self->changed);
+
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      Job *job = job_new (key, 0);
+
+      job->reparse = TRUE;
+      sightline_dispatch (self, job);
+    }
+
+  g_hash_table_remove_all (self->changed);
+  self->changed_source = 0;
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+file_changed (GFileMonitor      *monitor,
+              GFile             *file,
+              GFile             *other_file,
+              GFileMonitorEvent  event_type,
+              gpointer           user_data)
+{
+  Sightline *self = user_data;
+  const gchar *filename = g_object_get_data (G_OBJECT (monitor), "filename");
+
+  if (event_type == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED)
+    return;
+
+  g_hash_table_add (self->changed, g_strdup (filename));
+
+  /* Editors save in several steps, so wait until they are done */
+  if (self->changed_source != 0)
+    g_source_remove (self->changed_source);
+
+  self->changed_source = g_timeout_add (REPARSE_DELAY_MSEC, sightline_reparse_changed, self);
+}
+
+static gboolean
+sightline_watch (gpointer data)
+{
+  WatchRequest *request = data;
+  Sightline *self = request->self;
+  g_autoptr(GFile) file = NULL;
+  g_autoptr(GError) error = NULL;
+  GFileMonitor *monitor;
+  gchar *key;
+
+  if (g_hash_table_contains (self->monitors, request->filename))
+    return G_SOURCE_REMOVE;
+
+  file = g_file_new_for_path (request->filename);
+
+  if (NULL == (monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, &error)))
+    {
+      g_printerr (_("Cannot watch %s: %s\n"), request->filename, error->message);
+      return G_SOURCE_REMOVE;
+    }
+
+  key = g_strdup (request->filename);
+  g_object_set_data (G_OBJECT (monitor), "filename", key);
+  g_signal_connect (monitor, "changed", G_CALLBACK (file_changed), self);
+  g_hash_table_insert (self->monitors, key, monitor);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+watch_request_free (gpointer data)
+{
+  WatchRequest *request = data;
+
+  g_free (request->filename);
+  g_slice_free (WatchRequest, request);
+}
+
+/*
+ * Keeps a unit parsed with --daemon, replacing any previous parse of the
+ * file, whose calls leave the totals. The file is watched from the main
+ * loop, which is where file monitors deliver their events.
+ */
+static void
+sightline_keep_unit (Sightline           *self,
+                     const gchar         *filename,
+                     const gchar * const *argv,
+                     CXTranslationUnit    unit)
+{
+  WatchRequest *request;
+  Resident *resident;
+  Resident *previous;
+
+  resident = g_slice_new0 (Resident);
+  resident->filename = g_strdup (filename);
+  resident->argv = argv;
+  resident->unit = unit;
+  resident->calls = sl_call_table_new ();
+
+  g_mutex_lock (&self->residents_mutex);
+  if (NULL != (previous = g_hash_table_lookup (self->residents, filename)))
+    sl_call_table_subtract (self->results->calls, previous->calls);
+  g_hash_table_replace (self->residents, resident->filename, resident);
+  g_mutex_unlock (&self->residents_mutex);
+
+  request = g_slice_new (WatchRequest);
+  request->self = self;
+  request->filename = g_strdup (filename);
+
+  g_main_context_invoke_full (NULL, G_PRIORITY_DEFAULT, sightline_watch, request, watch_request_free);
+}
+
+/* Records the contribution of the current unit and moves it to the worker */
+static void
+sightline_finish_unit (Sightline           *self,
+                       Worker              *worker,
+                       const gchar         *filename,
+                       const gchar * const *argv,
+                       GPtrArray           *dependencies,
+                       GPtrArray           *claimed)
+{
+  /* The totals are kept up to date as units are parsed, for requests */
+  if (self->daemon != NULL)
+    {
+      sightline_count_resident (self, filename, worker->unit->calls);
+      results_clear (worker->unit);
+      return;
+    }
+
+  if (self->state != NULL)
+    sl_state_update (self->state,
+                     filename,
+                     argv,
+                     dependencies,
+                     claimed,
+                     worker->unit->calls,
+                     worker->unit->xref);
+
+  /* Only the exact counts of a unit are kept, for the cache and the state */
+  if (worker->sketch != NULL)
+    {
+      sl_space_saving_add_calls (worker->sketch, worker->unit->calls);
+      sl_call_table_clear (worker->unit->calls);
+    }
+
+  results_merge (worker->results, worker->unit);
+}
+
+static gchar *
+get_header_key (const gchar * const *argv,
+                const gchar         *path)
+{
+  /* Flag sets are never freed, so their vectors identify them */
+  return g_strdup_printf ("%p:%s", (gpointer)argv, path);
+}
+
+/*
+ * Claims @path for the current translation unit unless another unit with
+ * the same flags already has, in which case the top-level code of the
+ * header is counted as part of this unit. Returns the results to count
+ * into, or %NULL if the header belongs to another unit.
+ */
+static Results *
+sightline_claim_header (Sightline           *self,
+                        Worker              *worker,
+                        const gchar * const *argv,
+                        const gchar         *path)
+{
+  Results *results;
+  gboolean claimed;
+  gchar *key;
+
+  if (NULL != (results = g_hash_table_lookup (worker->unit_headers, path)))
+    return results;
+
+  key = get_header_key (argv, path);
+
+  g_mutex_lock (&self->headers_mutex);
+  claimed = g_hash_table_add (self->headers, key);
+  g_mutex_unlock (&self->headers_mutex);
+
+  if (!claimed)
+    return NULL;
+
+  results = results_new ();
+  g_hash_table_insert (worker->unit_headers, g_strdup (path), results);
+
+  return results;
+}
+
+/*
+ * Loads the counts for every header claimed by the current translation
+ * unit from the cache. Returns %FALSE if any of them is missing, in which
+ * case the unit needs to be parsed.
+ */
+static gboolean
+sightline_lookup_headers (Sightline           *self,
+                          Worker              *worker,
+                          const gchar * const *argv,
+                          GPtrArray           *dependencies)
+{
+  guint i;
+
+  for (i = 0; i < dependencies->len; i++)
+    {
+      const gchar *path = g_ptr_array_index (dependencies, i);
+      g_autofree gchar *key = NULL;
+      Results *results;
+
+      if (NULL == (results = sightline_claim_header (self, worker, argv, path)))
+        continue;
+
+      if (NULL == (key = sl_result_cache_get_key (self->cache, path, argv)) ||
+          !sightline_lookup_cached (self, key, NULL, results))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/*
+ * Moves the results for the headers claimed by the current unit to the
+ * unit, adding their paths to @claimed.
+ */
+static void
+sightline_finish_headers (Sightline           *self,
+                          Worker              *worker,
+                          const gchar * const *argv,
+                          gboolean             store,
+                          GPtrArray           *claimed)
+{
+  g_autoptr(GPtrArray) no_dependencies = g_ptr_array_new ();
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, worker->unit_headers);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const gchar *path = key;
+      Results *results = value;
+
+      /* The contents of the header are part of its key, there is nothing to revalidate */
+      if (store)
+        {
+          g_autofree gchar *cache_key = sl_result_cache_get_key (self->cache, path, argv);
+
+          if (cache_key != NULL)
+            sightline_store_cached (self, cache_key, no_dependencies, results);
+        }
+
+      if (claimed != NULL)
+        g_ptr_array_add (claimed, g_strdup (path));
+
+      results_merge (worker->unit, results);
+    }
+
+  g_hash_table_remove_all (worker->unit_headers);
+}
+
+/*
+ * With --headers-once, picks the table for a top-level cursor based on the
+ * file it is in. Consecutive top-level cursors are almost always from the
+ * same file, so the previous decision is reused when it is.
+ */
+static void
+visit_set_target (Visit    *visit,
+                  CXCursor  cursor)
+{
+  CXSourceLocation location = clang_getCursorLocation (cursor);
+  const gchar *path;
+  CXFile file = NULL;
+  CXString str;
+
+  if (clang_Location_isFromMainFile (location))
+    {
+      visit->target = visit->worker->unit;
+      visit->target_file = NULL;
+      return;
+    }
+
+  clang_getExpansionLocation (location, &file, NULL, NULL, NULL);
+
+  if (file == NULL)
+    {
+      visit->target = NULL;
+      visit->target_file = NULL;
+      return;
+    }
+
+  if (visit->target_file != NULL && clang_File_isEqual (file, visit->target_file))
+    return;
+
+  str = clang_getFileName (file);
+  path = clang_getCString (str);
+
+  if (path != NULL)
+    visit->target = sightline_claim_header (visit->self, visit->worker, visit->argv, path);
+  else
+    visit->target = NULL;
+
+  visit->target_file = file;
+  clang_disposeString (str);
+}
+
+/* Records an occurrence of @symbol at the location of @cursor */
+static void
+visit_add_xref (Visit      *visit,
+                SlXrefKind  kind,
+                CXCursor    cursor,
+                CXCursor    symbol)
+{
+  CXString usr;
+  CXString name;
+  const gchar *cusr;
+  const gchar *cname;
+  const gchar *path;
+  CXFile file = NULL;
+  guint line;
+  guint column;
+
+  clang_getExpansionLocation (clang_getCursorLocation (cursor), &file, &line, &column, NULL);
+
+  if (file == NULL)
+    return;
+
+  /* Occurrences are mostly in the same file as the previous one */
+  if (visit->xref_file == NULL || !clang_File_isEqual (file, visit->xref_file))
+    {
+      if (visit->xref_file != NULL)
+        clang_disposeString (visit->xref_path);
+      visit->xref_path = clang_getFileName (file);
+      visit->xref_file = file;
+    }
+
+  usr = clang_getCursorUSR (symbol);
+  name = clang_getCursorSpelling (symbol);
+  cusr = clang_getCString (usr);
+  cname = clang_getCString (name);
+  path = clang_getCString (visit->xref_path);
+
+  if (cusr != NULL && *cusr != '\0' && cname != NULL && *cname != '\0' && path != NULL)
+    sl_xref_builder_add (visit->target->xref, kind, cusr, cname, path, line, column, visit->caller);
+
+  clang_disposeString (name);
+  clang_disposeString (usr);
+}
+
+static inline SlXrefKind
+get_declaration_kind (CXCursor cursor)
+{
+  return clang_isCursorDefinition (cursor) ? SL_XREF_DEFINITION : SL_XREF_DECLARATION;
+}
+
+/* Locals and parameters are not interesting outside of their function */
+static inline gboolean
+is_local (CXCursor cursor)
+{
+  enum CXCursorKind kind = clang_getCursorKind (cursor);
+
+  return kind == CXCursor_ParmDecl ||
+         (kind == CXCursor_VarDecl && clang_getCursorLinkage (cursor) == CXLinkage_NoLinkage);
+}
+
+static enum CXChildVisitResult cursor_visitor (CXCursor     cursor,
+                                               CXCursor     parent,
+                                               CXClientData client_data);
+
+/* Counts calls, for each callee */
+static void
+pass_calls (CXCursor cursor,
+            gpointer data)
+{
+  Visit *visit = data;
+
+  worker_inc_call_count (visit->worker, visit->target->calls, cursor);
+}
+
+/* Counts uses of types, by the name of the type referred to */
+static void
+pass_types (CXCursor cursor,
+            gpointer data)
+{
+  Visit *visit = data;
+
+  worker_inc_call_count (visit->worker, visit->target->types, cursor);
+}
+
+/* Counts expansions of macros, found in the detailed preprocessing record */
+static void
+pass_macros (CXCursor cursor,
+             gpointer data)
+{
+  Visit *visit = data;
+
+  worker_inc_call_count (visit->worker, visit->target->macros, cursor);
+}
+
+/* Counts calls, for each caller and callee */
+static void
+pass_call_graph (CXCursor cursor,
+                 gpointer data)
+{
+  Visit *visit = data;
+  GString *edge = visit->worker->edge;
+  g_autofree gchar *edge_name = NULL;
+  const gchar *caller;
+  const gchar *cname;
+  const gchar *ckey;
+  CXString name;
+  CXString usr = { 0 };
+  CXCursor decl;
+
+  /* Calls outside of a function, in initializers, have no caller */
+  if (visit->caller_name == NULL || *visit->caller_name == '\0')
+    return;
+
+  name = clang_getCursorSpelling (cursor);
+  cname = clang_getCString (name);
+
+  if (cname == NULL || *cname == '\0')
+    goto cleanup;
+
+  caller = visit->caller_name;
+  ckey = cname;
+
+  if (key_by_usr)
+    {
+      const gchar *cusr;
+
+      if (visit->caller != NULL && *visit->caller != '\0')
+        caller = visit->caller;
+
+      decl = clang_getCursorReferenced (cursor);
+
+      if (!clang_Cursor_isNull (decl))
+        {
+          usr = clang_getCursorUSR (decl);
+          cusr = clang_getCString (usr);
+
+          if (cusr != NULL && *cusr != '\0')
+            ckey = cusr;
+        }
+    }
+
+  g_string_truncate (edge, 0);
+  g_string_append (edge, caller);
+  g_string_append_c (edge, '\t');
+  g_string_append (edge, ckey);
+
+  if (caller != visit->caller_name || ckey != cname)
+    edge_name = g_strdup_printf ("%s\t%s", visit->caller_name, cname);
+
+  sl_call_table_add (visit->target->edges,
+                     edge->str,
+                     edge->len,
+                     sl_call_table_hash (edge->str, edge->len),
+                     edge_name,
+                     1);
+
+cleanup:
+  if (usr.data != NULL)
+    clang_disposeString (usr);
+  clang_disposeString (name);
+}
+
+/* Records definitions, declarations, calls and references */
+static void
+pass_xref (CXCursor cursor,
+           gpointer data)
+{
+  enum CXCursorKind kind = clang_getCursorKind (cursor);
+  Visit *visit = data;
+  CXCursor referenced;
+
+  switch ((int)kind)
+    {
+    case CXCursor_CallExpr:
+      referenced = clang_getCursorReferenced (cursor);
+      if (!clang_Cursor_isNull (referenced))
+        {
+          visit_add_xref (visit, SL_XREF_CALL, cursor, referenced);
+          visit->callee = referenced;
+          visit->call_location = clang_getCursorLocation (cursor);
+        }
+      break;
+
+    case CXCursor_VarDecl:
+      if (!is_local (cursor))
+        visit_add_xref (visit, get_declaration_kind (cursor), cursor, cursor);
+      break;
+
+    case CXCursor_FunctionDecl:
+    case CXCursor_CXXMethod:
+    case CXCursor_Constructor:
+    case CXCursor_Destructor:
+    case CXCursor_FunctionTemplate:
+    case CXCursor_StructDecl:
+    case CXCursor_UnionDecl:
+    case CXCursor_ClassDecl:
+    case CXCursor_EnumDecl:
+    case CXCursor_EnumConstantDecl:
+    case CXCursor_TypedefDecl:
+    case CXCursor_FieldDecl:
+    case CXCursor_MacroDefinition:
+      visit_add_xref (visit, get_declaration_kind (cursor), cursor, cursor);
+      break;
+
+    case CXCursor_DeclRefExpr:
+    case CXCursor_MemberRefExpr:
+    case CXCursor_TypeRef:
+    case CXCursor_MacroExpansion:
+      referenced = clang_getCursorReferenced (cursor);
+      if (clang_Cursor_isNull (referenced) || is_local (referenced))
+        break;
+      if (clang_equalCursors (referenced, visit->callee) &&
+          clang_equalLocations (clang_getCursorLocation (cursor), visit->call_location))
+        break;
+      visit_add_xref (visit, SL_XREF_REFERENCE, cursor, referenced);
+      break;
+
+    default:
+      break;
+    }
+}
+
+/* Visits the body of a function, so occurrences within it know their caller */
+static void
+visit_function (Visit    *visit,
+                CXCursor  cursor)
+{
+  const gchar *caller = visit->caller;
+  const gchar *caller_name = visit->caller_name;
+  CXString usr;
+  CXString name;
+
+  usr = clang_getCursorUSR (cursor);
+  name = clang_getCursorSpelling (cursor);
+  visit->caller = clang_getCString (usr);
+  visit->caller_name = clang_getCString (name);
+  clang_visitChildren (cursor, cursor_visitor, visit);
+  visit->caller = caller;
+  visit->caller_name = caller_name;
+  clang_disposeString (name);
+  clang_disposeString (usr);
+}
+
+static inline gboolean
+is_function_kind (enum CXCursorKind kind)
+{
+  return kind == CXCursor_FunctionDecl ||
+         kind == CXCursor_CXXMethod ||
+         kind == CXCursor_Constructor ||
+         kind == CXCursor_Destructor ||
+         kind == CXCursor_FunctionTemplate;
+}
+
+static enum CXChildVisitResult
+cursor_visitor (CXCursor     cursor,
+                CXCursor     parent,
+                CXClientData client_data)
+{
+  enum CXCursorKind kind = clang_getCursorKind (cursor);
+  Visit *visit = client_data;
+
+  if (headers_once && clang_getCursorKind (parent) == CXCursor_TranslationUnit)
+    {
+      visit_set_target (visit, cursor);
+
+      if (visit->target == NULL)
+        return CXChildVisit_Continue;
+    }
+
+  sl_pass_registry_dispatch (passes, kind, cursor, visit);
+
+  if (track_callers && is_function_kind (kind) && clang_isCursorDefinition (cursor))
+    {
+      visit_function (visit, cursor);
+      return CXChildVisit_Continue;
+    }
+
+  return CXChildVisit_Recurse;
+}
+
+/*
+ * Registers the analyses the options ask for, which then share a single
+ * traversal of each translation unit.
+ */
+static void
+setup_passes (void)
+{
+  static const enum CXCursorKind call_kinds[] = {
+    CXCursor_CallExpr,
+  };
+  static const enum CXCursorKind xref_kinds[] = {
+    CXCursor_CallExpr,
+    CXCursor_VarDecl,
+    CXCursor_FunctionDecl,
+    CXCursor_CXXMethod,
+    CXCursor_Constructor,
+    CXCursor_Destructor,
+    CXCursor_FunctionTemplate,
+    CXCursor_StructDecl,
+    CXCursor_UnionDecl,
+    CXCursor_ClassDecl,
+    CXCursor_EnumDecl,
+    CXCursor_EnumConstantDecl,
+    CXCursor_TypedefDecl,
+    CXCursor_FieldDecl,
+    CXCursor_MacroDefinition,
+    CXCursor_DeclRefExpr,
+    CXCursor_MemberRefExpr,
+    CXCursor_TypeRef,
+    CXCursor_MacroExpansion,
+  };
+  static const enum CXCursorKind type_kinds[] = {
+    CXCursor_TypeRef,
+  };
+  static const enum CXCursorKind macro_kinds[] = {
+    CXCursor_MacroExpansion,
+  };
+
+  passes = sl_pass_registry_new ();
+
+  sl_pass_registry_add (passes, "calls", call_kinds, G_N_ELEMENTS (call_kinds), pass_calls);
+
+  if (call_graph != NULL)
+    sl_pass_registry_add (passes, "call-graph", call_kinds, G_N_ELEMENTS (call_kinds), pass_call_graph);
+
+  if (xref_index != NULL)
+    sl_pass_registry_add (passes, "xref", xref_kinds, G_N_ELEMENTS (xref_kinds), pass_xref);
+
+  if (type_usage > 0)
+    sl_pass_registry_add (passes, "types", type_kinds, G_N_ELEMENTS (type_kinds), pass_types);
+
+  if (macro_expansions > 0)
+    sl_pass_registry_add (passes, "macros", macro_kinds, G_N_ELEMENTS (macro_kinds), pass_macros);
+
+  /* Both need to know which function each cursor is in */
+  track_callers = call_graph != NULL || xref_index != NULL;
+}
+
+/* Sums what libclang allocated for @unit, adding it to the statistics */
+static guint64
+sightline_measure_memory (Sightline         *self,
+                          CXTranslationUnit  unit)
+{
+  CXTUResourceUsage usage;
+  guint64 total = 0;
+  guint i;
+
+  g_assert (unit != NULL);
+
+  usage = clang_getCXTUResourceUsage (unit);
+  for (i = 0; i < usage.numEntries; i++)
+    {
+      total += usage.entries[i].amount;
+
+      if (self->stats != NULL)
+        sl_stats_add_memory (self->stats,
+                             clang_getTUResourceUsageName (usage.entries[i].kind),
+                             usage.entries[i].amount);
+    }
+  clang_disposeCXTUResourceUsage (usage);
+
+  return total;
+}
+
+static void
+sightline_record_unit (Sightline         *self,
+                       const gchar       *filename,
+                       gboolean           parsed,
+                       const SlStatsTime *cache_time,
+                       const SlStatsTime *parse_time,
+                       const SlStatsTime *visit_time)
+{
+  g_assert (self->stats != NULL);
+
+  sl_stats_add_time (self->stats, SL_STATS_PHASE_CACHE, cache_time);
+  sl_stats_add_unit (self->stats, filename, parse_time, visit_time);
+  sl_stats_add_count (self->stats, parsed ? SL_STATS_PARSED : SL_STATS_FAILED, 1);
+}
+
+/*
+ * Parses and visits a translation unit in this process, counting into the
+ * unit of @worker and the headers it claims, and adding the headers it
+ * includes to @dependencies and who includes them to @inclusions, either
+ * of which may be %NULL. @memory is set to what libclang needed.
+ */
+static gboolean
+sightline_parse_unit (Sightline            *self,
+                      Worker               *worker,
+                      const gchar          *filename,
+                      const gchar * const  *argv,
+                      const gchar * const  *parse_argv,
+                      GPtrArray            *dependencies,
+                      GPtrArray            *inclusions,
+                      SlStatsTime          *parse_time,
+                      SlStatsTime          *visit_time,
+                      guint64              *memory,
+                      GError              **error)
+{
+  CXTranslationUnit unit;
+  CXCursor cursor;
+  Visit visit = { self, worker, argv, worker->unit, NULL };
+  SlStatsTimer timer = { 0 };
+  guint options = CXTranslationUnit_DetailedPreprocessingRecord;
+
+  /* Resident units keep a precompiled preamble from their first reparse on */
+  if (self->daemon != NULL)
+    options |= CXTranslationUnit_PrecompiledPreamble;
+
+  sl_stats_timer_start (&timer);
+
+  unit = clang_parseTranslationUnit (worker->index,
+                                     filename,
+                                     parse_argv,
+                                     g_strv_length ((gchar **)parse_argv),
+                                     NULL,
+                                     0,
+                                     options);
+
+  sl_stats_timer_lap (&timer, parse_time);
+
+  if (unit == NULL)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED, "libclang could not parse it");
+      return FALSE;
+    }
+
+  cursor = clang_getTranslationUnitCursor (unit);
+  clang_visitChildren (cursor, cursor_visitor, &visit);
+
+  sl_stats_timer_lap (&timer, visit_time);
+
+  if (visit.xref_file != NULL)
+    clang_disposeString (visit.xref_path);
+
+  if (dependencies != NULL || inclusions != NULL)
+    {
+      Inclusions data = { dependencies, inclusions };
+      clang_getInclusions (unit, inclusion_visitor, &data);
+    }
+
+  *memory = sightline_measure_memory (self, unit);
+
+  worker_clear_decls (worker);
+
+  if (self->daemon != NULL)
+    sightline_keep_unit (self, filename, argv, unit);
+  else
+    clang_disposeTranslationUnit (unit);
+
+  return TRUE;
+}
+
+/* Results travel between processes as the blobs the cache and state use */
+static GVariant *
+results_to_variant (Results *results)
+{
+  g_autoptr(GBytes) calls = NULL;
+  g_autoptr(GBytes) extra = NULL;
+
+  calls = sl_call_table_serialize (results->calls);
+
+  if (NULL == (extra = results_serialize_extra (results)))
+    extra = g_bytes_new (NULL, 0);
+
+  return g_variant_new ("(@ay@ay)", bytes_to_variant (calls), bytes_to_variant (extra));
+}
+
+static gboolean
+results_add_variant (Results  *results,
+                     GVariant *variant)
+{
+  g_autoptr(GVariant) calls = NULL;
+  g_autoptr(GVariant) extra = NULL;
+  g_autoptr(GBytes) calls_bytes = NULL;
+  g_autoptr(GBytes) extra_bytes = NULL;
+
+  g_variant_get (variant, "(@ay@ay)", &calls, &extra);
+
+  calls_bytes = variant_to_bytes (calls);
+  if (!sl_call_table_deserialize (results->calls, calls_bytes))
+    return FALSE;
+
+  if (!results_has_extra (results))
+    return TRUE;
+
+  extra_bytes = variant_to_bytes (extra);
+
+  return results_deserialize_extra (results, extra_bytes);
+}
+
+/*
+ * Counts the calls in a translation unit with --lexical, from its text
+ * alone. The time spent lexing is counted as parsing.
+ */
+static gboolean
+sightline_lex_unit (Sightline    *self,
+                    Worker       *worker,
+                    const gchar  *filename,
+                    SlStatsTime  *parse_time,
+                    GError      **error)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+  SlStatsTimer timer = { 0 };
+
+  sl_stats_timer_start (&timer);
+
+  if (NULL == (mapped = g_mapped_file_new (filename, FALSE, error)))
+    return FALSE;
+
+  sl_call_lexer_count (g_mapped_file_get_contents (mapped),
+                       g_mapped_file_get_length (mapped),
+                       worker->unit->calls);
+
+  sl_stats_timer_lap (&timer, parse_time);
+
+  return TRUE;
+}
+
+/*
+ * Does what sightline_parse_unit() does in the child process of @worker,
+ * so that a unit which crashes or hangs libclang only costs that unit. The
+ * child counts every header separately, and each is claimed here.
+ */
+static gboolean
+sightline_parse_isolated (Sightline            *self,
+                          Worker               *worker,
+                          const gchar          *filename,
+                          const gchar * const  *argv,
+                          const gchar * const  *parse_argv,
+                          GPtrArray            *dependencies,
+                          GPtrArray            *inclusions,
+                          SlStatsTime          *parse_time,
+                          SlStatsTime          *visit_time,
+                          guint64              *memory,
+                          GError              **error)
+{
+  g_autoptr(GVariant) request = NULL;
+  g_autoptr(GVariant) reply = NULL;
+  g_autoptr(GVariant) unit = NULL;
+  g_autoptr(GVariant) headers = NULL;
+  g_autoptr(GBytes) request_bytes = NULL;
+  g_autoptr(GBytes) reply_bytes = NULL;
+  g_autofree const gchar **includes = NULL;
+  g_autofree const gchar **pairs = NULL;
+  const gchar *path;
+  GVariant *header;
+  GVariantIter iter;
+  gboolean parsed;
+  guint i;
+
+  if (worker->process == NULL)
+    worker->process = sl_worker_process_new ((const gchar * const *)worker_argv, MAX (recycle_after, 0));
+
+  request = g_variant_ref_sink (g_variant_new ("(^ay^aay)", filename, parse_argv));
+  request_bytes = g_variant_get_data_as_bytes (request);
+
+  if (NULL == (reply_bytes = sl_worker_process_call (worker->process,
+                                                     request_bytes,
+                                                     (gint64)timeout * G_USEC_PER_SEC,
+                                                     error)))
+    return FALSE;
+
+  reply = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (WORKER_REPLY_TYPE), reply_bytes, FALSE));
+  g_variant_get (reply, "(bxxxxt^a&ay^a&ay@(ayay)@a(ay(ayay)))",
+                 &parsed,
+                 &parse_time->wall, &parse_time->cpu,
+                 &visit_time->wall, &visit_time->cpu,
+                 memory,
+                 &includes, &pairs, &unit, &headers);
+
+  if (!parsed)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED, "libclang could not parse it");
+      return FALSE;
+    }
+
+  if (dependencies != NULL)
+    {
+      for (i = 0; includes[i] != NULL; i++)
+        g_ptr_array_add (dependencies, g_strdup (includes[i]));
+    }
+
+  if (inclusions != NULL)
+    {
+      for (i = 0; pairs[i] != NULL; i++)
+        g_ptr_array_add (inclusions, g_strdup (pairs[i]));
+    }
+
+  if (!results_add_variant (worker->unit, unit))
+    goto invalid;
+
+  g_variant_iter_init (&iter, headers);
+
+  while (g_variant_iter_next (&iter, "(^&ay@(ayay))", &path, &header))
+    {
+      g_autoptr(GVariant) owned = header;
+      Results *results;
+
+      if (NULL != (results = sightline_claim_header (self, worker, argv, path)) &&
+          !results_add_variant (results, header))
+        goto invalid;
+    }
+
+  return TRUE;
+
+invalid:
+  g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid reply from worker process");
+
+  return FALSE;
+}
+
+/*
+ * Parses a translation unit. @argv identifies the flags of the unit (for
+ * the cache, the state and header claims) while @parse_argv is what it is
+ * parsed with, which may include a PCH.
+ */
+static void
+sightline_parse (Sightline           *self,
+                 Worker              *worker,
+                 const gchar         *filename,
+                 const gchar * const *argv,
+                 const gchar * const *parse_argv)
+{
+  g_autoptr(GPtrArray) dependencies = NULL;
+  g_autoptr(GPtrArray) inclusions = NULL;
+  g_autoptr(GPtrArray) claimed = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *key = NULL;
+  SlStatsTimer timer = { 0 };
+  SlStatsTime cache_time = { 0 };
+  SlStatsTime parse_time = { 0 };
+  SlStatsTime visit_time = { 0 };
+  GHashTableIter iter;
+  gpointer value;
+  gboolean parsed;
+  guint64 memory = 0;
+  gint64 begin;
+
+  if (self->stats != NULL)
+    sl_stats_timer_start (&timer);
+
+  if (headers_once || self->state != NULL)
+    dependencies = g_ptr_array_new_with_free_func (g_free);
+
+  if (headers_once && self->state != NULL)
+    claimed = g_ptr_array_new_with_free_func (g_free);
+
+  if (self->cache != NULL &&
+      NULL != (key = sl_result_cache_get_key (self->cache, filename, argv)))
+    {
+      if (sightline_lookup_cached (self, key, dependencies, worker->unit))
+        {
+          /* Headers are cached separately, since the unit that counts them may change */
+          if (!headers_once ||
+              sightline_lookup_headers (self, worker, argv, dependencies))
+            {
+              if (self->stats != NULL)
+                {
+                  sl_stats_timer_lap (&timer, &cache_time);
+                  sl_stats_add_time (self->stats, SL_STATS_PHASE_CACHE, &cache_time);
+                  sl_stats_add_count (self->stats, SL_STATS_CACHED, 1);
+                }
+
+              sightline_finish_headers (self, worker, argv, FALSE, claimed);
+              sightline_finish_unit (self, worker, filename, argv, dependencies, claimed);
+              return;
+            }
+
+          /* Keep the claimed headers, they will be counted by parsing */
+          results_clear (worker->unit);
+          g_hash_table_iter_init (&iter, worker->unit_headers);
+          while (g_hash_table_iter_next (&iter, NULL, &value))
+            results_clear (value);
+        }
+    }
+
+  if (self->stats != NULL)
+    sl_stats_timer_lap (&timer, &cache_time);
+
+  if (key != NULL && dependencies == NULL)
+    dependencies = g_ptr_array_new_with_free_func (g_free);
+
+  if (dependencies != NULL)
+    g_ptr_array_set_size (dependencies, 0);
+
+  if (self->includes != NULL)
+    inclusions = g_ptr_array_new_with_free_func (g_free);
+
+  begin = g_get_monotonic_time ();
+
+  if (lexical)
+    parsed = sightline_lex_unit (self, worker, filename, &parse_time, &error);
+  else if (isolate)
+    parsed = sightline_parse_isolated (self, worker, filename, argv, parse_argv,
+                                       dependencies, inclusions, &parse_time, &visit_time, &memory, &error);
+  else
+    parsed = sightline_parse_unit (self, worker, filename, argv, parse_argv,
+                                   dependencies, inclusions, &parse_time, &visit_time, &memory, &error);
+
+  /* Lexing says nothing about what parsing the unit costs */
+  if (self->costs != NULL && !lexical)
+    sl_cost_model_record (self->costs, filename, g_get_monotonic_time () - begin, memory);
+
+  if (self->stats != NULL)
+    sl_stats_timer_lap (&timer, NULL);
+
+  /* Nothing is cached or recorded in the state, so it is tried again next time */
+  if (!parsed)
+    {
+      g_printerr (_("Failed to parse %s: %s\n"), filename, error->message);
+
+      if (self->stats != NULL)
+        sightline_record_unit (self, filename, FALSE, &cache_time, &parse_time, &visit_time);
+
+      results_clear (worker->unit);
+      g_hash_table_remove_all (worker->unit_headers);
+      return;
+    }
+
+  /* Units read from the cache or unchanged since --state are left out */
+  if (inclusions != NULL)
+    {
+      g_ptr_array_add (inclusions, NULL);
+      sl_include_graph_add_unit (self->includes, filename,
+                                 (const gchar * const *)inclusions->pdata,
+                                 parse_time.wall);
+    }
+
+  if (key != NULL)
+    sightline_store_cached (self, key, dependencies, worker->unit);
+
+  if (self->stats != NULL)
+    {
+      sl_stats_timer_lap (&timer, &cache_time);
+      sightline_record_unit (self, filename, TRUE, &cache_time, &parse_time, &visit_time);
+    }
+
+  sightline_finish_headers (self, worker, argv, key != NULL, claimed);
+  sightline_finish_unit (self, worker, filename, argv, dependencies, claimed);
+}
+
+/*
+ * Reparses a resident unit whose file changed, reusing its preamble, and
+ * replaces what it adds to the totals. It is moved out of the table while
+ * being reparsed, so another job for the same file meanwhile only marks it
+ * dirty, and it is reparsed again before going back.
+ */
+static void
+sightline_reparse (Sightline   *self,
+                   Worker      *worker,
+                   const gchar *filename)
+{
+  Visit visit = { self, worker, NULL, worker->unit, NULL };
+  Resident *resident;
+  CXCursor cursor;
+  gint ret;
+
+  g_mutex_lock (&self->residents_mutex);
+
+  if (NULL != (resident = g_hash_table_lookup (self->residents, filename)))
+    {
+      g_hash_table_steal (self->residents, filename);
+      g_hash_table_insert (self->reparsing, resident->filename, resident);
+    }
+  else if (NULL != (resident = g_hash_table_lookup (self->reparsing, filename)))
+    {
+      resident->dirty = TRUE;
+      resident = NULL;
+    }
+
+  g_mutex_unlock (&self->residents_mutex);
+
+  if (resident == NULL)
+    return;
+
+  for (;;)
+    {
+      ret = clang_reparseTranslationUnit (resident->unit, 0, NULL,
+                                          clang_defaultReparseOptions (resident->unit));
+
+      if (ret == 0)
+        {
+          visit.argv = resident->argv;
+          cursor = clang_getTranslationUnitCursor (resident->unit);
+          clang_visitChildren (cursor, cursor_visitor, &visit);
+          worker_clear_decls (worker);
+        }
+      else
+        g_printerr (_("Failed to reparse %s, dropping it\n"), filename);
+
+      g_mutex_lock (&self->residents_mutex);
+
+      if (ret != 0 || !resident->dirty)
+        break;
+
+      /* The reparse may have read the file before its last change */
+      resident->dirty = FALSE;
+      g_mutex_unlock (&self->residents_mutex);
+
+      results_clear (worker->unit);
+    }
+
+  g_hash_table_remove (self->reparsing, filename);
+  sl_call_table_subtract (self->results->calls, resident->calls);
+
+  /* A unit libclang failed to reparse cannot be used anymore */
+  if (ret != 0 || g_hash_table_contains (self->residents, filename))
+    g_clear_pointer (&resident, resident_free);
+  else
+    {
+      sl_call_table_merge (resident->calls, worker->unit->calls);
+      sl_call_table_add_table (self->results->calls, resident->calls);
+      g_hash_table_insert (self->residents, resident->filename, resident);
+    }
+
+  g_mutex_unlock (&self->residents_mutex);
+
+  results_clear (worker->unit);
+}
+
+/*
+ * The loop of a worker process, started with --worker: parses the units
+ * it is sent on stdin and writes what it found to stdout, until stdin is
+ * closed.
+ */
+static gint
+sightline_serve (Sightline *self)
+{
+  g_autoptr(GError) error = NULL;
+  GBytes *request_bytes;
+  Worker *worker;
+  gint out;
+
+  /* Only replies may go to the real stdout, anything else to stderr */
+  out = dup (STDOUT_FILENO);
+  dup2 (STDERR_FILENO, STDOUT_FILENO);
+
+  worker = sightline_get_worker (self);
+
+  while (NULL != (request_bytes = sl_worker_process_read_message (STDIN_FILENO, -1, &error)))
+    {
+      g_autoptr(GBytes) owned = request_bytes;
+      g_autoptr(GVariant) request = NULL;
+      g_autoptr(GVariant) reply = NULL;
+      g_autoptr(GBytes) reply_bytes = NULL;
+      g_autoptr(GPtrArray) dependencies = NULL;
+      g_autoptr(GPtrArray) inclusions = NULL;
+      g_autofree gchar *filename = NULL;
+      g_auto(GStrv) parse_argv = NULL;
+      SlStatsTime parse_time = { 0 };
+      SlStatsTime visit_time = { 0 };
+      GVariantBuilder headers;
+      guint64 memory = 0;
+      GHashTableIter iter;
+      gpointer key;
+      gpointer value;
+      gboolean parsed;
+
+      request = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE ("(ayaay)"), request_bytes, FALSE));
+      g_variant_get (request, "(^ay^aay)", &filename, &parse_argv);
+
+      dependencies = g_ptr_array_new_with_free_func (g_free);
+      inclusions = g_ptr_array_new_with_free_func (g_free);
+      parsed = sightline_parse_unit (self, worker, filename,
+                                     (const gchar * const *)parse_argv,
+                                     (const gchar * const *)parse_argv,
+                                     dependencies,
+                                     collect_inclusions ? inclusions : NULL,
+                                     &parse_time, &visit_time, &memory, NULL);
+      g_ptr_array_add (dependencies, NULL);
+      g_ptr_array_add (inclusions, NULL);
+
+      g_variant_builder_init (&headers, G_VARIANT_TYPE ("a(ay(ayay))"));
+      g_hash_table_iter_init (&iter, worker->unit_headers);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        g_variant_builder_add (&headers, "(^ay@(ayay))", key, results_to_variant (value));
+
+      reply = g_variant_ref_sink (g_variant_new ("(bxxxxt^aay^aay@(ayay)@a(ay(ayay)))",
+                                                 parsed,
+                                                 parse_time.wall, parse_time.cpu,
+                                                 visit_time.wall, visit_time.cpu,
+                                                 memory,
+                                                 (const gchar * const *)dependencies->pdata,
+                                                 (const gchar * const *)inclusions->pdata,
+                                                 results_to_variant (worker->unit),
+                                                 g_variant_builder_end (&headers)));
+      reply_bytes = g_variant_get_data_as_bytes (reply);
+
+      /* Every header is claimed afresh by each unit, the parent decides */
+      results_clear (worker->unit);
+      g_hash_table_remove_all (worker->unit_headers);
+      g_hash_table_remove_all (self->headers);
+
+      if (!sl_worker_process_write_message (out, reply_bytes, &error))
+        break;
+    }
+
+  close (out);
+
+  if (error != NULL)
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Waits until a unit estimated to need @memory fits in --memory-budget
+ * along with the units being parsed. Other workers keep going with the
+ * smaller units which do fit, and a unit needing more than the whole
+ * budget is parsed alone.
+ */
+static void
+sightline_admit (Sightline *self,
+                 guint64    memory)
+{
+  gboolean held = FALSE;
+
+  g_mutex_lock (&self->memory_mutex);
+
+  while (self->memory_in_use > 0 && self->memory_in_use + memory > memory_budget)
+    {
+      held = TRUE;
+      g_cond_wait (&self->memory_cond, &self->memory_mutex);
+    }
+
+  self->memory_in_use += memory;
+
+  g_mutex_unlock (&self->memory_mutex);
+
+  if (held && self->stats != NULL)
+    sl_stats_add_count (self->stats, SL_STATS_HELD, 1);
+}
+
+static void
+sightline_retire (Sightline *self,
+                  guint64    memory)
+{
+  g_mutex_lock (&self->memory_mutex);
+  self->memory_in_use -= memory;
+  g_cond_broadcast (&self->memory_cond);
+  g_mutex_unlock (&self->memory_mutex);
+}
+
+static void
+sightline_run_job (gpointer data,
+                   gpointer user_data)
+{
+  Sightline *self = user_data;
+  Job *job = data;
+
+  if (memory_budget > 0)
+    sightline_admit (self, job->memory);
+
+  if (job->reparse)
+    sightline_reparse (self, sightline_get_worker (self), job->filename);
+  else
+    sightline_parse (self,
+                     sightline_get_worker (self),
+                     job->filename,
+                     job_get_argv (job),
+                     job_get_parse_argv (job));
+
+  if (memory_budget > 0)
+    sightline_retire (self, job->memory);
+
+  job_free (job);
+
+  if (self->daemon != NULL)
+    {
+      g_mutex_lock (&self->jobs_mutex);
+      if (--self->n_outstanding == 0)
+        g_cond_broadcast (&self->jobs_cond);
+      g_mutex_unlock (&self->jobs_mutex);
+    }
+}
+
+static void
+sightline_dispatch (Sightline *self,
+                    Job       *job)
+{
+  if (self->daemon != NULL)
+    {
+      g_mutex_lock (&self->jobs_mutex);
+      self->n_outstanding++;
+      g_mutex_unlock (&self->jobs_mutex);
+    }
+
+  if (self->pool != NULL)
+    {
+      if (job->cost < 0)
+        sl_cost_model_estimate (self->costs, job->filename, &job->cost, &job->memory);
+      g_thread_pool_push (self->pool, job, NULL);
+    }
+  else
+    sightline_run_job (job, self);
+}
+
+/*
+ * Finds the leading includes shared by every translation unit in the group
+ * and, if there are any, precompiles them once and points each job at the
+ * resulting PCH.
+ */
+static void
+sightline_build_pch (gpointer data,
+                     gpointer user_data)
+{
+  g_autoptr(GPtrArray) prefix = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree const gchar **argv = NULL;
+  SlFlagTable *flag_table = sl_flag_table_get_default ();
+  const gchar * const *group_argv;
+  Sightline *self = user_data;
+  PchGroup *group = data;
+  Job *first;
+  guint flags;
+  guint len;
+  guint i;
+
+  first = g_ptr_array_index (group->jobs, 0);
+  prefix = sl_pch_scan_prefix (first->filename);
+
+  for (i = 1; i < group->jobs->len && prefix->len > 0; i++)
+    {
+      g_autoptr(GPtrArray) other = NULL;
+      Job *job = g_ptr_array_index (group->jobs, i);
+      guint j;
+
+      other = sl_pch_scan_prefix (job->filename);
+
+      for (j = 0; j < prefix->len && j < other->len; j++)
+        {
+          if (!g_str_equal (g_ptr_array_index (prefix, j), g_ptr_array_index (other, j)))
+            break;
+        }
+
+      g_ptr_array_set_size (prefix, j);
+    }
+
+  if (prefix->len == 0)
+    return;
+
+  group_argv = job_get_argv (first);
+
+  if (!sl_pch_build (sightline_get_worker (self)->index,
+                     group->header,
+                     group->pch,
+                     prefix,
+                     group_argv,
+                     &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return;
+    }
+
+  /* Every job in the group moves to the same flag set with -include-pch */
+  len = g_strv_length ((gchar **)group_argv);
+  argv = g_new (const gchar *, len + 2);
+  memcpy (argv, group_argv, sizeof (gchar *) * len);
+  argv[len++] = "-include-pch";
+  argv[len++] = group->pch;
+  flags = sl_flag_table_insert (flag_table, argv, len);
+
+  for (i = 0; i < group->jobs->len; i++)
+    {
+      Job *job = g_ptr_array_index (group->jobs, i);
+
+      job->parse_flags = flags;
+    }
+}
+
+static void
+sightline_run_pch (gpointer data,
+                   gpointer user_data)
+{
+  Sightline *self = user_data;
+  SlStatsTimer timer;
+  SlStatsTime time = { 0 };
+
+  if (self->stats == NULL)
+    {
+      sightline_build_pch (data, self);
+      return;
+    }
+
+  sl_stats_timer_start (&timer);
+  sightline_build_pch (data, self);
+  sl_stats_timer_lap (&timer, &time);
+  sl_stats_add_time (self->stats, SL_STATS_PHASE_PCH, &time);
+}
+
+static void
+sightline_build_pchs (Sightline *self)
+{
+  g_autoptr(GHashTable) groups = NULL;
+  g_autoptr(GError) error = NULL;
+  GThreadPool *pool = NULL;
+  GHashTableIter iter;
+  gpointer value;
+  guint i;
+
+  if (NULL == (self->pch_dir = g_dir_make_tmp ("sightline-pch-XXXXXX", &error)))
+    {
+      g_printerr ("%s\n", error->message);
+      return;
+    }
+
+  /*
+   * Translation units may only share a PCH if they were compiled with the
+   * exact same flags, so group the pending jobs by their flag set.
+   */
+  groups = g_hash_table_new (NULL, NULL);
+  self->pch_groups = g_ptr_array_new_with_free_func ((GDestroyNotify)pch_group_free);
+
+  for (i = 0; i < self->pending->len; i++)
+    {
+      Job *job = g_ptr_array_index (self->pending, i);
+      PchGroup *group;
+
+      if (NULL == (group = g_hash_table_lookup (groups, GUINT_TO_POINTER (job->flags))))
+        {
+          group = pch_group_new (self->pch_dir, self->pch_groups->len);
+          g_ptr_array_add (self->pch_groups, group);
+          g_hash_table_insert (groups, GUINT_TO_POINTER (job->flags), group);
+        }
+
+      g_ptr_array_add (group->jobs, job);
+    }
+
+  if (n_jobs > 1)
+    pool = g_thread_pool_new (sightline_run_pch, self, n_jobs, TRUE, NULL);
+
+  g_hash_table_iter_init (&iter, groups);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      PchGroup *group = value;
+
+      if (group->jobs->len < PCH_MIN_GROUP_SIZE)
+        continue;
+
+      if (pool != NULL)
+        g_thread_pool_push (pool, group, NULL);
+      else
+        sightline_run_pch (group, self);
+    }
+
+  if (pool != NULL)
+    g_thread_pool_free (pool, FALSE, TRUE);
+}
+
+/* Headers counted by unchanged units must not be counted again */
+static void
+sightline_preclaim_header (const gchar * const *argv,
+                           const gchar         *path,
+                           gpointer             user_data)
+{
+  Sightline *self = user_data;
+
+  g_mutex_lock (&self->headers_mutex);
+  g_hash_table_add (self->headers, get_header_key (argv, path));
+  g_mutex_unlock (&self->headers_mutex);
+}
+
+/*
+ * Releases the headers counted by a unit of the previous run which changed
+ * or is gone, so that whichever unit includes them next counts them.
+ */
+static void
+sightline_release_headers (Sightline   *self,
+                           const gchar *filename)
+{
+  g_autoptr(GPtrArray) headers = NULL;
+  const gchar * const *argv = NULL;
+  guint i;
+
+  if (!headers_once ||
+      NULL == (headers = sl_state_get_headers (self->state, filename, &argv)))
+    return;
+
+  g_mutex_lock (&self->headers_mutex);
+
+  for (i = 0; i < headers->len; i++)
+    {
+      const gchar *path = g_ptr_array_index (headers, i);
+      g_autofree gchar *key = get_header_key (argv, path);
+      Release *release;
+
+      g_hash_table_remove (self->headers, key);
+
+      release = g_slice_new (Release);
+      release->argv = argv;
+      release->path = g_strdup (path);
+      g_ptr_array_add (self->released, release);
+    }
+
+  g_mutex_unlock (&self->headers_mutex);
+}
+
+/*
+ * Once every job has completed, a header released by one unit may not have
+ * been counted by any other, since the units still including it were not
+ * parsed. One of them is parsed again to count it.
+ */
+static void
+sightline_recount_released (Sightline *self)
+{
+  g_autoptr(GPtrArray) unseen = sl_state_get_unseen (self->state);
+  guint i;
+
+  for (i = 0; i < unseen->len; i++)
+    sightline_release_headers (self, g_ptr_array_index (unseen, i));
+
+  /* Parsing a unit again releases its own headers, so this may grow */
+  for (i = 0; i < self->released->len; i++)
+    {
+      const Release *release = g_ptr_array_index (self->released, i);
+      g_autofree gchar *key = get_header_key (release->argv, release->path);
+      g_autofree gchar *filename = NULL;
+      gboolean counted;
+
+      g_mutex_lock (&self->headers_mutex);
+      counted = g_hash_table_contains (self->headers, key);
+      g_mutex_unlock (&self->headers_mutex);
+
+      if (counted ||
+          NULL == (filename = sl_state_find_dependent (self->state, release->argv, release->path)))
+        continue;
+
+      sightline_release_headers (self, filename);
+      sl_state_invalidate (self->state, filename);
+      sightline_parse (self,
+                       sightline_get_worker (self),
+                       filename,
+                       release->argv,
+                       release->argv);
+    }
+}
+
+static void
+sightline_add_job (const gchar *subdir,
+                   const gchar *filename,
+                   guint        flags,
+                   gpointer     user_data)
+{
+  g_autoptr(GFile) file = NULL;
+  Sightline *self = user_data;
+  Job *job;
+
+  file = g_file_new_for_path (filename);
+
+  if (self->stats != NULL)
+    sl_stats_add_count (self->stats, SL_STATS_JOBS, 1);
+
+  if (g_hash_table_contains (self->parsed, file))
+    {
+      g_printerr ("Skipping %s, already parsed\n", filename);
+      if (self->stats != NULL)
+        sl_stats_add_count (self->stats, SL_STATS_DUPLICATES, 1);
+      return;
+    }
+
+  g_hash_table_add (self->parsed, g_steal_pointer (&file));
+
+  if (self->db != NULL)
+    sl_compile_db_add (self->db, subdir, filename, flags);
+
+  if (self->state != NULL)
+    {
+      const gchar * const *argv = sl_flag_table_lookup (sl_flag_table_get_default (), flags);
+
+      /* Unchanged, its previous contribution is part of the totals */
+      if (sl_state_is_current (self->state, filename, argv))
+        {
+          if (self->stats != NULL)
+            sl_stats_add_count (self->stats, SL_STATS_UNCHANGED, 1);
+          return;
+        }
+
+      sightline_release_headers (self, filename);
+    }
+
+  /* PCH groups can only be determined once every job is known */
+  if (self->pending != NULL)
+    {
+      g_ptr_array_add (self->pending, job_new (filename, flags));
+      return;
+    }
+
+  /*
+   * Without a pool we parse synchronously from the signal handler, which
+   * saves copying the arguments for the common single-threaded case.
+   */
+  if (self->pool == NULL)
+    {
+      const gchar * const *argv = sl_flag_table_lookup (sl_flag_table_get_default (), flags);
+
+      sightline_parse (self, sightline_get_worker (self), filename, argv, argv);
+      return;
+    }
+
+  job = job_new (filename, flags);
+
+  /* A unit kept parsed with the same flags only needs reparsing */
+  if (self->daemon != NULL)
+    job->reparse = sightline_is_resident (self, filename, job_get_argv (job));
+
+  sightline_dispatch (self, job);
+}
+
+static void
+flags_extracted (SlLogReader *reader,
+                 const gchar *subdir,
+                 const gchar *filename,
+                 guint        flags,
+                 gpointer     user_data)
+{
+  sightline_add_job (subdir, filename, flags, user_data);
+}
+
+/*
+ * Reads the jobs from a build log, a compile_commands.json or a binary
+ * compilation database written with --export-db.
+ */
+static gboolean
+sightline_ingest (Sightline    *self,
+                  const gchar  *filename,
+                  GError      **error)
+{
+  g_autoptr(SlLogReader) reader = NULL;
+  SlLogReaderStats stats;
+  gboolean ret;
+
+  if (sl_compile_db_is_database (filename))
+    {
+      g_autoptr(SlCompileDb) db = NULL;
+
+      if (NULL == (db = sl_compile_db_new_from_file (filename, error)))
+        return FALSE;
+
+      sl_compile_db_foreach (db, sightline_add_job, self);
+
+      return TRUE;
+    }
+
+  reader = sl_log_reader_new ();
+  sl_log_reader_set_n_threads (reader, n_jobs);
+  sl_log_reader_set_collect_stats (reader, self->stats != NULL);
+
+  g_signal_connect (reader, "flags-extracted", G_CALLBACK (flags_extracted), self);
+
+  if (g_str_has_suffix (filename, ".json"))
+    ret = sl_log_reader_ingest_compile_commands (reader, filename, error);
+  else
+    ret = sl_log_reader_ingest (reader, filename, error);
+
+  if (self->stats != NULL)
+    {
+      sl_log_reader_get_stats (reader, &stats);
+      sl_stats_add_count (self->stats, SL_STATS_BYTES, stats.n_bytes);
+      sl_stats_add_count (self->stats, SL_STATS_LINES, stats.n_lines);
+      sl_stats_add_count (self->stats, SL_STATS_COMMANDS, stats.n_commands);
+      sl_stats_add_time (self->stats, SL_STATS_PHASE_SCAN, &stats.scan);
+      sl_stats_add_time (self->stats, SL_STATS_PHASE_ARGUMENTS, &stats.arguments);
+    }
+
+  return ret;
+}
+
+static void
+print_occurrence (const SlXrefOccurrence *occurrence,
+                  gpointer                user_data)
+{
+  const gchar *kind;
+
+  switch (occurrence->kind)
+    {
+    case SL_XREF_DECLARATION: kind = "declaration"; break;
+    case SL_XREF_DEFINITION:  kind = "definition"; break;
+    case SL_XREF_CALL:        kind = "call"; break;
+    case SL_XREF_REFERENCE:
+    default:                  kind = "reference"; break;
+    }
+
+  g_print ("%s:%u:%u: %s of %s",
+           occurrence->file, occurrence->line, occurrence->column,
+           kind, key_by_usr ? occurrence->usr : occurrence->name);
+
+  if (occurrence->context_name != NULL)
+    g_print (" in %s", key_by_usr ? occurrence->context_usr : occurrence->context_name);
+
+  g_print ("\n");
+}
+
+static void
+append_dot_id (GString     *str,
+               const gchar *id,
+               gsize        len)
+{
+  gsize i;
+
+  g_string_append_c (str, '"');
+
+  for (i = 0; i < len; i++)
+    {
+      if (id[i] == '"' || id[i] == '\\')
+        g_string_append_c (str, '\\');
+      g_string_append_c (str, id[i]);
+    }
+
+  g_string_append_c (str, '"');
+}
+
+/*
+ * Writes the call graph as a dot file, the most frequent edges first. With
+ * --usr, nodes are USRs labelled with the name of the function.
+ */
+static gboolean
+write_call_graph (SlCallTable  *edges,
+                  const gchar  *filename,
+                  GError      **error)
+{
+  g_autoptr(GHashTable) labelled = NULL;
+  g_autoptr(GString) str = NULL;
+  g_autofree guint *ranked = NULL;
+  const SlCallEntry *entries;
+  guint n_entries;
+  guint i;
+
+  labelled = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  str = g_string_new ("digraph calls {\n");
+  entries = sl_call_table_get_entries (edges, &n_entries);
+  ranked = sl_call_table_rank (edges);
+
+  for (i = 0; i < n_entries; i++)
+    {
+      const SlCallEntry *entry = &entries[ranked[i]];
+      const gchar *callee = strchr (entry->key, '\t');
+
+      if (entry->count == 0 || callee == NULL)
+        continue;
+
+      if (entry->name != entry->key)
+        {
+          g_auto(GStrv) keys = g_strsplit (entry->key, "\t", 2);
+          g_auto(GStrv) names = g_strsplit (entry->name, "\t", 2);
+          guint j;
+
+          for (j = 0; j < 2 && keys[j] != NULL && names[j] != NULL; j++)
+            {
+              if (g_hash_table_contains (labelled, keys[j]))
+                continue;
+
+              g_hash_table_add (labelled, g_strdup (keys[j]));
+              g_string_append (str, "  ");
+              append_dot_id (str, keys[j], strlen (keys[j]));
+              g_string_append (str, " [label=");
+              append_dot_id (str, names[j], strlen (names[j]));
+              g_string_append (str, "];\n");
+            }
+        }
+
+      g_string_append (str, "  ");
+      append_dot_id (str, entry->key, callee - entry->key);
+      g_string_append (str, " -> ");
+      append_dot_id (str, callee + 1, strlen (callee + 1));
+      g_string_append_printf (str, " [weight=%u, label=\"%u\"];\n", entry->count, entry->count);
+    }
+
+  g_string_append (str, "}\n");
+
+  return g_file_set_contents (filename, str->str, str->len, error);
+}
+
+/* Prints the @max_entries most counted entries of @table to stderr */
+static void
+print_usage_report (SlCallTable *table,
+                    const gchar *title,
+                    guint        max_entries)
+{
+  g_autofree guint *ranked = NULL;
+  const SlCallEntry *entries;
+  guint n_entries;
+  guint i;
+
+  entries = sl_call_table_get_entries (table, &n_entries);
+  ranked = sl_call_table_rank (table);
+
+  g_printerr ("%8s  %s\n", "Uses", title);
+
+  for (i = 0; i < n_entries && i < max_entries; i++)
+    {
+      const SlCallEntry *entry = &entries[ranked[i]];
+
+      if (entry->count == 0)
+        break;
+
+      if (entry->name != entry->key)
+        g_printerr ("%8u  %s (%s)\n", entry->count, entry->name, entry->key);
+      else
+        g_printerr ("%8u  %s\n", entry->count, entry->name);
+    }
+}
+
+/*
+ * Prints the most called functions with --approximate. A count may be too
+ * high by the error printed with it, and anything missing from the list
+ * was called at most as often as the last one printed.
+ */
+static void
+sightline_print_approximate (Sightline *self)
+{
+  g_autofree guint *ranked = NULL;
+  const SlSpaceSavingEntry *entries;
+  guint n_entries;
+  guint i;
+
+  entries = sl_space_saving_get_entries (self->sketch, &n_entries);
+  ranked = sl_space_saving_rank (self->sketch);
+
+  for (i = 0; i < n_entries && i < top_k; i++)
+    {
+      const SlSpaceSavingEntry *entry = &entries[ranked[i]];
+
+      g_print ("%6"G_GUINT64_FORMAT": %s", entry->count, entry->name);
+
+      if (entry->name != entry->key)
+        g_print (" (%s)", entry->key);
+
+      if (entry->error > 0)
+        g_print (" (at most %"G_GUINT64_FORMAT" too many)", entry->error);
+
+      g_print ("\n");
+    }
+}
+
+/* sightline --xref FILE query SYMBOL... */
+static gint
+sightline_query (gint    argc,
+                 gchar **argv)
+{
+  g_autoptr(SlXref) xref = NULL;
+  g_autoptr(GError) error = NULL;
+  gint i;
+
+  if (xref_index == NULL)
+    {
+      g_printerr ("%s\n", _("query requires --xref FILE"));
+      return EXIT_FAILURE;
+    }
+
+  if (NULL == (xref = sl_xref_new_from_file (xref_index, &error)))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i < argc; i++)
+    {
+      if (sl_xref_query (xref, argv[i], SL_XREF_ALL, print_occurrence, NULL) == 0)
+        g_printerr (_("No occurrences of %s\n"), argv[i]);
+    }
+
+  return EXIT_SUCCESS;
+}
+
+static void
+sightline_wait_jobs (Sightline *self)
+{
+  g_mutex_lock (&self->jobs_mutex);
+  while (self->n_outstanding > 0)
+    g_cond_wait (&self->jobs_cond, &self->jobs_mutex);
+  g_mutex_unlock (&self->jobs_mutex);
+}
+
+static void
+append_status (Sightline *self,
+               GString   *reply)
+{
+  guint n_residents;
+  guint n_outstanding;
+
+  g_mutex_lock (&self->residents_mutex);
+  n_residents = g_hash_table_size (self->residents);
+  g_mutex_unlock (&self->residents_mutex);
+
+  g_mutex_lock (&self->jobs_mutex);
+  n_outstanding = self->n_outstanding;
+  g_mutex_unlock (&self->jobs_mutex);
+
+  g_string_append_printf (reply, "%u translation units parsed, %u queued or being parsed\n",
+                          n_residents, n_outstanding);
+}
+
+/*
+ * Reads logs for the daemon, then waits until every unit they name is
+ * parsed. Units seen in a previous log are parsed again, or reparsed if
+ * their flags are the same, which also catches changes to their headers.
+ */
+static gboolean
+sightline_daemon_ingest (Sightline            *self,
+                         const gchar * const  *paths,
+                         GString              *reply,
+                         GError              **error)
+{
+  gboolean ret = TRUE;
+  guint i;
 
-typedef struct
-{
-  GHashTable *callcounts;
-  GHashTable *parsed;
-} Sightline;
+  g_mutex_lock (&self->ingest_mutex);
 
-static void
-sightline_inc_call_count (Sightline *self,
-                          CXCursor   cursor)
+  g_hash_table_remove_all (self->parsed);
+
+  for (i = 0; ret && paths[i] != NULL; i++)
+    ret = sightline_ingest (self, paths[i], error);
+
+  g_mutex_unlock (&self->ingest_mutex);
+
+  sightline_wait_jobs (self);
+
+  if (ret)
+    append_status (self, reply);
+
+  return ret;
+}
+
+/*
+ * Answers a request to the daemon, from the thread of its connection:
+ *
+ *   ingest LOG_FILE...   parse the units of build logs or databases
+ *   reparse FILE...      reparse units, after changing their headers
+ *   top [N]              the N most called functions
+ *   count NAME...        how often each function is called
+ *   status               how many units are parsed
+ *   quit                 stop the daemon
+ */
+static gboolean
+sightline_handle_request (SlDaemon             *daemon,
+                          const gchar * const  *args,
+                          GString              *reply,
+                          GError              **error,
+                          gpointer              user_data)
 {
-  CXString str;
-  const gchar *cstr;
+  Sightline *self = user_data;
+  const gchar *request = args[0];
+  const SlCallEntry *entries;
+  guint n_entries;
+  guint i;
+  guint j;
+
+  if (g_str_equal (request, "ingest") && args[1] != NULL)
+    return sightline_daemon_ingest (self, args + 1, reply, error);
 
-  str = clang_getCursorSpelling (cursor);
-  cstr = clang_getCString (str);
+  if (g_str_equal (request, "reparse") && args[1] != NULL)
+    {
+      for (i = 1; args[i] != NULL; i++)
+        {
+          Job *job = job_new (args[i], 0);
+
+          job->reparse = TRUE;
+          sightline_dispatch (self, job);
+        }
 
-  if (cstr && *cstr)
+      sightline_wait_jobs (self);
+      append_status (self, reply);
+
+      return TRUE;
+    }
+
+  if (g_str_equal (request, "top") && (args[1] == NULL || args[2] == NULL))
     {
-      CallCount *count = g_hash_table_lookup (self->callcounts, cstr);
+      g_autofree guint *ranked = NULL;
+      guint64 top = DEFAULT_DAEMON_TOP;
+      gchar *end = NULL;
+
+      if (args[1] != NULL && ((top = g_ascii_strtoull (args[1], &end, 10)) == 0 || *end != '\0'))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                       "Invalid number of functions: %s", args[1]);
+          return FALSE;
+        }
+
+      g_mutex_lock (&self->residents_mutex);
+
+      entries = sl_call_table_get_entries (self->results->calls, &n_entries);
+      ranked = sl_call_table_rank (self->results->calls);
 
-      if (count == NULL)
+      for (i = 0; i < n_entries && i < top; i++)
         {
-          gsize len = strlen (cstr);
+          const SlCallEntry *entry = &entries[ranked[i]];
 
-          count = g_malloc (sizeof (CallCount) + len + 1);
-          count->count = 0;
-          memcpy (count->name, cstr, len);
-          count->name[len] = '\0';
+          if (entry->count == 0)
+            break;
 
-          g_hash_table_insert (self->callcounts, count->name, count);
+          if (entry->name != entry->key)
+            g_string_append_printf (reply, "%6u: %s (%s)\n", entry->count, entry->name, entry->key);
+          else
+            g_string_append_printf (reply, "%6u: %s\n", entry->count, entry->name);
         }
 
-      count->count++;
+      g_mutex_unlock (&self->residents_mutex);
+
+      return TRUE;
     }
 
-  clang_disposeString (str);
-}
+  /* With --usr, every static function of the name is counted */
+  if (g_str_equal (request, "count") && args[1] != NULL)
+    {
+      g_mutex_lock (&self->residents_mutex);
 
-static enum CXChildVisitResult
-cursor_visitor (CXCursor     cursor,
-                CXCursor     parent,
-                CXClientData client_data)
-{
-  enum CXCursorKind kind = clang_getCursorKind (cursor);
-  Sightline *self = client_data;
+      entries = sl_call_table_get_entries (self->results->calls, &n_entries);
 
-  switch ((int)kind)
+      for (i = 1; args[i] != NULL; i++)
+        {
+          guint count = 0;
+
+          for (j = 0; j < n_entries; j++)
+            {
+              if (g_str_equal (entries[j].name, args[i]) || g_str_equal (entries[j].key, args[i]))
+                count += entries[j].count;
+            }
+
+          g_string_append_printf (reply, "%6u: %s\n", count, args[i]);
+        }
+
+      g_mutex_unlock (&self->residents_mutex);
+
+      return TRUE;
+    }
+
+  if (g_str_equal (request, "status") && args[1] == NULL)
     {
-    case CXCursor_CallExpr:
-      sightline_inc_call_count (self, cursor);
-      break;
+      append_status (self, reply);
+      return TRUE;
+    }
 
-    default:
-      break;
+  if (g_str_equal (request, "quit") && args[1] == NULL)
+    {
+      sl_daemon_quit (daemon);
+      return TRUE;
     }
 
-  return CXChildVisit_Recurse;
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+               "Invalid request: %s", request);
+
+  return FALSE;
 }
 
-static void
-flags_extracted (SlLogReader         *reader,
-                 const gchar         *subdir,
-                 const gchar         *filename,
-                 const gchar * const *command_line_args,
-                 gpointer             user_data)
+static gpointer
+sightline_ingest_thread (gpointer data)
 {
-  g_autofree gchar *cmdstr = g_strjoinv (" ", (gchar **)command_line_args);
-  g_autoptr(GFile) file = NULL;
-  Sightline *self = user_data;
-  CXTranslationUnit unit;
-  CXCursor cursor;
-  CXIndex index;
+  Sightline *self = data;
+  g_autoptr(GString) reply = g_string_new (NULL);
+  g_autoptr(GError) error = NULL;
 
-  file = g_file_new_for_path (filename);
+  if (sightline_daemon_ingest (self, (const gchar * const *)self->daemon_logs, reply, &error))
+    g_printerr ("%s", reply->str);
+  else
+    g_printerr ("%s\n", error->message);
 
-  if (g_hash_table_contains (self->parsed, file))
+  return NULL;
+}
+
+/*
+ * sightline --daemon SOCKET [LOG_FILE...]: parses the units of the logs
+ * given, then keeps them parsed and answers requests until asked to quit.
+ * Requests are answered while the logs are read.
+ */
+static gint
+sightline_run_daemon (Sightline  *self,
+                      gint        n_logs,
+                      gchar     **logs)
+{
+  g_autoptr(GError) error = NULL;
+  GThread *ingest = NULL;
+  gint i;
+
+  self->daemon = sl_daemon_new (sightline_handle_request, self);
+  self->daemon_logs = g_new0 (gchar *, n_logs + 1);
+  for (i = 0; i < n_logs; i++)
+    self->daemon_logs[i] = g_strdup (logs[i]);
+  self->residents = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify)resident_free);
+  self->reparsing = g_hash_table_new (g_str_hash, g_str_equal);
+  self->monitors = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  self->changed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_mutex_init (&self->residents_mutex);
+  g_mutex_init (&self->ingest_mutex);
+  g_mutex_init (&self->jobs_mutex);
+  g_cond_init (&self->jobs_cond);
+
+  if (!sl_daemon_listen (self->daemon, daemon_socket, &error))
     {
-      g_printerr ("Skipping %s, already parsed\n", filename);
-      return;
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
     }
 
-  g_hash_table_add (self->parsed, g_steal_pointer (&file));
+  if (n_logs > 0)
+    ingest = g_thread_new ("ingest", sightline_ingest_thread, self);
 
-  index = clang_createIndex (0, 0);
-  unit = clang_parseTranslationUnit (index,
-                                     filename,
-                                     command_line_args,
-                                     g_strv_length ((gchar **)command_line_args),
-                                     NULL,
-                                     0,
-                                     CXTranslationUnit_DetailedPreprocessingRecord);
-  cursor = clang_getTranslationUnitCursor (unit);
-  clang_visitChildren (cursor, cursor_visitor, self);
-  clang_disposeTranslationUnit (unit);
-  clang_disposeIndex (index);
+  sl_daemon_run (self->daemon);
+
+  /*
+   * Requests and the logs given may still be queueing jobs, and jobs use
+   * the resident units, so tear down in that order.
+   */
+  sl_daemon_stop (self->daemon);
+
+  if (ingest != NULL)
+    g_thread_join (ingest);
+
+  if (self->changed_source != 0)
+    {
+      g_source_remove (self->changed_source);
+      self->changed_source = 0;
+    }
+
+  sightline_wait_jobs (self);
+  g_thread_pool_free (self->pool, FALSE, TRUE);
+  self->pool = NULL;
+
+  if (self->costs != NULL && !sl_cost_model_save (self->costs, &error))
+    g_printerr (_("Failed to save parse costs: %s\n"), error->message);
+
+  g_clear_pointer (&self->monitors, g_hash_table_unref);
+  g_clear_pointer (&self->changed, g_hash_table_unref);
+  g_clear_pointer (&self->residents, g_hash_table_unref);
+  g_clear_pointer (&self->reparsing, g_hash_table_unref);
+  g_clear_pointer (&self->daemon_logs, g_strfreev);
+  g_clear_pointer (&self->daemon, sl_daemon_free);
+
+  g_mutex_clear (&self->residents_mutex);
+  g_mutex_clear (&self->ingest_mutex);
+  g_mutex_clear (&self->jobs_mutex);
+  g_cond_clear (&self->jobs_cond);
+
+  return EXIT_SUCCESS;
 }
 
+/* sightline --connect SOCKET REQUEST... */
 static gint
-sort_by_count (gconstpointer a,
-               gconstpointer b)
+sightline_connect (gint    argc,
+                   gchar **argv)
 {
-  const CallCount * const *cca = a;
-  const CallCount * const *ccb = b;
+  g_autoptr(GPtrArray) args = NULL;
+  g_autoptr(GString) reply = NULL;
+  g_autoptr(GError) error = NULL;
+  gboolean has_files;
+  gint i;
+
+  if (argc < 1)
+    {
+      g_printerr ("%s\n", _("--connect requires a request, such as top or ingest LOG_FILE"));
+      return EXIT_FAILURE;
+    }
+
+  /* The daemon may run from another directory */
+  has_files = g_str_equal (argv[0], "ingest") || g_str_equal (argv[0], "reparse");
+  args = g_ptr_array_new_with_free_func (g_free);
+
+  for (i = 0; i < argc; i++)
+    {
+      if (i > 0 && has_files && !g_path_is_absolute (argv[i]))
+        {
+          g_autofree gchar *cwd = g_get_current_dir ();
+          g_ptr_array_add (args, g_build_filename (cwd, argv[i], NULL));
+        }
+      else
+        g_ptr_array_add (args, g_strdup (argv[i]));
+    }
+
+  g_ptr_array_add (args, NULL);
+
+  reply = g_string_new (NULL);
+
+  if (!sl_daemon_call (connect_socket, (const gchar * const *)args->pdata, reply, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
 
-  return (*ccb)->count - (*cca)->count;
+  g_print ("%s", reply->str);
+
+  return EXIT_SUCCESS;
 }
 
 gint
@@ -143,13 +3291,18 @@ main (gint argc,
 {
   g_autoptr(GOptionContext) context = NULL;
   g_autoptr(GError) error = NULL;
-  g_autoptr(GPtrArray) sorted = NULL;
+  g_autofree guint *ranked = NULL;
+  g_autofree gchar *salt = NULL;
+  g_autofree gchar *costs = NULL;
+  const SlCallEntry *entries;
   Sightline *self;
-  GHashTableIter iter;
-  gpointer key, value;
+  SlStatsTimer timer = { 0 };
+  SlStatsTime aggregate = { 0 };
+  guint n_entries;
   gint i;
 
-  context = g_option_context_new (_("LOG_FILE... - Extract information about builds"));
+  context = g_option_context_new (_("LOG_FILE... | query SYMBOL... - Extract information about builds"));
+  g_option_context_add_main_entries (context, entries, NULL);
 
   if (!g_option_context_parse (context, &argc, &argv, &error))
     {
@@ -157,45 +3310,383 @@ main (gint argc,
       return EXIT_FAILURE;
     }
 
+  if (argc > 1 && g_str_equal (argv[1], "query"))
+    return sightline_query (argc - 2, argv + 2);
+
+  if (connect_socket != NULL)
+    return sightline_connect (argc - 1, argv + 1);
+
+  if (approximate && top_k <= 0)
+    {
+      g_printerr (_("--approximate requires --top\n"));
+      return EXIT_FAILURE;
+    }
+
+  /* The state subtracts what changed from exact totals */
+  if (approximate && state_file != NULL)
+    {
+      g_printerr (_("--approximate cannot be used with --state\n"));
+      return EXIT_FAILURE;
+    }
+
+  /* Without parsing there are no USRs, references, callers or includes */
+  if (lexical && (key_by_usr || headers_once || use_pch || isolate || timeout > 0 ||
+                  memory_budget > 0 || xref_index != NULL || call_graph != NULL ||
+                  include_graph != NULL || header_costs > 0 || type_usage > 0 ||
+                  macro_expansions > 0))
+    {
+      g_printerr (_("--lexical cannot be used with options which need a parse\n"));
+      return EXIT_FAILURE;
+    }
+
+  /*
+   * A daemon only keeps the calls of the units it keeps parsed. Those stay
+   * in memory for good, which a budget for units being parsed ignores.
+   */
+  if (daemon_socket != NULL &&
+      (state_file != NULL || cache_dir != NULL || use_pch || isolate || timeout > 0 ||
+       memory_budget > 0 ||
+       headers_once || approximate || lexical || show_stats || xref_index != NULL ||
+       call_graph != NULL || include_graph != NULL || header_costs > 0 ||
+       type_usage > 0 || macro_expansions > 0 ||
+       export_json != NULL || export_db != NULL))
+    {
+      g_printerr (_("--daemon can only be used with --jobs and --usr\n"));
+      return EXIT_FAILURE;
+    }
+
+  /* The state does not keep the edges of unchanged units */
+  if (call_graph != NULL && state_file != NULL)
+    {
+      g_printerr (_("--call-graph cannot be used with --state\n"));
+      return EXIT_FAILURE;
+    }
+
+  /* Nor their types and macros */
+  if ((type_usage > 0 || macro_expansions > 0) && state_file != NULL)
+    {
+      g_printerr (_("--type-usage and --macro-expansions cannot be used with --state\n"));
+      return EXIT_FAILURE;
+    }
+
+  setup_passes ();
+
+  collect_inclusions = include_graph != NULL || header_costs > 0;
+
   self = g_new0 (Sightline, 1);
-  self->callcounts = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+  self->results = results_new ();
   self->parsed = g_hash_table_new_full (g_file_hash, (GEqualFunc)g_file_equal, g_object_unref, NULL);
+  self->workers = g_ptr_array_new ();
+  g_mutex_init (&self->workers_mutex);
+  self->headers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_mutex_init (&self->headers_mutex);
+  g_mutex_init (&self->memory_mutex);
+  g_cond_init (&self->memory_cond);
+
+  if (worker_mode)
+    return sightline_serve (self);
+
+  if (show_stats)
+    self->stats = sl_stats_new ();
+
+  if (approximate)
+    self->sketch = sl_space_saving_new (get_approximate_capacity ());
+
+  if (collect_inclusions)
+    self->includes = sl_include_graph_new ();
+
+  /* Costs order the queue of the pool and admit units to --memory-budget */
+  if (n_jobs != 1 || daemon_socket != NULL || memory_budget > 0)
+    {
+      costs = g_build_filename (g_get_user_cache_dir (), "sightline", "costs", NULL);
+      self->costs = sl_cost_model_new (costs);
+    }
+
+  salt = g_strdup_printf ("%s%s%s%s%s%s%s",
+                          key_by_usr ? "usr;" : "",
+                          headers_once ? "headers-once;" : "",
+                          xref_index != NULL ? "xref;" : "",
+                          call_graph != NULL ? "call-graph;" : "",
+                          type_usage > 0 ? "types;" : "",
+                          macro_expansions > 0 ? "macros;" : "",
+                          lexical ? "lexical;" : "");
+
+  if (cache_dir != NULL)
+    {
+      self->cache = sl_result_cache_new (cache_dir);
+      if (*salt != '\0')
+        sl_result_cache_set_salt (self->cache, salt);
+    }
+
+  if (state_file != NULL)
+    {
+      g_autoptr(GError) state_error = NULL;
+
+      self->released = g_ptr_array_new_with_free_func ((GDestroyNotify)release_free);
+      self->state = sl_state_new_from_file (state_file, salt, &state_error);
+
+      if (self->state != NULL && !sl_state_load_totals (self->state, self->results->calls, self->results->xref))
+        {
+          g_set_error (&state_error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "%s is not a valid state file", state_file);
+          g_clear_pointer (&self->state, sl_state_free);
+          results_clear (self->results);
+        }
+
+      /* Without a usable state everything is parsed, as if it were the first run */
+      if (self->state == NULL)
+        {
+          if (!g_error_matches (state_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+            g_printerr (_("Ignoring previous state: %s\n"), state_error->message);
+          self->state = sl_state_new (salt);
+        }
+      else if (headers_once)
+        sl_state_foreach_header (self->state, sightline_preclaim_header, self);
+    }
+
+  if (n_jobs <= 0)
+    n_jobs = g_get_num_processors ();
+
+  if (timeout > 0)
+    isolate = TRUE;
+
+  /* Workers run this same program, collecting what the options ask for */
+  if (isolate)
+    {
+      GPtrArray *args = g_ptr_array_new ();
+      gchar *path;
+
+      if (NULL == (path = g_file_read_link ("/proc/self/exe", NULL)))
+        path = g_strdup (argv[0]);
+
+      g_ptr_array_add (args, path);
+      g_ptr_array_add (args, g_strdup ("--worker"));
+      if (key_by_usr)
+        g_ptr_array_add (args, g_strdup ("--usr"));
+      if (headers_once)
+        g_ptr_array_add (args, g_strdup ("--headers-once"));
+      if (xref_index != NULL)
+        {
+          g_ptr_array_add (args, g_strdup ("--xref"));
+          g_ptr_array_add (args, g_strdup (xref_index));
+        }
+      if (call_graph != NULL)
+        {
+          g_ptr_array_add (args, g_strdup ("--call-graph"));
+          g_ptr_array_add (args, g_strdup (call_graph));
+        }
+      if (collect_inclusions)
+        g_ptr_array_add (args, g_strdup ("--header-costs"));
+      if (type_usage > 0)
+        g_ptr_array_add (args, g_strdup ("--type-usage"));
+      if (macro_expansions > 0)
+        g_ptr_array_add (args, g_strdup ("--macro-expansions"));
+      g_ptr_array_add (args, NULL);
+
+      worker_argv = (gchar **)g_ptr_array_free (args, FALSE);
+
+      /* A worker dying between requests must not take us with it */
+      signal (SIGPIPE, SIG_IGN);
+    }
+
+  /* A daemon always parses in the pool, so requests are answered meanwhile */
+  if (n_jobs > 1 || daemon_socket != NULL)
+    {
+      self->pool = g_thread_pool_new (sightline_run_job, self, n_jobs, TRUE, &error);
+
+      if (self->pool == NULL)
+        {
+          g_printerr ("%s\n", error->message);
+          return EXIT_FAILURE;
+        }
+
+      g_thread_pool_set_sort_function (self->pool, job_compare_cost, NULL);
+    }
+
+  if (daemon_socket != NULL)
+    return sightline_run_daemon (self, argc - 1, argv + 1);
+
+  if (use_pch)
+    self->pending = g_ptr_array_new ();
+
+  if (export_json != NULL || export_db != NULL)
+    self->db = sl_compile_db_new ();
 
   for (i = 1; i < argc; i++)
     {
-      g_autoptr(SlLogReader) reader = NULL;
       g_autoptr(GError) error = NULL;
-      const gchar *filename = argv[i];
 
-      reader = sl_log_reader_new ();
+      if (!sightline_ingest (self, argv[i], &error))
+        {
+          g_printerr ("%s\n", error->message);
+          return EXIT_FAILURE;
+        }
+    }
+
+  if (self->db != NULL)
+    {
+      if ((export_json != NULL && !sl_compile_db_save_json (self->db, export_json, &error)) ||
+          (export_db != NULL && !sl_compile_db_save (self->db, export_db, &error)))
+        {
+          g_printerr ("%s\n", error->message);
+          return EXIT_FAILURE;
+        }
+
+      g_clear_pointer (&self->db, sl_compile_db_free);
+    }
+
+  if (self->pending != NULL)
+    {
+      sightline_build_pchs (self);
+
+      /* Every job is known here, so the first ones started are the longest too */
+      if (self->pool != NULL)
+        {
+          for (i = 0; i < self->pending->len; i++)
+            {
+              Job *job = g_ptr_array_index (self->pending, i);
+              sl_cost_model_estimate (self->costs, job->filename, &job->cost, &job->memory);
+            }
+
+          g_ptr_array_sort (self->pending, job_compare_cost_ptr);
+        }
+
+      for (i = 0; i < self->pending->len; i++)
+        sightline_dispatch (self, g_ptr_array_index (self->pending, i));
+
+      g_clear_pointer (&self->pending, g_ptr_array_unref);
+    }
+
+  /* Wait for outstanding jobs before collecting results */
+  if (self->pool != NULL)
+    g_thread_pool_free (self->pool, FALSE, TRUE);
+
+  if (self->state != NULL)
+    sightline_recount_released (self);
+
+  if (self->costs != NULL && !sl_cost_model_save (self->costs, &error))
+    {
+      g_printerr (_("Failed to save parse costs: %s\n"), error->message);
+      g_clear_error (&error);
+    }
+
+  if (self->stats != NULL)
+    sl_stats_timer_start (&timer);
+
+  for (i = 0; i < self->workers->len; i++)
+    {
+      Worker *worker = g_ptr_array_index (self->workers, i);
+
+      if (self->sketch != NULL)
+        sl_space_saving_merge (self->sketch, worker->sketch);
+
+      results_merge (self->results, worker->results);
+      worker_free (worker);
+    }
+
+  g_private_set (&current_worker, NULL);
 
-      g_signal_connect (reader, "flags-extracted", G_CALLBACK (flags_extracted), self);
+  if (self->state != NULL)
+    {
+      sl_state_finish (self->state, self->results->calls, self->results->xref);
 
-      if (!sl_log_reader_ingest (reader, filename, &error))
+      if (!sl_state_save (self->state, state_file, self->results->calls, self->results->xref, &error))
         {
           g_printerr ("%s\n", error->message);
           return EXIT_FAILURE;
         }
     }
 
-  g_hash_table_iter_init (&iter, self->callcounts);
+  if (xref_index != NULL && !sl_xref_builder_write (self->results->xref, xref_index, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (call_graph != NULL && !write_call_graph (self->results->edges, call_graph, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
 
-  sorted = g_ptr_array_new ();
+  if (include_graph != NULL && !sl_include_graph_save (self->includes, include_graph, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
 
-  while (g_hash_table_iter_next (&iter, &key, &value))
-    g_ptr_array_add (sorted, value);
+  if (self->sketch != NULL)
+    sightline_print_approximate (self);
+  else
+    {
+      entries = sl_call_table_get_entries (self->results->calls, &n_entries);
+      ranked = sl_call_table_rank (self->results->calls);
 
-  g_ptr_array_sort (sorted, sort_by_count);
+      for (i = 0; i < n_entries && (top_k <= 0 || i < top_k); i++)
+        {
+          const SlCallEntry *entry = &entries[ranked[i]];
+
+          /* Only callees of translation units which changed or are gone */
+          if (entry->count == 0)
+            break;
+
+          if (entry->name != entry->key)
+            g_print ("%6u: %s (%s)\n", entry->count, entry->name, entry->key);
+          else
+            g_print ("%6u: %s\n", entry->count, entry->name);
+        }
+    }
+
+  if (self->stats != NULL)
+    {
+      g_autoptr(GString) str = NULL;
+
+      sl_stats_timer_lap (&timer, &aggregate);
+      sl_stats_add_time (self->stats, SL_STATS_PHASE_AGGREGATE, &aggregate);
 
-  for (i = 0; i < sorted->len; i++)
+      str = sl_stats_format (self->stats, stats_format);
+      g_printerr ("%s", str->str);
+    }
+
+  if (header_costs > 0)
     {
-      CallCount *count = g_ptr_array_index (sorted, i);
+      g_autoptr(GString) str = NULL;
 
-      g_print ("%6u: %s\n", count->count, count->name);
+      str = sl_include_graph_format_report (self->includes, header_costs);
+      g_printerr ("%s", str->str);
     }
 
-  g_hash_table_unref (self->callcounts);
+  if (type_usage > 0)
+    print_usage_report (self->results->types, "Most used types", type_usage);
+
+  if (macro_expansions > 0)
+    print_usage_report (self->results->macros, "Most expanded macros", macro_expansions);
+
+  results_free (self->results);
   g_hash_table_unref (self->parsed);
+  g_hash_table_unref (self->headers);
+  g_ptr_array_unref (self->workers);
+  g_clear_pointer (&self->pch_groups, g_ptr_array_unref);
+  g_clear_pointer (&self->cache, sl_result_cache_free);
+  g_clear_pointer (&self->state, sl_state_free);
+  g_clear_pointer (&self->released, g_ptr_array_unref);
+  g_clear_pointer (&self->stats, sl_stats_free);
+  g_clear_pointer (&self->costs, sl_cost_model_free);
+  g_clear_pointer (&self->sketch, sl_space_saving_free);
+  g_clear_pointer (&self->includes, sl_include_graph_free);
+  g_clear_pointer (&worker_argv, g_strfreev);
+  g_clear_pointer (&passes, sl_pass_registry_free);
+
+  if (self->pch_dir != NULL)
+    {
+      g_rmdir (self->pch_dir);
+      g_free (self->pch_dir);
+    }
+
+  g_mutex_clear (&self->workers_mutex);
+  g_mutex_clear (&self->headers_mutex);
+  g_mutex_clear (&self->memory_mutex);
+  g_cond_clear (&self->memory_cond);
   g_free (self);
 
   return EXIT_SUCCESS;
@@ -0,0 +1,608 @@
+/* sl-call-lexer.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-call-lexer"
+
+#include <string.h>
+
+#include "sl-call-lexer.h"
+
+/*
+ * Counts calls with --lexical from the text of a file alone, without
+ * preprocessing or parsing it, as a name followed by a parenthesis within
+ * a function body. This is an order of magnitude faster than libclang,
+ * and it is wrong in a few ways the counts of a full parse are not:
+ *
+ *  - function-like macros count as calls under their own name, and the
+ *    calls they expand to are not counted
+ *  - calls in the code of included headers are not counted
+ *  - every branch of #if and #ifdef is counted, except for #if 0
+ *  - calls cannot be told apart by USR, and local declarations of
+ *    function pointers may count as calls of their type
+ *
+ * Function bodies are told from other braces by the closing parenthesis
+ * before them, which is good enough for C and most of C++.
+ */
+
+#define MAX_DEPTH        256
+#define MAX_CONDITIONALS 64
+
+typedef enum
+{
+  SCOPE_DATA, /* file scope, structs, enums, namespaces and initializers */
+  SCOPE_CODE, /* function bodies and the blocks within them */
+} Scope;
+
+typedef enum
+{
+  TOKEN_OTHER,
+  TOKEN_NAME,        /* an identifier, which may be called */
+  TOKEN_TYPE,        /* a keyword naming or qualifying a type */
+  TOKEN_KEYWORD,     /* a keyword followed by parentheses, such as sizeof */
+  TOKEN_CLOSE_PAREN,
+} TokenKind;
+
+/* The braces open when an #if started, and after its first branch */
+typedef struct
+{
+  gint depth;
+  gint depth_after_first;
+} Conditional;
+
+typedef struct
+{
+  const gchar *data;
+  gsize        len;
+  gsize        pos;
+  SlCallTable *calls;
+
+  guint8       scopes[MAX_DEPTH];
+  gint         depth;
+
+  Conditional  conditionals[MAX_CONDITIONALS];
+  gint         n_conditionals;
+
+  /* The last two tokens, and where the last identifier is */
+  TokenKind    prev;
+  TokenKind    prev2;
+  gsize        name;
+  gsize        name_len;
+  gboolean     at_line_start;
+} Lexer;
+
+typedef struct
+{
+  const gchar *word;
+  guint        len;
+  TokenKind    kind;
+} Keyword;
+
+#define KEYWORD(w, k) { w, sizeof w - 1, k }
+
+/* Statements may be followed by a call, unlike types */
+static const Keyword keywords[] = {
+  KEYWORD ("_Alignas", TOKEN_KEYWORD),
+  KEYWORD ("_Alignof", TOKEN_KEYWORD),
+  KEYWORD ("_Bool", TOKEN_TYPE),
+  KEYWORD ("_Complex", TOKEN_TYPE),
+  KEYWORD ("_Generic", TOKEN_KEYWORD),
+  KEYWORD ("_Static_assert", TOKEN_KEYWORD),
+  KEYWORD ("__alignof__", TOKEN_KEYWORD),
+  KEYWORD ("__asm", TOKEN_KEYWORD),
+  KEYWORD ("__asm__", TOKEN_KEYWORD),
+  KEYWORD ("__attribute", TOKEN_KEYWORD),
+  KEYWORD ("__attribute__", TOKEN_KEYWORD),
+  KEYWORD ("__builtin_offsetof", TOKEN_KEYWORD),
+  KEYWORD ("__declspec", TOKEN_KEYWORD),
+  KEYWORD ("__inline", TOKEN_TYPE),
+  KEYWORD ("__inline__", TOKEN_TYPE),
+  KEYWORD ("__restrict", TOKEN_TYPE),
+  KEYWORD ("__typeof", TOKEN_KEYWORD),
+  KEYWORD ("__typeof__", TOKEN_KEYWORD),
+  KEYWORD ("alignas", TOKEN_KEYWORD),
+  KEYWORD ("alignof", TOKEN_KEYWORD),
+  KEYWORD ("asm", TOKEN_KEYWORD),
+  KEYWORD ("auto", TOKEN_TYPE),
+  KEYWORD ("bool", TOKEN_TYPE),
+  KEYWORD ("case", TOKEN_OTHER),
+  KEYWORD ("catch", TOKEN_KEYWORD),
+  KEYWORD ("char", TOKEN_TYPE),
+  KEYWORD ("const", TOKEN_TYPE),
+  KEYWORD ("decltype", TOKEN_KEYWORD),
+  KEYWORD ("delete", TOKEN_TYPE),
+  KEYWORD ("do", TOKEN_OTHER),
+  KEYWORD ("double", TOKEN_TYPE),
+  KEYWORD ("else", TOKEN_OTHER),
+  KEYWORD ("enum", TOKEN_TYPE),
+  KEYWORD ("extern", TOKEN_TYPE),
+  KEYWORD ("float", TOKEN_TYPE),
+  KEYWORD ("for", TOKEN_KEYWORD),
+  KEYWORD ("goto", TOKEN_OTHER),
+  KEYWORD ("if", TOKEN_KEYWORD),
+  KEYWORD ("inline", TOKEN_TYPE),
+  KEYWORD ("int", TOKEN_TYPE),
+  KEYWORD ("long", TOKEN_TYPE),
+  KEYWORD ("new", TOKEN_TYPE),
+  KEYWORD ("noexcept", TOKEN_KEYWORD),
+  KEYWORD ("offsetof", TOKEN_KEYWORD),
+  KEYWORD ("operator", TOKEN_TYPE),
+  KEYWORD ("register", TOKEN_TYPE),
+  KEYWORD ("restrict", TOKEN_TYPE),
+  KEYWORD ("return", TOKEN_OTHER),
+  KEYWORD ("short", TOKEN_TYPE),
+  KEYWORD ("signed", TOKEN_TYPE),
+  KEYWORD ("sizeof", TOKEN_KEYWORD),
+  KEYWORD ("static", TOKEN_TYPE),
+  KEYWORD ("static_assert", TOKEN_KEYWORD),
+  KEYWORD ("struct", TOKEN_TYPE),
+  KEYWORD ("switch", TOKEN_KEYWORD),
+  KEYWORD ("throw", TOKEN_OTHER),
+  KEYWORD ("typedef", TOKEN_TYPE),
+  KEYWORD ("typeof", TOKEN_KEYWORD),
+  KEYWORD ("union", TOKEN_TYPE),
+  KEYWORD ("unsigned", TOKEN_TYPE),
+  KEYWORD ("va_arg", TOKEN_KEYWORD),
+  KEYWORD ("void", TOKEN_TYPE),
+  KEYWORD ("volatile", TOKEN_TYPE),
+  KEYWORD ("while", TOKEN_KEYWORD),
+};
+
+static inline gboolean
+is_word_start (guchar c)
+{
+  return g_ascii_isalpha (c) || c == '_' || c == '$';
+}
+
+static inline gboolean
+is_word_char (guchar c)
+{
+  return g_ascii_isalnum (c) || c == '_' || c == '$';
+}
+
+static TokenKind
+classify_word (const gchar *word,
+               gsize        len)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (keywords); i++)
+    {
+      if (keywords[i].len == len &&
+          keywords[i].word[0] == word[0] &&
+          memcmp (keywords[i].word, word, len) == 0)
+        return keywords[i].kind;
+    }
+
+  return TOKEN_NAME;
+}
+
+static inline void
+push_token (Lexer     *lexer,
+            TokenKind  kind)
+{
+  lexer->prev2 = lexer->prev;
+  lexer->prev = kind;
+  lexer->at_line_start = FALSE;
+}
+
+static inline Scope
+get_scope (Lexer *lexer)
+{
+  if (lexer->depth == 0)
+    return SCOPE_DATA;
+
+  return lexer->scopes[MIN (lexer->depth, MAX_DEPTH) - 1];
+}
+
+/* Moves to the next line, or past the end of a continued one */
+static void
+skip_line (Lexer *lexer)
+{
+  while (lexer->pos < lexer->len)
+    {
+      const gchar *nl = memchr (lexer->data + lexer->pos, '\n', lexer->len - lexer->pos);
+
+      if (nl == NULL)
+        {
+          lexer->pos = lexer->len;
+          break;
+        }
+
+      lexer->pos = nl - lexer->data + 1;
+
+      if (nl == lexer->data || nl[-1] != '\\')
+        break;
+    }
+
+  lexer->at_line_start = TRUE;
+}
+
+static void
+skip_block_comment (Lexer *lexer)
+{
+  lexer->pos += 2;
+
+  while (lexer->pos + 1 < lexer->len)
+    {
+      const gchar *star = memchr (lexer->data + lexer->pos, '*', lexer->len - lexer->pos - 1);
+
+      if (star == NULL)
+        break;
+
+      lexer->pos = star - lexer->data + 1;
+
+      if (lexer->data[lexer->pos] == '/')
+        {
+          lexer->pos++;
+          return;
+        }
+    }
+
+  lexer->pos = lexer->len;
+}
+
+static void
+skip_quoted (Lexer *lexer)
+{
+  gchar quote = lexer->data[lexer->pos++];
+
+  while (lexer->pos < lexer->len)
+    {
+      gchar c = lexer->data[lexer->pos];
+
+      if (c == '\\')
+        lexer->pos += 2;
+      else if (c == quote)
+        {
+          lexer->pos++;
+          break;
+        }
+      else if (c == '\n')
+        break;
+      else
+        lexer->pos++;
+    }
+
+  lexer->pos = MIN (lexer->pos, lexer->len);
+}
+
+/* Reads the name of a directive, after the '#' and any blanks */
+static gsize
+read_directive (Lexer        *lexer,
+                const gchar **name)
+{
+  gsize begin;
+
+  for (lexer->pos++;
+       lexer->pos < lexer->len && (lexer->data[lexer->pos] == ' ' || lexer->data[lexer->pos] == '\t');
+       lexer->pos++) { }
+
+  begin = lexer->pos;
+
+  for (; lexer->pos < lexer->len && g_ascii_isalpha (lexer->data[lexer->pos]); lexer->pos++) { }
+
+  *name = lexer->data + begin;
+
+  return lexer->pos - begin;
+}
+
+static inline gboolean
+directive_equal (const gchar *name,
+                 gsize        len,
+                 const gchar *directive)
+{
+  return strlen (directive) == len && memcmp (name, directive, len) == 0;
+}
+
+static inline gboolean
+is_conditional_start (const gchar *name,
+                      gsize        len)
+{
+  return directive_equal (name, len, "if") ||
+         directive_equal (name, len, "ifdef") ||
+         directive_equal (name, len, "ifndef");
+}
+
+static void
+push_conditional (Lexer *lexer)
+{
+  if (lexer->n_conditionals < MAX_CONDITIONALS)
+    {
+      lexer->conditionals[lexer->n_conditionals].depth = lexer->depth;
+      lexer->conditionals[lexer->n_conditionals].depth_after_first = -1;
+    }
+
+  lexer->n_conditionals++;
+}
+
+/*
+ * Skips the lines of an #if 0, through its #endif. An #else or #elif of
+ * it is lexed like the first branch of any other #if.
+ */
+static void
+skip_disabled (Lexer *lexer)
+{
+  guint nesting = 0;
+
+  skip_line (lexer);
+
+  while (lexer->pos < lexer->len)
+    {
+      const gchar *name;
+      gsize len;
+
+      for (; lexer->pos < lexer->len && g_ascii_isspace (lexer->data[lexer->pos]); lexer->pos++) { }
+
+      if (lexer->pos >= lexer->len || lexer->data[lexer->pos] != '#')
+        {
+          skip_line (lexer);
+          continue;
+        }
+
+      len = read_directive (lexer, &name);
+
+      if (is_conditional_start (name, len))
+        nesting++;
+      else if (directive_equal (name, len, "endif") && nesting-- == 0)
+        break;
+      else if (nesting == 0 && (directive_equal (name, len, "else") || directive_equal (name, len, "elif")))
+        {
+          push_conditional (lexer);
+          break;
+        }
+
+      skip_line (lexer);
+    }
+
+  skip_line (lexer);
+}
+
+/*
+ * Every branch of a conditional is lexed, but the braces they open may not
+ * balance, so each branch starts from the braces open at the #if and the
+ * first branch decides what is open after the #endif.
+ */
+static void
+lex_directive (Lexer *lexer)
+{
+  Conditional *conditional = NULL;
+  const gchar *name;
+  gsize len;
+
+  len = read_directive (lexer, &name);
+
+  if (lexer->n_conditionals > 0 && lexer->n_conditionals <= MAX_CONDITIONALS)
+    conditional = &lexer->conditionals[lexer->n_conditionals - 1];
+
+  if (directive_equal (name, len, "if"))
+    {
+      const gchar *p = lexer->data + lexer->pos;
+      const gchar *end = lexer->data + lexer->len;
+
+      for (; p < end && (*p == ' ' || *p == '\t'); p++) { }
+
+      if (p < end && *p == '0' && (p + 1 == end || !is_word_char (p[1])))
+        {
+          skip_disabled (lexer);
+          return;
+        }
+
+      push_conditional (lexer);
+    }
+  else if (is_conditional_start (name, len))
+    push_conditional (lexer);
+  else if (directive_equal (name, len, "else") || directive_equal (name, len, "elif"))
+    {
+      if (conditional != NULL)
+        {
+          if (conditional->depth_after_first < 0)
+            conditional->depth_after_first = lexer->depth;
+          lexer->depth = conditional->depth;
+        }
+    }
+  else if (directive_equal (name, len, "endif") && lexer->n_conditionals > 0)
+    {
+      if (conditional != NULL && conditional->depth_after_first >= 0)
+        lexer->depth = conditional->depth_after_first;
+      lexer->n_conditionals--;
+    }
+
+  skip_line (lexer);
+}
+
+static void
+open_brace (Lexer *lexer)
+{
+  Scope scope = SCOPE_DATA;
+
+  if (get_scope (lexer) == SCOPE_CODE || lexer->prev == TOKEN_CLOSE_PAREN)
+    scope = SCOPE_CODE;
+
+  if (lexer->depth < MAX_DEPTH)
+    lexer->scopes[lexer->depth] = scope;
+
+  lexer->depth++;
+}
+
+/* A name followed by a parenthesis is a call, unless a type precedes it */
+static void
+open_paren (Lexer *lexer)
+{
+  const gchar *name = lexer->data + lexer->name;
+
+  if (lexer->prev != TOKEN_NAME ||
+      lexer->prev2 == TOKEN_NAME ||
+      lexer->prev2 == TOKEN_TYPE ||
+      get_scope (lexer) != SCOPE_CODE)
+    return;
+
+  sl_call_table_add (lexer->calls,
+                     name,
+                     lexer->name_len,
+                     sl_call_table_hash (name, lexer->name_len),
+                     NULL,
+                     1);
+}
+
+static void
+lex_word (Lexer *lexer)
+{
+  gsize begin = lexer->pos;
+  TokenKind kind;
+
+  for (lexer->pos++; lexer->pos < lexer->len && is_word_char (lexer->data[lexer->pos]); lexer->pos++) { }
+
+  kind = classify_word (lexer->data + begin, lexer->pos - begin);
+
+  /* Qualifiers of a member function, before its body */
+  if (kind == TOKEN_TYPE && lexer->prev == TOKEN_CLOSE_PAREN)
+    return;
+
+  if (kind == TOKEN_NAME)
+    {
+      lexer->name = begin;
+      lexer->name_len = lexer->pos - begin;
+    }
+
+  push_token (lexer, kind);
+}
+
+static void
+lex_number (Lexer *lexer)
+{
+  for (lexer->pos++; lexer->pos < lexer->len; lexer->pos++)
+    {
+      gchar c = lexer->data[lexer->pos];
+
+      if (is_word_char (c) || c == '.')
+        continue;
+
+      /* Exponents of decimal and hexadecimal floating point */
+      if ((c == '+' || c == '-') && strchr ("eEpP", lexer->data[lexer->pos - 1]) != NULL)
+        continue;
+
+      break;
+    }
+
+  push_token (lexer, TOKEN_OTHER);
+}
+
+/**
+ * sl_call_lexer_count:
+ * @data: the text of a C or C++ file
+ * @len: the length of @data in bytes
+ * @calls: the table to count calls in
+ *
+ * Counts the calls in @data by name, without preprocessing or parsing it.
+ */
+void
+sl_call_lexer_count (const gchar *data,
+                     gsize        len,
+                     SlCallTable *calls)
+{
+  Lexer lexer = { 0 };
+
+  g_return_if_fail (data != NULL || len == 0);
+  g_return_if_fail (calls != NULL);
+
+  lexer.data = data;
+  lexer.len = len;
+  lexer.calls = calls;
+  lexer.at_line_start = TRUE;
+
+  while (lexer.pos < lexer.len)
+    {
+      gchar c = lexer.data[lexer.pos];
+      gchar next = lexer.pos + 1 < lexer.len ? lexer.data[lexer.pos + 1] : '\0';
+
+      switch (c)
+        {
+        case '\n':
+          lexer.at_line_start = TRUE;
+          lexer.pos++;
+          break;
+
+        case ' ': case '\t': case '\r': case '\f': case '\v':
+          lexer.pos++;
+          break;
+
+        case '#':
+          if (lexer.at_line_start)
+            lex_directive (&lexer);
+          else
+            {
+              lexer.pos++;
+              push_token (&lexer, TOKEN_OTHER);
+            }
+          break;
+
+        case '/':
+          if (next == '*')
+            skip_block_comment (&lexer);
+          else if (next == '/')
+            skip_line (&lexer);
+          else
+            {
+              lexer.pos++;
+              push_token (&lexer, TOKEN_OTHER);
+            }
+          break;
+
+        case '"': case '\'':
+          skip_quoted (&lexer);
+          push_token (&lexer, TOKEN_OTHER);
+          break;
+
+        case '(':
+          open_paren (&lexer);
+          lexer.pos++;
+          push_token (&lexer, TOKEN_OTHER);
+          break;
+
+        case ')':
+          lexer.pos++;
+          push_token (&lexer, TOKEN_CLOSE_PAREN);
+          break;
+
+        case '{':
+          open_brace (&lexer);
+          lexer.pos++;
+          push_token (&lexer, TOKEN_OTHER);
+          break;
+
+        case '}':
+          if (lexer.depth > 0)
+            lexer.depth--;
+          lexer.pos++;
+          push_token (&lexer, TOKEN_OTHER);
+          break;
+
+        default:
+          if (is_word_start (c))
+            lex_word (&lexer);
+          else if (g_ascii_isdigit (c) || (c == '.' && g_ascii_isdigit (next)))
+            lex_number (&lexer);
+          else
+            {
+              lexer.pos++;
+              push_token (&lexer, TOKEN_OTHER);
+            }
+          break;
+        }
+    }
+}
@@ -0,0 +1,33 @@
+/* sl-call-lexer.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SL_CALL_LEXER_H
+#define SL_CALL_LEXER_H
+
+#include <glib.h>
+
+#include "sl-call-table.h"
+
+G_BEGIN_DECLS
+
+void sl_call_lexer_count (const gchar *data,
+                          gsize        len,
+                          SlCallTable *calls);
+
+G_END_DECLS
+
+#endif /* SL_CALL_LEXER_H */
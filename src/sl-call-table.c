@@ -0,0 +1,568 @@
+/* sl-call-table.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-call-table"
+
+#include <string.h>
+
+#include "sl-call-table.h"
+
+/*
+ * Counts calls per callee. Large builds contain tens of millions of call
+ * expressions but comparatively few distinct callees, so this is mostly
+ * lookups of keys which are already present.
+ *
+ * Entries are kept in a dense array, in insertion order, and located with
+ * an open-addressed (linear probing) index of slots. Each slot carries the
+ * full hash of its entry so that probing rarely touches the entry itself,
+ * and merging or growing never needs to rehash a key. Key and name strings
+ * are copied into a string chunk rather than allocated individually.
+ *
+ * Tables are not thread-safe; each thread keeps its own and they are merged
+ * once parsing has finished.
+ */
+
+#define MIN_SLOTS  256
+#define EMPTY_SLOT 0
+
+typedef struct
+{
+  guint32 hash;
+  guint32 index; /* entry index + 1, or EMPTY_SLOT */
+} Slot;
+
+/* The serialized form of a table, see sl_call_table_serialize() */
+typedef struct
+{
+  guint32 n_entries;
+  guint32 strings_len;
+} BlobHeader;
+
+typedef struct
+{
+  guint32 key;
+  guint32 name;
+  guint32 count;
+} BlobEntry;
+
+G_STATIC_ASSERT (sizeof (BlobHeader) == 8);
+G_STATIC_ASSERT (sizeof (BlobEntry) == 12);
+
+struct _SlCallTable
+{
+  GStringChunk *strings;
+  SlCallEntry  *entries;
+  guint         n_entries;
+  guint         n_allocated;
+  Slot         *slots;
+  guint         mask;
+};
+
+SlCallTable *
+sl_call_table_new (void)
+{
+  SlCallTable *self;
+
+  self = g_slice_new0 (SlCallTable);
+  self->strings = g_string_chunk_new (16 * 1024);
+  self->slots = g_new0 (Slot, MIN_SLOTS);
+  self->mask = MIN_SLOTS - 1;
+
+  return self;
+}
+
+void
+sl_call_table_free (SlCallTable *self)
+{
+  if (self != NULL)
+    {
+      g_string_chunk_free (self->strings);
+      g_free (self->entries);
+      g_free (self->slots);
+      g_slice_free (SlCallTable, self);
+    }
+}
+
+/**
+ * sl_call_table_clear:
+ * @self: a #SlCallTable
+ *
+ * Removes every entry, keeping the allocated index so the table can be
+ * reused for another translation unit.
+ */
+void
+sl_call_table_clear (SlCallTable *self)
+{
+  g_return_if_fail (self != NULL);
+
+  if (self->n_entries == 0)
+    return;
+
+  g_string_chunk_clear (self->strings);
+  memset (self->slots, 0, sizeof (Slot) * (self->mask + 1));
+  self->n_entries = 0;
+}
+
+/**
+ * sl_call_table_hash:
+ * @key: the key to hash
+ * @len: the length of @key in bytes
+ *
+ * Hashes @key (FNV-1a) so that callers may compute it once and reuse it.
+ *
+ * Returns: the hash of @key
+ */
+guint32
+sl_call_table_hash (const gchar *key,
+                    gsize        len)
+{
+  guint32 hash = 2166136261u;
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    {
+      hash ^= (guint8)key[i];
+      hash *= 16777619u;
+    }
+
+  return hash;
+}
+
+static void
+sl_call_table_grow (SlCallTable *self)
+{
+  guint n_slots = (self->mask + 1) * 2;
+  Slot *slots = g_new0 (Slot, n_slots);
+  guint mask = n_slots - 1;
+  guint i;
+
+  /* Hashes are stored in the slots, so no key is rehashed */
+  for (i = 0; i <= self->mask; i++)
+    {
+      const Slot *slot = &self->slots[i];
+      guint pos;
+
+      if (slot->index == EMPTY_SLOT)
+        continue;
+
+      for (pos = slot->hash & mask; slots[pos].index != EMPTY_SLOT; pos = (pos + 1) & mask) { }
+
+      slots[pos] = *slot;
+    }
+
+  g_free (self->slots);
+  self->slots = slots;
+  self->mask = mask;
+}
+
+/**
+ * sl_call_table_add:
+ * @self: a #SlCallTable
+ * @key: the callee key, which need not be nul terminated
+ * @key_len: the length of @key in bytes
+ * @hash: the result of sl_call_table_hash() for @key
+ * @name: (nullable): the name to display, or %NULL to use @key
+ * @count: the number of calls to add
+ *
+ * Adds @count calls to the entry for @key, creating it if necessary.
+ * @name is only used when the entry is created.
+ *
+ * Returns: the index of the entry, for use with sl_call_table_increment()
+ */
+guint
+sl_call_table_add (SlCallTable *self,
+                   const gchar *key,
+                   gsize        key_len,
+                   guint32      hash,
+                   const gchar *name,
+                   guint        count)
+{
+  SlCallEntry *entry;
+  guint pos;
+
+  g_return_val_if_fail (self != NULL, 0);
+  g_return_val_if_fail (key != NULL, 0);
+
+  for (pos = hash & self->mask; self->slots[pos].index != EMPTY_SLOT; pos = (pos + 1) & self->mask)
+    {
+      const Slot *slot = &self->slots[pos];
+
+      if (slot->hash != hash)
+        continue;
+
+      entry = &self->entries[slot->index - 1];
+
+      if (strncmp (entry->key, key, key_len) == 0 && entry->key[key_len] == '\0')
+        {
+          entry->count += count;
+          return slot->index - 1;
+        }
+    }
+
+  if (self->n_entries == self->n_allocated)
+    {
+      self->n_allocated = MAX (64, self->n_allocated * 2);
+      self->entries = g_renew (SlCallEntry, self->entries, self->n_allocated);
+    }
+
+  entry = &self->entries[self->n_entries];
+  entry->key = g_string_chunk_insert_len (self->strings, key, key_len);
+  entry->name = (name == NULL) ? entry->key : g_string_chunk_insert (self->strings, name);
+  entry->hash = hash;
+  entry->count = count;
+
+  self->slots[pos].hash = hash;
+  self->slots[pos].index = ++self->n_entries;
+
+  /* Keep the load factor at or below one half */
+  if (self->n_entries * 2 > self->mask + 1)
+    sl_call_table_grow (self);
+
+  return self->n_entries - 1;
+}
+
+/**
+ * sl_call_table_increment:
+ * @self: a #SlCallTable
+ * @index: an index returned from sl_call_table_add()
+ * @count: the number of calls to add
+ *
+ * Adds @count calls to an existing entry without looking it up.
+ */
+void
+sl_call_table_increment (SlCallTable *self,
+                         guint        index,
+                         guint        count)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (index < self->n_entries);
+
+  self->entries[index].count += count;
+}
+
+/**
+ * sl_call_table_add_table:
+ * @self: a #SlCallTable
+ * @other: the #SlCallTable to add to @self
+ *
+ * Adds the counts from @other to @self, leaving @other as it is. Stored
+ * hashes are reused, so only keys new to @self are copied.
+ */
+void
+sl_call_table_add_table (SlCallTable *self,
+                         SlCallTable *other)
+{
+  guint i;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (other != NULL);
+  g_return_if_fail (self != other);
+
+  for (i = 0; i < other->n_entries; i++)
+    {
+      const SlCallEntry *entry = &other->entries[i];
+
+      sl_call_table_add (self,
+                         entry->key,
+                         strlen (entry->key),
+                         entry->hash,
+                         entry->name != entry->key ? entry->name : NULL,
+                         entry->count);
+    }
+}
+
+/**
+ * sl_call_table_merge:
+ * @self: a #SlCallTable
+ * @other: the #SlCallTable to merge into @self
+ *
+ * Adds the counts from @other to @self and clears @other, like
+ * sl_call_table_add_table() for a table which is not needed anymore.
+ */
+void
+sl_call_table_merge (SlCallTable *self,
+                     SlCallTable *other)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (other != NULL);
+  g_return_if_fail (self != other);
+
+  sl_call_table_add_table (self, other);
+  sl_call_table_clear (other);
+}
+
+/**
+ * sl_call_table_subtract:
+ * @self: a #SlCallTable
+ * @other: the #SlCallTable to subtract from @self
+ *
+ * Removes the counts in @other from @self and clears @other. This is the
+ * inverse of sl_call_table_merge(), used to take back the contribution of
+ * a translation unit which changed. Entries are kept when their count
+ * drops to zero.
+ */
+void
+sl_call_table_subtract (SlCallTable *self,
+                        SlCallTable *other)
+{
+  guint i;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (other != NULL);
+  g_return_if_fail (self != other);
+
+  for (i = 0; i < other->n_entries; i++)
+    {
+      const SlCallEntry *entry = &other->entries[i];
+      guint pos;
+
+      for (pos = entry->hash & self->mask;
+           self->slots[pos].index != EMPTY_SLOT;
+           pos = (pos + 1) & self->mask)
+        {
+          SlCallEntry *found;
+
+          if (self->slots[pos].hash != entry->hash)
+            continue;
+
+          found = &self->entries[self->slots[pos].index - 1];
+
+          if (g_str_equal (found->key, entry->key))
+            {
+              found->count -= MIN (found->count, entry->count);
+              break;
+            }
+        }
+    }
+
+  sl_call_table_clear (other);
+}
+
+/**
+ * sl_call_table_serialize:
+ * @self: a #SlCallTable
+ *
+ * Serializes the entries of @self, for storing alongside other state.
+ * Entries whose count was subtracted down to zero are left out.
+ *
+ * Returns: (transfer full): a #GBytes to pass to sl_call_table_deserialize()
+ */
+GBytes *
+sl_call_table_serialize (SlCallTable *self)
+{
+  g_autoptr(GString) strings = NULL;
+  GByteArray *buf;
+  BlobHeader header;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  strings = g_string_new (NULL);
+  buf = g_byte_array_new ();
+
+  header.n_entries = 0;
+  header.strings_len = 0;
+  g_byte_array_append (buf, (const guint8 *)&header, sizeof header);
+
+  for (i = 0; i < self->n_entries; i++)
+    {
+      const SlCallEntry *entry = &self->entries[i];
+      BlobEntry blob;
+
+      if (entry->count == 0)
+        continue;
+
+      header.n_entries++;
+
+      blob.key = strings->len;
+      blob.count = entry->count;
+      g_string_append_len (strings, entry->key, strlen (entry->key) + 1);
+
+      /* Unless keyed by USR, the name is the key and is stored once */
+      blob.name = blob.key;
+      if (entry->name != entry->key)
+        {
+          blob.name = strings->len;
+          g_string_append_len (strings, entry->name, strlen (entry->name) + 1);
+        }
+
+      g_byte_array_append (buf, (const guint8 *)&blob, sizeof blob);
+    }
+
+  /* Keep whatever follows aligned when this is embedded in another file */
+  do
+    g_string_append_c (strings, '\0');
+  while ((strings->len % 4) != 0);
+
+  header.strings_len = strings->len;
+  memcpy (buf->data, &header, sizeof header);
+  g_byte_array_append (buf, (const guint8 *)strings->str, strings->len);
+
+  return g_byte_array_free_to_bytes (buf);
+}
+
+/**
+ * sl_call_table_deserialize:
+ * @self: a #SlCallTable
+ * @bytes: the result of sl_call_table_serialize()
+ *
+ * Adds the entries serialized in @bytes to @self.
+ *
+ * Returns: %TRUE if @bytes was valid
+ */
+gboolean
+sl_call_table_deserialize (SlCallTable *self,
+                           GBytes      *bytes)
+{
+  const BlobHeader *header;
+  const BlobEntry *blobs;
+  const gchar *strings;
+  const guint8 *data;
+  gsize len;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (bytes != NULL, FALSE);
+
+  data = g_bytes_get_data (bytes, &len);
+
+  if (len < sizeof *header)
+    return FALSE;
+
+  header = (const BlobHeader *)(gconstpointer)data;
+
+  if (header->strings_len == 0 ||
+      len < sizeof *header + (guint64)header->n_entries * sizeof (BlobEntry) + header->strings_len)
+    return FALSE;
+
+  blobs = (const BlobEntry *)(gconstpointer)(data + sizeof *header);
+  strings = (const gchar *)&blobs[header->n_entries];
+
+  if (strings[header->strings_len - 1] != '\0')
+    return FALSE;
+
+  for (i = 0; i < header->n_entries; i++)
+    {
+      if (blobs[i].key >= header->strings_len || blobs[i].name >= header->strings_len)
+        return FALSE;
+    }
+
+  for (i = 0; i < header->n_entries; i++)
+    {
+      const gchar *key = &strings[blobs[i].key];
+      gsize key_len = strlen (key);
+
+      sl_call_table_add (self,
+                         key,
+                         key_len,
+                         sl_call_table_hash (key, key_len),
+                         blobs[i].name != blobs[i].key ? &strings[blobs[i].name] : NULL,
+                         blobs[i].count);
+    }
+
+  return TRUE;
+}
+
+/**
+ * sl_call_table_get_entries:
+ * @self: a #SlCallTable
+ * @n_entries: (out): the number of entries
+ *
+ * Gets the entries in the order they were first added. The array is only
+ * valid until @self is next modified.
+ *
+ * Returns: (array length=n_entries): the entries
+ */
+const SlCallEntry *
+sl_call_table_get_entries (SlCallTable *self,
+                           guint       *n_entries)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (n_entries != NULL, NULL);
+
+  *n_entries = self->n_entries;
+
+  return self->entries;
+}
+
+/**
+ * sl_call_table_rank:
+ * @self: a #SlCallTable
+ *
+ * Orders the entries by descending call count. This is an LSD radix sort
+ * over the 32-bit counts, a byte at a time, skipping bytes which are the
+ * same for every entry (typically all but the lowest one or two). The sort
+ * is stable, so entries with equal counts remain in insertion order.
+ *
+ * Returns: (transfer full): entry indexes in rank order, of the same length
+ *   as the table. Free with g_free().
+ */
+guint *
+sl_call_table_rank (SlCallTable *self)
+{
+  g_autofree guint *tmp = NULL;
+  guint *order;
+  guint shift;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  order = g_new (guint, MAX (1, self->n_entries));
+  tmp = g_new (guint, MAX (1, self->n_entries));
+
+  for (i = 0; i < self->n_entries; i++)
+    order[i] = i;
+
+  for (shift = 0; shift < 32; shift += 8)
+    {
+      guint offsets[256] = { 0 };
+      guint sum = 0;
+      guint *swap;
+
+      /* Complement the counts so that ascending order is descending rank */
+      for (i = 0; i < self->n_entries; i++)
+        offsets[((~self->entries[i].count) >> shift) & 0xFF]++;
+
+      for (i = 0; i < 256; i++)
+        {
+          guint n = offsets[i];
+
+          if (n == self->n_entries)
+            break;
+
+          offsets[i] = sum;
+          sum += n;
+        }
+
+      if (i < 256)
+        continue;
+
+      for (i = 0; i < self->n_entries; i++)
+        {
+          guint index = order[i];
+
+          tmp[offsets[((~self->entries[index].count) >> shift) & 0xFF]++] = index;
+        }
+
+      swap = order;
+      order = tmp;
+      tmp = swap;
+    }
+
+  return order;
+}
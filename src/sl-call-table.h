@@ -0,0 +1,71 @@
+/* sl-call-table.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_CALL_TABLE_H
+#define SL_CALL_TABLE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SlCallTable SlCallTable;
+
+typedef struct
+{
+  /* The identity of the callee, either its name or its USR */
+  const gchar *key;
+
+  /* The name to display, which is @key unless keyed by USR */
+  const gchar *name;
+
+  guint32      hash;
+  guint32      count;
+} SlCallEntry;
+
+SlCallTable       *sl_call_table_new         (void);
+void               sl_call_table_free        (SlCallTable       *self);
+void               sl_call_table_clear       (SlCallTable       *self);
+guint32            sl_call_table_hash        (const gchar       *key,
+                                              gsize              len);
+guint              sl_call_table_add         (SlCallTable       *self,
+                                              const gchar       *key,
+                                              gsize              key_len,
+                                              guint32            hash,
+                                              const gchar       *name,
+                                              guint              count);
+void               sl_call_table_increment   (SlCallTable       *self,
+                                              guint              index,
+                                              guint              count);
+void               sl_call_table_add_table   (SlCallTable       *self,
+                                              SlCallTable       *other);
+void               sl_call_table_merge       (SlCallTable       *self,
+                                              SlCallTable       *other);
+void               sl_call_table_subtract    (SlCallTable       *self,
+                                              SlCallTable       *other);
+GBytes            *sl_call_table_serialize   (SlCallTable       *self);
+gboolean           sl_call_table_deserialize (SlCallTable       *self,
+                                              GBytes            *bytes);
+const SlCallEntry *sl_call_table_get_entries (SlCallTable       *self,
+                                              guint             *n_entries);
+guint             *sl_call_table_rank        (SlCallTable       *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SlCallTable, sl_call_table_free)
+
+G_END_DECLS
+
+#endif /* SL_CALL_TABLE_H */
@@ -0,0 +1,565 @@
+/* sl-compile-db.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-compile-db"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sl-compile-db.h"
+#include "sl-flag-table.h"
+
+/*
+ * The compile jobs found in a build log: for each source file, the
+ * directory it was built from and the flag set (see #SlFlagTable) it is
+ * parsed with. This can be saved as a compile_commands.json or in a binary
+ * form which loads without any parsing:
+ *
+ *   DbHeader
+ *   DbEntry[n_entries]   (sorted by filename)
+ *   DbSet[n_sets]        (each distinct flag set once)
+ *   guint32 args[n_args] (string offsets, referenced by the sets)
+ *   gchar strings[strings_len]
+ *
+ * Every string is stored once. Loading maps the file, interns each flag set
+ * and points the entries straight into the mapping.
+ *
+ * Either way only the flag sets are kept, not the commands of the build, so
+ * both files are meant to be read back by sightline rather than by other
+ * tools.
+ */
+
+#define DB_MAGIC   0x42444c53 /* "SLDB" */
+#define DB_VERSION 1
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint32 n_entries;
+  guint32 n_sets;
+  guint32 n_args;
+  guint32 strings_len;
+} DbHeader;
+
+typedef struct
+{
+  guint32 directory;
+  guint32 filename;
+  guint32 set;
+} DbEntry;
+
+typedef struct
+{
+  guint32 first;
+  guint32 n_args;
+} DbSet;
+
+G_STATIC_ASSERT (sizeof (DbHeader) == 24);
+G_STATIC_ASSERT (sizeof (DbEntry) == 12);
+G_STATIC_ASSERT (sizeof (DbSet) == 8);
+
+typedef struct
+{
+  const gchar *directory;
+  const gchar *filename;
+  guint        flags;
+} Entry;
+
+struct _SlCompileDb
+{
+  GStringChunk *strings;
+  GArray       *entries;
+  GMappedFile  *mf;
+  guint         sorted : 1;
+};
+
+SlCompileDb *
+sl_compile_db_new (void)
+{
+  SlCompileDb *self;
+
+  self = g_slice_new0 (SlCompileDb);
+  self->strings = g_string_chunk_new (4096);
+  self->entries = g_array_new (FALSE, FALSE, sizeof (Entry));
+  self->sorted = TRUE;
+
+  return self;
+}
+
+void
+sl_compile_db_free (SlCompileDb *self)
+{
+  if (self != NULL)
+    {
+      g_clear_pointer (&self->strings, g_string_chunk_free);
+      g_clear_pointer (&self->entries, g_array_unref);
+      g_clear_pointer (&self->mf, g_mapped_file_unref);
+      g_slice_free (SlCompileDb, self);
+    }
+}
+
+/**
+ * sl_compile_db_is_database:
+ * @filename: a file
+ *
+ * Checks if @filename is a binary database written by sl_compile_db_save().
+ *
+ * Returns: %TRUE if @filename starts with the database signature
+ */
+gboolean
+sl_compile_db_is_database (const gchar *filename)
+{
+  guint32 magic = 0;
+  FILE *fp;
+  gboolean ret;
+
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  if (NULL == (fp = g_fopen (filename, "rb")))
+    return FALSE;
+
+  ret = fread (&magic, sizeof magic, 1, fp) == 1 && magic == DB_MAGIC;
+  fclose (fp);
+
+  return ret;
+}
+
+static gboolean
+set_invalid (GError      **error,
+             const gchar  *filename)
+{
+  g_set_error (error,
+               G_IO_ERROR,
+               G_IO_ERROR_INVALID_DATA,
+               "%s is not a valid compilation database",
+               filename);
+  return FALSE;
+}
+
+static gboolean
+sl_compile_db_load (SlCompileDb  *self,
+                    const gchar  *filename,
+                    GError      **error)
+{
+  g_autofree const gchar **argv = NULL;
+  g_autofree guint *set_flags = NULL;
+  SlFlagTable *flag_table = sl_flag_table_get_default ();
+  const DbHeader *header;
+  const DbEntry *entries;
+  const DbSet *sets;
+  const guint32 *args;
+  const gchar *strings;
+  const gchar *data;
+  guint64 required;
+  gsize len;
+  guint i;
+
+  g_assert (self != NULL);
+  g_assert (self->mf == NULL);
+
+  if (NULL == (self->mf = g_mapped_file_new (filename, FALSE, error)))
+    return FALSE;
+
+  data = g_mapped_file_get_contents (self->mf);
+  len = g_mapped_file_get_length (self->mf);
+
+  if (len < sizeof *header)
+    return set_invalid (error, filename);
+
+  header = (const DbHeader *)(gconstpointer)data;
+
+  if (header->magic != DB_MAGIC || header->version != DB_VERSION)
+    return set_invalid (error, filename);
+
+  required = sizeof *header
+           + (guint64)header->n_entries * sizeof (DbEntry)
+           + (guint64)header->n_sets * sizeof (DbSet)
+           + (guint64)header->n_args * sizeof (guint32)
+           + header->strings_len;
+
+  if (len < required || header->strings_len == 0)
+    return set_invalid (error, filename);
+
+  entries = (const DbEntry *)(gconstpointer)(data + sizeof *header);
+  sets = (const DbSet *)(gconstpointer)&entries[header->n_entries];
+  args = (const guint32 *)(gconstpointer)&sets[header->n_sets];
+  strings = (const gchar *)&args[header->n_args];
+
+  if (strings[header->strings_len - 1] != '\0')
+    return set_invalid (error, filename);
+
+  for (i = 0; i < header->n_args; i++)
+    {
+      if (args[i] >= header->strings_len)
+        return set_invalid (error, filename);
+    }
+
+  /* Each distinct flag set is interned once, however many files use it */
+  set_flags = g_new (guint, MAX (1, header->n_sets));
+
+  for (i = 0; i < header->n_sets; i++)
+    {
+      const DbSet *set = &sets[i];
+      guint j;
+
+      if ((guint64)set->first + set->n_args > header->n_args)
+        return set_invalid (error, filename);
+
+      argv = g_renew (const gchar *, argv, set->n_args + 1);
+
+      for (j = 0; j < set->n_args; j++)
+        argv[j] = &strings[args[set->first + j]];
+
+      set_flags[i] = sl_flag_table_insert (flag_table, argv, set->n_args);
+    }
+
+  g_array_set_size (self->entries, header->n_entries);
+
+  for (i = 0; i < header->n_entries; i++)
+    {
+      const DbEntry *db_entry = &entries[i];
+      Entry *entry = &g_array_index (self->entries, Entry, i);
+
+      if (db_entry->directory >= header->strings_len ||
+          db_entry->filename >= header->strings_len ||
+          db_entry->set >= header->n_sets)
+        return set_invalid (error, filename);
+
+      entry->directory = &strings[db_entry->directory];
+      entry->filename = &strings[db_entry->filename];
+      entry->flags = set_flags[db_entry->set];
+    }
+
+  self->sorted = TRUE;
+
+  return TRUE;
+}
+
+/**
+ * sl_compile_db_new_from_file:
+ * @filename: a file written with sl_compile_db_save()
+ * @error: a location for a #GError or %NULL
+ *
+ * Loads a binary compilation database. The file is mapped and must not
+ * be modified while the #SlCompileDb is in use.
+ *
+ * Returns: (transfer full): a #SlCompileDb or %NULL and @error is set.
+ */
+SlCompileDb *
+sl_compile_db_new_from_file (const gchar  *filename,
+                             GError      **error)
+{
+  g_autoptr(SlCompileDb) self = NULL;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  self = sl_compile_db_new ();
+
+  if (!sl_compile_db_load (self, filename, error))
+    return NULL;
+
+  return g_steal_pointer (&self);
+}
+
+void
+sl_compile_db_add (SlCompileDb *self,
+                   const gchar *directory,
+                   const gchar *filename,
+                   guint        flags)
+{
+  Entry entry;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (directory != NULL);
+  g_return_if_fail (filename != NULL);
+
+  entry.directory = g_string_chunk_insert_const (self->strings, directory);
+  entry.filename = g_string_chunk_insert (self->strings, filename);
+  entry.flags = flags;
+
+  g_array_append_val (self->entries, entry);
+
+  self->sorted = FALSE;
+}
+
+guint
+sl_compile_db_get_size (SlCompileDb *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->entries->len;
+}
+
+/**
+ * sl_compile_db_foreach:
+ * @self: a #SlCompileDb
+ * @func: a function to call for each file
+ * @user_data: closure data for @func
+ *
+ * Calls @func for every file in the database.
+ */
+void
+sl_compile_db_foreach (SlCompileDb     *self,
+                       SlCompileDbFunc  func,
+                       gpointer         user_data)
+{
+  guint i;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (func != NULL);
+
+  for (i = 0; i < self->entries->len; i++)
+    {
+      const Entry *entry = &g_array_index (self->entries, Entry, i);
+
+      func (entry->directory, entry->filename, entry->flags, user_data);
+    }
+}
+
+static gint
+compare_entry (gconstpointer a,
+               gconstpointer b)
+{
+  const Entry *entrya = a;
+  const Entry *entryb = b;
+
+  return strcmp (entrya->filename, entryb->filename);
+}
+
+static void
+sl_compile_db_sort (SlCompileDb *self)
+{
+  if (!self->sorted)
+    {
+      g_array_sort (self->entries, compare_entry);
+      self->sorted = TRUE;
+    }
+}
+
+static guint32
+intern_string (GHashTable  *offsets,
+               GString     *strings,
+               const gchar *str)
+{
+  gpointer value;
+
+  /* Offsets are stored plus one, so that zero means missing */
+  if (g_hash_table_lookup_extended (offsets, str, NULL, &value))
+    return GPOINTER_TO_UINT (value) - 1;
+
+  value = GUINT_TO_POINTER (strings->len + 1);
+  g_hash_table_insert (offsets, (gpointer)str, value);
+  g_string_append_len (strings, str, strlen (str) + 1);
+
+  return GPOINTER_TO_UINT (value) - 1;
+}
+
+/**
+ * sl_compile_db_save:
+ * @self: a #SlCompileDb
+ * @filename: the file to write
+ * @error: a location for a #GError or %NULL
+ *
+ * Writes the database in the binary format read by
+ * sl_compile_db_new_from_file().
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+sl_compile_db_save (SlCompileDb  *self,
+                    const gchar  *filename,
+                    GError      **error)
+{
+  g_autoptr(GHashTable) offsets = NULL;
+  g_autoptr(GHashTable) set_ids = NULL;
+  g_autoptr(GByteArray) entries = NULL;
+  g_autoptr(GByteArray) buf = NULL;
+  g_autoptr(GArray) sets = NULL;
+  g_autoptr(GArray) args = NULL;
+  g_autoptr(GString) strings = NULL;
+  SlFlagTable *flag_table = sl_flag_table_get_default ();
+  DbHeader header = { 0 };
+  guint i;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  sl_compile_db_sort (self);
+
+  offsets = g_hash_table_new (g_str_hash, g_str_equal);
+  set_ids = g_hash_table_new (NULL, NULL);
+  entries = g_byte_array_new ();
+  sets = g_array_new (FALSE, FALSE, sizeof (DbSet));
+  args = g_array_new (FALSE, FALSE, sizeof (guint32));
+  strings = g_string_new (NULL);
+
+  for (i = 0; i < self->entries->len; i++)
+    {
+      const Entry *entry = &g_array_index (self->entries, Entry, i);
+      DbEntry db_entry;
+      gpointer value;
+
+      if (!g_hash_table_lookup_extended (set_ids, GUINT_TO_POINTER (entry->flags), NULL, &value))
+        {
+          const gchar * const *argv = sl_flag_table_lookup (flag_table, entry->flags);
+          DbSet set;
+
+          set.first = args->len;
+          set.n_args = 0;
+
+          for (; argv != NULL && argv[set.n_args] != NULL; set.n_args++)
+            {
+              guint32 offset = intern_string (offsets, strings, argv[set.n_args]);
+
+              g_array_append_val (args, offset);
+            }
+
+          value = GUINT_TO_POINTER (sets->len);
+          g_hash_table_insert (set_ids, GUINT_TO_POINTER (entry->flags), value);
+          g_array_append_val (sets, set);
+        }
+
+      db_entry.directory = intern_string (offsets, strings, entry->directory);
+      db_entry.filename = intern_string (offsets, strings, entry->filename);
+      db_entry.set = GPOINTER_TO_UINT (value);
+
+      g_byte_array_append (entries, (const guint8 *)&db_entry, sizeof db_entry);
+    }
+
+  /* Always have a non-empty string table so loading can validate it */
+  g_string_append_c (strings, '\0');
+
+  header.magic = DB_MAGIC;
+  header.version = DB_VERSION;
+  header.n_entries = self->entries->len;
+  header.n_sets = sets->len;
+  header.n_args = args->len;
+  header.strings_len = strings->len;
+
+  buf = g_byte_array_sized_new (sizeof header + entries->len +
+                                sets->len * sizeof (DbSet) +
+                                args->len * sizeof (guint32) +
+                                strings->len);
+  g_byte_array_append (buf, (const guint8 *)&header, sizeof header);
+  g_byte_array_append (buf, entries->data, entries->len);
+  g_byte_array_append (buf, (const guint8 *)sets->data, sets->len * sizeof (DbSet));
+  g_byte_array_append (buf, (const guint8 *)args->data, args->len * sizeof (guint32));
+  g_byte_array_append (buf, (const guint8 *)strings->str, strings->len);
+
+  return g_file_set_contents (filename, (const gchar *)buf->data, buf->len, error);
+}
+
+static void
+append_json_string (GString     *str,
+                    const gchar *value)
+{
+  g_string_append_c (str, '"');
+
+  for (; *value != '\0'; value++)
+    {
+      guchar c = *value;
+
+      if (c == '"' || c == '\\')
+        {
+          g_string_append_c (str, '\\');
+          g_string_append_c (str, c);
+        }
+      else if (c < 0x20)
+        g_string_append_printf (str, "\\u%04x", c);
+      else
+        g_string_append_c (str, c);
+    }
+
+  g_string_append_c (str, '"');
+}
+
+/**
+ * sl_compile_db_save_json:
+ * @self: a #SlCompileDb
+ * @filename: the file to write
+ * @error: a location for a #GError or %NULL
+ *
+ * Writes the database as a compile_commands.json. Paths in the flag sets
+ * are relative to the current directory, so that is used as the directory
+ * of every command.
+ *
+ * The commands are what libclang is given, with "clang" as the compiler:
+ * the flags sightline kept from the log, the include directory of clang
+ * and what was probed from the compiler of the build. They are not the
+ * commands of the build, so the file is meant to be read back by sightline
+ * rather than by other tools.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+sl_compile_db_save_json (SlCompileDb  *self,
+                         const gchar  *filename,
+                         GError      **error)
+{
+  g_autoptr(GString) str = NULL;
+  g_autofree gchar *cwd = NULL;
+  SlFlagTable *flag_table = sl_flag_table_get_default ();
+  guint i;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  sl_compile_db_sort (self);
+
+  cwd = g_get_current_dir ();
+  str = g_string_new ("[\n");
+
+  for (i = 0; i < self->entries->len; i++)
+    {
+      const Entry *entry = &g_array_index (self->entries, Entry, i);
+      const gchar * const *argv = sl_flag_table_lookup (flag_table, entry->flags);
+      g_autofree gchar *path = NULL;
+
+      if (g_path_is_absolute (entry->filename))
+        path = g_strdup (entry->filename);
+      else
+        path = g_build_filename (cwd, entry->filename, NULL);
+
+      g_string_append (str, "  {\n    \"directory\": ");
+      append_json_string (str, cwd);
+      g_string_append (str, ",\n    \"file\": ");
+      append_json_string (str, path);
+      g_string_append (str, ",\n    \"arguments\": [\"clang\"");
+
+      for (; argv != NULL && *argv != NULL; argv++)
+        {
+          g_string_append (str, ", ");
+          append_json_string (str, *argv);
+        }
+
+      g_string_append (str, ", \"-c\", ");
+      append_json_string (str, path);
+      g_string_append (str, "]\n  }");
+
+      if (i + 1 < self->entries->len)
+        g_string_append_c (str, ',');
+      g_string_append_c (str, '\n');
+    }
+
+  g_string_append (str, "]\n");
+
+  return g_file_set_contents (filename, str->str, str->len, error);
+}
@@ -0,0 +1,57 @@
+/* sl-compile-db.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_COMPILE_DB_H
+#define SL_COMPILE_DB_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SlCompileDb SlCompileDb;
+
+typedef void (*SlCompileDbFunc) (const gchar *directory,
+                                 const gchar *filename,
+                                 guint        flags,
+                                 gpointer     user_data);
+
+SlCompileDb *sl_compile_db_new           (void);
+SlCompileDb *sl_compile_db_new_from_file (const gchar      *filename,
+                                          GError          **error);
+void         sl_compile_db_free          (SlCompileDb      *self);
+gboolean     sl_compile_db_is_database   (const gchar      *filename);
+void         sl_compile_db_add           (SlCompileDb      *self,
+                                          const gchar      *directory,
+                                          const gchar      *filename,
+                                          guint             flags);
+guint        sl_compile_db_get_size      (SlCompileDb      *self);
+void         sl_compile_db_foreach       (SlCompileDb      *self,
+                                          SlCompileDbFunc   func,
+                                          gpointer          user_data);
+gboolean     sl_compile_db_save          (SlCompileDb      *self,
+                                          const gchar      *filename,
+                                          GError          **error);
+gboolean     sl_compile_db_save_json     (SlCompileDb      *self,
+                                          const gchar      *filename,
+                                          GError          **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SlCompileDb, sl_compile_db_free)
+
+G_END_DECLS
+
+#endif /* SL_COMPILE_DB_H */
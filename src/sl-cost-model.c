@@ -0,0 +1,368 @@
+/* sl-cost-model.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define G_LOG_DOMAIN "sl-cost-model"
+
+#include <errno.h>
+#include <string.h>
+
+#include "sl-cost-model.h"
+#include "sl-file-info.h"
+
+/*
+ * Remembers how long each translation unit took to parse and how much
+ * memory libclang needed for it, so the longest ones can be started first
+ * and no more are parsed at once than fit in memory. Files without a
+ * history are estimated from their size and the number of headers they
+ * include, which is what dominates both for a typical C file.
+ *
+ * The history is a text file with a header line followed by one
+ * "AGE\tDURATION\tMEMORY\tPATH" line per file, durations being in
+ * microseconds and memory in bytes. The age is how many saves ago the file
+ * was last parsed, and files not parsed for MAX_AGE saves are forgotten, so
+ * the history does not keep every file ever parsed. Entries another run
+ * saved meanwhile are kept when saving.
+ */
+
+#define HEADER "sightline-costs 1"
+
+#define MAX_AGE 20
+
+#define USEC_PER_BYTE      1
+#define USEC_PER_INCLUDE   20000
+#define MEMORY_PER_BYTE    100
+#define MEMORY_PER_INCLUDE (4 * 1024 * 1024)
+
+typedef struct
+{
+  gint64  duration;
+  guint64 memory;
+  guint   age;
+
+  /* If it was recorded since the history was loaded */
+  guint   seen : 1;
+} Cost;
+
+struct _SlCostModel
+{
+  gchar      *filename;
+  GMutex      mutex;
+
+  /* Path to its Cost */
+  GHashTable *costs;
+  guint       dirty : 1;
+};
+
+static void
+load_costs (const gchar *filename,
+            GHashTable  *costs)
+{
+  g_autofree gchar *contents = NULL;
+  gchar *line;
+  gchar *next;
+
+  g_assert (filename != NULL);
+  g_assert (costs != NULL);
+
+  if (!g_file_get_contents (filename, &contents, NULL, NULL) ||
+      !g_str_has_prefix (contents, HEADER "\n"))
+    return;
+
+  for (line = contents + strlen (HEADER "\n"); *line != '\0'; line = next)
+    {
+      gchar *end;
+      Cost *cost;
+      gint64 duration;
+      guint64 memory;
+      guint64 age;
+
+      if (NULL != (next = strchr (line, '\n')))
+        *next++ = '\0';
+      else
+        next = line + strlen (line);
+
+      age = g_ascii_strtoull (line, &end, 10);
+      if (end == line || *end != '\t' || age >= MAX_AGE)
+        continue;
+
+      line = end + 1;
+      duration = g_ascii_strtoll (line, &end, 10);
+      if (end == line || *end != '\t' || duration <= 0)
+        continue;
+
+      line = end + 1;
+      memory = g_ascii_strtoull (line, &end, 10);
+      if (end == line || *end != '\t')
+        continue;
+
+      cost = g_new0 (Cost, 1);
+      cost->duration = duration;
+      cost->memory = memory;
+      cost->age = age;
+      g_hash_table_insert (costs, g_strdup (end + 1), cost);
+    }
+}
+
+/**
+ * sl_cost_model_new:
+ * @filename: where the history of costs is kept
+ *
+ * Creates a new #SlCostModel, loading the history in @filename if it
+ * exists. An unreadable history is ignored, and replaced when saved.
+ *
+ * Returns: (transfer full): A newly allocated #SlCostModel.
+ */
+SlCostModel *
+sl_cost_model_new (const gchar *filename)
+{
+  SlCostModel *self;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  self = g_new0 (SlCostModel, 1);
+  self->filename = g_strdup (filename);
+  self->costs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  g_mutex_init (&self->mutex);
+
+  load_costs (self->filename, self->costs);
+
+  return self;
+}
+
+void
+sl_cost_model_free (SlCostModel *self)
+{
+  if (self != NULL)
+    {
+      g_hash_table_unref (self->costs);
+      g_mutex_clear (&self->mutex);
+      g_free (self->filename);
+      g_free (self);
+    }
+}
+
+static guint
+count_includes (const gchar *data,
+                gsize        len)
+{
+  const gchar *end = data + len;
+  const gchar *p = data;
+  guint n_includes = 0;
+
+  while (NULL != (p = memchr (p, '#', end - p)))
+    {
+      p++;
+
+      while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+
+      if (end - p >= 7 && memcmp (p, "include", 7) == 0)
+        n_includes++;
+    }
+
+  return n_includes;
+}
+
+/**
+ * sl_cost_model_estimate:
+ * @self: An #SlCostModel
+ * @path: the path of a translation unit
+ * @duration: (out) (optional): the estimated parse time, in microseconds
+ * @memory: (out) (optional): the estimated memory needed, in bytes
+ *
+ * Estimates what parsing @path will cost, from the previous time it was
+ * parsed if it ever was. Estimates without a history are cheap and rough.
+ * This is safe to call from multiple threads.
+ */
+void
+sl_cost_model_estimate (SlCostModel *self,
+                        const gchar *path,
+                        gint64      *duration,
+                        guint64     *memory)
+{
+  g_autoptr(GMappedFile) mf = NULL;
+  const Cost *found;
+  SlFileInfo info;
+  Cost cost = { 0 };
+  gsize size = 0;
+  guint n_includes = 0;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (path != NULL);
+
+  g_mutex_lock (&self->mutex);
+  if (NULL != (found = g_hash_table_lookup (self->costs, path)))
+    cost = *found;
+  g_mutex_unlock (&self->mutex);
+
+  /* A unit which failed to parse before has a duration but no memory */
+  if (cost.duration == 0 || cost.memory == 0)
+    {
+      if (NULL != (mf = g_mapped_file_new (path, FALSE, NULL)))
+        {
+          size = g_mapped_file_get_length (mf);
+          n_includes = count_includes (g_mapped_file_get_contents (mf), size);
+        }
+      else if (sl_file_info_get (path, FALSE, &info))
+        size = info.size;
+
+      if (cost.duration == 0)
+        cost.duration = size * USEC_PER_BYTE + n_includes * USEC_PER_INCLUDE;
+      if (cost.memory == 0)
+        cost.memory = size * MEMORY_PER_BYTE + n_includes * MEMORY_PER_INCLUDE;
+    }
+
+  if (duration != NULL)
+    *duration = cost.duration;
+
+  if (memory != NULL)
+    *memory = cost.memory;
+}
+
+/**
+ * sl_cost_model_record:
+ * @self: An #SlCostModel
+ * @path: the path of a translation unit
+ * @duration: how long it took to parse, in microseconds
+ * @memory: how much memory libclang used for it, or 0 if unknown
+ *
+ * Adds what parsing @path cost to its history. Durations are averaged with
+ * the previous one, so a single slow run (on a loaded machine, say) does
+ * not reorder everything, while memory replaces the previous value since
+ * it hardly varies between runs. This is safe to call from multiple
+ * threads.
+ */
+void
+sl_cost_model_record (SlCostModel *self,
+                      const gchar *path,
+                      gint64       duration,
+                      guint64      memory)
+{
+  Cost *cost;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (path != NULL);
+
+  duration = MAX (duration, 1);
+
+  g_mutex_lock (&self->mutex);
+
+  if (NULL != (cost = g_hash_table_lookup (self->costs, path)))
+    cost->duration = (cost->duration + duration) / 2;
+  else
+    {
+      cost = g_new0 (Cost, 1);
+      cost->duration = duration;
+      g_hash_table_insert (self->costs, g_strdup (path), cost);
+    }
+
+  if (memory != 0)
+    cost->memory = memory;
+
+  cost->seen = TRUE;
+  self->dirty = TRUE;
+
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * sl_cost_model_save:
+ * @self: An #SlCostModel
+ * @error: A location for a #GError, or %NULL
+ *
+ * Writes the history back to the file it was loaded from, creating its
+ * directory if necessary. Nothing is written if nothing was recorded.
+ * Files which were not recorded age by one save, and are dropped once
+ * they are too old.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+sl_cost_model_save (SlCostModel  *self,
+                    GError      **error)
+{
+  g_autoptr(GHashTable) saved = NULL;
+  g_autoptr(GString) str = NULL;
+  g_autofree gchar *dir = NULL;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  if (!self->dirty)
+    return TRUE;
+
+  dir = g_path_get_dirname (self->filename);
+
+  if (g_mkdir_with_parents (dir, 0750) != 0)
+    {
+      int errsv = errno;
+
+      g_set_error (error,
+                   G_FILE_ERROR,
+                   g_file_error_from_errno (errsv),
+                   "Failed to create %s: %s",
+                   dir, g_strerror (errsv));
+      return FALSE;
+    }
+
+  str = g_string_new (HEADER "\n");
+
+  /* Another run may have saved since we loaded, keep what it added */
+  saved = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  load_costs (self->filename, saved);
+
+  g_mutex_lock (&self->mutex);
+
+  g_hash_table_iter_init (&iter, self->costs);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      Cost *cost = value;
+
+      cost->age = cost->seen ? 0 : cost->age + 1;
+      cost->seen = FALSE;
+
+      g_hash_table_remove (saved, key);
+
+      if (cost->age >= MAX_AGE)
+        continue;
+
+      g_string_append_printf (str, "%u\t%"G_GINT64_FORMAT"\t%"G_GUINT64_FORMAT"\t%s\n",
+                              cost->age, cost->duration, cost->memory, (const gchar *)key);
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  g_hash_table_iter_init (&iter, saved);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const Cost *cost = value;
+
+      g_string_append_printf (str, "%u\t%"G_GINT64_FORMAT"\t%"G_GUINT64_FORMAT"\t%s\n",
+                              cost->age, cost->duration, cost->memory, (const gchar *)key);
+    }
+
+  if (!g_file_set_contents (self->filename, str->str, str->len, error))
+    return FALSE;
+
+  self->dirty = FALSE;
+
+  return TRUE;
+}
@@ -0,0 +1,45 @@
+/* sl-cost-model.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_COST_MODEL_H
+#define SL_COST_MODEL_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SlCostModel SlCostModel;
+
+SlCostModel *sl_cost_model_new      (const gchar  *filename);
+void         sl_cost_model_free     (SlCostModel  *self);
+void         sl_cost_model_estimate (SlCostModel  *self,
+                                     const gchar  *path,
+                                     gint64       *duration,
+                                     guint64      *memory);
+void         sl_cost_model_record   (SlCostModel  *self,
+                                     const gchar  *path,
+                                     gint64        duration,
+                                     guint64       memory);
+gboolean     sl_cost_model_save     (SlCostModel  *self,
+                                     GError      **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SlCostModel, sl_cost_model_free)
+
+G_END_DECLS
+
+#endif /* SL_COST_MODEL_H */
@@ -0,0 +1,452 @@
+/* sl-daemon.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-daemon"
+
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "sl-daemon.h"
+
+/* Connections handled at once, each in a thread of its own */
+#define MAX_CONNECTIONS 16
+
+/*
+ * Serves requests on a local socket with --daemon. A request is a line of
+ * words, quoted as for a shell. The reply is a line with "ok" and the
+ * length of the text following it, or a line with "error" and a message.
+ *
+ * Connections are handled in threads of their own, so a long request such
+ * as ingesting a log does not hold up queries, while accepting them and
+ * anything else needing the main loop, such as file monitors, runs in the
+ * thread calling sl_daemon_run().
+ *
+ * Connections are counted as they are accepted, before their thread runs,
+ * so sl_daemon_stop() can wait for every one of them to be done with the
+ * daemon. Connections idle in between requests are cancelled then.
+ */
+struct _SlDaemon
+{
+  SlDaemonHandler  handler;
+  gpointer         user_data;
+  GSocketService  *service;
+  GMainLoop       *loop;
+  gchar           *path;
+
+  GCancellable    *cancellable;
+  GMutex           mutex;
+  GCond            cond;
+  guint            n_connections;
+  guint            stopped : 1;
+};
+
+static gboolean
+write_reply (GOutputStream  *output,
+             gboolean        ok,
+             const gchar    *text,
+             GError        **error)
+{
+  g_autoptr(GString) str = NULL;
+
+  g_assert (G_IS_OUTPUT_STREAM (output));
+  g_assert (text != NULL);
+
+  str = g_string_new (NULL);
+
+  if (ok)
+    g_string_printf (str, "ok %" G_GSIZE_FORMAT "\n%s", strlen (text), text);
+  else
+    {
+      g_autofree gchar *message = g_strdup (text);
+
+      g_string_printf (str, "error %s\n", g_strdelimit (message, "\r\n", ' '));
+    }
+
+  return g_output_stream_write_all (output, str->str, str->len, NULL, NULL, error);
+}
+
+static gboolean
+count_connection (GSocketService    *service,
+                  GSocketConnection *connection,
+                  GObject           *source_object,
+                  gpointer           user_data)
+{
+  SlDaemon *self = user_data;
+
+  g_assert (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+  self->n_connections++;
+  g_mutex_unlock (&self->mutex);
+
+  /* Let the service hand the connection to one of its threads */
+  return FALSE;
+}
+
+static gboolean
+handle_connection (GThreadedSocketService *service,
+                   GSocketConnection      *connection,
+                   GObject                *source_object,
+                   gpointer                user_data)
+{
+  SlDaemon *self = user_data;
+  g_autoptr(GDataInputStream) input = NULL;
+  g_autoptr(GError) error = NULL;
+  GOutputStream *output;
+  gchar *line;
+
+  g_assert (self != NULL);
+  g_assert (G_IS_SOCKET_CONNECTION (connection));
+
+  input = g_data_input_stream_new (g_io_stream_get_input_stream (G_IO_STREAM (connection)));
+  g_data_input_stream_set_newline_type (input, G_DATA_STREAM_NEWLINE_TYPE_LF);
+  output = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+
+  while (NULL != (line = g_data_input_stream_read_line (input, NULL, self->cancellable, &error)))
+    {
+      g_autofree gchar *owned = line;
+      g_autoptr(GError) request_error = NULL;
+      g_autoptr(GString) reply = NULL;
+      g_auto(GStrv) args = NULL;
+      gboolean ok;
+
+      if (*g_strstrip (line) == '\0')
+        continue;
+
+      reply = g_string_new (NULL);
+      ok = g_shell_parse_argv (line, NULL, &args, &request_error) &&
+           self->handler (self, (const gchar * const *)args, reply, &request_error, self->user_data);
+
+      if (!ok && request_error == NULL)
+        g_set_error_literal (&request_error, G_IO_ERROR, G_IO_ERROR_FAILED, "Request failed");
+
+      if (!write_reply (output, ok, ok ? reply->str : request_error->message, &error))
+        break;
+    }
+
+  if (error != NULL)
+    g_debug ("Closing connection: %s", error->message);
+
+  /* Nothing may touch @self past this, as sl_daemon_stop() may return */
+  g_mutex_lock (&self->mutex);
+  if (--self->n_connections == 0)
+    g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->mutex);
+
+  return TRUE;
+}
+
+/**
+ * sl_daemon_new:
+ * @handler: the function answering requests
+ * @user_data: data for @handler
+ *
+ * Creates a daemon answering requests with @handler, once it listens on
+ * a socket with sl_daemon_listen().
+ *
+ * Returns: (transfer full): a new #SlDaemon
+ */
+SlDaemon *
+sl_daemon_new (SlDaemonHandler handler,
+               gpointer        user_data)
+{
+  SlDaemon *self;
+
+  g_return_val_if_fail (handler != NULL, NULL);
+
+  self = g_slice_new0 (SlDaemon);
+  self->handler = handler;
+  self->user_data = user_data;
+  self->service = g_threaded_socket_service_new (MAX_CONNECTIONS);
+  self->loop = g_main_loop_new (NULL, FALSE);
+  self->cancellable = g_cancellable_new ();
+  g_mutex_init (&self->mutex);
+  g_cond_init (&self->cond);
+
+  g_signal_connect (self->service, "incoming", G_CALLBACK (count_connection), self);
+  g_signal_connect (self->service, "run", G_CALLBACK (handle_connection), self);
+
+  return self;
+}
+
+/**
+ * sl_daemon_free:
+ * @self: a #SlDaemon
+ *
+ * Stops @self with sl_daemon_stop(), if that was not done already, and
+ * frees it.
+ */
+void
+sl_daemon_free (SlDaemon *self)
+{
+  if (self != NULL)
+    {
+      sl_daemon_stop (self);
+
+      g_object_unref (self->service);
+      g_object_unref (self->cancellable);
+      g_main_loop_unref (self->loop);
+      g_mutex_clear (&self->mutex);
+      g_cond_clear (&self->cond);
+
+      if (self->path != NULL)
+        {
+          g_unlink (self->path);
+          g_free (self->path);
+        }
+
+      g_slice_free (SlDaemon, self);
+    }
+}
+
+/**
+ * sl_daemon_listen:
+ * @self: a #SlDaemon
+ * @path: the path of the socket
+ * @error: a location for a #GError, or %NULL
+ *
+ * Listens for connections on a Unix socket at @path, which only the user
+ * running the daemon may connect to. A socket left behind by a daemon
+ * which is gone is replaced, but not one a daemon still listens on.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+sl_daemon_listen (SlDaemon     *self,
+                  const gchar  *path,
+                  GError      **error)
+{
+  g_autoptr(GSocketAddress) address = NULL;
+  GStatBuf st;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (self->path == NULL, FALSE);
+
+  address = g_unix_socket_address_new (path);
+
+  if (g_lstat (path, &st) == 0)
+    {
+      g_autoptr(GSocketClient) client = NULL;
+      g_autoptr(GSocketConnection) connection = NULL;
+
+      if (!S_ISSOCK (st.st_mode))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_EXISTS,
+                       "%s exists and is not a socket", path);
+          return FALSE;
+        }
+
+      client = g_socket_client_new ();
+      connection = g_socket_client_connect (client, G_SOCKET_CONNECTABLE (address), NULL, NULL);
+
+      if (connection != NULL)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_ADDRESS_IN_USE,
+                       "A daemon is already listening on %s", path);
+          return FALSE;
+        }
+
+      g_unlink (path);
+    }
+
+  if (!g_socket_listener_add_address (G_SOCKET_LISTENER (self->service),
+                                      address,
+                                      G_SOCKET_TYPE_STREAM,
+                                      G_SOCKET_PROTOCOL_DEFAULT,
+                                      NULL,
+                                      NULL,
+                                      error))
+    return FALSE;
+
+  g_chmod (path, 0600);
+
+  self->path = g_strdup (path);
+  g_socket_service_start (self->service);
+
+  return TRUE;
+}
+
+/**
+ * sl_daemon_run:
+ * @self: a #SlDaemon
+ *
+ * Runs the main loop, accepting connections, until sl_daemon_quit() is
+ * called.
+ */
+void
+sl_daemon_run (SlDaemon *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_main_loop_run (self->loop);
+}
+
+/**
+ * sl_daemon_quit:
+ * @self: a #SlDaemon
+ *
+ * Makes sl_daemon_run() return. This may be called from any thread, such
+ * as that of a request.
+ */
+void
+sl_daemon_quit (SlDaemon *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_main_loop_quit (self->loop);
+}
+
+/**
+ * sl_daemon_stop:
+ * @self: a #SlDaemon
+ *
+ * Stops accepting connections, closes those waiting for a request and
+ * waits until the requests being answered are done, so the handler is
+ * not called anymore once this returns. This must be called from the
+ * thread which called sl_daemon_run(), after it returned.
+ */
+void
+sl_daemon_stop (SlDaemon *self)
+{
+  g_return_if_fail (self != NULL);
+
+  if (self->stopped)
+    return;
+
+  self->stopped = TRUE;
+
+  g_socket_service_stop (self->service);
+  g_socket_listener_close (G_SOCKET_LISTENER (self->service));
+  g_cancellable_cancel (self->cancellable);
+
+  g_mutex_lock (&self->mutex);
+  while (self->n_connections > 0)
+    g_cond_wait (&self->cond, &self->mutex);
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * sl_daemon_call:
+ * @path: the socket of the daemon
+ * @args: (array zero-terminated=1): the words of the request
+ * @reply: where to append the reply
+ * @error: a location for a #GError, or %NULL
+ *
+ * Sends a request to the daemon listening on @path and waits for its
+ * reply. If the daemon fails the request, @error is set to its message.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+sl_daemon_call (const gchar          *path,
+                const gchar * const  *args,
+                GString              *reply,
+                GError              **error)
+{
+  g_autoptr(GSocketAddress) address = NULL;
+  g_autoptr(GSocketClient) client = NULL;
+  g_autoptr(GSocketConnection) connection = NULL;
+  g_autoptr(GDataInputStream) input = NULL;
+  g_autoptr(GString) request = NULL;
+  g_autoptr(GError) local_error = NULL;
+  g_autofree gchar *status = NULL;
+  GOutputStream *output;
+  guint64 len = 0;
+  gsize n_read = 0;
+  gchar *end = NULL;
+  gsize old_len;
+  guint i;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (args != NULL && args[0] != NULL, FALSE);
+  g_return_val_if_fail (reply != NULL, FALSE);
+
+  request = g_string_new (NULL);
+
+  for (i = 0; args[i] != NULL; i++)
+    {
+      g_autofree gchar *quoted = g_shell_quote (args[i]);
+
+      if (i > 0)
+        g_string_append_c (request, ' ');
+      g_string_append (request, quoted);
+    }
+
+  g_string_append_c (request, '\n');
+
+  address = g_unix_socket_address_new (path);
+  client = g_socket_client_new ();
+
+  if (NULL == (connection = g_socket_client_connect (client, G_SOCKET_CONNECTABLE (address), NULL, error)))
+    return FALSE;
+
+  output = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+
+  if (!g_output_stream_write_all (output, request->str, request->len, NULL, NULL, error))
+    return FALSE;
+
+  input = g_data_input_stream_new (g_io_stream_get_input_stream (G_IO_STREAM (connection)));
+  g_data_input_stream_set_newline_type (input, G_DATA_STREAM_NEWLINE_TYPE_LF);
+
+  if (NULL == (status = g_data_input_stream_read_line (input, NULL, NULL, &local_error)))
+    {
+      if (local_error != NULL)
+        g_propagate_error (error, g_steal_pointer (&local_error));
+      else
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE,
+                             "The daemon closed the connection");
+      return FALSE;
+    }
+
+  if (g_str_has_prefix (status, "error "))
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED, status + strlen ("error "));
+      return FALSE;
+    }
+
+  if (g_str_has_prefix (status, "ok "))
+    len = g_ascii_strtoull (status + strlen ("ok "), &end, 10);
+
+  if (end == NULL || *end != '\0')
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Invalid reply from the daemon: %s", status);
+      return FALSE;
+    }
+
+  old_len = reply->len;
+  g_string_set_size (reply, old_len + len);
+
+  if (!g_input_stream_read_all (G_INPUT_STREAM (input), reply->str + old_len, len, &n_read, NULL, error))
+    {
+      g_string_set_size (reply, old_len + n_read);
+      return FALSE;
+    }
+
+  if (n_read < len)
+    {
+      g_string_set_size (reply, old_len + n_read);
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE,
+                           "The daemon closed the connection");
+      return FALSE;
+    }
+
+  return TRUE;
+}
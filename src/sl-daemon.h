@@ -0,0 +1,55 @@
+/* sl-daemon.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SL_DAEMON_H
+#define SL_DAEMON_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SlDaemon SlDaemon;
+
+/*
+ * Answers a request, appending the reply to @reply. This is called from
+ * the thread of the connection, so requests may be handled concurrently.
+ */
+typedef gboolean (*SlDaemonHandler) (SlDaemon             *daemon,
+                                     const gchar * const  *args,
+                                     GString              *reply,
+                                     GError              **error,
+                                     gpointer              user_data);
+
+SlDaemon *sl_daemon_new    (SlDaemonHandler        handler,
+                            gpointer               user_data);
+void      sl_daemon_free   (SlDaemon              *self);
+gboolean  sl_daemon_listen (SlDaemon              *self,
+                            const gchar           *path,
+                            GError               **error);
+void      sl_daemon_run    (SlDaemon              *self);
+void      sl_daemon_quit   (SlDaemon              *self);
+void      sl_daemon_stop   (SlDaemon              *self);
+gboolean  sl_daemon_call   (const gchar           *path,
+                            const gchar * const   *args,
+                            GString               *reply,
+                            GError               **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SlDaemon, sl_daemon_free)
+
+G_END_DECLS
+
+#endif /* SL_DAEMON_H */
@@ -0,0 +1,156 @@
+/* sl-file-info.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-file-info"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "sl-file-info.h"
+
+/*
+ * Both the result cache and the incremental state decide whether a file
+ * changed by its size and mtime, falling back to a digest of the contents
+ * when only the mtime differs. The answers are memoized for the whole
+ * process, since files are assumed not to change during a single run and
+ * the same headers are checked for most translation units.
+ */
+
+#define DIGEST_TYPE G_CHECKSUM_SHA1
+
+G_LOCK_DEFINE_STATIC (files);
+static GHashTable *files;
+
+static gboolean
+compute_digest (const gchar *path,
+                guint8      *digest)
+{
+  g_autoptr(GMappedFile) mf = NULL;
+  g_autoptr(GChecksum) checksum = NULL;
+  gsize len = SL_FILE_INFO_DIGEST_LEN;
+
+  if (NULL == (mf = g_mapped_file_new (path, FALSE, NULL)))
+    return FALSE;
+
+  checksum = g_checksum_new (DIGEST_TYPE);
+  g_checksum_update (checksum,
+                     (const guchar *)g_mapped_file_get_contents (mf),
+                     g_mapped_file_get_length (mf));
+  g_checksum_get_digest (checksum, digest, &len);
+
+  return TRUE;
+}
+
+/**
+ * sl_file_info_get:
+ * @path: the path of a file
+ * @need_digest: if the digest of the contents is required
+ * @info: (out): a location for the information
+ *
+ * Looks up (and memoizes) the size and mtime of @path, computing the
+ * digest of its contents as well if @need_digest is set. This is safe to
+ * call from multiple threads.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @info is undefined.
+ */
+gboolean
+sl_file_info_get (const gchar *path,
+                  gboolean     need_digest,
+                  SlFileInfo  *info)
+{
+  SlFileInfo *cached = NULL;
+  GStatBuf st;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (info != NULL, FALSE);
+
+  G_LOCK (files);
+  if (files != NULL && NULL != (cached = g_hash_table_lookup (files, path)))
+    *info = *cached;
+  G_UNLOCK (files);
+
+  if (cached != NULL && (info->has_digest || !need_digest))
+    return TRUE;
+
+  if (cached == NULL)
+    {
+      if (g_stat (path, &st) != 0)
+        return FALSE;
+
+      memset (info, 0, sizeof *info);
+      info->size = st.st_size;
+      info->mtime = (gint64)st.st_mtim.tv_sec * G_GINT64_CONSTANT (1000000000) + st.st_mtim.tv_nsec;
+    }
+
+  if (need_digest)
+    {
+      if (!compute_digest (path, info->digest))
+        return FALSE;
+      info->has_digest = TRUE;
+    }
+
+  cached = g_new (SlFileInfo, 1);
+  *cached = *info;
+
+  G_LOCK (files);
+  if (files == NULL)
+    files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  g_hash_table_insert (files, g_strdup (path), cached);
+  G_UNLOCK (files);
+
+  return TRUE;
+}
+
+/**
+ * sl_file_info_is_current:
+ * @path: the path of a file
+ * @size: the size the file had
+ * @mtime: the mtime the file had, in nanoseconds
+ * @digest: the digest of the contents the file had
+ *
+ * Checks whether @path is unchanged. A file which was touched but has the
+ * same contents is unchanged.
+ *
+ * Returns: %TRUE if @path is unchanged
+ */
+gboolean
+sl_file_info_is_current (const gchar  *path,
+                         guint64       size,
+                         gint64        mtime,
+                         const guint8 *digest)
+{
+  SlFileInfo info;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (digest != NULL, FALSE);
+
+  if (!sl_file_info_get (path, FALSE, &info))
+    return FALSE;
+
+  if (info.size != size)
+    return FALSE;
+
+  if (info.mtime == mtime)
+    return TRUE;
+
+  /* Touched but possibly unchanged, compare the contents */
+  if (!sl_file_info_get (path, TRUE, &info))
+    return FALSE;
+
+  return memcmp (info.digest, digest, SL_FILE_INFO_DIGEST_LEN) == 0;
+}
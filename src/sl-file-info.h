@@ -0,0 +1,46 @@
+/* sl-file-info.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_FILE_INFO_H
+#define SL_FILE_INFO_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define SL_FILE_INFO_DIGEST_LEN 20
+
+typedef struct
+{
+  guint64  size;
+  gint64   mtime;
+  gboolean has_digest;
+  guint8   digest[SL_FILE_INFO_DIGEST_LEN];
+} SlFileInfo;
+
+gboolean sl_file_info_get        (const gchar  *path,
+                                  gboolean      need_digest,
+                                  SlFileInfo   *info);
+gboolean sl_file_info_is_current (const gchar  *path,
+                                  guint64       size,
+                                  gint64        mtime,
+                                  const guint8 *digest);
+
+G_END_DECLS
+
+#endif /* SL_FILE_INFO_H */
@@ -0,0 +1,215 @@
+/* sl-flag-table.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-flag-table"
+
+#include <string.h>
+
+#include "sl-flag-table.h"
+
+/*
+ * Most translation units within a directory are compiled with the very
+ * same flags. Rather than carrying a copy of the argument vector with
+ * every job, each flag is interned into a string pool and each distinct
+ * vector of interned flags is stored once and identified by an integer.
+ *
+ * Since every flag is interned, two vectors are equal exactly when their
+ * pointers are equal, which keeps hashing and comparison cheap.
+ *
+ * Flag sets are never removed, so the vectors returned from
+ * sl_flag_table_lookup() are valid for the lifetime of the table.
+ */
+
+struct _SlFlagTable
+{
+  GMutex        mutex;
+  GStringChunk *strings;
+  GHashTable   *ids;
+  GPtrArray    *sets;
+  GPtrArray    *scratch;
+};
+
+static guint
+flag_set_hash (gconstpointer data)
+{
+  const gchar * const *set = data;
+  guint hash = 5381;
+
+  for (; *set != NULL; set++)
+    hash = (hash << 5) + hash + g_direct_hash (*set);
+
+  return hash;
+}
+
+static gboolean
+flag_set_equal (gconstpointer a,
+                gconstpointer b)
+{
+  const gchar * const *seta = a;
+  const gchar * const *setb = b;
+
+  for (; *seta != NULL && *seta == *setb; seta++, setb++) { }
+
+  return *seta == *setb;
+}
+
+SlFlagTable *
+sl_flag_table_new (void)
+{
+  SlFlagTable *self;
+
+  self = g_slice_new0 (SlFlagTable);
+  g_mutex_init (&self->mutex);
+  self->strings = g_string_chunk_new (4096);
+  self->ids = g_hash_table_new (flag_set_hash, flag_set_equal);
+  self->sets = g_ptr_array_new_with_free_func (g_free);
+  self->scratch = g_ptr_array_new ();
+
+  return self;
+}
+
+void
+sl_flag_table_free (SlFlagTable *self)
+{
+  if (self != NULL)
+    {
+      g_clear_pointer (&self->ids, g_hash_table_unref);
+      g_clear_pointer (&self->sets, g_ptr_array_unref);
+      g_clear_pointer (&self->scratch, g_ptr_array_unref);
+      g_clear_pointer (&self->strings, g_string_chunk_free);
+      g_mutex_clear (&self->mutex);
+      g_slice_free (SlFlagTable, self);
+    }
+}
+
+/**
+ * sl_flag_table_get_default:
+ *
+ * Gets the process-wide flag table, so that flag set identifiers may be
+ * shared between every log reader and consumer of jobs.
+ *
+ * Returns: (transfer none): A #SlFlagTable
+ */
+SlFlagTable *
+sl_flag_table_get_default (void)
+{
+  static SlFlagTable *instance;
+
+  if (g_once_init_enter (&instance))
+    g_once_init_leave (&instance, sl_flag_table_new ());
+
+  return instance;
+}
+
+/**
+ * sl_flag_table_insert:
+ * @self: a #SlFlagTable
+ * @flags: (array length=n_flags): the flags to intern
+ * @n_flags: the number of elements in @flags
+ *
+ * Interns each of @flags and the vector as a whole. This is safe to call
+ * from multiple threads.
+ *
+ * Returns: the identifier of the flag set, which may be passed to
+ *   sl_flag_table_lookup().
+ */
+guint
+sl_flag_table_insert (SlFlagTable         *self,
+                      const gchar * const *flags,
+                      guint                n_flags)
+{
+  gpointer value;
+  guint ret;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, 0);
+  g_return_val_if_fail (flags != NULL || n_flags == 0, 0);
+
+  g_mutex_lock (&self->mutex);
+
+  g_ptr_array_set_size (self->scratch, 0);
+
+  for (i = 0; i < n_flags; i++)
+    g_ptr_array_add (self->scratch, g_string_chunk_insert_const (self->strings, flags[i]));
+
+  g_ptr_array_add (self->scratch, NULL);
+
+  if (g_hash_table_lookup_extended (self->ids, self->scratch->pdata, NULL, &value))
+    ret = GPOINTER_TO_UINT (value);
+  else
+    {
+      gchar **set;
+
+      set = g_new (gchar *, self->scratch->len);
+      memcpy (set, self->scratch->pdata, sizeof (gchar *) * self->scratch->len);
+
+      ret = self->sets->len;
+      g_ptr_array_add (self->sets, set);
+      g_hash_table_insert (self->ids, set, GUINT_TO_POINTER (ret));
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
+
+/**
+ * sl_flag_table_lookup:
+ * @self: a #SlFlagTable
+ * @id: an identifier from sl_flag_table_insert()
+ *
+ * Gets the flags for @id.
+ *
+ * Returns: (transfer none): a %NULL terminated vector of flags
+ */
+const gchar * const *
+sl_flag_table_lookup (SlFlagTable *self,
+                      guint        id)
+{
+  const gchar * const *ret;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  g_mutex_lock (&self->mutex);
+  ret = (id < self->sets->len) ? g_ptr_array_index (self->sets, id) : NULL;
+  g_mutex_unlock (&self->mutex);
+
+  g_return_val_if_fail (ret != NULL, NULL);
+
+  return ret;
+}
+
+/**
+ * sl_flag_table_get_size:
+ * @self: a #SlFlagTable
+ *
+ * Returns: the number of distinct flag sets in @self
+ */
+guint
+sl_flag_table_get_size (SlFlagTable *self)
+{
+  guint ret;
+
+  g_return_val_if_fail (self != NULL, 0);
+
+  g_mutex_lock (&self->mutex);
+  ret = self->sets->len;
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
@@ -0,0 +1,42 @@
+/* sl-flag-table.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_FLAG_TABLE_H
+#define SL_FLAG_TABLE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SlFlagTable SlFlagTable;
+
+SlFlagTable         *sl_flag_table_get_default (void);
+SlFlagTable         *sl_flag_table_new         (void);
+void                 sl_flag_table_free        (SlFlagTable         *self);
+guint                sl_flag_table_insert      (SlFlagTable         *self,
+                                                const gchar * const *flags,
+                                                guint                n_flags);
+const gchar * const *sl_flag_table_lookup      (SlFlagTable         *self,
+                                                guint                id);
+guint                sl_flag_table_get_size    (SlFlagTable         *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SlFlagTable, sl_flag_table_free)
+
+G_END_DECLS
+
+#endif /* SL_FLAG_TABLE_H */
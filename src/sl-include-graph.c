@@ -0,0 +1,517 @@
+/* sl-include-graph.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-include-graph"
+
+#include <string.h>
+
+#include "sl-file-info.h"
+#include "sl-include-graph.h"
+
+/*
+ * The include graph of every translation unit parsed, with --include-graph
+ * and --header-costs. Each file is a node and each file it was seen to
+ * include is an edge, merged over every unit whatever its flags.
+ *
+ * libclang only times a parse as a whole, so each header is charged a share
+ * of the parse time of every unit including it, in proportion to its size
+ * among the files of that unit. Preprocessing and parsing take about as long
+ * as there is text, and a header included everywhere adds up quickly.
+ */
+struct _SlIncludeGraph
+{
+  GMutex        mutex;
+  GStringChunk *strings;
+
+  /* Path to the index of its node + 1 */
+  GHashTable   *ids;
+  GArray       *nodes;
+  guint         n_units;
+
+  /* Bumped for every unit added and every file walked from */
+  guint         generation;
+};
+
+typedef struct
+{
+  const gchar *path;
+  guint64      size;
+
+  /* With everything it includes, directly or not, each file once */
+  guint64      total_size;
+
+  /* The parse time charged to it, in microseconds */
+  gint64       cost;
+
+  /* Units including it, and files seen including it directly */
+  guint        n_units;
+  guint        n_includers;
+
+  /* Indexes of the files it includes directly */
+  GArray      *includes;
+
+  /* The last unit or walk which reached it */
+  guint        generation;
+} Node;
+
+static void
+clear_node (gpointer data)
+{
+  Node *node = data;
+
+  g_array_unref (node->includes);
+}
+
+/**
+ * sl_include_graph_new:
+ *
+ * Creates an empty include graph. Units may be added to it from any thread.
+ *
+ * Returns: (transfer full): a new #SlIncludeGraph
+ */
+SlIncludeGraph *
+sl_include_graph_new (void)
+{
+  SlIncludeGraph *self;
+
+  self = g_slice_new0 (SlIncludeGraph);
+  g_mutex_init (&self->mutex);
+  self->strings = g_string_chunk_new (4096);
+  self->ids = g_hash_table_new (g_str_hash, g_str_equal);
+  self->nodes = g_array_new (FALSE, FALSE, sizeof (Node));
+  g_array_set_clear_func (self->nodes, clear_node);
+
+  return self;
+}
+
+void
+sl_include_graph_free (SlIncludeGraph *self)
+{
+  if (self != NULL)
+    {
+      g_hash_table_unref (self->ids);
+      g_array_unref (self->nodes);
+      g_string_chunk_free (self->strings);
+      g_mutex_clear (&self->mutex);
+      g_slice_free (SlIncludeGraph, self);
+    }
+}
+
+static inline Node *
+get_node (SlIncludeGraph *self,
+          guint           id)
+{
+  return &g_array_index (self->nodes, Node, id);
+}
+
+static guint
+lookup_node (SlIncludeGraph *self,
+             const gchar    *path)
+{
+  SlFileInfo info;
+  Node node = { 0 };
+  guint id;
+
+  g_assert (self != NULL);
+  g_assert (path != NULL);
+
+  if (0 != (id = GPOINTER_TO_UINT (g_hash_table_lookup (self->ids, path))))
+    return id - 1;
+
+  node.path = g_string_chunk_insert_const (self->strings, path);
+  node.includes = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  if (sl_file_info_get (path, FALSE, &info))
+    node.size = info.size;
+
+  id = self->nodes->len;
+  g_array_append_val (self->nodes, node);
+  g_hash_table_insert (self->ids, (gchar *)node.path, GUINT_TO_POINTER (id + 1));
+
+  return id;
+}
+
+static void
+add_edge (SlIncludeGraph *self,
+          guint           includer,
+          guint           included)
+{
+  GArray *includes = get_node (self, includer)->includes;
+  guint i;
+
+  g_assert (self != NULL);
+
+  for (i = 0; i < includes->len; i++)
+    {
+      if (g_array_index (includes, guint, i) == included)
+        return;
+    }
+
+  g_array_append_val (includes, included);
+  get_node (self, included)->n_includers++;
+}
+
+/**
+ * sl_include_graph_add_unit:
+ * @self: a #SlIncludeGraph
+ * @filename: the translation unit
+ * @inclusions: (array zero-terminated=1): pairs of an including file and
+ *   the file it includes
+ * @parse_time: how long parsing @filename took, in microseconds
+ *
+ * Adds the includes of a translation unit to the graph, and charges the
+ * files it includes with their share of @parse_time.
+ */
+void
+sl_include_graph_add_unit (SlIncludeGraph      *self,
+                           const gchar         *filename,
+                           const gchar * const *inclusions,
+                           gint64               parse_time)
+{
+  g_autoptr(GArray) headers = NULL;
+  guint64 total;
+  guint unit;
+  guint i;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (filename != NULL);
+  g_return_if_fail (inclusions != NULL);
+
+  headers = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  g_mutex_lock (&self->mutex);
+
+  self->n_units++;
+  self->generation++;
+
+  unit = lookup_node (self, filename);
+  get_node (self, unit)->generation = self->generation;
+  total = get_node (self, unit)->size;
+
+  for (i = 0; inclusions[i] != NULL && inclusions[i + 1] != NULL; i += 2)
+    {
+      guint includer = lookup_node (self, inclusions[i]);
+      guint included = lookup_node (self, inclusions[i + 1]);
+      Node *node;
+
+      add_edge (self, includer, included);
+
+      node = get_node (self, included);
+
+      if (node->generation != self->generation)
+        {
+          node->generation = self->generation;
+          node->n_units++;
+          total += node->size;
+          g_array_append_val (headers, included);
+        }
+    }
+
+  for (i = 0; i < headers->len && total > 0; i++)
+    {
+      Node *node = get_node (self, g_array_index (headers, guint, i));
+
+      node->cost += parse_time * node->size / total;
+    }
+
+  g_mutex_unlock (&self->mutex);
+}
+
+/* Walks from every header to sum the size of what it pulls in */
+static void
+update_total_sizes (SlIncludeGraph *self)
+{
+  g_autoptr(GArray) stack = NULL;
+  guint i;
+  guint j;
+
+  g_assert (self != NULL);
+
+  stack = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  for (i = 0; i < self->nodes->len; i++)
+    {
+      Node *header = get_node (self, i);
+
+      header->total_size = 0;
+
+      if (header->n_units == 0)
+        continue;
+
+      header->generation = ++self->generation;
+      g_array_append_val (stack, i);
+
+      while (stack->len > 0)
+        {
+          Node *node = get_node (self, g_array_index (stack, guint, stack->len - 1));
+
+          g_array_set_size (stack, stack->len - 1);
+          header->total_size += node->size;
+
+          for (j = 0; j < node->includes->len; j++)
+            {
+              guint id = g_array_index (node->includes, guint, j);
+              Node *included = get_node (self, id);
+
+              if (included->generation != self->generation)
+                {
+                  included->generation = self->generation;
+                  g_array_append_val (stack, id);
+                }
+            }
+        }
+    }
+}
+
+static gint
+compare_cost (gconstpointer a,
+              gconstpointer b,
+              gpointer      user_data)
+{
+  SlIncludeGraph *self = user_data;
+  const Node *node_a = get_node (self, *(const guint *)a);
+  const Node *node_b = get_node (self, *(const guint *)b);
+
+  if (node_a->cost > node_b->cost)
+    return -1;
+  else if (node_a->cost < node_b->cost)
+    return 1;
+
+  return strcmp (node_a->path, node_b->path);
+}
+
+/* The index of every header, the most costly first */
+static GArray *
+rank_headers (SlIncludeGraph *self)
+{
+  GArray *ranked;
+  guint i;
+
+  g_assert (self != NULL);
+
+  ranked = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  for (i = 0; i < self->nodes->len; i++)
+    {
+      if (get_node (self, i)->n_units > 0)
+        g_array_append_val (ranked, i);
+    }
+
+  g_array_sort_with_data (ranked, compare_cost, self);
+
+  return ranked;
+}
+
+/**
+ * sl_include_graph_format_report:
+ * @self: a #SlIncludeGraph
+ * @max_headers: how many headers to list
+ *
+ * Lists the @max_headers headers costing the most parse time, with how
+ * many units include them and how much they pull in.
+ *
+ * Returns: (transfer full): the formatted report
+ */
+GString *
+sl_include_graph_format_report (SlIncludeGraph *self,
+                                guint           max_headers)
+{
+  g_autoptr(GArray) ranked = NULL;
+  GString *str;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  update_total_sizes (self);
+  ranked = rank_headers (self);
+
+  str = g_string_new (NULL);
+  g_string_append_printf (str, "%u headers included by %u translation units\n\n",
+                          ranked->len, self->n_units);
+  g_string_append_printf (str, "%12s %8s %10s %12s  %s\n",
+                          "Cost (ms)", "Units", "Size (KB)", "Total (KB)", "Costliest headers");
+
+  for (i = 0; i < ranked->len && i < max_headers; i++)
+    {
+      const Node *node = get_node (self, g_array_index (ranked, guint, i));
+
+      g_string_append_printf (str, "%12.1f %8u %10.1f %12.1f  %s\n",
+                              (gdouble)node->cost / 1000.0,
+                              node->n_units,
+                              node->size / 1024.0,
+                              node->total_size / 1024.0,
+                              node->path);
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  return str;
+}
+
+static void
+append_quoted (GString     *str,
+               const gchar *value)
+{
+  g_string_append_c (str, '"');
+
+  for (; *value != '\0'; value++)
+    {
+      guchar c = *value;
+
+      if (c == '"' || c == '\\')
+        {
+          g_string_append_c (str, '\\');
+          g_string_append_c (str, c);
+        }
+      else if (c < 0x20)
+        g_string_append_printf (str, "\\u%04x", c);
+      else
+        g_string_append_c (str, c);
+    }
+
+  g_string_append_c (str, '"');
+}
+
+/* Nodes are labelled with the file name, and headers with their cost */
+static GString *
+format_dot (SlIncludeGraph *self)
+{
+  GString *str;
+  guint i;
+  guint j;
+
+  g_assert (self != NULL);
+
+  str = g_string_new ("digraph includes {\n");
+
+  for (i = 0; i < self->nodes->len; i++)
+    {
+      const Node *node = get_node (self, i);
+      g_autofree gchar *basename = g_path_get_basename (node->path);
+      g_autofree gchar *label = NULL;
+
+      if (node->n_units > 0)
+        label = g_strdup_printf ("%s (%.1f ms)", basename, (gdouble)node->cost / 1000.0);
+
+      g_string_append_printf (str, "  n%u [label=", i);
+      append_quoted (str, label != NULL ? label : basename);
+      g_string_append (str, ", tooltip=");
+      append_quoted (str, node->path);
+      g_string_append (str, "];\n");
+    }
+
+  for (i = 0; i < self->nodes->len; i++)
+    {
+      const Node *node = get_node (self, i);
+
+      for (j = 0; j < node->includes->len; j++)
+        g_string_append_printf (str, "  n%u -> n%u;\n", i, g_array_index (node->includes, guint, j));
+    }
+
+  g_string_append (str, "}\n");
+
+  return str;
+}
+
+/* Files are listed once, and includes refer to them by their index */
+static GString *
+format_json (SlIncludeGraph *self)
+{
+  GString *str;
+  gboolean first = TRUE;
+  guint i;
+  guint j;
+
+  g_assert (self != NULL);
+
+  str = g_string_new ("{\n  \"files\": [\n");
+
+  for (i = 0; i < self->nodes->len; i++)
+    {
+      const Node *node = get_node (self, i);
+
+      g_string_append (str, "    { \"path\": ");
+      append_quoted (str, node->path);
+      g_string_append_printf (str,
+                              ", \"size\": %" G_GUINT64_FORMAT
+                              ", \"total_size\": %" G_GUINT64_FORMAT
+                              ", \"units\": %u, \"includers\": %u, \"cost\": %.6f }%s\n",
+                              node->size,
+                              node->total_size,
+                              node->n_units,
+                              node->n_includers,
+                              (gdouble)node->cost / G_USEC_PER_SEC,
+                              i + 1 < self->nodes->len ? "," : "");
+    }
+
+  g_string_append (str, "  ],\n  \"includes\": [");
+
+  for (i = 0; i < self->nodes->len; i++)
+    {
+      const Node *node = get_node (self, i);
+
+      for (j = 0; j < node->includes->len; j++)
+        {
+          g_string_append_printf (str, "%s\n    [%u, %u]",
+                                  first ? "" : ",",
+                                  i, g_array_index (node->includes, guint, j));
+          first = FALSE;
+        }
+    }
+
+  g_string_append (str, "\n  ]\n}\n");
+
+  return str;
+}
+
+/**
+ * sl_include_graph_save:
+ * @self: a #SlIncludeGraph
+ * @filename: the file to write
+ * @error: a location for a #GError, or %NULL
+ *
+ * Writes the graph to @filename, as JSON if it ends with ".json" and as a
+ * dot graph otherwise.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+sl_include_graph_save (SlIncludeGraph  *self,
+                       const gchar     *filename,
+                       GError         **error)
+{
+  g_autoptr(GString) str = NULL;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  g_mutex_lock (&self->mutex);
+
+  update_total_sizes (self);
+
+  if (g_str_has_suffix (filename, ".json"))
+    str = format_json (self);
+  else
+    str = format_dot (self);
+
+  g_mutex_unlock (&self->mutex);
+
+  return g_file_set_contents (filename, str->str, str->len, error);
+}
@@ -0,0 +1,43 @@
+/* sl-include-graph.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SL_INCLUDE_GRAPH_H
+#define SL_INCLUDE_GRAPH_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SlIncludeGraph SlIncludeGraph;
+
+SlIncludeGraph *sl_include_graph_new           (void);
+void            sl_include_graph_free          (SlIncludeGraph       *self);
+void            sl_include_graph_add_unit      (SlIncludeGraph       *self,
+                                                const gchar          *filename,
+                                                const gchar * const  *inclusions,
+                                                gint64                parse_time);
+GString        *sl_include_graph_format_report (SlIncludeGraph       *self,
+                                                guint                 max_headers);
+gboolean        sl_include_graph_save          (SlIncludeGraph       *self,
+                                                const gchar          *filename,
+                                                GError              **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SlIncludeGraph, sl_include_graph_free)
+
+G_END_DECLS
+
+#endif /* SL_INCLUDE_GRAPH_H */
@@ -0,0 +1,393 @@
+/* sl-json-reader.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-json-reader"
+
+#include <string.h>
+
+#include "sl-json-reader.h"
+
+/*
+ * A pull reader for JSON documents which may be far larger than we would
+ * like to hold as a tree, such as the compile_commands.json of a large
+ * project. Tokens are read one at a time from the buffer; strings without
+ * escapes are returned as slices of the buffer.
+ *
+ * The reader does not validate structure. Commas and colons are treated
+ * as separators, so callers are expected to know that within an object
+ * strings alternate between member names and values.
+ */
+
+/**
+ * sl_json_reader_init:
+ * @reader: an uninitialized #SlJsonReader
+ * @data: the JSON document
+ * @len: the length of @data in bytes
+ *
+ * Initializes @reader to read @data, which is not copied. Call
+ * sl_json_reader_clear() when done.
+ */
+void
+sl_json_reader_init (SlJsonReader *reader,
+                     const gchar  *data,
+                     gsize         len)
+{
+  g_return_if_fail (reader != NULL);
+  g_return_if_fail (data != NULL || len == 0);
+
+  reader->data = data;
+  reader->len = len;
+  reader->pos = 0;
+  reader->scratch = NULL;
+}
+
+void
+sl_json_reader_clear (SlJsonReader *reader)
+{
+  g_return_if_fail (reader != NULL);
+
+  if (reader->scratch != NULL)
+    {
+      g_string_free (reader->scratch, TRUE);
+      reader->scratch = NULL;
+    }
+}
+
+/**
+ * sl_json_reader_get_offset:
+ * @reader: a #SlJsonReader
+ *
+ * Gets the offset of the reader within the document, for error messages.
+ *
+ * Returns: an offset in bytes
+ */
+gsize
+sl_json_reader_get_offset (SlJsonReader *reader)
+{
+  g_return_val_if_fail (reader != NULL, 0);
+
+  return reader->pos;
+}
+
+static gint
+hex_value (gchar c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+static gboolean
+read_hex4 (const gchar *p,
+           const gchar *end,
+           gunichar    *out)
+{
+  gunichar value = 0;
+  guint i;
+
+  if (end - p < 4)
+    return FALSE;
+
+  for (i = 0; i < 4; i++)
+    {
+      gint digit = hex_value (p[i]);
+
+      if (digit < 0)
+        return FALSE;
+
+      value = (value << 4) | digit;
+    }
+
+  *out = value;
+
+  return TRUE;
+}
+
+/* Decodes the escaped string between @p and @end (exclusive of quotes) */
+static gboolean
+unescape (const gchar *p,
+          const gchar *end,
+          GString     *out)
+{
+  while (p < end)
+    {
+      const gchar *bs = memchr (p, '\\', end - p);
+      gunichar ch;
+
+      if (bs == NULL)
+        {
+          g_string_append_len (out, p, end - p);
+          break;
+        }
+
+      g_string_append_len (out, p, bs - p);
+      p = bs + 1;
+
+      if (p >= end)
+        return FALSE;
+
+      switch (*p++)
+        {
+        case '"': g_string_append_c (out, '"'); break;
+        case '\\': g_string_append_c (out, '\\'); break;
+        case '/': g_string_append_c (out, '/'); break;
+        case 'b': g_string_append_c (out, '\b'); break;
+        case 'f': g_string_append_c (out, '\f'); break;
+        case 'n': g_string_append_c (out, '\n'); break;
+        case 'r': g_string_append_c (out, '\r'); break;
+        case 't': g_string_append_c (out, '\t'); break;
+
+        case 'u':
+          if (!read_hex4 (p, end, &ch))
+            return FALSE;
+          p += 4;
+
+          /* Characters outside the BMP are written as a surrogate pair */
+          if (ch >= 0xD800 && ch < 0xDC00)
+            {
+              gunichar low;
+
+              if (end - p < 6 || p[0] != '\\' || p[1] != 'u' ||
+                  !read_hex4 (p + 2, end, &low) || low < 0xDC00 || low > 0xDFFF)
+                return FALSE;
+
+              p += 6;
+              ch = 0x10000 + ((ch - 0xD800) << 10) + (low - 0xDC00);
+            }
+
+          g_string_append_unichar (out, ch);
+          break;
+
+        default:
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+static SlJsonToken
+read_string (SlJsonReader  *reader,
+             const gchar  **value,
+             gsize         *value_len)
+{
+  const gchar *start = reader->data + reader->pos + 1;
+  const gchar *end = reader->data + reader->len;
+  const gchar *p = start;
+
+  for (;;)
+    {
+      const gchar *q = memchr (p, '"', end - p);
+      const gchar *bs;
+
+      if (q == NULL)
+        return SL_JSON_ERROR;
+
+      /* The quote is escaped if preceded by an odd number of backslashes */
+      for (bs = q; bs > start && bs[-1] == '\\'; bs--) { }
+
+      if (((q - bs) & 1) == 0)
+        {
+          p = q;
+          break;
+        }
+
+      p = q + 1;
+    }
+
+  reader->pos = p + 1 - reader->data;
+
+  if (memchr (start, '\\', p - start) == NULL)
+    {
+      *value = start;
+      *value_len = p - start;
+      return SL_JSON_STRING;
+    }
+
+  if (reader->scratch == NULL)
+    reader->scratch = g_string_new (NULL);
+
+  g_string_truncate (reader->scratch, 0);
+
+  if (!unescape (start, p, reader->scratch))
+    return SL_JSON_ERROR;
+
+  *value = reader->scratch->str;
+  *value_len = reader->scratch->len;
+
+  return SL_JSON_STRING;
+}
+
+static gboolean
+read_literal (SlJsonReader *reader,
+              const gchar  *literal,
+              gsize         len)
+{
+  if (reader->len - reader->pos < len ||
+      memcmp (reader->data + reader->pos, literal, len) != 0)
+    return FALSE;
+
+  reader->pos += len;
+
+  return TRUE;
+}
+
+/**
+ * sl_json_reader_next:
+ * @reader: a #SlJsonReader
+ * @value: (out) (optional): the value of strings and numbers
+ * @value_len: (out) (optional): the length of @value in bytes
+ *
+ * Reads the next token. For %SL_JSON_STRING and %SL_JSON_NUMBER, @value is
+ * set to the decoded text, which is valid until the next call.
+ *
+ * Returns: the token read, %SL_JSON_END at the end of the document, or
+ *   %SL_JSON_ERROR if the document is malformed.
+ */
+SlJsonToken
+sl_json_reader_next (SlJsonReader  *reader,
+                     const gchar  **value,
+                     gsize         *value_len)
+{
+  const gchar *dummy;
+  gsize dummy_len;
+
+  g_return_val_if_fail (reader != NULL, SL_JSON_ERROR);
+
+  if (value == NULL)
+    value = &dummy;
+  if (value_len == NULL)
+    value_len = &dummy_len;
+
+  while (reader->pos < reader->len)
+    {
+      gchar c = reader->data[reader->pos];
+
+      switch (c)
+        {
+        case ' ': case '\t': case '\n': case '\r': case ',': case ':':
+          reader->pos++;
+          continue;
+
+        case '[':
+          reader->pos++;
+          return SL_JSON_BEGIN_ARRAY;
+
+        case ']':
+          reader->pos++;
+          return SL_JSON_END_ARRAY;
+
+        case '{':
+          reader->pos++;
+          return SL_JSON_BEGIN_OBJECT;
+
+        case '}':
+          reader->pos++;
+          return SL_JSON_END_OBJECT;
+
+        case '"':
+          return read_string (reader, value, value_len);
+
+        case 't':
+          return read_literal (reader, "true", 4) ? SL_JSON_TRUE : SL_JSON_ERROR;
+
+        case 'f':
+          return read_literal (reader, "false", 5) ? SL_JSON_FALSE : SL_JSON_ERROR;
+
+        case 'n':
+          return read_literal (reader, "null", 4) ? SL_JSON_NULL : SL_JSON_ERROR;
+
+        default:
+          if (c == '-' || g_ascii_isdigit (c))
+            {
+              gsize start = reader->pos;
+
+              while (reader->pos < reader->len &&
+                     strchr ("+-.eE0123456789", reader->data[reader->pos]) != NULL)
+                reader->pos++;
+
+              *value = reader->data + start;
+              *value_len = reader->pos - start;
+
+              return SL_JSON_NUMBER;
+            }
+
+          return SL_JSON_ERROR;
+        }
+    }
+
+  return SL_JSON_END;
+}
+
+/**
+ * sl_json_reader_skip_value:
+ * @reader: a #SlJsonReader
+ * @token: the first token of the value
+ *
+ * Skips the remainder of a value whose first token has already been read,
+ * such as a nested object the caller is not interested in.
+ *
+ * Returns: %TRUE if successful; %FALSE if the document is malformed.
+ */
+gboolean
+sl_json_reader_skip_value (SlJsonReader *reader,
+                           SlJsonToken   token)
+{
+  guint depth = 0;
+
+  g_return_val_if_fail (reader != NULL, FALSE);
+
+  for (;;)
+    {
+      switch (token)
+        {
+        case SL_JSON_BEGIN_ARRAY:
+        case SL_JSON_BEGIN_OBJECT:
+          depth++;
+          break;
+
+        case SL_JSON_END_ARRAY:
+        case SL_JSON_END_OBJECT:
+          if (depth == 0)
+            return FALSE;
+          depth--;
+          break;
+
+        case SL_JSON_ERROR:
+        case SL_JSON_END:
+          return FALSE;
+
+        case SL_JSON_STRING:
+        case SL_JSON_NUMBER:
+        case SL_JSON_TRUE:
+        case SL_JSON_FALSE:
+        case SL_JSON_NULL:
+        default:
+          break;
+        }
+
+      if (depth == 0)
+        return TRUE;
+
+      token = sl_json_reader_next (reader, NULL, NULL);
+    }
+}
@@ -0,0 +1,63 @@
+/* sl-json-reader.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_JSON_READER_H
+#define SL_JSON_READER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  SL_JSON_ERROR,
+  SL_JSON_END,
+  SL_JSON_BEGIN_ARRAY,
+  SL_JSON_END_ARRAY,
+  SL_JSON_BEGIN_OBJECT,
+  SL_JSON_END_OBJECT,
+  SL_JSON_STRING,
+  SL_JSON_NUMBER,
+  SL_JSON_TRUE,
+  SL_JSON_FALSE,
+  SL_JSON_NULL,
+} SlJsonToken;
+
+typedef struct
+{
+  /*< private >*/
+  const gchar *data;
+  gsize        len;
+  gsize        pos;
+  GString     *scratch;
+} SlJsonReader;
+
+void         sl_json_reader_init       (SlJsonReader  *reader,
+                                        const gchar   *data,
+                                        gsize          len);
+void         sl_json_reader_clear      (SlJsonReader  *reader);
+SlJsonToken  sl_json_reader_next       (SlJsonReader  *reader,
+                                        const gchar  **value,
+                                        gsize         *value_len);
+gboolean     sl_json_reader_skip_value (SlJsonReader  *reader,
+                                        SlJsonToken    token);
+gsize        sl_json_reader_get_offset (SlJsonReader  *reader);
+
+G_END_DECLS
+
+#endif /* SL_JSON_READER_H */
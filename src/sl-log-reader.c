@@ -19,16 +19,117 @@
 #define _GNU_SOURCE
 #define G_LOG_DOMAIN "sl-log-reader"
 
+#include <gio/gunixinputstream.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
-#include "sl-line-reader.h"
+#include "sl-flag-table.h"
+#include "sl-json-reader.h"
 #include "sl-log-reader.h"
+#include "sl-read-ahead.h"
+#include "sl-scanner.h"
+#include "sl-tokenizer.h"
+#include "sl-toolchain.h"
+#include "sl-xz-decompressor.h"
+
+/* Amount of a mapped log to scan before releasing the pages */
+#define WINDOW_SIZE (64 * 1024 * 1024)
+
+/* Don't bother splitting buffers into pieces smaller than this */
+#define MIN_SEGMENT_SIZE (1024 * 1024)
+
+/*
+ * Reusable storage for the arguments of a command, so that parsing a
+ * command only allocates when it needs more room than any before it.
+ */
+typedef struct
+{
+  GString     *strings;
+  GArray      *offsets;
+  GPtrArray   *argv;
+
+  /* The compiler of the last command and its toolchain */
+  GString           *compiler;
+  const SlToolchain *toolchain;
+} ArgvBuilder;
 
 struct _SlLogReader
 {
-  GObject  parent_instance;
-  gchar   *clang_include_path;
+  GObject     parent_instance;
+  const gchar *clang_include_path;
+
+  /*
+   * Directories entered but not yet left, in the order they were entered.
+   * With make -j, recursive makes run concurrently and their messages
+   * interleave, so a "Leaving directory" does not necessarily refer to
+   * the most recently entered one.
+   */
+  GArray     *directories;
+
+  /* Set of every directory path seen, so events can share them */
+  GHashTable *paths;
+
+  guint       n_threads;
+
+  /* Used when scanning serially, segments have their own */
+  ArgvBuilder argv;
+
+  gboolean    collect_stats;
+  SlLogReaderStats stats;
+};
+
+typedef struct
+{
+  guint        level;
+  const gchar *path;
+} DirectoryEntry;
+
+typedef enum
+{
+  COMPRESSION_NONE,
+  COMPRESSION_GZIP,
+  COMPRESSION_XZ,
+} Compression;
+
+typedef struct
+{
+  SlScanKind   kind;
+  guint        level;
+  const gchar *match;
+  gsize        match_len;
+  const gchar *subdir;
+} ScanEvent;
+
+typedef struct
+{
+  const gchar *subdir;
+  guint        flags;
+  GPtrArray   *filenames;
+} ParsedCommand;
+
+typedef struct
+{
+  SlLogReader *self;
+  const gchar *data;
+  gsize        len;
+  GArray      *events;
+  GPtrArray   *commands;
+  ArgvBuilder  argv;
+
+  /* Only with statistics, added to those of the reader once joined */
+  guint64      n_lines;
+  SlStatsTime  scan;
+  SlStatsTime  arguments;
+} Segment;
+
+enum {
+  PROP_0,
+  PROP_N_THREADS,
+  PROP_COLLECT_STATS,
+  N_PROPS
 };
 
 enum {
@@ -36,42 +137,133 @@ enum {
   N_SIGNALS
 };
 
+static GParamSpec *properties [N_PROPS];
 static guint signals [N_SIGNALS];
 
 G_DEFINE_TYPE (SlLogReader, sl_log_reader, G_TYPE_OBJECT)
 
-static inline gboolean
-str_empty0 (const gchar *str)
+static void
+argv_builder_init (ArgvBuilder *builder)
 {
-  return !str || !*str;
+  builder->strings = g_string_new (NULL);
+  builder->offsets = g_array_new (FALSE, FALSE, sizeof (gsize));
+  builder->argv = g_ptr_array_new ();
+  builder->compiler = g_string_new (NULL);
+  builder->toolchain = NULL;
 }
 
 static void
-sl_log_reader_discover_clang_include_path (SlLogReader *self)
+argv_builder_clear (ArgvBuilder *builder)
 {
-  g_autoptr(GSubprocess) subprocess = NULL;
-  g_autofree gchar *stdoutstr = NULL;
+  if (builder->strings != NULL)
+    {
+      g_string_free (builder->strings, TRUE);
+      builder->strings = NULL;
+    }
 
-  g_assert (SL_IS_LOG_READER (self));
-  g_assert (self->clang_include_path == NULL);
+  if (builder->compiler != NULL)
+    {
+      g_string_free (builder->compiler, TRUE);
+      builder->compiler = NULL;
+    }
+
+  g_clear_pointer (&builder->offsets, g_array_unref);
+  g_clear_pointer (&builder->argv, g_ptr_array_unref);
+}
+
+static void
+argv_builder_reset (ArgvBuilder *builder)
+{
+  g_string_truncate (builder->strings, 0);
+  g_array_set_size (builder->offsets, 0);
+  g_ptr_array_set_size (builder->argv, 0);
+}
+
+/* Starts a new argument */
+static void
+argv_builder_add (ArgvBuilder *builder,
+                  const gchar *str,
+                  gsize        len)
+{
+  gsize offset;
+
+  /* Arguments are separated by the nul terminating the previous one */
+  if (builder->offsets->len > 0)
+    g_string_append_c (builder->strings, '\0');
+
+  offset = builder->strings->len;
+  g_array_append_val (builder->offsets, offset);
+  g_string_append_len (builder->strings, str, len);
+}
+
+/* Appends to the most recently added argument */
+static void
+argv_builder_extend (ArgvBuilder *builder,
+                     const gchar *str,
+                     gsize        len)
+{
+  g_assert (builder->offsets->len > 0);
 
-  subprocess = g_subprocess_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE,
-                                 NULL,
-                                 "clang",
-                                 "-print-file-name=include",
-                                 NULL);
+  g_string_append_len (builder->strings, str, len);
+}
 
-  if (!subprocess ||
-      !g_subprocess_communicate_utf8 (subprocess, NULL, NULL, &stdoutstr, NULL, NULL))
+/* Commands in a log mostly use the same compiler, so the last one is remembered */
+static const SlToolchain *
+argv_builder_get_toolchain (ArgvBuilder *builder,
+                            const gchar *compiler,
+                            gsize        len)
+{
+  if (builder->toolchain == NULL ||
+      builder->compiler->len != len ||
+      memcmp (builder->compiler->str, compiler, len) != 0)
     {
-      g_warning ("Failed to discover clang include path");
-      return;
+      g_string_truncate (builder->compiler, 0);
+      g_string_append_len (builder->compiler, compiler, len);
+      builder->toolchain = sl_toolchain_lookup (compiler, len);
     }
 
-  g_strstrip (stdoutstr);
+  return builder->toolchain;
+}
+
+/* Removes the most recently added argument if it is @str */
+static void
+argv_builder_remove_last_if (ArgvBuilder *builder,
+                             const gchar *str)
+{
+  gsize offset;
 
-  if (!g_str_equal (stdoutstr, "include"))
-    self->clang_include_path = g_strdup_printf ("-I%s", stdoutstr);
+  if (builder->offsets->len == 0)
+    return;
+
+  offset = g_array_index (builder->offsets, gsize, builder->offsets->len - 1);
+
+  if (strcmp (builder->strings->str + offset, str) != 0)
+    return;
+
+  g_string_truncate (builder->strings, offset > 0 ? offset - 1 : 0);
+  g_array_set_size (builder->offsets, builder->offsets->len - 1);
+}
+
+/*
+ * Returns the arguments as a vector of strings, which remain valid until
+ * the builder is next modified.
+ */
+static const gchar * const *
+argv_builder_finish (ArgvBuilder *builder,
+                     guint       *n_args)
+{
+  guint i;
+
+  /* The string may have moved while growing, so pointers are made last */
+  g_ptr_array_set_size (builder->argv, builder->offsets->len);
+
+  for (i = 0; i < builder->offsets->len; i++)
+    g_ptr_array_index (builder->argv, i) =
+      builder->strings->str + g_array_index (builder->offsets, gsize, i);
+
+  *n_args = builder->argv->len;
+
+  return (const gchar * const *)builder->argv->pdata;
 }
 
 static void
@@ -79,7 +271,7 @@ sl_log_reader_constructed (GObject *object)
 {
   SlLogReader *self = (SlLogReader *)object;
 
-  sl_log_reader_discover_clang_include_path (self);
+  self->clang_include_path = sl_toolchain_get_clang_include ();
 
   G_OBJECT_CLASS (sl_log_reader_parent_class)->constructed (object);
 }
@@ -89,11 +281,59 @@ sl_log_reader_finalize (GObject *object)
 {
   SlLogReader *self = (SlLogReader *)object;
 
-  g_clear_pointer (&self->clang_include_path, g_free);
+  g_clear_pointer (&self->directories, g_array_unref);
+  g_clear_pointer (&self->paths, g_hash_table_unref);
+  argv_builder_clear (&self->argv);
 
   G_OBJECT_CLASS (sl_log_reader_parent_class)->finalize (object);
 }
 
+static void
+sl_log_reader_get_property (GObject    *object,
+                            guint       prop_id,
+                            GValue     *value,
+                            GParamSpec *pspec)
+{
+  SlLogReader *self = SL_LOG_READER (object);
+
+  switch (prop_id)
+    {
+    case PROP_N_THREADS:
+      g_value_set_uint (value, self->n_threads);
+      break;
+
+    case PROP_COLLECT_STATS:
+      g_value_set_boolean (value, self->collect_stats);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+sl_log_reader_set_property (GObject      *object,
+                            guint         prop_id,
+                            const GValue *value,
+                            GParamSpec   *pspec)
+{
+  SlLogReader *self = SL_LOG_READER (object);
+
+  switch (prop_id)
+    {
+    case PROP_N_THREADS:
+      sl_log_reader_set_n_threads (self, g_value_get_uint (value));
+      break;
+
+    case PROP_COLLECT_STATS:
+      sl_log_reader_set_collect_stats (self, g_value_get_boolean (value));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
 static void
 sl_log_reader_class_init (SlLogReaderClass *klass)
 {
@@ -101,300 +341,1139 @@ sl_log_reader_class_init (SlLogReaderClass *klass)
 
   object_class->constructed = sl_log_reader_constructed;
   object_class->finalize = sl_log_reader_finalize;
+  object_class->get_property = sl_log_reader_get_property;
+  object_class->set_property = sl_log_reader_set_property;
+
+  properties [PROP_N_THREADS] =
+    g_param_spec_uint ("n-threads",
+                       "Threads",
+                       "The number of threads used to scan large logs",
+                       1, G_MAXUINT, 1,
+                       (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_COLLECT_STATS] =
+    g_param_spec_boolean ("collect-stats",
+                          "Collect Stats",
+                          "Whether to count lines and time scanning and parsing commands",
+                          FALSE,
+                          (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_properties (object_class, N_PROPS, properties);
 
   signals [FLAGS_EXTRACTED] =
     g_signal_new ("flags-extracted",
                   G_TYPE_FROM_CLASS (klass),
                   G_SIGNAL_RUN_LAST,
                   0, NULL, NULL, NULL,
-                  G_TYPE_NONE, 3, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRV);
+                  G_TYPE_NONE,
+                  3,
+                  G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                  G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                  G_TYPE_UINT);
 }
 
 static void
 sl_log_reader_init (SlLogReader *self)
 {
+  self->n_threads = 1;
+  self->directories = g_array_new (FALSE, FALSE, sizeof (DirectoryEntry));
+  self->paths = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  argv_builder_init (&self->argv);
 }
 
+/*
+ * Relative paths in the log are relative to the directory make was in,
+ * but clang resolves them relative to the working directory.
+ */
 static void
-sl_log_reader_parse_c_cxx_include (SlLogReader  *self,
-                                   GPtrArray    *ret,
-                                   const gchar  *part1,
-                                   const gchar  *part2,
-                                   const gchar  *subdir)
-{
-  static const gchar *dummy = "-I";
-  g_autofree gchar *adjusted = NULL;
-
-  g_assert (self != NULL);
-  g_assert (ret != NULL);
-  g_assert (part1 != NULL);
-  g_assert (subdir != NULL);
-
-  /*
-   * We will get parts either like ("-Ifoo", NULL) or ("-I", "foo").
-   * Canonicalize things so we are always dealing with something that looks
-   * like ("-I", "foo") since we might need to mutate the path.
-   */
-
-  if (part2 == NULL)
+argv_builder_extend_path (ArgvBuilder *builder,
+                          const gchar *subdir,
+                          const gchar *path,
+                          gsize        len)
+{
+  if (len == 0 || path[0] != '/')
     {
-      g_assert (strlen (part1) > 2);
-      part2 = &part1 [2];
-      part1 = dummy;
+      argv_builder_extend (builder, subdir, strlen (subdir));
+      if (!g_str_has_suffix (subdir, "/"))
+        argv_builder_extend (builder, "/", 1);
     }
 
-  g_assert (!str_empty0 (part1));
-  g_assert (!str_empty0 (part2));
+  argv_builder_extend (builder, path, len);
+}
 
-  /*
-   * If the path is relative, then we need to adjust it to be relative to the
-   * target file rather than relative to the makefile. Clang expects the
-   * path information to be as such.
-   */
+static gchar *
+build_source_path (const gchar *subdir,
+                   const gchar *path,
+                   gsize        len)
+{
+  if (path[0] == '/')
+    return g_strndup (path, len);
 
-  if (!g_path_is_absolute (part2))
-    {
-      adjusted = g_build_filename (subdir, part2, NULL);
-      part2 = adjusted;
-    }
+  return g_strdup_printf ("%s%s%.*s",
+                          subdir,
+                          g_str_has_suffix (subdir, "/") ? "" : "/",
+                          (gint)len, path);
+}
+
+static gboolean
+is_compiler (const gchar *word,
+             gsize        len)
+{
+  g_autofree gchar *copy = NULL;
+  const gchar *base;
 
-  g_ptr_array_add (ret, g_strdup_printf ("%s%s", part1, part2));
+  if (len == 0 || word[0] == '-')
+    return FALSE;
+
+  copy = g_strndup (word, len);
+  base = strrchr (copy, '/') ? strrchr (copy, '/') + 1 : copy;
+
+  return strstr (base, "gcc") != NULL ||
+         strstr (base, "g++") != NULL ||
+         strstr (base, "clang") != NULL ||
+         g_str_equal (base, "cc") ||
+         g_str_equal (base, "c++");
 }
 
 static void
 sl_log_reader_parse_c_cxx (SlLogReader *self,
-                           const gchar *line,
+                           const gchar *command,
+                           gsize        len,
                            const gchar *subdir,
                            GPtrArray   *filenames,
-                           GPtrArray   *ret)
+                           ArgvBuilder *argv)
 {
-  g_auto(GStrv) argv = NULL;
-  g_autoptr(GError) error = NULL;
-  gboolean in_expand = FALSE;
-  gsize i;
-  gint argc = 0;
+  const SlToolchain *toolchain = NULL;
+  SlTokenizer tokenizer;
+  SlToken token;
+  gboolean in_prefix = TRUE;
 
-  g_assert (line != NULL);
-  g_assert (ret != NULL);
+  g_assert (command != NULL);
   g_assert (subdir != NULL);
   g_assert (filenames != NULL);
-  g_assert (ret != NULL);
+  g_assert (argv != NULL);
 
-  while (g_ascii_isspace (*line))
-    line++;
+  if (self->clang_include_path != NULL)
+    argv_builder_add (argv, self->clang_include_path, strlen (self->clang_include_path));
 
-  if (!g_shell_parse_argv (line, &argc, &argv, &error))
-    {
-      /* TODO: Line might have ended with \, or inside a ( */
-      g_debug ("Incomplete command: %s\n", error->message);
-      return;
-    }
-
-  g_ptr_array_add (ret, g_strdup (self->clang_include_path));
+  sl_tokenizer_init (&tokenizer, command, len);
 
-  for (i = 0; argv[i]; i++)
+  while (sl_tokenizer_next (&tokenizer, &token))
     {
-      const gchar *flag = argv [i];
-      const gchar *dot;
-      const gchar *tick;
+      /* The compiler comes first, or after libtool and its options */
+      if (in_prefix && token.kind == SL_TOKEN_OTHER && is_compiler (token.value, token.value_len))
+        {
+          toolchain = argv_builder_get_toolchain (argv, token.value, token.value_len);
+          in_prefix = FALSE;
+          continue;
+        }
 
-    try_again:
+      in_prefix = in_prefix && token.kind == SL_TOKEN_OTHER;
 
-      if (NULL != (tick = strchr (flag, '`')))
+      switch (token.kind)
         {
-          in_expand = !in_expand;
+        case SL_TOKEN_SOURCE:
+          g_ptr_array_add (filenames, build_source_path (subdir, token.value, token.value_len));
+          break;
 
-          if (!in_expand)
+        case SL_TOKEN_INCLUDE: /* -I./includes/ -I ./includes/ */
+          if (token.value_len > 2)
+            {
+              argv_builder_add (argv, "-I", 2);
+              argv_builder_extend_path (argv, subdir, token.value + 2, token.value_len - 2);
+            }
+          else if (sl_tokenizer_next (&tokenizer, &token) && token.value_len > 0)
             {
-              flag = ++tick;
-              goto try_again;
+              argv_builder_add (argv, "-I", 2);
+              argv_builder_extend_path (argv, subdir, token.value, token.value_len);
             }
 
-          continue;
+          /* Commands we exported ourselves already contain it */
+          if (self->clang_include_path != NULL)
+            argv_builder_remove_last_if (argv, self->clang_include_path);
+          break;
+
+        case SL_TOKEN_SYSTEM_INCLUDE: /* -isystem/usr/include/foo -idirafter ./include */
+          {
+            const gchar *prefix = token.value[2] == 's' ? "-isystem" : "-idirafter";
+            gsize prefix_len = strlen (prefix);
+
+            if (token.value_len > prefix_len)
+              {
+                argv_builder_add (argv, prefix, prefix_len);
+                argv_builder_extend_path (argv, subdir, token.value + prefix_len, token.value_len - prefix_len);
+              }
+            else if (sl_tokenizer_next (&tokenizer, &token) && token.value_len > 0)
+              {
+                argv_builder_add (argv, prefix, prefix_len);
+                argv_builder_extend_path (argv, subdir, token.value, token.value_len);
+              }
+          }
+          break;
+
+        case SL_TOKEN_FLAG: /* -fPIC -Werror -m64 -pthread */
+        case SL_TOKEN_STD: /* -std=gnu11 */
+          argv_builder_add (argv, token.value, token.value_len);
+          break;
+
+        case SL_TOKEN_DEFINE: /* -Dfoo -D foo */
+        case SL_TOKEN_LANGUAGE: /* -xc++ -x c++ */
+          argv_builder_add (argv, token.value, token.value_len);
+          if (token.value_len == 2 && sl_tokenizer_next (&tokenizer, &token))
+            argv_builder_add (argv, token.value, token.value_len);
+          break;
+
+        case SL_TOKEN_OTHER:
+        case SL_TOKEN_EXPANSION:
+        default:
+          break;
         }
+    }
 
-      if (in_expand || strlen (flag) < 2)
-        continue;
+  sl_tokenizer_clear (&tokenizer);
 
-      /* Try to extract filenames of source files */
-      if (NULL != (dot = strrchr (flag, '.')))
-        {
-          if ((strcmp (dot, ".c") == 0) ||
-              (strcmp (dot, ".h") == 0) ||
-              (strcmp (dot, ".cc") == 0) ||
-              (strcmp (dot, ".hh") == 0) ||
-              (strcmp (dot, ".cxx") == 0) ||
-              (strcmp (dot, ".cpp") == 0))
-            {
-              const gchar *tmp;
+  /* What the compiler searches and defines which clang does not */
+  if (toolchain != NULL)
+    {
+      const gchar * const *flags = sl_toolchain_get_flags (toolchain);
 
-              if ((tmp = strstr (flag, "`")))
-                flag = ++tmp;
+      for (; *flags != NULL; flags++)
+        argv_builder_add (argv, *flags, strlen (*flags));
+    }
+}
 
-              if (g_path_is_absolute (flag))
-                g_ptr_array_add (filenames, g_strdup (flag));
-              else
-                g_ptr_array_add (filenames, g_build_filename (subdir, flag, NULL));
+/*
+ * Parses a single compiler invocation, interning the resulting flags in the
+ * default #SlFlagTable. This only depends on @command and @subdir, so it is
+ * safe to call from multiple threads at once as long as each thread has its
+ * own @argv.
+ */
+static gboolean
+sl_log_reader_parse_command (SlLogReader *self,
+                             const gchar *subdir,
+                             const gchar *command,
+                             gsize        len,
+                             GPtrArray   *filenames,
+                             ArgvBuilder *argv,
+                             guint       *flags)
+{
+  const gchar * const *args;
+  guint n_args;
 
-              continue;
-            }
-        }
+  g_assert (SL_IS_LOG_READER (self));
+  g_assert (command != NULL);
+  g_assert (filenames != NULL);
+  g_assert (argv != NULL);
+  g_assert (flags != NULL);
 
-      if (flag [0] != '-')
-        continue;
+  if (len == 0)
+    return FALSE;
 
-      /* Extract preprorcesser/warnings/link information */
-      switch (flag [1])
-        {
-        case 'I': /* -I./includes/ -I ./includes/ */
-          {
-            const gchar *part1 = flag;
-            const gchar *part2 = NULL;
+  /* Logs are not required to be UTF-8 as a whole, but anything we hand to clang must be */
+  if (!g_utf8_validate (command, len, NULL))
+    {
+      g_debug ("Ignoring command containing invalid UTF-8");
+      return FALSE;
+    }
 
-            if (strcmp (flag, "-I") == 0 && argv[i+1])
-              part2 = argv [++i];
+  argv_builder_reset (argv);
 
-            sl_log_reader_parse_c_cxx_include (self, ret, part1, part2, subdir);
-          }
-          break;
+  /* The log may be mapped read-only, so the command is tokenized in place */
+  sl_log_reader_parse_c_cxx (self, command, len, subdir, filenames, argv);
 
-        case 'f': /* -fPIC... */
-        case 'W': /* -Werror... */
-        case 'm': /* -m64 -mtune=native */
-          g_ptr_array_add (ret, g_strdup (flag));
-          break;
+  args = argv_builder_finish (argv, &n_args);
 
-        case 'D': /* -Dfoo -D foo */
-        case 'x': /* -xc++ */
-          g_ptr_array_add (ret, g_strdup (flag));
-          if ((strlen (flag) == 2) && argv[i+1])
-            g_ptr_array_add (ret, g_strdup (argv [++i]));
-          break;
+  if (n_args == 0 || filenames->len == 0)
+    return FALSE;
 
-        default:
-          if (g_str_has_prefix (flag, "-std=") ||
-              g_str_has_prefix (flag, "-pthread"))
-            g_ptr_array_add (ret, g_strdup (flag));
+  *flags = sl_flag_table_insert (sl_flag_table_get_default (), args, n_args);
+
+  return TRUE;
+}
+
+static void
+sl_log_reader_emit (SlLogReader *self,
+                    const gchar *subdir,
+                    GPtrArray   *filenames,
+                    guint        flags)
+{
+  guint i;
+
+  g_assert (SL_IS_LOG_READER (self));
+
+  self->stats.n_jobs += filenames->len;
+
+  for (i = 0; i < filenames->len; i++)
+    {
+      const gchar *filename = g_ptr_array_index (filenames, i);
+
+      g_signal_emit (self, signals [FLAGS_EXTRACTED], 0,
+                     subdir, filename, flags);
+    }
+}
+
+static const gchar *
+sl_log_reader_intern_path (SlLogReader *self,
+                           const gchar *path,
+                           gsize        len)
+{
+  g_autofree gchar *copy = g_strndup (path, len);
+  const gchar *ret;
+
+  if (NULL == (ret = g_hash_table_lookup (self->paths, copy)))
+    {
+      ret = copy;
+      g_hash_table_add (self->paths, g_steal_pointer (&copy));
+    }
+
+  return ret;
+}
+
+static const gchar *
+sl_log_reader_get_current_directory (SlLogReader *self)
+{
+  if (self->directories->len == 0)
+    return ".";
+
+  return g_array_index (self->directories, DirectoryEntry, self->directories->len - 1).path;
+}
+
+static void
+sl_log_reader_change_directory (SlLogReader *self,
+                                SlScanKind   kind,
+                                guint        level,
+                                const gchar *path,
+                                gsize        len)
+{
+  DirectoryEntry entry;
+  guint i;
+
+  g_assert (SL_IS_LOG_READER (self));
+
+  entry.level = level;
+  entry.path = sl_log_reader_intern_path (self, path, len);
+
+  if (kind == SL_SCAN_ENTER_DIRECTORY)
+    {
+      g_array_append_val (self->directories, entry);
+      return;
+    }
+
+  /* Paths are interned, so they can be compared by pointer */
+  for (i = self->directories->len; i > 0; i--)
+    {
+      const DirectoryEntry *iter = &g_array_index (self->directories, DirectoryEntry, i - 1);
+
+      if (iter->level == entry.level && iter->path == entry.path)
+        {
+          g_array_remove_index (self->directories, i - 1);
           break;
         }
     }
 }
 
+static guint64
+count_lines (const gchar *data,
+             gsize        len)
+{
+  const gchar *end = data + len;
+  guint64 n_lines = 0;
+
+  while (data < end && NULL != (data = memchr (data, '\n', end - data)))
+    {
+      n_lines++;
+      data++;
+    }
+
+  return n_lines;
+}
+
+/*
+ * Extracts N from "make[N]: Entering directory". Messages from the
+ * top-level make have no level and are treated as level 0.
+ */
+static guint
+parse_make_level (const gchar *line,
+                  gsize        len)
+{
+  const gchar *colon;
+  const gchar *bracket;
+
+  if (NULL == (colon = memchr (line, ':', len)) ||
+      NULL == (bracket = memrchr (line, '[', colon - line)))
+    return 0;
+
+  return (guint)g_ascii_strtoull (bracket + 1, NULL, 10);
+}
+
 static void
-sl_log_reader_parse_command (SlLogReader  *self,
-                             const gchar  *subdir,
-                             gchar        *command,
-                             gsize         len,
-                             SlLineReader *reader)
+parsed_command_free (gpointer data)
 {
-  g_autoptr(GPtrArray) argv = NULL;
-  g_autoptr(GPtrArray) filenames = NULL;
+  ParsedCommand *command = data;
+
+  g_ptr_array_unref (command->filenames);
+  g_slice_free (ParsedCommand, command);
+}
+
+static gpointer
+segment_scan (gpointer data)
+{
+  Segment *segment = data;
+  SlStatsTimer timer = { 0 };
+  SlScanMatch match;
+  SlScanner scanner;
+
+  if (segment->self->collect_stats)
+    {
+      sl_stats_timer_start (&timer);
+      segment->n_lines = count_lines (segment->data, segment->len);
+    }
+
+  sl_scanner_init (&scanner, segment->data, segment->len);
+
+  while (sl_scanner_next (&scanner, &match))
+    {
+      ScanEvent event = { 0 };
+
+      event.kind = match.kind;
+      event.match = match.match;
+      event.match_len = match.match_len;
+
+      if (match.kind != SL_SCAN_COMMAND)
+        event.level = parse_make_level (match.line, match.line_len);
+
+      g_array_append_val (segment->events, event);
+    }
+
+  if (segment->self->collect_stats)
+    sl_stats_timer_lap (&timer, &segment->scan);
+
+  return NULL;
+}
+
+static gpointer
+segment_parse (gpointer data)
+{
+  Segment *segment = data;
+  SlStatsTimer timer = { 0 };
+  guint i;
+
+  if (segment->self->collect_stats)
+    sl_stats_timer_start (&timer);
+
+  for (i = 0; i < segment->events->len; i++)
+    {
+      const ScanEvent *event = &g_array_index (segment->events, ScanEvent, i);
+      ParsedCommand *command;
+
+      if (event->kind != SL_SCAN_COMMAND)
+        continue;
+
+      command = g_slice_new0 (ParsedCommand);
+      command->subdir = event->subdir;
+      command->filenames = g_ptr_array_new_with_free_func (g_free);
+
+      if (!sl_log_reader_parse_command (segment->self,
+                                        event->subdir,
+                                        event->match,
+                                        event->match_len,
+                                        command->filenames,
+                                        &segment->argv,
+                                        &command->flags))
+        {
+          parsed_command_free (command);
+          continue;
+        }
+
+      g_ptr_array_add (segment->commands, command);
+    }
+
+  if (segment->self->collect_stats)
+    sl_stats_timer_lap (&timer, &segment->arguments);
+
+  return NULL;
+}
+
+static void
+run_segments (Segment     *segments,
+              guint        n_segments,
+              GThreadFunc  func)
+{
+  g_autofree GThread **threads = g_new0 (GThread *, n_segments);
+  guint i;
+
+  /* The calling thread takes the first segment */
+  for (i = 1; i < n_segments; i++)
+    threads[i] = g_thread_new ("sl-log-reader", func, &segments[i]);
+
+  func (&segments[0]);
+
+  for (i = 1; i < n_segments; i++)
+    g_thread_join (threads[i]);
+}
+
+/*
+ * Splits @data on line boundaries into one segment per thread. Each segment
+ * is scanned independently, then the directory events are replayed in log
+ * order to assign the working directory of every command. Commands are then
+ * parsed in parallel and finally emitted in log order, so the result is
+ * identical to scanning the buffer serially.
+ */
+static void
+sl_log_reader_ingest_parallel (SlLogReader *self,
+                               const gchar *data,
+                               gsize        len,
+                               guint        n_segments)
+{
+  g_autofree Segment *segments = NULL;
+  SlStatsTimer timer = { 0 };
+  gsize pos = 0;
+  guint i;
+  guint j;
 
   g_assert (SL_IS_LOG_READER (self));
-  g_assert (command != NULL);
-  g_assert (len > 0);
-  g_assert (reader != NULL);
+  g_assert (n_segments > 1);
 
-  command[len] = '\0';
+  segments = g_new0 (Segment, n_segments);
 
-  argv = g_ptr_array_new_with_free_func (g_free);
-  filenames = g_ptr_array_new_with_free_func (g_free);
+  for (i = 0; i < n_segments; i++)
+    {
+      gsize end = (i + 1 == n_segments) ? len : MAX (pos, len / n_segments * (i + 1));
+
+      end = sl_scanner_find_line_boundary (data, len, end);
+
+      segments[i].self = self;
+      segments[i].data = data + pos;
+      segments[i].len = end - pos;
+      segments[i].events = g_array_new (FALSE, FALSE, sizeof (ScanEvent));
+      segments[i].commands = g_ptr_array_new_with_free_func (parsed_command_free);
+      argv_builder_init (&segments[i].argv);
+
+      pos = end;
+    }
+
+  run_segments (segments, n_segments, segment_scan);
 
-  sl_log_reader_parse_c_cxx (self, command, subdir, filenames, argv);
+  if (self->collect_stats)
+    sl_stats_timer_start (&timer);
 
-  if (argv->len > 0)
+  for (i = 0; i < n_segments; i++)
     {
-      guint i;
+      for (j = 0; j < segments[i].events->len; j++)
+        {
+          ScanEvent *event = &g_array_index (segments[i].events, ScanEvent, j);
+
+          if (event->kind == SL_SCAN_COMMAND)
+            {
+              event->subdir = sl_log_reader_get_current_directory (self);
+              self->stats.n_commands++;
+            }
+          else
+            sl_log_reader_change_directory (self,
+                                            event->kind,
+                                            event->level,
+                                            event->match,
+                                            event->match_len);
+        }
+    }
+
+  if (self->collect_stats)
+    sl_stats_timer_lap (&timer, &self->stats.scan);
 
-      g_ptr_array_add (argv, NULL);
+  run_segments (segments, n_segments, segment_parse);
 
-      for (i = 0; i < filenames->len; i++)
+  for (i = 0; i < n_segments; i++)
+    {
+      /* Time is summed over the threads, like that of parsing translation units */
+      self->stats.n_lines += segments[i].n_lines;
+      self->stats.scan.wall += segments[i].scan.wall;
+      self->stats.scan.cpu += segments[i].scan.cpu;
+      self->stats.arguments.wall += segments[i].arguments.wall;
+      self->stats.arguments.cpu += segments[i].arguments.cpu;
+
+      for (j = 0; j < segments[i].commands->len; j++)
         {
-          const gchar *filename = g_ptr_array_index (filenames, i);
+          const ParsedCommand *command = g_ptr_array_index (segments[i].commands, j);
 
-          g_signal_emit (self, signals [FLAGS_EXTRACTED], 0,
-                         subdir, filename, argv->pdata);
+          sl_log_reader_emit (self, command->subdir, command->filenames, command->flags);
         }
+
+      g_array_unref (segments[i].events);
+      g_ptr_array_unref (segments[i].commands);
+      argv_builder_clear (&segments[i].argv);
     }
 }
 
-gboolean
-sl_log_reader_ingest (SlLogReader  *self,
-                      const gchar  *filename,
-                      GError      **error)
+static void
+sl_log_reader_ingest_data (SlLogReader *self,
+                           const gchar *data,
+                           gsize        len)
 {
-  g_autofree gchar *subdir = NULL;
-  g_autofree gchar *data = NULL;
-  SlLineReader *reader;
-  const gchar *end;
-  gchar *line;
-  gsize data_len;
-  gsize len;
+  SlStatsTimer timer = { 0 };
+  SlScanMatch match;
+  SlScanner scanner;
+  guint n_segments;
 
-  g_return_val_if_fail (SL_IS_LOG_READER (self), TRUE);
-  g_return_val_if_fail (filename != NULL, TRUE);
+  g_assert (SL_IS_LOG_READER (self));
+  g_assert (data != NULL || len == 0);
 
-  if (!g_file_get_contents (filename, &data, &data_len, error))
-    return FALSE;
+  self->stats.n_bytes += len;
 
-  if (!g_utf8_validate (data, data_len, &end))
+  n_segments = MIN (self->n_threads, len / MIN_SEGMENT_SIZE);
+
+  if (n_segments > 1)
     {
-      g_set_error (error,
-                   G_FILE_ERROR,
-                   G_FILE_ERROR_FAILED,
-                   "The file contained invalid UTF-8");
-      return FALSE;
+      sl_log_reader_ingest_parallel (self, data, len, n_segments);
+      return;
     }
 
-  reader = sl_line_reader_new (data, data_len);
+  if (self->collect_stats)
+    {
+      sl_stats_timer_start (&timer);
+      self->stats.n_lines += count_lines (data, len);
+    }
 
-  while (NULL != (line = (gchar *)sl_line_reader_next (reader, &len)))
+  sl_scanner_init (&scanner, data, len);
+
+  while (sl_scanner_next (&scanner, &match))
     {
-      struct { const gchar *command; gsize len; } commands[] = {
-        { "gcc", 3 },
-        { "clang", 5 },
-      };
-      const gchar *change_dir;
-      guint i;
+      g_autoptr(GPtrArray) filenames = NULL;
+      const gchar *subdir;
+      gboolean parsed;
+      guint flags;
 
       /*
        * Keep track of subdirectory changes. On some systems we can look for subdir=
        * but if subdir-objects is disabled, we sadly cannot.
        */
-      if (NULL != (change_dir = memmem (line, len, ": Entering directory '", 22)))
+      if (match.kind != SL_SCAN_COMMAND)
         {
-          g_free (subdir);
-          subdir = g_strndup (change_dir + 22, len - (change_dir - line) - 22 - 1);
+          sl_log_reader_change_directory (self,
+                                          match.kind,
+                                          parse_make_level (match.line, match.line_len),
+                                          match.match,
+                                          match.match_len);
           continue;
         }
 
-      /*
-       * Look to see if this line starts calling gcc somewhere in it.
-       *
-       * We can probably speed this up by using a regex that does all
-       * of the lookups at once rather than multiple lookups/scans.
-       */
-      for (i = 0; i < G_N_ELEMENTS (commands); i++)
+      self->stats.n_commands++;
+
+      if (self->collect_stats)
+        sl_stats_timer_lap (&timer, &self->stats.scan);
+
+      filenames = g_ptr_array_new_with_free_func (g_free);
+      subdir = sl_log_reader_get_current_directory (self);
+      parsed = sl_log_reader_parse_command (self, subdir, match.match, match.match_len,
+                                            filenames, &self->argv, &flags);
+
+      if (self->collect_stats)
+        sl_stats_timer_lap (&timer, &self->stats.arguments);
+
+      if (parsed)
+        sl_log_reader_emit (self, subdir, filenames, flags);
+
+      /* Handlers may parse the translation unit, which is not ours to count */
+      if (self->collect_stats)
+        sl_stats_timer_lap (&timer, NULL);
+    }
+
+  if (self->collect_stats)
+    sl_stats_timer_lap (&timer, &self->stats.scan);
+}
+
+/*
+ * Scans a mapped log a window at a time, splitting windows on line
+ * boundaries. Once a window has been scanned its pages are dropped so
+ * that the resident size does not grow with the size of the log.
+ */
+static void
+sl_log_reader_ingest_mapped (SlLogReader *self,
+                             GMappedFile *mf)
+{
+  const gchar *data = g_mapped_file_get_contents (mf);
+  gsize len = g_mapped_file_get_length (mf);
+  gsize page_size = sysconf (_SC_PAGESIZE);
+  gsize pos = 0;
+  gsize released = 0;
+
+  g_assert (SL_IS_LOG_READER (self));
+
+#ifdef MADV_SEQUENTIAL
+  if (len > 0)
+    madvise ((gpointer)data, len, MADV_SEQUENTIAL);
+#endif
+
+  while (pos < len)
+    {
+      gsize end = sl_scanner_find_line_boundary (data, len, MIN (len, pos + WINDOW_SIZE));
+
+      sl_log_reader_ingest_data (self, data + pos, end - pos);
+      pos = end;
+
+#ifdef MADV_DONTNEED
+      if (pos - released >= WINDOW_SIZE)
+        {
+          gsize until = pos / page_size * page_size;
+
+          madvise ((gpointer)(data + released), until - released, MADV_DONTNEED);
+          released = until;
+        }
+#endif
+    }
+}
+
+static Compression
+detect_compression (const guint8 *data,
+                    gsize         len)
+{
+  static const guint8 gzip_magic[] = { 0x1f, 0x8b };
+  static const guint8 xz_magic[] = { 0xfd, '7', 'z', 'X', 'Z', 0x00 };
+
+  if (len >= sizeof gzip_magic && memcmp (data, gzip_magic, sizeof gzip_magic) == 0)
+    return COMPRESSION_GZIP;
+
+  if (len >= sizeof xz_magic && memcmp (data, xz_magic, sizeof xz_magic) == 0)
+    return COMPRESSION_XZ;
+
+  return COMPRESSION_NONE;
+}
+
+/*
+ * Looks at the start of @stream and, if it is compressed, wraps it in a
+ * stream which decompresses it as it is read.
+ */
+static GInputStream *
+open_decompressed (GInputStream  *stream,
+                   GCancellable  *cancellable,
+                   GError       **error)
+{
+  g_autoptr(GInputStream) buffered = NULL;
+  g_autoptr(GConverter) converter = NULL;
+  const guint8 *magic;
+  gsize len;
+
+  g_assert (G_IS_INPUT_STREAM (stream));
+
+  buffered = g_buffered_input_stream_new (stream);
+
+  while ((len = g_buffered_input_stream_get_available (G_BUFFERED_INPUT_STREAM (buffered))) < 6)
+    {
+      gssize n_read = g_buffered_input_stream_fill (G_BUFFERED_INPUT_STREAM (buffered), 6 - len,
+                                                    cancellable, error);
+
+      if (n_read < 0)
+        return NULL;
+      else if (n_read == 0)
+        break;
+    }
+
+  magic = g_buffered_input_stream_peek_buffer (G_BUFFERED_INPUT_STREAM (buffered), &len);
+
+  switch (detect_compression (magic, len))
+    {
+    case COMPRESSION_GZIP:
+      converter = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+      break;
+
+    case COMPRESSION_XZ:
+#ifdef HAVE_LZMA
+      converter = sl_xz_decompressor_new ();
+      break;
+#else
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                           _("Reading xz compressed logs requires building with liblzma"));
+      return NULL;
+#endif
+
+    case COMPRESSION_NONE:
+    default:
+      return g_steal_pointer (&buffered);
+    }
+
+  return g_converter_input_stream_new (buffered, converter);
+}
+
+/**
+ * sl_log_reader_ingest_stream:
+ * @self: a #SlLogReader
+ * @stream: a #GInputStream containing a build log
+ * @cancellable: (nullable): a #GCancellable or %NULL
+ * @error: a location for a #GError or %NULL
+ *
+ * Reads the build log from @stream, emitting #SlLogReader::flags-extracted
+ * for every compiler invocation found. Logs compressed with gzip (or xz,
+ * when built with liblzma) are decompressed as they are read.
+ *
+ * Reading and decompressing happen on another thread a few blocks ahead of
+ * scanning. Lines which span blocks are carried over to the next, so memory
+ * use is bounded by the block size and the longest line in the log.
+ *
+ * Returns: %TRUE if the stream was read to the end; otherwise %FALSE and
+ *   @error is set.
+ */
+gboolean
+sl_log_reader_ingest_stream (SlLogReader   *self,
+                             GInputStream  *stream,
+                             GCancellable  *cancellable,
+                             GError       **error)
+{
+  g_autoptr(GInputStream) decompressed = NULL;
+  g_autoptr(SlReadAhead) read_ahead = NULL;
+  g_autoptr(GByteArray) buf = NULL;
+
+  g_return_val_if_fail (SL_IS_LOG_READER (self), FALSE);
+  g_return_val_if_fail (G_IS_INPUT_STREAM (stream), FALSE);
+  g_return_val_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable), FALSE);
+
+  if (NULL == (decompressed = open_decompressed (stream, cancellable, error)))
+    return FALSE;
+
+  read_ahead = sl_read_ahead_new (decompressed);
+  buf = g_byte_array_new ();
+
+  g_array_set_size (self->directories, 0);
+
+  for (;;)
+    {
+      const guint8 *data;
+      gsize len;
+      gsize complete;
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, error) ||
+          !sl_read_ahead_next (read_ahead, &data, &len, error))
+        return FALSE;
+
+      if (len == 0)
+        break;
+
+      /* Scan complete lines in place, only copying what spans blocks */
+      if (buf->len == 0)
+        {
+          complete = sl_scanner_find_last_line_boundary ((const gchar *)data, len);
+          sl_log_reader_ingest_data (self, (const gchar *)data, complete);
+          g_byte_array_append (buf, data + complete, len - complete);
+          continue;
+        }
+
+      g_byte_array_append (buf, data, len);
+
+      /* Keep reading until we have at least one complete line */
+      if (0 == (complete = sl_scanner_find_last_line_boundary ((const gchar *)buf->data, buf->len)))
+        continue;
+
+      sl_log_reader_ingest_data (self, (const gchar *)buf->data, complete);
+      g_byte_array_remove_range (buf, 0, complete);
+    }
+
+  /* Trailing line without a newline */
+  sl_log_reader_ingest_data (self, (const gchar *)buf->data, buf->len);
+
+  return TRUE;
+}
+
+/**
+ * sl_log_reader_ingest_command:
+ * @self: a #SlLogReader
+ * @directory: the directory the command was run from
+ * @command: a compiler invocation
+ * @len: the length of @command in bytes, or -1 if it is nul terminated
+ *
+ * Parses a single compiler invocation, such as one from a compilation
+ * database, emitting #SlLogReader::flags-extracted for each source file.
+ */
+void
+sl_log_reader_ingest_command (SlLogReader *self,
+                              const gchar *directory,
+                              const gchar *command,
+                              gssize       len)
+{
+  g_autoptr(GPtrArray) filenames = NULL;
+  SlStatsTimer timer = { 0 };
+  gboolean parsed;
+  guint flags;
+
+  g_return_if_fail (SL_IS_LOG_READER (self));
+  g_return_if_fail (directory != NULL);
+  g_return_if_fail (command != NULL);
+
+  if (len < 0)
+    len = strlen (command);
+
+  filenames = g_ptr_array_new_with_free_func (g_free);
+  self->stats.n_commands++;
+
+  if (self->collect_stats)
+    sl_stats_timer_start (&timer);
+
+  parsed = sl_log_reader_parse_command (self, directory, command, len, filenames, &self->argv, &flags);
+
+  if (self->collect_stats)
+    sl_stats_timer_lap (&timer, &self->stats.arguments);
+
+  if (parsed)
+    sl_log_reader_emit (self, directory, filenames, flags);
+}
+
+/*
+ * Reads one object of a compile_commands.json, after its opening brace,
+ * and ingests the command it describes.
+ */
+static gboolean
+sl_log_reader_ingest_compile_command (SlLogReader  *self,
+                                      SlJsonReader *reader,
+                                      GString      *command)
+{
+  g_autofree gchar *directory = NULL;
+  const gchar *value;
+  gsize value_len;
+  SlJsonToken token;
+
+  g_string_truncate (command, 0);
+
+  while (SL_JSON_STRING == (token = sl_json_reader_next (reader, &value, &value_len)))
+    {
+      g_autofree gchar *member = g_strndup (value, value_len);
+
+      token = sl_json_reader_next (reader, &value, &value_len);
+
+      if (token == SL_JSON_STRING && g_str_equal (member, "directory"))
         {
-          gchar *cmd_begin;
+          g_free (directory);
+          directory = g_strndup (value, value_len);
+        }
+      else if (token == SL_JSON_STRING && g_str_equal (member, "command"))
+        {
+          g_string_truncate (command, 0);
+          g_string_append_len (command, value, value_len);
+        }
+      else if (token == SL_JSON_BEGIN_ARRAY && g_str_equal (member, "arguments"))
+        {
+          /* Quote each argument so the command tokenizes back into the same words */
+          g_string_truncate (command, 0);
+
+          while (SL_JSON_STRING == (token = sl_json_reader_next (reader, &value, &value_len)))
+            {
+              g_autofree gchar *arg = g_strndup (value, value_len);
+              g_autofree gchar *quoted = g_shell_quote (arg);
 
-          if (NULL == (cmd_begin = memmem (line, len, commands[i].command, commands[i].len)))
-            continue;
+              if (command->len > 0)
+                g_string_append_c (command, ' ');
+              g_string_append (command, quoted);
+            }
 
-          if (cmd_begin == line || g_ascii_isspace (cmd_begin[-1]))
-            sl_log_reader_parse_command (self,
-                                         subdir ? subdir : ".",
-                                         cmd_begin,
-                                         len - (cmd_begin - line),
-                                         reader);
+          if (token != SL_JSON_END_ARRAY)
+            return FALSE;
         }
+      else if (!sl_json_reader_skip_value (reader, token))
+        return FALSE;
     }
 
+  if (token != SL_JSON_END_OBJECT)
+    return FALSE;
+
+  if (command->len > 0)
+    sl_log_reader_ingest_command (self, directory ? directory : ".", command->str, command->len);
+
   return TRUE;
 }
 
+/**
+ * sl_log_reader_ingest_compile_commands:
+ * @self: a #SlLogReader
+ * @filename: the path to a compile_commands.json
+ * @error: a location for a #GError or %NULL
+ *
+ * Reads a JSON compilation database, as written by CMake, Meson, Bear or
+ * sightline itself, treating each command as if it was found in a log.
+ * The file is read incrementally, so large databases are never held in
+ * memory as a tree.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+sl_log_reader_ingest_compile_commands (SlLogReader  *self,
+                                       const gchar  *filename,
+                                       GError      **error)
+{
+  g_autoptr(GMappedFile) mf = NULL;
+  g_autoptr(GString) command = NULL;
+  SlJsonReader reader;
+  SlJsonToken token;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (SL_IS_LOG_READER (self), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  if (NULL == (mf = g_mapped_file_new (filename, FALSE, error)))
+    return FALSE;
+
+  command = g_string_new (NULL);
+  sl_json_reader_init (&reader,
+                       g_mapped_file_get_contents (mf),
+                       g_mapped_file_get_length (mf));
+
+  if (sl_json_reader_next (&reader, NULL, NULL) == SL_JSON_BEGIN_ARRAY)
+    {
+      while (SL_JSON_BEGIN_OBJECT == (token = sl_json_reader_next (&reader, NULL, NULL)))
+        {
+          if (!sl_log_reader_ingest_compile_command (self, &reader, command))
+            break;
+        }
+
+      ret = (token == SL_JSON_END_ARRAY);
+    }
+
+  if (!ret)
+    g_set_error (error,
+                 G_IO_ERROR,
+                 G_IO_ERROR_INVALID_DATA,
+                 "%s: malformed compilation database near offset %"G_GSIZE_FORMAT,
+                 filename,
+                 sl_json_reader_get_offset (&reader));
+
+  sl_json_reader_clear (&reader);
+
+  return ret;
+}
+
+/**
+ * sl_log_reader_ingest:
+ * @self: a #SlLogReader
+ * @filename: the path to a build log, or "-" for standard input
+ * @error: a location for a #GError or %NULL
+ *
+ * Reads the build log at @filename. Regular files are mapped into memory,
+ * anything else (pipes, standard input, compressed logs) is streamed with
+ * sl_log_reader_ingest_stream().
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+sl_log_reader_ingest (SlLogReader  *self,
+                      const gchar  *filename,
+                      GError      **error)
+{
+  g_autoptr(GInputStream) stream = NULL;
+  g_autoptr(GMappedFile) mf = NULL;
+  g_autoptr(GFile) file = NULL;
+  GStatBuf st;
+
+  g_return_val_if_fail (SL_IS_LOG_READER (self), TRUE);
+  g_return_val_if_fail (filename != NULL, TRUE);
+
+  if (g_str_equal (filename, "-"))
+    {
+      stream = g_unix_input_stream_new (STDIN_FILENO, FALSE);
+      return sl_log_reader_ingest_stream (self, stream, NULL, error);
+    }
+
+  if (g_stat (filename, &st) == 0 &&
+      S_ISREG (st.st_mode) &&
+      NULL != (mf = g_mapped_file_new (filename, FALSE, NULL)))
+    {
+      if (detect_compression ((const guint8 *)g_mapped_file_get_contents (mf),
+                              g_mapped_file_get_length (mf)) == COMPRESSION_NONE)
+        {
+          g_array_set_size (self->directories, 0);
+          sl_log_reader_ingest_mapped (self, mf);
+          return TRUE;
+        }
+
+      /* Compressed logs are decompressed as they are streamed */
+      g_clear_pointer (&mf, g_mapped_file_unref);
+    }
+
+  file = g_file_new_for_path (filename);
+
+  if (NULL == (stream = G_INPUT_STREAM (g_file_read (file, NULL, error))))
+    return FALSE;
+
+  return sl_log_reader_ingest_stream (self, stream, NULL, error);
+}
+
 SlLogReader *
 sl_log_reader_new (void)
 {
   return g_object_new (SL_TYPE_LOG_READER, NULL);
 }
+
+guint
+sl_log_reader_get_n_threads (SlLogReader *self)
+{
+  g_return_val_if_fail (SL_IS_LOG_READER (self), 0);
+
+  return self->n_threads;
+}
+
+/**
+ * sl_log_reader_set_n_threads:
+ * @self: a #SlLogReader
+ * @n_threads: the number of threads to use
+ *
+ * Sets the number of threads used to scan and parse large logs. The order
+ * of #SlLogReader::flags-extracted emissions is the same regardless of the
+ * number of threads, and they are always emitted from the calling thread.
+ */
+void
+sl_log_reader_set_n_threads (SlLogReader *self,
+                             guint        n_threads)
+{
+  g_return_if_fail (SL_IS_LOG_READER (self));
+
+  n_threads = MAX (1, n_threads);
+
+  if (n_threads != self->n_threads)
+    {
+      self->n_threads = n_threads;
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_N_THREADS]);
+    }
+}
+
+gboolean
+sl_log_reader_get_collect_stats (SlLogReader *self)
+{
+  g_return_val_if_fail (SL_IS_LOG_READER (self), FALSE);
+
+  return self->collect_stats;
+}
+
+/**
+ * sl_log_reader_set_collect_stats:
+ * @self: a #SlLogReader
+ * @collect_stats: whether to collect statistics
+ *
+ * Sets whether lines are counted and the time spent scanning logs and
+ * parsing commands is measured, which costs a few clock reads per command.
+ * Bytes, commands and jobs are always counted.
+ */
+void
+sl_log_reader_set_collect_stats (SlLogReader *self,
+                                 gboolean     collect_stats)
+{
+  g_return_if_fail (SL_IS_LOG_READER (self));
+
+  collect_stats = !!collect_stats;
+
+  if (collect_stats != self->collect_stats)
+    {
+      self->collect_stats = collect_stats;
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_COLLECT_STATS]);
+    }
+}
+
+/**
+ * sl_log_reader_get_stats:
+ * @self: a #SlLogReader
+ * @stats: (out): a location for the statistics
+ *
+ * Gets what has been read since @self was created.
+ */
+void
+sl_log_reader_get_stats (SlLogReader      *self,
+                         SlLogReaderStats *stats)
+{
+  g_return_if_fail (SL_IS_LOG_READER (self));
+  g_return_if_fail (stats != NULL);
+
+  *stats = self->stats;
+}
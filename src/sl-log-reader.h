@@ -21,16 +21,51 @@
 
 #include <gio/gio.h>
 
+#include "sl-stats.h"
+
 G_BEGIN_DECLS
 
 #define SL_TYPE_LOG_READER (sl_log_reader_get_type())
 
 G_DECLARE_FINAL_TYPE (SlLogReader, sl_log_reader, SL, LOG_READER, GObject)
 
-SlLogReader *sl_log_reader_new    (void);
-gboolean     sl_log_reader_ingest (SlLogReader  *self,
-                                   const gchar  *filename,
-                                   GError      **error);
+typedef struct
+{
+  guint64     n_bytes;
+  guint64     n_lines;
+
+  /* Compiler invocations found, and the source files they compile */
+  guint       n_commands;
+  guint       n_jobs;
+
+  /* Only measured while collecting statistics */
+  SlStatsTime scan;
+  SlStatsTime arguments;
+} SlLogReaderStats;
+
+SlLogReader *sl_log_reader_new                     (void);
+guint        sl_log_reader_get_n_threads           (SlLogReader      *self);
+void         sl_log_reader_set_n_threads           (SlLogReader      *self,
+                                                    guint             n_threads);
+gboolean     sl_log_reader_get_collect_stats       (SlLogReader      *self);
+void         sl_log_reader_set_collect_stats       (SlLogReader      *self,
+                                                    gboolean          collect_stats);
+void         sl_log_reader_get_stats               (SlLogReader      *self,
+                                                    SlLogReaderStats *stats);
+gboolean     sl_log_reader_ingest                  (SlLogReader      *self,
+                                                    const gchar      *filename,
+                                                    GError          **error);
+gboolean     sl_log_reader_ingest_stream           (SlLogReader      *self,
+                                                    GInputStream     *stream,
+                                                    GCancellable     *cancellable,
+                                                    GError          **error);
+void         sl_log_reader_ingest_command          (SlLogReader      *self,
+                                                    const gchar      *directory,
+                                                    const gchar      *command,
+                                                    gssize            len);
+gboolean     sl_log_reader_ingest_compile_commands (SlLogReader      *self,
+                                                    const gchar      *filename,
+                                                    GError          **error);
 
 G_END_DECLS
 
@@ -0,0 +1,139 @@
+/* sl-pass-registry.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define G_LOG_DOMAIN "sl-pass-registry"
+
+
+#include "sl-pass-registry.h"
+
+/*
+ * Analyses of a translation unit are passes which register for the cursor
+ * kinds they care about, so that a single traversal of the AST serves all
+ * of them. Each cursor costs one lookup in a table indexed by its kind,
+ * and nothing more for kinds no pass registered for.
+ *
+ * Passes are registered before any traversal and the registry is only read
+ * afterwards, so it can be shared by every thread without locking.
+ */
+
+struct _SlPassRegistry
+{
+  /* The functions registered for each kind, or %NULL for none */
+  GArray *by_kind[SL_PASS_REGISTRY_MAX_KIND];
+};
+
+/**
+ * sl_pass_registry_new:
+ *
+ * Creates a new, empty #SlPassRegistry.
+ *
+ * Returns: (transfer full): A newly allocated #SlPassRegistry.
+ */
+SlPassRegistry *
+sl_pass_registry_new (void)
+{
+  SlPassRegistry *self;
+
+  self = g_new0 (SlPassRegistry, 1);
+
+  return self;
+}
+
+void
+sl_pass_registry_free (SlPassRegistry *self)
+{
+  guint i;
+
+  if (self != NULL)
+    {
+      for (i = 0; i < SL_PASS_REGISTRY_MAX_KIND; i++)
+        g_clear_pointer (&self->by_kind[i], g_array_unref);
+
+      g_free (self);
+    }
+}
+
+/**
+ * sl_pass_registry_add:
+ * @self: An #SlPassRegistry
+ * @name: the name of the pass
+ * @kinds: (array length=n_kinds): the cursor kinds the pass handles
+ * @n_kinds: the number of kinds
+ * @func: the function to call for each cursor of one of @kinds
+ *
+ * Registers a pass. During a traversal, @func is called with each cursor
+ * of one of @kinds, after the passes registered before it.
+ */
+void
+sl_pass_registry_add (SlPassRegistry          *self,
+                      const gchar             *name,
+                      const enum CXCursorKind *kinds,
+                      guint                    n_kinds,
+                      SlPassFunc               func)
+{
+  guint i;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (name != NULL);
+  g_return_if_fail (kinds != NULL || n_kinds == 0);
+  g_return_if_fail (func != NULL);
+
+  g_debug ("Registering pass %s for %u cursor kinds", name, n_kinds);
+
+  for (i = 0; i < n_kinds; i++)
+    {
+      guint kind = kinds[i];
+
+      g_return_if_fail (kind < SL_PASS_REGISTRY_MAX_KIND);
+
+      if (self->by_kind[kind] == NULL)
+        self->by_kind[kind] = g_array_new (FALSE, FALSE, sizeof (SlPassFunc));
+
+      g_array_append_val (self->by_kind[kind], func);
+    }
+}
+
+/**
+ * sl_pass_registry_dispatch:
+ * @self: An #SlPassRegistry
+ * @kind: the kind of @cursor
+ * @cursor: the cursor being visited
+ * @visit_data: the state of the traversal, passed to each pass
+ *
+ * Calls every pass registered for @kind with @cursor. The kind is passed
+ * in since the traversal needs it anyway.
+ */
+void
+sl_pass_registry_dispatch (SlPassRegistry    *self,
+                           enum CXCursorKind  kind,
+                           CXCursor           cursor,
+                           gpointer           visit_data)
+{
+  const GArray *funcs;
+  guint i;
+
+  g_return_if_fail (self != NULL);
+
+  if ((guint)kind >= SL_PASS_REGISTRY_MAX_KIND ||
+      NULL == (funcs = self->by_kind[kind]))
+    return;
+
+  for (i = 0; i < funcs->len; i++)
+    g_array_index (funcs, SlPassFunc, i) (cursor, visit_data);
+}
@@ -0,0 +1,51 @@
+/* sl-pass-registry.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_PASS_REGISTRY_H
+#define SL_PASS_REGISTRY_H
+
+#include <clang-c/Index.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Cursor kinds at or above this cannot be registered for */
+#define SL_PASS_REGISTRY_MAX_KIND 1024
+
+typedef struct _SlPassRegistry SlPassRegistry;
+
+typedef void (*SlPassFunc) (CXCursor cursor,
+                            gpointer visit_data);
+
+SlPassRegistry *sl_pass_registry_new      (void);
+void            sl_pass_registry_free     (SlPassRegistry           *self);
+void            sl_pass_registry_add      (SlPassRegistry           *self,
+                                           const gchar              *name,
+                                           const enum CXCursorKind  *kinds,
+                                           guint                     n_kinds,
+                                           SlPassFunc                func);
+void            sl_pass_registry_dispatch (SlPassRegistry           *self,
+                                           enum CXCursorKind         kind,
+                                           CXCursor                  cursor,
+                                           gpointer                  visit_data);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SlPassRegistry, sl_pass_registry_free)
+
+G_END_DECLS
+
+#endif /* SL_PASS_REGISTRY_H */
@@ -0,0 +1,214 @@
+/* sl-pch.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-pch"
+
+#include <string.h>
+
+#include "sl-pch.h"
+
+static const gchar *
+skip_space_and_comments (const gchar *p,
+                         const gchar *end)
+{
+  while (p < end)
+    {
+      if (g_ascii_isspace (*p))
+        p++;
+      else if (p + 1 < end && p[0] == '/' && p[1] == '/')
+        {
+          if (NULL == (p = memchr (p, '\n', end - p)))
+            return end;
+        }
+      else if (p + 1 < end && p[0] == '/' && p[1] == '*')
+        {
+          for (p += 2; p + 1 < end; p++)
+            {
+              if (p[0] == '*' && p[1] == '/')
+                break;
+            }
+
+          p += 2;
+        }
+      else
+        break;
+    }
+
+  return MIN (p, end);
+}
+
+/**
+ * sl_pch_scan_prefix:
+ * @filename: the source file to scan
+ *
+ * Scans the leading "#include" directives of @filename, stopping at the
+ * first line that is not an include, comment, or blank line. System
+ * includes are returned as-is ("<glib.h>"). Quoted includes are resolved
+ * against the directory of @filename and returned as an absolute path so
+ * they may be included from a header in another directory. A quoted
+ * include that cannot be resolved terminates the prefix.
+ *
+ * Returns: (transfer full): A #GPtrArray of include targets, suitable for
+ *   placing after "#include ".
+ */
+GPtrArray *
+sl_pch_scan_prefix (const gchar *filename)
+{
+  g_autofree gchar *contents = NULL;
+  g_autofree gchar *dirname = NULL;
+  GPtrArray *ret;
+  const gchar *p;
+  const gchar *end;
+  gsize len;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  ret = g_ptr_array_new_with_free_func (g_free);
+
+  if (!g_file_get_contents (filename, &contents, &len, NULL))
+    return ret;
+
+  dirname = g_path_get_dirname (filename);
+  end = contents + len;
+
+  for (p = skip_space_and_comments (contents, end);
+       p < end && *p == '#';
+       p = skip_space_and_comments (p, end))
+    {
+      const gchar *target;
+      gchar close;
+
+      for (p++; p < end && (*p == ' ' || *p == '\t'); p++) { }
+
+      if (end - p < 7 || strncmp (p, "include", 7) != 0)
+        break;
+
+      for (p += 7; p < end && (*p == ' ' || *p == '\t'); p++) { }
+
+      if (p == end || (*p != '<' && *p != '"'))
+        break;
+
+      close = (*p == '<') ? '>' : '"';
+      target = p + 1;
+
+      for (p = target; p < end && *p != close && *p != '\n'; p++) { }
+
+      if (p == end || *p != close || p == target)
+        break;
+
+      if (close == '>')
+        g_ptr_array_add (ret, g_strndup (target - 1, p - target + 2));
+      else
+        {
+          g_autofree gchar *relative = g_strndup (target, p - target);
+          g_autofree gchar *path = NULL;
+
+          if (g_path_is_absolute (relative))
+            path = g_steal_pointer (&relative);
+          else
+            path = g_build_filename (dirname, relative, NULL);
+
+          if (!g_file_test (path, G_FILE_TEST_IS_REGULAR))
+            break;
+
+          g_ptr_array_add (ret, g_strdup_printf ("\"%s\"", path));
+        }
+
+      p++;
+    }
+
+  return ret;
+}
+
+/**
+ * sl_pch_build:
+ * @index: the #CXIndex to parse within
+ * @header: the path of the prefix header to generate
+ * @pch: the path of the precompiled header to generate
+ * @includes: include targets as returned from sl_pch_scan_prefix()
+ * @argv: the compiler flags shared by the translation units
+ * @error: a location for a #GError, or %NULL
+ *
+ * Writes a header containing @includes to @header, parses it with @argv,
+ * and serializes the result to @pch so that it may be used with
+ * "-include-pch" by any translation unit compiled with @argv.
+ *
+ * Returns: %TRUE if @pch was created; otherwise %FALSE and @error is set.
+ */
+gboolean
+sl_pch_build (CXIndex               index,
+              const gchar          *header,
+              const gchar          *pch,
+              GPtrArray            *includes,
+              const gchar * const  *argv,
+              GError              **error)
+{
+  g_autoptr(GString) contents = NULL;
+  CXTranslationUnit unit;
+  gint ret;
+  guint i;
+
+  g_return_val_if_fail (index != NULL, FALSE);
+  g_return_val_if_fail (header != NULL, FALSE);
+  g_return_val_if_fail (pch != NULL, FALSE);
+  g_return_val_if_fail (includes != NULL, FALSE);
+  g_return_val_if_fail (argv != NULL, FALSE);
+
+  contents = g_string_new (NULL);
+
+  for (i = 0; i < includes->len; i++)
+    g_string_append_printf (contents, "#include %s\n",
+                            (const gchar *)g_ptr_array_index (includes, i));
+
+  if (!g_file_set_contents (header, contents->str, contents->len, error))
+    return FALSE;
+
+  unit = clang_parseTranslationUnit (index,
+                                     header,
+                                     argv,
+                                     g_strv_length ((gchar **)argv),
+                                     NULL,
+                                     0,
+                                     CXTranslationUnit_ForSerialization |
+                                     CXTranslationUnit_Incomplete);
+
+  if (unit == NULL)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_FAILED,
+                   "Failed to parse precompiled header %s",
+                   header);
+      return FALSE;
+    }
+
+  ret = clang_saveTranslationUnit (unit, pch, clang_defaultSaveOptions (unit));
+  clang_disposeTranslationUnit (unit);
+
+  if (ret != CXSaveError_None)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_FAILED,
+                   "Failed to save precompiled header %s",
+                   pch);
+      return FALSE;
+    }
+
+  return TRUE;
+}
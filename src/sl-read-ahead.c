@@ -0,0 +1,215 @@
+/* sl-read-ahead.c
+ *
+ * Copyright (C) 2015 Christian Hergert <christian@hergert.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-read-ahead"
+
+#include "sl-read-ahead.h"
+
+/* Size of each read, and how many may be waiting to be consumed */
+#define BLOCK_SIZE (256 * 1024)
+#define N_BLOCKS   4
+
+/*
+ * Reads a stream on a thread of its own, so that reading (and, through a
+ * GConverterInputStream, decompressing) overlaps with scanning what was
+ * read before. The blocks are recycled between a queue of free blocks and
+ * one of filled blocks, which bounds memory use and blocks the reader
+ * whenever it gets ahead of the consumer.
+ */
+
+typedef struct
+{
+  guint8 *data;
+  gsize   len;
+} Block;
+
+struct _SlReadAhead
+{
+  GInputStream *stream;
+  GCancellable *cancellable;
+  GThread      *thread;
+  GAsyncQueue  *free_blocks;
+  GAsyncQueue  *full_blocks;
+  Block         blocks[N_BLOCKS];
+
+  /* The block returned by the last call to sl_read_ahead_next() */
+  Block        *current;
+
+  /* Set by the thread before it queues the empty block ending the stream */
+  GError       *error;
+
+  gboolean      finished;
+};
+
+static gpointer
+sl_read_ahead_worker (gpointer data)
+{
+  SlReadAhead *self = data;
+  gboolean at_end = FALSE;
+
+  while (!at_end)
+    {
+      Block *block = g_async_queue_pop (self->free_blocks);
+
+      if (g_cancellable_is_cancelled (self->cancellable))
+        break;
+
+      if (!g_input_stream_read_all (self->stream,
+                                    block->data,
+                                    BLOCK_SIZE,
+                                    &block->len,
+                                    self->cancellable,
+                                    &self->error))
+        block->len = 0;
+
+      /* An empty block marks the end of the stream, or an error */
+      at_end = block->len == 0;
+
+      g_async_queue_push (self->full_blocks, block);
+    }
+
+  return NULL;
+}
+
+/**
+ * sl_read_ahead_new:
+ * @stream: the #GInputStream to read
+ *
+ * Starts reading @stream on a new thread, which keeps up to a few blocks
+ * ahead of what has been consumed with sl_read_ahead_next().
+ *
+ * Returns: (transfer full): a new #SlReadAhead
+ */
+SlReadAhead *
+sl_read_ahead_new (GInputStream *stream)
+{
+  SlReadAhead *self;
+  guint i;
+
+  g_return_val_if_fail (G_IS_INPUT_STREAM (stream), NULL);
+
+  self = g_slice_new0 (SlReadAhead);
+  self->stream = g_object_ref (stream);
+  self->cancellable = g_cancellable_new ();
+  self->free_blocks = g_async_queue_new ();
+  self->full_blocks = g_async_queue_new ();
+
+  for (i = 0; i < N_BLOCKS; i++)
+    {
+      self->blocks[i].data = g_malloc (BLOCK_SIZE);
+      g_async_queue_push (self->free_blocks, &self->blocks[i]);
+    }
+
+  self->thread = g_thread_new ("sl-read-ahead", sl_read_ahead_worker, self);
+
+  return self;
+}
+
+void
+sl_read_ahead_free (SlReadAhead *self)
+{
+  Block *block;
+  guint i;
+
+  if (self == NULL)
+    return;
+
+  /*
+   * Stop the thread, waking it if it is waiting for a free block. The
+   * blocks are only freed once it has been joined.
+   */
+  g_cancellable_cancel (self->cancellable);
+
+  if (self->current != NULL)
+    g_async_queue_push (self->free_blocks, self->current);
+
+  /* The thread holds at most one block, so this leaves at least one free */
+  while (NULL != (block = g_async_queue_try_pop (self->full_blocks)))
+    g_async_queue_push (self->free_blocks, block);
+
+  g_thread_join (self->thread);
+
+  for (i = 0; i < N_BLOCKS; i++)
+    g_free (self->blocks[i].data);
+
+  g_async_queue_unref (self->free_blocks);
+  g_async_queue_unref (self->full_blocks);
+  g_clear_error (&self->error);
+  g_object_unref (self->cancellable);
+  g_object_unref (self->stream);
+  g_slice_free (SlReadAhead, self);
+}
+
+/**
+ * sl_read_ahead_next:
+ * @self: a #SlReadAhead
+ * @data: (out): a location for the data read
+ * @len: (out): a location for the length of @data, 0 at the end of the stream
+ * @error: a location for a #GError or %NULL
+ *
+ * Gets the next block of the stream, waiting for it to be read if
+ * necessary. @data is valid until the next call.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+sl_read_ahead_next (SlReadAhead   *self,
+                    const guint8 **data,
+                    gsize         *len,
+                    GError       **error)
+{
+  Block *block;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (data != NULL, FALSE);
+  g_return_val_if_fail (len != NULL, FALSE);
+
+  *data = NULL;
+  *len = 0;
+
+  if (self->current != NULL)
+    {
+      g_async_queue_push (self->free_blocks, self->current);
+      self->current = NULL;
+    }
+
+  if (self->finished)
+    return TRUE;
+
+  block = g_async_queue_pop (self->full_blocks);
+
+  if (block->len == 0)
+    {
+      self->finished = TRUE;
+      g_async_queue_push (self->free_blocks, block);
+
+      if (self->error != NULL)
+        {
+          g_propagate_error (error, g_steal_pointer (&self->error));
+          return FALSE;
+        }
+
+      return TRUE;
+    }
+
+  self->current = block;
+  *data = block->data;
+  *len = block->len;
+
+  return TRUE;
+}
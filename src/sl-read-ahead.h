@@ -0,0 +1,39 @@
+/* sl-read-ahead.h
+ *
+ * Copyright (C) 2015 Christian Hergert <christian@hergert.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_READ_AHEAD_H
+#define SL_READ_AHEAD_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SlReadAhead SlReadAhead;
+
+SlReadAhead *sl_read_ahead_new  (GInputStream   *stream);
+void         sl_read_ahead_free (SlReadAhead    *self);
+gboolean     sl_read_ahead_next (SlReadAhead    *self,
+                                 const guint8  **data,
+                                 gsize          *len,
+                                 GError        **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SlReadAhead, sl_read_ahead_free)
+
+G_END_DECLS
+
+#endif /* SL_READ_AHEAD_H */
@@ -0,0 +1,406 @@
+/* sl-result-cache.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-result-cache"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "sl-file-info.h"
+#include "sl-result-cache.h"
+
+/*
+ * Cache entries are stored one per file beneath the cache directory, named
+ * by the hex key (split into a two character fan-out directory). The key is
+ * derived from the source contents and normalized arguments. Since the set
+ * of headers a file includes is only known after parsing, each entry also
+ * records the dependencies seen at parse time and they are revalidated on
+ * lookup (first by size/mtime, then by content digest, see sl-file-info.c).
+ *
+ * The file is laid out so it can be used directly from a mapping:
+ *
+ *   EntryHeader
+ *   EntryDep[n_deps]
+ *   EntryCount[n_counts]
+ *   gchar strings[strings_len]   (\0 separated, referenced by offset)
+ *   guint8 extra[extra_len]      (opaque, such as cross-references)
+ *
+ * The string table is padded to a multiple of four bytes so that the extra
+ * data may be used in place.
+ */
+
+#define ENTRY_MAGIC   0x43524c53 /* "SLRC" */
+#define ENTRY_VERSION 4
+#define DIGEST_LEN    SL_FILE_INFO_DIGEST_LEN
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint32 n_deps;
+  guint32 n_counts;
+  guint32 strings_len;
+  guint32 extra_len;
+} EntryHeader;
+
+typedef struct
+{
+  guint64 size;
+  gint64  mtime;
+  guint32 path;
+  guint8  digest[DIGEST_LEN];
+} EntryDep;
+
+typedef struct
+{
+  guint32 key;
+  guint32 name;
+  guint32 count;
+} EntryCount;
+
+G_STATIC_ASSERT (sizeof (EntryHeader) == 24);
+G_STATIC_ASSERT (sizeof (EntryDep) == 40);
+G_STATIC_ASSERT (sizeof (EntryCount) == 12);
+
+struct _SlResultCache
+{
+  gchar *directory;
+  gchar *salt;
+};
+
+SlResultCache *
+sl_result_cache_new (const gchar *directory)
+{
+  SlResultCache *self;
+
+  g_return_val_if_fail (directory != NULL, NULL);
+
+  self = g_slice_new0 (SlResultCache);
+  self->directory = g_strdup (directory);
+
+  return self;
+}
+
+void
+sl_result_cache_free (SlResultCache *self)
+{
+  if (self != NULL)
+    {
+      g_clear_pointer (&self->directory, g_free);
+      g_clear_pointer (&self->salt, g_free);
+      g_slice_free (SlResultCache, self);
+    }
+}
+
+/**
+ * sl_result_cache_set_salt:
+ * @self: a #SlResultCache
+ * @salt: (nullable): a string identifying how results are computed
+ *
+ * Sets a string which is mixed into every key, so that results produced
+ * with different options (such as keying callees by USR) are kept apart.
+ */
+void
+sl_result_cache_set_salt (SlResultCache *self,
+                          const gchar   *salt)
+{
+  g_return_if_fail (self != NULL);
+
+  g_free (self->salt);
+  self->salt = g_strdup (salt);
+}
+
+static gchar *
+sl_result_cache_get_path (SlResultCache *self,
+                          const gchar   *key)
+{
+  g_autofree gchar *fanout = g_strndup (key, 2);
+
+  return g_build_filename (self->directory, fanout, key, NULL);
+}
+
+/**
+ * sl_result_cache_get_key:
+ * @self: a #SlResultCache
+ * @filename: the source file
+ * @argv: the arguments the source file is parsed with
+ *
+ * Computes the cache key for @filename. Arguments which only affect
+ * how fast a file is parsed (such as "-include-pch" and its temporary
+ * path) are not part of the key.
+ *
+ * Returns: (nullable) (transfer full): a hex key, or %NULL if @filename
+ *   could not be read.
+ */
+gchar *
+sl_result_cache_get_key (SlResultCache        *self,
+                         const gchar          *filename,
+                         const gchar * const  *argv)
+{
+  g_autoptr(GMappedFile) mf = NULL;
+  g_autoptr(GChecksum) checksum = NULL;
+  guint32 version = ENTRY_VERSION;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (argv != NULL, NULL);
+
+  if (NULL == (mf = g_mapped_file_new (filename, FALSE, NULL)))
+    return NULL;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (checksum, (const guchar *)&version, sizeof version);
+  if (self->salt != NULL)
+    g_checksum_update (checksum, (const guchar *)self->salt, strlen (self->salt) + 1);
+  g_checksum_update (checksum, (const guchar *)filename, strlen (filename) + 1);
+
+  for (i = 0; argv[i] != NULL; i++)
+    {
+      if (g_str_equal (argv[i], "-include-pch") && argv[i + 1] != NULL)
+        {
+          i++;
+          continue;
+        }
+
+      g_checksum_update (checksum, (const guchar *)argv[i], strlen (argv[i]) + 1);
+    }
+
+  g_checksum_update (checksum, (const guchar *)"", 1);
+  g_checksum_update (checksum,
+                     (const guchar *)g_mapped_file_get_contents (mf),
+                     g_mapped_file_get_length (mf));
+
+  return g_strdup (g_checksum_get_string (checksum));
+}
+
+/**
+ * sl_result_cache_lookup:
+ * @self: a #SlResultCache
+ * @key: a key from sl_result_cache_get_key()
+ * @dependencies: (nullable) (element-type filename): an array to add the
+ *   stored dependencies to, or %NULL
+ * @func: a function to call for each stored call count
+ * @user_data: closure data for @func
+ * @extra: (out) (optional) (nullable): a location for the extra data
+ *   stored with the entry
+ *
+ * Looks for a valid entry for @key. If one is found, @func is called for
+ * every (key, name, count) that was stored and the dependencies of the
+ * entry are added to @dependencies.
+ *
+ * Returns: %TRUE if the entry was found and all of its dependencies are
+ *   unchanged; otherwise %FALSE and @func is not called.
+ */
+gboolean
+sl_result_cache_lookup (SlResultCache     *self,
+                        const gchar       *key,
+                        GPtrArray         *dependencies,
+                        SlResultCacheFunc  func,
+                        gpointer           user_data,
+                        GBytes           **extra)
+{
+  g_autoptr(GMappedFile) mf = NULL;
+  g_autofree gchar *path = NULL;
+  const EntryHeader *header;
+  const EntryDep *deps;
+  const EntryCount *counts;
+  const gchar *strings;
+  const gchar *data;
+  guint64 required;
+  gsize len;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (key != NULL, FALSE);
+  g_return_val_if_fail (func != NULL, FALSE);
+
+  path = sl_result_cache_get_path (self, key);
+
+  if (NULL == (mf = g_mapped_file_new (path, FALSE, NULL)))
+    return FALSE;
+
+  data = g_mapped_file_get_contents (mf);
+  len = g_mapped_file_get_length (mf);
+
+  if (len < sizeof *header)
+    return FALSE;
+
+  header = (const EntryHeader *)(gconstpointer)data;
+
+  if (header->magic != ENTRY_MAGIC || header->version != ENTRY_VERSION)
+    return FALSE;
+
+  required = sizeof *header
+           + (guint64)header->n_deps * sizeof (EntryDep)
+           + (guint64)header->n_counts * sizeof (EntryCount)
+           + header->strings_len
+           + header->extra_len;
+
+  if (len < required || header->strings_len == 0)
+    return FALSE;
+
+  deps = (const EntryDep *)(gconstpointer)(data + sizeof *header);
+  counts = (const EntryCount *)(gconstpointer)&deps[header->n_deps];
+  strings = (const gchar *)&counts[header->n_counts];
+
+  if (strings[header->strings_len - 1] != '\0')
+    return FALSE;
+
+  for (i = 0; i < header->n_deps; i++)
+    {
+      if (deps[i].path >= header->strings_len ||
+          !sl_file_info_is_current (&strings[deps[i].path], deps[i].size, deps[i].mtime, deps[i].digest))
+        return FALSE;
+    }
+
+  for (i = 0; i < header->n_counts; i++)
+    {
+      if (counts[i].key >= header->strings_len ||
+          counts[i].name >= header->strings_len)
+        return FALSE;
+    }
+
+  if (dependencies != NULL)
+    {
+      for (i = 0; i < header->n_deps; i++)
+        g_ptr_array_add (dependencies, g_strdup (&strings[deps[i].path]));
+    }
+
+  for (i = 0; i < header->n_counts; i++)
+    func (&strings[counts[i].key], &strings[counts[i].name], counts[i].count, user_data);
+
+  if (extra != NULL)
+    {
+      g_autoptr(GBytes) bytes = g_mapped_file_get_bytes (mf);
+
+      *extra = NULL;
+      if (header->extra_len > 0)
+        *extra = g_bytes_new_from_bytes (bytes, required - header->extra_len, header->extra_len);
+    }
+
+  return TRUE;
+}
+
+/**
+ * sl_result_cache_store:
+ * @self: a #SlResultCache
+ * @key: a key from sl_result_cache_get_key()
+ * @dependencies: (element-type filename): the headers included by the file
+ * @calls: the calls made by the file
+ * @extra: (nullable): additional data to store with the entry
+ *
+ * Stores the result of parsing a translation unit. Failure to write the
+ * entry is not fatal and only results in a cache miss on the next run.
+ */
+void
+sl_result_cache_store (SlResultCache        *self,
+                       const gchar          *key,
+                       GPtrArray            *dependencies,
+                       SlCallTable          *calls,
+                       GBytes               *extra)
+{
+  g_autoptr(GByteArray) buf = NULL;
+  g_autoptr(GString) strings = NULL;
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *dir = NULL;
+  const SlCallEntry *entries;
+  EntryHeader header = { 0 };
+  guint n_entries;
+  guint i;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (key != NULL);
+  g_return_if_fail (dependencies != NULL);
+  g_return_if_fail (calls != NULL);
+
+  entries = sl_call_table_get_entries (calls, &n_entries);
+
+  buf = g_byte_array_new ();
+  strings = g_string_new (NULL);
+
+  header.magic = ENTRY_MAGIC;
+  header.version = ENTRY_VERSION;
+  header.n_deps = dependencies->len;
+  header.n_counts = n_entries;
+  g_byte_array_append (buf, (const guint8 *)&header, sizeof header);
+
+  for (i = 0; i < dependencies->len; i++)
+    {
+      const gchar *dep_path = g_ptr_array_index (dependencies, i);
+      EntryDep dep = { 0 };
+      SlFileInfo info;
+
+      /* Don't store anything we could never validate */
+      if (!sl_file_info_get (dep_path, TRUE, &info))
+        return;
+
+      dep.size = info.size;
+      dep.mtime = info.mtime;
+      dep.path = strings->len;
+      memcpy (dep.digest, info.digest, DIGEST_LEN);
+      g_string_append_len (strings, dep_path, strlen (dep_path) + 1);
+
+      g_byte_array_append (buf, (const guint8 *)&dep, sizeof dep);
+    }
+
+  for (i = 0; i < n_entries; i++)
+    {
+      const SlCallEntry *entry = &entries[i];
+      EntryCount count;
+
+      count.key = strings->len;
+      count.count = entry->count;
+      g_string_append_len (strings, entry->key, strlen (entry->key) + 1);
+
+      /* Unless keyed by USR, the name is the key and is stored once */
+      count.name = count.key;
+      if (entry->name != entry->key)
+        {
+          count.name = strings->len;
+          g_string_append_len (strings, entry->name, strlen (entry->name) + 1);
+        }
+
+      g_byte_array_append (buf, (const guint8 *)&count, sizeof count);
+    }
+
+  /* Always have a non-empty string table so lookups can validate it */
+  do
+    g_string_append_c (strings, '\0');
+  while ((strings->len % 4) != 0);
+
+  ((EntryHeader *)(gpointer)buf->data)->strings_len = strings->len;
+  g_byte_array_append (buf, (const guint8 *)strings->str, strings->len);
+
+  if (extra != NULL)
+    {
+      gsize extra_len;
+      const guint8 *extra_data = g_bytes_get_data (extra, &extra_len);
+
+      ((EntryHeader *)(gpointer)buf->data)->extra_len = extra_len;
+      g_byte_array_append (buf, extra_data, extra_len);
+    }
+
+  path = sl_result_cache_get_path (self, key);
+  dir = g_path_get_dirname (path);
+
+  if (g_mkdir_with_parents (dir, 0750) != 0)
+    return;
+
+  g_file_set_contents (path, (const gchar *)buf->data, buf->len, NULL);
+}
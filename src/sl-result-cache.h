@@ -0,0 +1,58 @@
+/* sl-result-cache.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_RESULT_CACHE_H
+#define SL_RESULT_CACHE_H
+
+#include <glib.h>
+
+#include "sl-call-table.h"
+
+G_BEGIN_DECLS
+
+typedef struct _SlResultCache SlResultCache;
+
+typedef void (*SlResultCacheFunc) (const gchar *key,
+                                   const gchar *name,
+                                   guint        count,
+                                   gpointer     user_data);
+
+SlResultCache *sl_result_cache_new      (const gchar          *directory);
+void           sl_result_cache_free     (SlResultCache        *self);
+void           sl_result_cache_set_salt (SlResultCache        *self,
+                                         const gchar          *salt);
+gchar         *sl_result_cache_get_key  (SlResultCache        *self,
+                                         const gchar          *filename,
+                                         const gchar * const  *argv);
+gboolean       sl_result_cache_lookup   (SlResultCache        *self,
+                                         const gchar          *key,
+                                         GPtrArray            *dependencies,
+                                         SlResultCacheFunc     func,
+                                         gpointer              user_data,
+                                         GBytes              **extra);
+void           sl_result_cache_store    (SlResultCache        *self,
+                                         const gchar          *key,
+                                         GPtrArray            *dependencies,
+                                         SlCallTable          *calls,
+                                         GBytes               *extra);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SlResultCache, sl_result_cache_free)
+
+G_END_DECLS
+
+#endif /* SL_RESULT_CACHE_H */
@@ -0,0 +1,579 @@
+/* sl-scanner.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#define G_LOG_DOMAIN "sl-scanner"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# include <immintrin.h>
+# define HAVE_AVX2_DISPATCH 1
+#endif
+
+#include "sl-scanner.h"
+
+/*
+ * The scanner makes a single pass over the log looking for every pattern
+ * at once. Rather than searching for each literal, it computes a bitmask
+ * of candidate positions for a 64 byte block using a few byte compares:
+ *
+ *   - whitespace, '/' or '-' followed by 'g', 'c' or 'l', which is where
+ *     any of the compiler names may begin, after the directory or target
+ *     prefixing it if any, or
+ *   - ':' followed by ' ' and 'E' or 'L', for make's directory messages.
+ *
+ * Candidates are rare in typical logs and are verified with a scalar
+ * compare. Once a line has produced a match, the rest of it is skipped.
+ * Commands continue across lines ending in a backslash, as in the shell.
+ *
+ * The mask needs to look two bytes ahead of each position, so the vector
+ * paths require BLOCK_SIZE + 2 readable bytes and the tail is handled by
+ * the scalar implementation.
+ */
+
+#define BLOCK_SIZE 64
+#define LOOKAHEAD  2
+
+typedef guint64 (*ComputeMask) (const gchar *p);
+
+static const struct {
+  const gchar *name;
+  gsize        len;
+} commands[] = {
+  /* Longest first, since some are prefixes of others */
+  { "libtool", 7 },
+  { "clang++", 7 },
+  { "clang", 5 },
+  { "g++", 3 },
+  { "gcc", 3 },
+  { "cc", 2 },
+};
+
+static const gchar enter_directory[] = ": Entering directory ";
+static const gchar leave_directory[] = ": Leaving directory ";
+
+static inline gboolean
+is_boundary (gchar c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '/' || c == '-';
+}
+
+static inline gboolean
+is_command_start (gchar c)
+{
+  return c == 'g' || c == 'c' || c == 'l';
+}
+
+static inline gboolean
+is_candidate (gchar c0,
+              gchar c1,
+              gchar c2)
+{
+  return (is_boundary (c0) && is_command_start (c1)) ||
+         (c0 == ':' && c1 == ' ' && (c2 == 'E' || c2 == 'L'));
+}
+
+static guint64
+compute_mask_scalar (const gchar *p,
+                     gsize        avail)
+{
+  guint64 mask = 0;
+  gsize i;
+
+  for (i = 0; i < MIN (avail, BLOCK_SIZE); i++)
+    {
+      gchar c1 = (i + 1 < avail) ? p[i + 1] : 0;
+      gchar c2 = (i + 2 < avail) ? p[i + 2] : 0;
+
+      if (is_candidate (p[i], c1, c2))
+        mask |= G_GUINT64_CONSTANT (1) << i;
+    }
+
+  return mask;
+}
+
+#if defined(__SSE2__)
+static inline guint32
+compute_mask_sse2_16 (const gchar *p)
+{
+  __m128i c0 = _mm_loadu_si128 ((const __m128i *)(gconstpointer)p);
+  __m128i c1 = _mm_loadu_si128 ((const __m128i *)(gconstpointer)(p + 1));
+  __m128i c2 = _mm_loadu_si128 ((const __m128i *)(gconstpointer)(p + 2));
+  __m128i boundary;
+  __m128i start;
+  __m128i dir;
+
+  boundary = _mm_or_si128 (_mm_or_si128 (_mm_or_si128 (_mm_cmpeq_epi8 (c0, _mm_set1_epi8 (' ')),
+                                                       _mm_cmpeq_epi8 (c0, _mm_set1_epi8 ('\t'))),
+                                         _mm_cmpeq_epi8 (c0, _mm_set1_epi8 ('\n'))),
+                           _mm_or_si128 (_mm_cmpeq_epi8 (c0, _mm_set1_epi8 ('/')),
+                                         _mm_cmpeq_epi8 (c0, _mm_set1_epi8 ('-'))));
+  start = _mm_or_si128 (_mm_or_si128 (_mm_cmpeq_epi8 (c1, _mm_set1_epi8 ('g')),
+                                      _mm_cmpeq_epi8 (c1, _mm_set1_epi8 ('c'))),
+                        _mm_cmpeq_epi8 (c1, _mm_set1_epi8 ('l')));
+  dir = _mm_and_si128 (_mm_and_si128 (_mm_cmpeq_epi8 (c0, _mm_set1_epi8 (':')),
+                                      _mm_cmpeq_epi8 (c1, _mm_set1_epi8 (' '))),
+                       _mm_or_si128 (_mm_cmpeq_epi8 (c2, _mm_set1_epi8 ('E')),
+                                     _mm_cmpeq_epi8 (c2, _mm_set1_epi8 ('L'))));
+
+  return (guint32)_mm_movemask_epi8 (_mm_or_si128 (_mm_and_si128 (boundary, start), dir));
+}
+
+static guint64
+compute_mask_sse2 (const gchar *p)
+{
+  return (guint64)compute_mask_sse2_16 (p) |
+         ((guint64)compute_mask_sse2_16 (p + 16) << 16) |
+         ((guint64)compute_mask_sse2_16 (p + 32) << 32) |
+         ((guint64)compute_mask_sse2_16 (p + 48) << 48);
+}
+#endif
+
+#ifdef HAVE_AVX2_DISPATCH
+__attribute__((target ("avx2")))
+static inline guint32
+compute_mask_avx2_32 (const gchar *p)
+{
+  __m256i c0 = _mm256_loadu_si256 ((const __m256i *)(gconstpointer)p);
+  __m256i c1 = _mm256_loadu_si256 ((const __m256i *)(gconstpointer)(p + 1));
+  __m256i c2 = _mm256_loadu_si256 ((const __m256i *)(gconstpointer)(p + 2));
+  __m256i boundary;
+  __m256i start;
+  __m256i dir;
+
+  boundary = _mm256_or_si256 (_mm256_or_si256 (_mm256_or_si256 (_mm256_cmpeq_epi8 (c0, _mm256_set1_epi8 (' ')),
+                                                                _mm256_cmpeq_epi8 (c0, _mm256_set1_epi8 ('\t'))),
+                                               _mm256_cmpeq_epi8 (c0, _mm256_set1_epi8 ('\n'))),
+                              _mm256_or_si256 (_mm256_cmpeq_epi8 (c0, _mm256_set1_epi8 ('/')),
+                                               _mm256_cmpeq_epi8 (c0, _mm256_set1_epi8 ('-'))));
+  start = _mm256_or_si256 (_mm256_or_si256 (_mm256_cmpeq_epi8 (c1, _mm256_set1_epi8 ('g')),
+                                            _mm256_cmpeq_epi8 (c1, _mm256_set1_epi8 ('c'))),
+                           _mm256_cmpeq_epi8 (c1, _mm256_set1_epi8 ('l')));
+  dir = _mm256_and_si256 (_mm256_and_si256 (_mm256_cmpeq_epi8 (c0, _mm256_set1_epi8 (':')),
+                                            _mm256_cmpeq_epi8 (c1, _mm256_set1_epi8 (' '))),
+                          _mm256_or_si256 (_mm256_cmpeq_epi8 (c2, _mm256_set1_epi8 ('E')),
+                                           _mm256_cmpeq_epi8 (c2, _mm256_set1_epi8 ('L'))));
+
+  return (guint32)_mm256_movemask_epi8 (_mm256_or_si256 (_mm256_and_si256 (boundary, start), dir));
+}
+
+__attribute__((target ("avx2")))
+static guint64
+compute_mask_avx2 (const gchar *p)
+{
+  return (guint64)compute_mask_avx2_32 (p) |
+         ((guint64)compute_mask_avx2_32 (p + 32) << 32);
+}
+#endif
+
+static guint64
+compute_mask_generic (const gchar *p)
+{
+  return compute_mask_scalar (p, BLOCK_SIZE + LOOKAHEAD);
+}
+
+static ComputeMask
+get_compute_mask (void)
+{
+  static gsize initialized;
+  static ComputeMask func;
+
+  if (g_once_init_enter (&initialized))
+    {
+      func = compute_mask_generic;
+
+#if defined(__SSE2__)
+      func = compute_mask_sse2;
+#endif
+
+#ifdef HAVE_AVX2_DISPATCH
+      __builtin_cpu_init ();
+      if (__builtin_cpu_supports ("avx2"))
+        func = compute_mask_avx2;
+#endif
+
+      g_once_init_leave (&initialized, 1);
+    }
+
+  return func;
+}
+
+static inline guint
+count_trailing_zeros (guint64 mask)
+{
+#ifdef __GNUC__
+  return __builtin_ctzll (mask);
+#else
+  guint i = 0;
+
+  while ((mask & 1) == 0)
+    {
+      mask >>= 1;
+      i++;
+    }
+
+  return i;
+#endif
+}
+
+static const gchar *
+find_line_start (const SlScanner *self,
+                 const gchar     *p)
+{
+  const gchar *nl = memrchr (self->data, '\n', p - self->data);
+
+  return nl ? nl + 1 : self->data;
+}
+
+static const gchar *
+find_line_end (const SlScanner *self,
+               const gchar     *p)
+{
+  const gchar *end = self->data + self->len;
+  const gchar *nl = memchr (p, '\n', end - p);
+
+  return nl ? nl : end;
+}
+
+/*
+ * Checks if the newline at @nl is escaped with a backslash, in which case
+ * the shell treats the following line as part of the same command.
+ */
+static inline gboolean
+is_continued (const gchar *data,
+              const gchar *nl)
+{
+  const gchar *p = nl;
+  guint n_backslashes = 0;
+
+  if (p > data && p[-1] == '\r')
+    p--;
+
+  while (p > data && p[-1] == '\\')
+    {
+      n_backslashes++;
+      p--;
+    }
+
+  return (n_backslashes & 1) != 0;
+}
+
+static const gchar *
+find_command_end (const SlScanner *self,
+                  const gchar     *p)
+{
+  const gchar *end = self->data + self->len;
+  const gchar *line_end;
+
+  while ((line_end = find_line_end (self, p)) < end && is_continued (self->data, line_end))
+    p = line_end + 1;
+
+  return line_end;
+}
+
+/*
+ * Skips a version suffix such as "-12" or "-17.0" after a compiler name,
+ * as installed side by side by most distributions. Returns the length of
+ * the suffix, or 0 if there is none.
+ */
+static gsize
+skip_version_suffix (const gchar *p,
+                     gsize        avail)
+{
+  gsize i = 2;
+
+  if (avail < 2 || p[0] != '-' || !g_ascii_isdigit (p[1]))
+    return 0;
+
+  while (i < avail && (g_ascii_isdigit (p[i]) || p[i] == '.'))
+    i++;
+
+  return i;
+}
+
+/*
+ * Finds the start of the word containing @p, which names the compiler when
+ * it is prefixed with its directory, as in "/usr/bin/gcc", or the target it
+ * builds for, as in "x86_64-linux-gnu-gcc". Returns %NULL if the word is a
+ * flag, as in "-lgcc" or "--gcc-toolchain=".
+ */
+static const gchar *
+find_word_start (const SlScanner *self,
+                 const gchar     *p)
+{
+  if (p == self->data || g_ascii_isspace (p[-1]))
+    return p;
+
+  if (p[-1] != '/' && p[-1] != '-')
+    return NULL;
+
+  while (p > self->data && !g_ascii_isspace (p[-1]))
+    p--;
+
+  return *p != '-' ? p : NULL;
+}
+
+static gboolean
+sl_scanner_match_command (SlScanner   *self,
+                          gsize        pos,
+                          SlScanMatch *match)
+{
+  const gchar *p = self->data + pos;
+  const gchar *word;
+  gsize avail = self->len - pos;
+  guint i;
+
+  /* The whole word is the command, so "x86_64-linux-gnu-gcc" is not "gcc" */
+  if (NULL == (word = find_word_start (self, p)))
+    return FALSE;
+
+  for (i = 0; i < G_N_ELEMENTS (commands); i++)
+    {
+      const gchar *line_end;
+      gsize len = commands[i].len;
+
+      if (avail <= len || memcmp (p, commands[i].name, len) != 0)
+        continue;
+
+      len += skip_version_suffix (p + len, avail - len);
+
+      if (avail <= len || (p[len] != ' ' && p[len] != '\t'))
+        continue;
+
+      line_end = find_command_end (self, p);
+
+      /* Only libtool's compile mode will contain a compiler invocation */
+      if (i == 0 && !memmem (p, line_end - p, "--mode=compile", 14))
+        return FALSE;
+
+      match->kind = SL_SCAN_COMMAND;
+      match->line = find_line_start (self, word);
+      match->line_len = line_end - match->line;
+      match->match = word;
+      match->match_len = line_end - word;
+
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+sl_scanner_match_directory (SlScanner   *self,
+                            gsize        pos,
+                            SlScanMatch *match)
+{
+  const gchar *p = self->data + pos;
+  const gchar *line_end;
+  const gchar *path;
+  gsize avail = self->len - pos;
+  gsize len;
+
+  if (avail >= sizeof enter_directory &&
+      memcmp (p, enter_directory, sizeof enter_directory - 1) == 0)
+    {
+      match->kind = SL_SCAN_ENTER_DIRECTORY;
+      len = sizeof enter_directory - 1;
+    }
+  else if (avail >= sizeof leave_directory &&
+           memcmp (p, leave_directory, sizeof leave_directory - 1) == 0)
+    {
+      match->kind = SL_SCAN_LEAVE_DIRECTORY;
+      len = sizeof leave_directory - 1;
+    }
+  else
+    return FALSE;
+
+  /* GNU make quotes with '' or, in older versions, `' */
+  if (p[len] != '\'' && p[len] != '`')
+    return FALSE;
+
+  path = p + len + 1;
+  line_end = find_line_end (self, p);
+
+  match->line = find_line_start (self, p);
+  match->line_len = line_end - match->line;
+  match->match = path;
+  match->match_len = line_end - path;
+
+  if (match->match_len > 0 && path[match->match_len - 1] == '\'')
+    match->match_len--;
+
+  return TRUE;
+}
+
+/**
+ * sl_scanner_init:
+ * @scanner: an uninitialized #SlScanner
+ * @data: the buffer to scan
+ * @len: the length of @data in bytes
+ *
+ * Initializes @scanner to scan @data. @data is not copied and must remain
+ * valid while the scanner is in use.
+ */
+void
+sl_scanner_init (SlScanner   *scanner,
+                 const gchar *data,
+                 gsize        len)
+{
+  g_return_if_fail (scanner != NULL);
+  g_return_if_fail (data != NULL || len == 0);
+
+  scanner->data = data;
+  scanner->len = len;
+  scanner->block = 0;
+  scanner->next = 0;
+  scanner->mask = 0;
+  scanner->started = FALSE;
+}
+
+/**
+ * sl_scanner_next:
+ * @scanner: a #SlScanner
+ * @match: (out): a location for the match
+ *
+ * Advances to the next compiler invocation or make directory message in
+ * the buffer. At most one match is produced per line.
+ *
+ * Returns: %TRUE if @match was set; %FALSE at the end of the buffer.
+ */
+gboolean
+sl_scanner_next (SlScanner   *scanner,
+                 SlScanMatch *match)
+{
+  ComputeMask compute_mask = get_compute_mask ();
+
+  g_return_val_if_fail (scanner != NULL, FALSE);
+  g_return_val_if_fail (match != NULL, FALSE);
+
+  /* The first line has no boundary character in front of it */
+  if (!scanner->started)
+    {
+      scanner->started = TRUE;
+
+      if (sl_scanner_match_command (scanner, 0, match))
+        goto skip_line;
+    }
+
+  for (;;)
+    {
+      gsize pos;
+
+      if (scanner->mask == 0)
+        {
+          gsize avail;
+
+          if (scanner->next >= scanner->len)
+            return FALSE;
+
+          scanner->block = scanner->next;
+          scanner->next = scanner->block + BLOCK_SIZE;
+          avail = scanner->len - scanner->block;
+
+          if (avail >= BLOCK_SIZE + LOOKAHEAD)
+            scanner->mask = compute_mask (scanner->data + scanner->block);
+          else
+            scanner->mask = compute_mask_scalar (scanner->data + scanner->block, avail);
+
+          continue;
+        }
+
+      pos = scanner->block + count_trailing_zeros (scanner->mask);
+      scanner->mask &= scanner->mask - 1;
+
+      if (scanner->data[pos] == ':')
+        {
+          if (sl_scanner_match_directory (scanner, pos, match))
+            goto skip_line;
+        }
+      else if (sl_scanner_match_command (scanner, pos + 1, match))
+        goto skip_line;
+    }
+
+skip_line:
+  /* Resume at the newline, which may be the boundary for the next line */
+  scanner->next = (match->line + match->line_len) - scanner->data;
+  scanner->mask = 0;
+
+  return TRUE;
+}
+
+/**
+ * sl_scanner_find_line_boundary:
+ * @data: a buffer
+ * @len: the length of @data in bytes
+ * @pos: the offset to start searching from
+ *
+ * Finds the end of the first line ending at or after @pos. Newlines escaped
+ * with a backslash do not end a line, so a command continued across several
+ * lines is never split.
+ *
+ * Returns: the offset just past the newline, or @len if there is none.
+ */
+gsize
+sl_scanner_find_line_boundary (const gchar *data,
+                               gsize        len,
+                               gsize        pos)
+{
+  const gchar *nl;
+
+  g_return_val_if_fail (data != NULL || len == 0, len);
+
+  while (pos < len && NULL != (nl = memchr (data + pos, '\n', len - pos)))
+    {
+      pos = nl - data + 1;
+
+      if (!is_continued (data, nl))
+        return pos;
+    }
+
+  return len;
+}
+
+/**
+ * sl_scanner_find_last_line_boundary:
+ * @data: a buffer
+ * @len: the length of @data in bytes
+ *
+ * Like sl_scanner_find_line_boundary() but searches backwards from the end
+ * of @data, for use when splitting a stream into complete lines.
+ *
+ * Returns: the offset just past the last unescaped newline, or 0.
+ */
+gsize
+sl_scanner_find_last_line_boundary (const gchar *data,
+                                    gsize        len)
+{
+  const gchar *nl;
+
+  g_return_val_if_fail (data != NULL || len == 0, 0);
+
+  while (len > 0 && NULL != (nl = memrchr (data, '\n', len)))
+    {
+      if (!is_continued (data, nl))
+        return nl - data + 1;
+
+      len = nl - data;
+    }
+
+  return 0;
+}
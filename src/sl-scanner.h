@@ -0,0 +1,77 @@
+/* sl-scanner.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_SCANNER_H
+#define SL_SCANNER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  SL_SCAN_COMMAND,
+  SL_SCAN_ENTER_DIRECTORY,
+  SL_SCAN_LEAVE_DIRECTORY,
+} SlScanKind;
+
+typedef struct
+{
+  SlScanKind   kind;
+
+  /*
+   * The whole line containing the match, without the trailing newline.
+   * For commands continued with a backslash this spans several lines.
+   */
+  const gchar *line;
+  gsize        line_len;
+
+  /*
+   * For commands, the compiler invocation through the end of the line,
+   * starting with the whole word naming the compiler, including any
+   * directory or target prefix. For directory changes, the directory with quoting removed.
+   */
+  const gchar *match;
+  gsize        match_len;
+} SlScanMatch;
+
+typedef struct
+{
+  /*< private >*/
+  const gchar *data;
+  gsize        len;
+  gsize        block;
+  gsize        next;
+  guint64      mask;
+  gboolean     started;
+} SlScanner;
+
+void     sl_scanner_init                    (SlScanner   *scanner,
+                                             const gchar *data,
+                                             gsize        len);
+gboolean sl_scanner_next                    (SlScanner   *scanner,
+                                             SlScanMatch *match);
+gsize    sl_scanner_find_line_boundary      (const gchar *data,
+                                             gsize        len,
+                                             gsize        pos);
+gsize    sl_scanner_find_last_line_boundary (const gchar *data,
+                                             gsize        len);
+
+G_END_DECLS
+
+#endif /* SL_SCANNER_H */
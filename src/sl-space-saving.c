@@ -0,0 +1,456 @@
+/* sl-space-saving.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define G_LOG_DOMAIN "sl-space-saving"
+
+#include <string.h>
+
+#include "sl-space-saving.h"
+
+/*
+ * The Space-Saving heavy hitters summary (Metwally et al.), counting calls
+ * in a fixed number of counters however many distinct callees there are.
+ * A callee without a counter takes over the one with the smallest count,
+ * inheriting that count as its error. Every callee called more than
+ * total / capacity times is guaranteed to have a counter, and each count
+ * is too high by at most its error.
+ *
+ * The counters are kept in a binary min-heap on their count, so that the
+ * counter to take over is always at the top.
+ */
+
+struct _SlSpaceSaving
+{
+  SlSpaceSavingEntry *entries;
+  guint              *heap;      /* entry indexes, the smallest count first */
+  guint              *positions; /* the position of each entry in the heap */
+  GHashTable         *index;     /* key to entry index + 1 */
+  guint               capacity;
+  guint               n_entries;
+  guint64             total;
+};
+
+static inline void
+entry_clear (SlSpaceSavingEntry *entry)
+{
+  if (entry->name != entry->key)
+    g_free ((gchar *)entry->name);
+  g_free ((gchar *)entry->key);
+  entry->key = NULL;
+  entry->name = NULL;
+}
+
+static inline gboolean
+heap_less (SlSpaceSaving *self,
+           guint          a,
+           guint          b)
+{
+  return self->entries[self->heap[a]].count < self->entries[self->heap[b]].count;
+}
+
+static inline void
+heap_swap (SlSpaceSaving *self,
+           guint          a,
+           guint          b)
+{
+  guint tmp = self->heap[a];
+
+  self->heap[a] = self->heap[b];
+  self->heap[b] = tmp;
+  self->positions[self->heap[a]] = a;
+  self->positions[self->heap[b]] = b;
+}
+
+static void
+heap_sift_down (SlSpaceSaving *self,
+                guint          pos)
+{
+  for (;;)
+    {
+      guint left = 2 * pos + 1;
+      guint right = left + 1;
+      guint smallest = pos;
+
+      if (left < self->n_entries && heap_less (self, left, smallest))
+        smallest = left;
+      if (right < self->n_entries && heap_less (self, right, smallest))
+        smallest = right;
+
+      if (smallest == pos)
+        break;
+
+      heap_swap (self, pos, smallest);
+      pos = smallest;
+    }
+}
+
+static void
+heap_sift_up (SlSpaceSaving *self,
+              guint          pos)
+{
+  while (pos > 0)
+    {
+      guint parent = (pos - 1) / 2;
+
+      if (!heap_less (self, pos, parent))
+        break;
+
+      heap_swap (self, pos, parent);
+      pos = parent;
+    }
+}
+
+/**
+ * sl_space_saving_new:
+ * @capacity: the number of counters
+ *
+ * Creates a new #SlSpaceSaving with @capacity counters, which is all the
+ * memory it will ever use besides the strings of the keys it holds.
+ *
+ * Returns: (transfer full): A newly allocated #SlSpaceSaving.
+ */
+SlSpaceSaving *
+sl_space_saving_new (guint capacity)
+{
+  SlSpaceSaving *self;
+
+  g_return_val_if_fail (capacity > 0, NULL);
+
+  self = g_new0 (SlSpaceSaving, 1);
+  self->capacity = capacity;
+  self->entries = g_new0 (SlSpaceSavingEntry, capacity);
+  self->heap = g_new (guint, capacity);
+  self->positions = g_new (guint, capacity);
+  self->index = g_hash_table_new (g_str_hash, g_str_equal);
+
+  return self;
+}
+
+void
+sl_space_saving_free (SlSpaceSaving *self)
+{
+  guint i;
+
+  if (self != NULL)
+    {
+      for (i = 0; i < self->n_entries; i++)
+        entry_clear (&self->entries[i]);
+
+      g_hash_table_unref (self->index);
+      g_free (self->entries);
+      g_free (self->heap);
+      g_free (self->positions);
+      g_free (self);
+    }
+}
+
+static inline guint64
+sl_space_saving_get_min (SlSpaceSaving *self)
+{
+  /* Until every counter is used, nothing was ever left out */
+  if (self->n_entries < self->capacity)
+    return 0;
+
+  return self->entries[self->heap[0]].count;
+}
+
+static void
+sl_space_saving_add_full (SlSpaceSaving *self,
+                          const gchar   *key,
+                          const gchar   *name,
+                          guint64        count,
+                          guint64        error)
+{
+  SlSpaceSavingEntry *entry;
+  gpointer value;
+  guint i;
+
+  g_assert (self != NULL);
+  g_assert (key != NULL);
+
+  self->total += count;
+
+  if (NULL != (value = g_hash_table_lookup (self->index, key)))
+    {
+      i = GPOINTER_TO_UINT (value) - 1;
+      self->entries[i].count += count;
+      self->entries[i].error += error;
+      heap_sift_down (self, self->positions[i]);
+      return;
+    }
+
+  if (self->n_entries < self->capacity)
+    {
+      i = self->n_entries++;
+      entry = &self->entries[i];
+      entry->count = count;
+      entry->error = error;
+      self->heap[i] = i;
+      self->positions[i] = i;
+    }
+  else
+    {
+      /* Take over the smallest counter, which bounds what this key had */
+      i = self->heap[0];
+      entry = &self->entries[i];
+      g_hash_table_remove (self->index, entry->key);
+      entry_clear (entry);
+      entry->error = entry->count + error;
+      entry->count += count;
+    }
+
+  entry->key = g_strdup (key);
+  entry->name = name != NULL && strcmp (name, key) != 0 ? g_strdup (name) : entry->key;
+  g_hash_table_insert (self->index, (gchar *)entry->key, GUINT_TO_POINTER (i + 1));
+
+  /* A new counter starts at the bottom, a taken over one at the top */
+  heap_sift_up (self, self->positions[i]);
+  heap_sift_down (self, self->positions[i]);
+}
+
+/**
+ * sl_space_saving_add:
+ * @self: a #SlSpaceSaving
+ * @key: the callee
+ * @name: (nullable): the name to display if different from @key
+ * @count: the number of calls to add
+ *
+ * Adds @count calls to @key, taking over the smallest counter if @key does
+ * not have one yet and every counter is used.
+ */
+void
+sl_space_saving_add (SlSpaceSaving *self,
+                     const gchar   *key,
+                     const gchar   *name,
+                     guint64        count)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (key != NULL);
+
+  sl_space_saving_add_full (self, key, name, count, 0);
+}
+
+/**
+ * sl_space_saving_add_calls:
+ * @self: a #SlSpaceSaving
+ * @calls: the exact counts of a translation unit
+ *
+ * Adds every callee in @calls, which is left as it is.
+ */
+void
+sl_space_saving_add_calls (SlSpaceSaving *self,
+                           SlCallTable   *calls)
+{
+  const SlCallEntry *entries;
+  guint n_entries;
+  guint i;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (calls != NULL);
+
+  entries = sl_call_table_get_entries (calls, &n_entries);
+
+  for (i = 0; i < n_entries; i++)
+    {
+      if (entries[i].count > 0)
+        sl_space_saving_add_full (self, entries[i].key, entries[i].name, entries[i].count, 0);
+    }
+}
+
+static gint
+compare_entry (gconstpointer a,
+               gconstpointer b)
+{
+  const SlSpaceSavingEntry *entry_a = a;
+  const SlSpaceSavingEntry *entry_b = b;
+
+  if (entry_a->count > entry_b->count)
+    return -1;
+  else if (entry_a->count < entry_b->count)
+    return 1;
+  else
+    return 0;
+}
+
+/**
+ * sl_space_saving_merge:
+ * @self: a #SlSpaceSaving
+ * @other: the #SlSpaceSaving to merge into @self
+ *
+ * Adds the counts in @other to @self, as if @self had seen what @other
+ * did (Agarwal et al., "Mergeable Summaries"). A key missing from one of
+ * the summaries may have had up to its smallest count there, which is
+ * added to both its count and its error. Then only the largest counts are
+ * kept. @other is left as it is.
+ */
+void
+sl_space_saving_merge (SlSpaceSaving *self,
+                       SlSpaceSaving *other)
+{
+  g_autoptr(GArray) merged = NULL;
+  guint64 self_min;
+  guint64 other_min;
+  guint i;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (other != NULL);
+  g_return_if_fail (self != other);
+
+  self_min = sl_space_saving_get_min (self);
+  other_min = sl_space_saving_get_min (other);
+
+  merged = g_array_sized_new (FALSE, FALSE, sizeof (SlSpaceSavingEntry), self->n_entries + other->n_entries);
+
+  for (i = 0; i < self->n_entries; i++)
+    {
+      SlSpaceSavingEntry entry = self->entries[i];
+      gpointer value;
+
+      if (NULL != (value = g_hash_table_lookup (other->index, entry.key)))
+        {
+          const SlSpaceSavingEntry *found = &other->entries[GPOINTER_TO_UINT (value) - 1];
+
+          entry.count += found->count;
+          entry.error += found->error;
+        }
+      else
+        {
+          entry.count += other_min;
+          entry.error += other_min;
+        }
+
+      g_array_append_val (merged, entry);
+    }
+
+  for (i = 0; i < other->n_entries; i++)
+    {
+      const SlSpaceSavingEntry *found = &other->entries[i];
+      SlSpaceSavingEntry entry;
+
+      if (g_hash_table_contains (self->index, found->key))
+        continue;
+
+      entry.key = g_strdup (found->key);
+      entry.name = found->name != found->key ? g_strdup (found->name) : entry.key;
+      entry.count = found->count + self_min;
+      entry.error = found->error + self_min;
+
+      g_array_append_val (merged, entry);
+    }
+
+  g_array_sort (merged, compare_entry);
+  g_hash_table_remove_all (self->index);
+
+  self->n_entries = MIN (merged->len, self->capacity);
+  self->total += other->total;
+
+  for (i = 0; i < merged->len; i++)
+    {
+      SlSpaceSavingEntry *entry = &g_array_index (merged, SlSpaceSavingEntry, i);
+
+      if (i >= self->n_entries)
+        {
+          entry_clear (entry);
+          continue;
+        }
+
+      self->entries[i] = *entry;
+      self->heap[i] = i;
+      self->positions[i] = i;
+      g_hash_table_insert (self->index, (gchar *)entry->key, GUINT_TO_POINTER (i + 1));
+    }
+
+  for (i = self->n_entries / 2; i > 0; i--)
+    heap_sift_down (self, i - 1);
+}
+
+/**
+ * sl_space_saving_get_total:
+ * @self: a #SlSpaceSaving
+ *
+ * Gets the number of calls added. No count is too high by more than this
+ * divided by the capacity.
+ *
+ * Returns: the number of calls
+ */
+guint64
+sl_space_saving_get_total (SlSpaceSaving *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->total;
+}
+
+/**
+ * sl_space_saving_get_entries:
+ * @self: a #SlSpaceSaving
+ * @n_entries: (out): the number of entries
+ *
+ * Gets the counters, in no particular order.
+ *
+ * Returns: (transfer none) (array length=n_entries): the entries
+ */
+const SlSpaceSavingEntry *
+sl_space_saving_get_entries (SlSpaceSaving *self,
+                             guint         *n_entries)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (n_entries != NULL, NULL);
+
+  *n_entries = self->n_entries;
+
+  return self->entries;
+}
+
+static gint
+compare_rank (gconstpointer a,
+              gconstpointer b,
+              gpointer      user_data)
+{
+  const SlSpaceSavingEntry *entries = user_data;
+
+  return compare_entry (&entries[*(const guint *)a], &entries[*(const guint *)b]);
+}
+
+/**
+ * sl_space_saving_rank:
+ * @self: a #SlSpaceSaving
+ *
+ * Orders the entries by descending count.
+ *
+ * Returns: (transfer full): entry indexes in rank order, of the same length
+ *   as the entries. Free with g_free().
+ */
+guint *
+sl_space_saving_rank (SlSpaceSaving *self)
+{
+  guint *order;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  order = g_new (guint, MAX (1, self->n_entries));
+
+  for (i = 0; i < self->n_entries; i++)
+    order[i] = i;
+
+  g_qsort_with_data (order, self->n_entries, sizeof (guint), compare_rank, self->entries);
+
+  return order;
+}
@@ -0,0 +1,62 @@
+/* sl-space-saving.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_SPACE_SAVING_H
+#define SL_SPACE_SAVING_H
+
+#include <glib.h>
+
+#include "sl-call-table.h"
+
+G_BEGIN_DECLS
+
+typedef struct _SlSpaceSaving SlSpaceSaving;
+
+typedef struct
+{
+  /* The identity of the callee, either its name or its USR */
+  const gchar *key;
+
+  /* The name to display, which is @key unless keyed by USR */
+  const gchar *name;
+
+  /* The true count is between @count - @error and @count */
+  guint64      count;
+  guint64      error;
+} SlSpaceSavingEntry;
+
+SlSpaceSaving            *sl_space_saving_new          (guint           capacity);
+void                      sl_space_saving_free         (SlSpaceSaving  *self);
+void                      sl_space_saving_add          (SlSpaceSaving  *self,
+                                                        const gchar    *key,
+                                                        const gchar    *name,
+                                                        guint64         count);
+void                      sl_space_saving_add_calls    (SlSpaceSaving  *self,
+                                                        SlCallTable    *calls);
+void                      sl_space_saving_merge        (SlSpaceSaving  *self,
+                                                        SlSpaceSaving  *other);
+guint64                   sl_space_saving_get_total    (SlSpaceSaving  *self);
+const SlSpaceSavingEntry *sl_space_saving_get_entries  (SlSpaceSaving  *self,
+                                                        guint          *n_entries);
+guint                    *sl_space_saving_rank         (SlSpaceSaving  *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SlSpaceSaving, sl_space_saving_free)
+
+G_END_DECLS
+
+#endif /* SL_SPACE_SAVING_H */
@@ -0,0 +1,1001 @@
+/* sl-state.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-state"
+
+#include <gio/gio.h>
+#include <string.h>
+
+#include "sl-file-info.h"
+#include "sl-flag-table.h"
+#include "sl-state.h"
+
+/*
+ * The state of a previous run, so that the next one only parses the
+ * translation units which changed. For each unit it records the flags it
+ * was compiled with, the files it depended on (with their size, mtime and
+ * digest) and what it contributed to the totals. The totals themselves are
+ * stored too, so that a run which finds a unit changed (or gone) subtracts
+ * its old contribution and adds the new one rather than starting over.
+ *
+ *   StateHeader
+ *   StateUnit[n_units]
+ *   gchar strings[strings_len]   (\0 separated, padded to 8 bytes)
+ *   blobs                        (each 8 byte aligned, referenced by offset)
+ *
+ * A unit's blobs are the serialized SlCallTable and SlXrefBuilder of its
+ * contribution and an info blob, which lists its dependencies and the
+ * headers it counted with --headers-once:
+ *
+ *   InfoHeader
+ *   InfoDep[n_deps]              (the first is the source file itself)
+ *   guint32 headers[n_headers]
+ *   gchar strings[strings_len]
+ *
+ * Units from the previous run keep referencing the mapped file, so loading
+ * the state does not depend on the size of what was recorded.
+ */
+
+#define STATE_MAGIC   0x54534c53 /* "SLST" */
+#define STATE_VERSION 1
+#define ALIGNMENT     8
+
+typedef struct
+{
+  guint64 offset;
+  guint64 length;
+} Blob;
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint32 n_units;
+  guint32 strings_len;
+  guint32 salt;
+  guint32 reserved;
+  Blob    calls;
+  Blob    xref;
+} StateHeader;
+
+typedef struct
+{
+  guint32 filename;
+  guint32 argv;
+  guint32 n_args;
+  guint32 reserved;
+  Blob    info;
+  Blob    calls;
+  Blob    xref;
+} StateUnit;
+
+typedef struct
+{
+  guint32 n_deps;
+  guint32 n_headers;
+  guint32 strings_len;
+  guint32 reserved;
+} InfoHeader;
+
+typedef struct
+{
+  guint64 size;
+  gint64  mtime;
+  guint32 path;
+  guint8  digest[SL_FILE_INFO_DIGEST_LEN];
+} InfoDep;
+
+G_STATIC_ASSERT (sizeof (StateHeader) == 56);
+G_STATIC_ASSERT (sizeof (StateUnit) == 64);
+G_STATIC_ASSERT (sizeof (InfoHeader) == 16);
+G_STATIC_ASSERT (sizeof (InfoDep) == 40);
+
+typedef struct
+{
+  const InfoHeader *header;
+  const InfoDep    *deps;
+  const guint32    *headers;
+  const gchar      *strings;
+} Info;
+
+typedef struct
+{
+  gchar               *filename;
+  const gchar * const *argv;
+
+  /* The contribution of the unit, NULL once invalidated */
+  GBytes              *info;
+  GBytes              *calls;
+  GBytes              *xref;
+
+  /* The contribution replaced during this run, to be subtracted */
+  GBytes              *stale_calls;
+  GBytes              *stale_xref;
+  guint                has_stale : 1;
+
+  /* If the unit is still part of the build */
+  guint                seen : 1;
+} Unit;
+
+struct _SlState
+{
+  GMutex       mutex;
+  gchar       *salt;
+  GMappedFile *mf;
+  GHashTable  *units;
+  GBytes      *calls;
+  GBytes      *xref;
+};
+
+static void
+unit_free (Unit *unit)
+{
+  g_free (unit->filename);
+  g_clear_pointer (&unit->info, g_bytes_unref);
+  g_clear_pointer (&unit->calls, g_bytes_unref);
+  g_clear_pointer (&unit->xref, g_bytes_unref);
+  g_clear_pointer (&unit->stale_calls, g_bytes_unref);
+  g_clear_pointer (&unit->stale_xref, g_bytes_unref);
+  g_slice_free (Unit, unit);
+}
+
+/* Moves the contribution of @unit aside, so it is subtracted when finishing */
+static void
+unit_invalidate (Unit *unit)
+{
+  if (unit->calls == NULL)
+    return;
+
+  g_assert (!unit->has_stale);
+
+  /* The info is kept, so the headers the unit counted can be released */
+  unit->stale_calls = g_steal_pointer (&unit->calls);
+  unit->stale_xref = g_steal_pointer (&unit->xref);
+  unit->has_stale = TRUE;
+}
+
+static gboolean
+info_parse (GBytes *bytes,
+            Info   *info)
+{
+  const guint8 *data;
+  gsize len;
+  guint i;
+
+  if (bytes == NULL)
+    return FALSE;
+
+  data = g_bytes_get_data (bytes, &len);
+
+  if (len < sizeof (InfoHeader))
+    return FALSE;
+
+  info->header = (const InfoHeader *)(gconstpointer)data;
+
+  if (info->header->strings_len == 0 ||
+      len < sizeof (InfoHeader)
+            + (guint64)info->header->n_deps * sizeof (InfoDep)
+            + (guint64)info->header->n_headers * sizeof (guint32)
+            + info->header->strings_len)
+    return FALSE;
+
+  info->deps = (const InfoDep *)(gconstpointer)(data + sizeof (InfoHeader));
+  info->headers = (const guint32 *)&info->deps[info->header->n_deps];
+  info->strings = (const gchar *)&info->headers[info->header->n_headers];
+
+  if (info->strings[info->header->strings_len - 1] != '\0')
+    return FALSE;
+
+  for (i = 0; i < info->header->n_deps; i++)
+    {
+      if (info->deps[i].path >= info->header->strings_len)
+        return FALSE;
+    }
+
+  for (i = 0; i < info->header->n_headers; i++)
+    {
+      if (info->headers[i] >= info->header->strings_len)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static GBytes *
+info_new (const gchar *filename,
+          GPtrArray   *dependencies,
+          GPtrArray   *headers)
+{
+  g_autoptr(GByteArray) buf = NULL;
+  g_autoptr(GString) strings = NULL;
+  InfoHeader header = { 0 };
+  guint i;
+
+  buf = g_byte_array_new ();
+  strings = g_string_new (NULL);
+
+  header.n_deps = 1 + (dependencies ? dependencies->len : 0);
+  header.n_headers = headers ? headers->len : 0;
+  g_byte_array_append (buf, (const guint8 *)&header, sizeof header);
+
+  for (i = 0; i < header.n_deps; i++)
+    {
+      const gchar *path = i == 0 ? filename : g_ptr_array_index (dependencies, i - 1);
+      InfoDep dep = { 0 };
+      SlFileInfo info;
+
+      /* Without a digest the unit could never be found unchanged */
+      if (!sl_file_info_get (path, TRUE, &info))
+        return NULL;
+
+      dep.size = info.size;
+      dep.mtime = info.mtime;
+      dep.path = strings->len;
+      memcpy (dep.digest, info.digest, SL_FILE_INFO_DIGEST_LEN);
+      g_string_append_len (strings, path, strlen (path) + 1);
+
+      g_byte_array_append (buf, (const guint8 *)&dep, sizeof dep);
+    }
+
+  for (i = 0; i < header.n_headers; i++)
+    {
+      const gchar *path = g_ptr_array_index (headers, i);
+      guint32 offset = strings->len;
+
+      g_string_append_len (strings, path, strlen (path) + 1);
+      g_byte_array_append (buf, (const guint8 *)&offset, sizeof offset);
+    }
+
+  g_string_append_c (strings, '\0');
+
+  header.strings_len = strings->len;
+  memcpy (buf->data, &header, sizeof header);
+  g_byte_array_append (buf, (const guint8 *)strings->str, strings->len);
+
+  return g_byte_array_free_to_bytes (g_steal_pointer (&buf));
+}
+
+static gboolean
+info_is_current (GBytes *bytes)
+{
+  Info info;
+  guint i;
+
+  if (!info_parse (bytes, &info))
+    return FALSE;
+
+  for (i = 0; i < info.header->n_deps; i++)
+    {
+      const InfoDep *dep = &info.deps[i];
+
+      if (!sl_file_info_is_current (&info.strings[dep->path], dep->size, dep->mtime, dep->digest))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+SlState *
+sl_state_new (const gchar *salt)
+{
+  SlState *self;
+
+  self = g_slice_new0 (SlState);
+  g_mutex_init (&self->mutex);
+  self->salt = g_strdup (salt ? salt : "");
+  self->units = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify)unit_free);
+
+  return self;
+}
+
+void
+sl_state_free (SlState *self)
+{
+  if (self != NULL)
+    {
+      g_clear_pointer (&self->units, g_hash_table_unref);
+      g_clear_pointer (&self->calls, g_bytes_unref);
+      g_clear_pointer (&self->xref, g_bytes_unref);
+      g_clear_pointer (&self->mf, g_mapped_file_unref);
+      g_clear_pointer (&self->salt, g_free);
+      g_mutex_clear (&self->mutex);
+      g_slice_free (SlState, self);
+    }
+}
+
+static gboolean
+set_invalid (GError      **error,
+             const gchar  *filename)
+{
+  g_set_error (error,
+               G_IO_ERROR,
+               G_IO_ERROR_INVALID_DATA,
+               "%s is not a valid state file",
+               filename);
+  return FALSE;
+}
+
+static GBytes *
+get_blob (GBytes     *bytes,
+          const Blob *blob)
+{
+  if (blob->length == 0)
+    return NULL;
+
+  return g_bytes_new_from_bytes (bytes, blob->offset, blob->length);
+}
+
+static gboolean
+blob_is_valid (const Blob *blob,
+               gsize       len)
+{
+  return blob->length == 0 ||
+         ((blob->offset % ALIGNMENT) == 0 &&
+          blob->offset <= len &&
+          blob->length <= len - blob->offset);
+}
+
+/**
+ * sl_state_new_from_file:
+ * @filename: a file written with sl_state_save()
+ * @salt: a string identifying how results are computed
+ * @error: a location for a #GError or %NULL
+ *
+ * Loads the state of a previous run. The state is only usable if it was
+ * computed with the same options, which is what @salt identifies; if it
+ * was not, %G_IO_ERROR_INVALID_DATA is returned.
+ *
+ * Returns: (transfer full): a #SlState or %NULL and @error is set.
+ */
+SlState *
+sl_state_new_from_file (const gchar  *filename,
+                        const gchar  *salt,
+                        GError      **error)
+{
+  g_autoptr(SlState) self = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GPtrArray) argv = NULL;
+  SlFlagTable *flag_table = sl_flag_table_get_default ();
+  const StateHeader *header;
+  const StateUnit *units;
+  const gchar *strings;
+  const gchar *data;
+  gsize len;
+  guint i;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  self = sl_state_new (salt);
+
+  if (NULL == (self->mf = g_mapped_file_new (filename, FALSE, error)))
+    return NULL;
+
+  bytes = g_mapped_file_get_bytes (self->mf);
+  data = g_bytes_get_data (bytes, &len);
+
+  if (len < sizeof *header)
+    return set_invalid (error, filename), NULL;
+
+  header = (const StateHeader *)(gconstpointer)data;
+
+  if (header->magic != STATE_MAGIC ||
+      header->version != STATE_VERSION ||
+      header->strings_len == 0 ||
+      len < sizeof *header + (guint64)header->n_units * sizeof (StateUnit) + header->strings_len ||
+      !blob_is_valid (&header->calls, len) ||
+      !blob_is_valid (&header->xref, len))
+    return set_invalid (error, filename), NULL;
+
+  units = (const StateUnit *)(gconstpointer)(data + sizeof *header);
+  strings = (const gchar *)&units[header->n_units];
+
+  if (strings[header->strings_len - 1] != '\0' || header->salt >= header->strings_len)
+    return set_invalid (error, filename), NULL;
+
+  if (!g_str_equal (&strings[header->salt], self->salt))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_DATA,
+                   "%s was computed with different options",
+                   filename);
+      return NULL;
+    }
+
+  self->calls = get_blob (bytes, &header->calls);
+  self->xref = get_blob (bytes, &header->xref);
+
+  argv = g_ptr_array_new ();
+
+  for (i = 0; i < header->n_units; i++)
+    {
+      const StateUnit *sunit = &units[i];
+      guint32 offset = sunit->argv;
+      Unit *unit;
+      guint j;
+
+      if (sunit->filename >= header->strings_len ||
+          !blob_is_valid (&sunit->info, len) ||
+          !blob_is_valid (&sunit->calls, len) ||
+          !blob_is_valid (&sunit->xref, len))
+        return set_invalid (error, filename), NULL;
+
+      g_ptr_array_set_size (argv, 0);
+
+      for (j = 0; j < sunit->n_args; j++)
+        {
+          if (offset >= header->strings_len)
+            return set_invalid (error, filename), NULL;
+
+          g_ptr_array_add (argv, (gpointer)&strings[offset]);
+          offset += strlen (&strings[offset]) + 1;
+        }
+
+      unit = g_slice_new0 (Unit);
+      unit->filename = g_strdup (&strings[sunit->filename]);
+      unit->argv = sl_flag_table_lookup (flag_table,
+                                         sl_flag_table_insert (flag_table,
+                                                               (const gchar * const *)argv->pdata,
+                                                               argv->len));
+      unit->info = get_blob (bytes, &sunit->info);
+      unit->calls = get_blob (bytes, &sunit->calls);
+      unit->xref = get_blob (bytes, &sunit->xref);
+
+      g_hash_table_replace (self->units, unit->filename, unit);
+    }
+
+  return g_steal_pointer (&self);
+}
+
+static void
+append_blob (GByteArray *buf,
+             GBytes     *bytes,
+             Blob       *blob)
+{
+  static const guint8 zeroes[ALIGNMENT];
+
+  blob->offset = 0;
+  blob->length = 0;
+
+  if (bytes == NULL || g_bytes_get_size (bytes) == 0)
+    return;
+
+  if ((buf->len % ALIGNMENT) != 0)
+    g_byte_array_append (buf, zeroes, ALIGNMENT - (buf->len % ALIGNMENT));
+
+  blob->offset = buf->len;
+  blob->length = g_bytes_get_size (bytes);
+  g_byte_array_append (buf, g_bytes_get_data (bytes, NULL), blob->length);
+}
+
+static void
+relocate_blob (Blob    *blob,
+               guint64  base)
+{
+  if (blob->length != 0)
+    blob->offset += base;
+}
+
+/**
+ * sl_state_save:
+ * @self: a #SlState
+ * @filename: the file to write
+ * @calls: the call counts of the run
+ * @xref: (nullable): the cross-references of the run
+ * @error: a location for a #GError or %NULL
+ *
+ * Writes the state of the run, including the totals computed by it. This
+ * should be called after sl_state_finish().
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+sl_state_save (SlState        *self,
+               const gchar    *filename,
+               SlCallTable    *calls,
+               SlXrefBuilder  *xref,
+               GError        **error)
+{
+  g_autoptr(GByteArray) blobs = NULL;
+  g_autoptr(GByteArray) buf = NULL;
+  g_autoptr(GString) strings = NULL;
+  g_autoptr(GArray) sunits = NULL;
+  g_autoptr(GBytes) calls_bytes = NULL;
+  g_autoptr(GBytes) xref_bytes = NULL;
+  StateHeader header = { 0 };
+  GHashTableIter iter;
+  gpointer value;
+  guint64 base;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (calls != NULL, FALSE);
+
+  blobs = g_byte_array_new ();
+  strings = g_string_new (NULL);
+  sunits = g_array_new (FALSE, FALSE, sizeof (StateUnit));
+
+  header.magic = STATE_MAGIC;
+  header.version = STATE_VERSION;
+  header.salt = strings->len;
+  g_string_append_len (strings, self->salt, strlen (self->salt) + 1);
+
+  calls_bytes = sl_call_table_serialize (calls);
+  append_blob (blobs, calls_bytes, &header.calls);
+
+  if (xref != NULL)
+    {
+      xref_bytes = sl_xref_builder_serialize (xref);
+      append_blob (blobs, xref_bytes, &header.xref);
+    }
+
+  g_mutex_lock (&self->mutex);
+
+  g_hash_table_iter_init (&iter, self->units);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      const Unit *unit = value;
+      StateUnit sunit = { 0 };
+
+      if (unit->calls == NULL)
+        continue;
+
+      sunit.filename = strings->len;
+      g_string_append_len (strings, unit->filename, strlen (unit->filename) + 1);
+
+      sunit.argv = strings->len;
+      for (sunit.n_args = 0; unit->argv[sunit.n_args] != NULL; sunit.n_args++)
+        g_string_append_len (strings, unit->argv[sunit.n_args], strlen (unit->argv[sunit.n_args]) + 1);
+
+      append_blob (blobs, unit->info, &sunit.info);
+      append_blob (blobs, unit->calls, &sunit.calls);
+      append_blob (blobs, unit->xref, &sunit.xref);
+
+      g_array_append_val (sunits, sunit);
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  /* Blobs follow the string table, which keeps them aligned */
+  do
+    g_string_append_c (strings, '\0');
+  while ((strings->len % ALIGNMENT) != 0);
+
+  header.n_units = sunits->len;
+  header.strings_len = strings->len;
+
+  base = sizeof header + (guint64)sunits->len * sizeof (StateUnit) + strings->len;
+
+  relocate_blob (&header.calls, base);
+  relocate_blob (&header.xref, base);
+
+  for (i = 0; i < sunits->len; i++)
+    {
+      StateUnit *sunit = &g_array_index (sunits, StateUnit, i);
+
+      relocate_blob (&sunit->info, base);
+      relocate_blob (&sunit->calls, base);
+      relocate_blob (&sunit->xref, base);
+    }
+
+  buf = g_byte_array_sized_new (base + blobs->len);
+  g_byte_array_append (buf, (const guint8 *)&header, sizeof header);
+  g_byte_array_append (buf, (const guint8 *)sunits->data, sizeof (StateUnit) * sunits->len);
+  g_byte_array_append (buf, (const guint8 *)strings->str, strings->len);
+  g_byte_array_append (buf, blobs->data, blobs->len);
+
+  return g_file_set_contents (filename, (const gchar *)buf->data, buf->len, error);
+}
+
+/**
+ * sl_state_load_totals:
+ * @self: a #SlState
+ * @calls: the table to add the previous call counts to
+ * @xref: (nullable): the builder to add the previous cross-references to
+ *
+ * Adds the totals of the previous run, which the run then adjusts for the
+ * translation units that changed.
+ *
+ * Returns: %TRUE if the totals were valid
+ */
+gboolean
+sl_state_load_totals (SlState       *self,
+                      SlCallTable   *calls,
+                      SlXrefBuilder *xref)
+{
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (calls != NULL, FALSE);
+
+  if (self->calls != NULL && !sl_call_table_deserialize (calls, self->calls))
+    return FALSE;
+
+  if (xref != NULL && self->xref != NULL && !sl_xref_builder_deserialize (xref, self->xref))
+    return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * sl_state_is_current:
+ * @self: a #SlState
+ * @filename: the source file of a translation unit
+ * @argv: the arguments of the translation unit, from the default #SlFlagTable
+ *
+ * Checks whether the translation unit is unchanged since the previous run,
+ * in which case its contribution to the totals is still valid. Otherwise
+ * its contribution is invalidated and the unit must be parsed and recorded
+ * with sl_state_update().
+ *
+ * Either way, the unit is known to still be part of the build.
+ *
+ * Returns: %TRUE if the unit does not need to be parsed
+ */
+gboolean
+sl_state_is_current (SlState             *self,
+                     const gchar         *filename,
+                     const gchar * const *argv)
+{
+  gboolean ret = FALSE;
+  Unit *unit;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (argv != NULL, FALSE);
+
+  g_mutex_lock (&self->mutex);
+
+  if (NULL != (unit = g_hash_table_lookup (self->units, filename)))
+    {
+      unit->seen = TRUE;
+
+      /* Flag sets are interned, so equal arguments have equal vectors */
+      ret = unit->calls != NULL && unit->argv == argv && info_is_current (unit->info);
+
+      if (!ret)
+        unit_invalidate (unit);
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
+
+/**
+ * sl_state_invalidate:
+ * @self: a #SlState
+ * @filename: the source file of a translation unit
+ *
+ * Invalidates the contribution of an unchanged translation unit, so that
+ * it may be parsed again.
+ */
+void
+sl_state_invalidate (SlState     *self,
+                     const gchar *filename)
+{
+  Unit *unit;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (filename != NULL);
+
+  g_mutex_lock (&self->mutex);
+  if (NULL != (unit = g_hash_table_lookup (self->units, filename)))
+    unit_invalidate (unit);
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * sl_state_update:
+ * @self: a #SlState
+ * @filename: the source file of a translation unit
+ * @argv: the arguments of the translation unit, from the default #SlFlagTable
+ * @dependencies: (element-type filename): the headers included by the unit
+ * @headers: (nullable) (element-type filename): the headers whose code was
+ *   counted as part of the unit
+ * @calls: the calls made by the unit
+ * @xref: (nullable): the cross-references of the unit
+ *
+ * Records the contribution of a translation unit which was parsed. This is
+ * safe to call from multiple threads.
+ */
+void
+sl_state_update (SlState             *self,
+                 const gchar         *filename,
+                 const gchar * const *argv,
+                 GPtrArray           *dependencies,
+                 GPtrArray           *headers,
+                 SlCallTable         *calls,
+                 SlXrefBuilder       *xref)
+{
+  g_autoptr(GBytes) info = NULL;
+  g_autoptr(GBytes) calls_bytes = NULL;
+  g_autoptr(GBytes) xref_bytes = NULL;
+  Unit *unit;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (filename != NULL);
+  g_return_if_fail (argv != NULL);
+  g_return_if_fail (dependencies != NULL);
+  g_return_if_fail (calls != NULL);
+
+  /* A unit which cannot be checked for changes is parsed on every run */
+  info = info_new (filename, dependencies, headers);
+  calls_bytes = sl_call_table_serialize (calls);
+  if (xref != NULL)
+    xref_bytes = sl_xref_builder_serialize (xref);
+
+  g_mutex_lock (&self->mutex);
+
+  if (NULL == (unit = g_hash_table_lookup (self->units, filename)))
+    {
+      unit = g_slice_new0 (Unit);
+      unit->filename = g_strdup (filename);
+      g_hash_table_insert (self->units, unit->filename, unit);
+    }
+
+  unit_invalidate (unit);
+  g_clear_pointer (&unit->info, g_bytes_unref);
+
+  unit->argv = argv;
+  unit->info = g_steal_pointer (&info);
+  unit->calls = g_steal_pointer (&calls_bytes);
+  unit->xref = g_steal_pointer (&xref_bytes);
+  unit->seen = TRUE;
+
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * sl_state_get_headers:
+ * @self: a #SlState
+ * @filename: the source file of a translation unit
+ * @argv: (out) (optional): a location for the arguments of the unit
+ *
+ * Gets the headers whose code was counted as part of a translation unit
+ * with --headers-once.
+ *
+ * Returns: (transfer full) (element-type filename) (nullable): the paths
+ *   of the headers, or %NULL if the unit is not known
+ */
+GPtrArray *
+sl_state_get_headers (SlState              *self,
+                      const gchar          *filename,
+                      const gchar * const **argv)
+{
+  GPtrArray *ret = NULL;
+  Unit *unit;
+  Info info;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  if (NULL != (unit = g_hash_table_lookup (self->units, filename)))
+    {
+      ret = g_ptr_array_new_with_free_func (g_free);
+
+      if (argv != NULL)
+        *argv = unit->argv;
+
+      if (info_parse (unit->info, &info))
+        {
+          for (i = 0; i < info.header->n_headers; i++)
+            g_ptr_array_add (ret, g_strdup (&info.strings[info.headers[i]]));
+        }
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
+
+/**
+ * sl_state_foreach_header:
+ * @self: a #SlState
+ * @func: a function to call for each header
+ * @user_data: closure data for @func
+ *
+ * Calls @func for each header counted as part of a translation unit with
+ * a valid contribution, along with the arguments of that unit.
+ */
+void
+sl_state_foreach_header (SlState           *self,
+                         SlStateHeaderFunc  func,
+                         gpointer           user_data)
+{
+  GHashTableIter iter;
+  gpointer value;
+  Info info;
+  guint i;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (func != NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  g_hash_table_iter_init (&iter, self->units);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      const Unit *unit = value;
+
+      if (unit->calls == NULL || !info_parse (unit->info, &info))
+        continue;
+
+      for (i = 0; i < info.header->n_headers; i++)
+        func (unit->argv, &info.strings[info.headers[i]], user_data);
+    }
+
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * sl_state_get_unseen:
+ * @self: a #SlState
+ *
+ * Gets the translation units of the previous run which were not part of
+ * this one, once every job is known.
+ *
+ * Returns: (transfer full) (element-type filename): the source files
+ */
+GPtrArray *
+sl_state_get_unseen (SlState *self)
+{
+  GPtrArray *ret;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  ret = g_ptr_array_new_with_free_func (g_free);
+
+  g_mutex_lock (&self->mutex);
+
+  g_hash_table_iter_init (&iter, self->units);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      const Unit *unit = value;
+
+      if (!unit->seen)
+        g_ptr_array_add (ret, g_strdup (unit->filename));
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
+
+/**
+ * sl_state_find_dependent:
+ * @self: a #SlState
+ * @argv: the arguments of a translation unit, from the default #SlFlagTable
+ * @path: the path of a header
+ *
+ * Finds a translation unit of this run with a valid contribution which was
+ * compiled with @argv and includes @path. This is used to find a unit to
+ * count a header which is no longer counted by any other. Units which were
+ * already invalidated during this run are skipped, since their previous
+ * contribution is waiting to be subtracted.
+ *
+ * Returns: (transfer full) (nullable): the source file of the unit
+ */
+gchar *
+sl_state_find_dependent (SlState             *self,
+                         const gchar * const *argv,
+                         const gchar         *path)
+{
+  gchar *ret = NULL;
+  GHashTableIter iter;
+  gpointer value;
+  Info info;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (argv != NULL, NULL);
+  g_return_val_if_fail (path != NULL, NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  g_hash_table_iter_init (&iter, self->units);
+
+  while (ret == NULL && g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      const Unit *unit = value;
+
+      if (!unit->seen || unit->has_stale || unit->calls == NULL || unit->argv != argv ||
+          !info_parse (unit->info, &info))
+        continue;
+
+      /* The first dependency is the source file itself */
+      for (i = 1; i < info.header->n_deps; i++)
+        {
+          if (g_str_equal (&info.strings[info.deps[i].path], path))
+            {
+              ret = g_strdup (unit->filename);
+              break;
+            }
+        }
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
+
+/**
+ * sl_state_finish:
+ * @self: a #SlState
+ * @calls: the totals to subtract stale call counts from
+ * @xref: (nullable): the totals to subtract stale cross-references from
+ *
+ * Subtracts the previous contribution of every translation unit which
+ * changed or is no longer part of the build, and forgets about the latter.
+ * This should be called once every job has completed.
+ */
+void
+sl_state_finish (SlState       *self,
+                 SlCallTable   *calls,
+                 SlXrefBuilder *xref)
+{
+  g_autoptr(SlCallTable) stale_calls = NULL;
+  g_autoptr(SlXrefBuilder) stale_xref = NULL;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (calls != NULL);
+
+  stale_calls = sl_call_table_new ();
+  if (xref != NULL)
+    stale_xref = sl_xref_builder_new ();
+
+  g_mutex_lock (&self->mutex);
+
+  g_hash_table_iter_init (&iter, self->units);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      Unit *unit = value;
+
+      if (!unit->seen)
+        unit_invalidate (unit);
+
+      if (unit->has_stale)
+        {
+          if (unit->stale_calls != NULL && sl_call_table_deserialize (stale_calls, unit->stale_calls))
+            sl_call_table_subtract (calls, stale_calls);
+
+          if (xref != NULL && unit->stale_xref != NULL &&
+              sl_xref_builder_deserialize (stale_xref, unit->stale_xref))
+            sl_xref_builder_subtract (xref, stale_xref);
+
+          g_clear_pointer (&unit->stale_calls, g_bytes_unref);
+          g_clear_pointer (&unit->stale_xref, g_bytes_unref);
+          unit->has_stale = FALSE;
+        }
+
+      if (unit->calls == NULL)
+        g_hash_table_iter_remove (&iter);
+    }
+
+  g_mutex_unlock (&self->mutex);
+}
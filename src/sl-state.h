@@ -0,0 +1,78 @@
+/* sl-state.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_STATE_H
+#define SL_STATE_H
+
+#include <glib.h>
+
+#include "sl-call-table.h"
+#include "sl-xref.h"
+
+G_BEGIN_DECLS
+
+typedef struct _SlState SlState;
+
+typedef void (*SlStateHeaderFunc) (const gchar * const *argv,
+                                   const gchar         *path,
+                                   gpointer             user_data);
+
+SlState   *sl_state_new                (const gchar          *salt);
+SlState   *sl_state_new_from_file      (const gchar          *filename,
+                                        const gchar          *salt,
+                                        GError              **error);
+void       sl_state_free               (SlState              *self);
+gboolean   sl_state_save               (SlState              *self,
+                                        const gchar          *filename,
+                                        SlCallTable          *calls,
+                                        SlXrefBuilder        *xref,
+                                        GError              **error);
+gboolean   sl_state_load_totals        (SlState              *self,
+                                        SlCallTable          *calls,
+                                        SlXrefBuilder        *xref);
+gboolean   sl_state_is_current         (SlState              *self,
+                                        const gchar          *filename,
+                                        const gchar * const  *argv);
+void       sl_state_invalidate         (SlState              *self,
+                                        const gchar          *filename);
+void       sl_state_update             (SlState              *self,
+                                        const gchar          *filename,
+                                        const gchar * const  *argv,
+                                        GPtrArray            *dependencies,
+                                        GPtrArray            *headers,
+                                        SlCallTable          *calls,
+                                        SlXrefBuilder        *xref);
+GPtrArray *sl_state_get_headers        (SlState              *self,
+                                        const gchar          *filename,
+                                        const gchar * const **argv);
+void       sl_state_foreach_header     (SlState              *self,
+                                        SlStateHeaderFunc     func,
+                                        gpointer              user_data);
+GPtrArray *sl_state_get_unseen         (SlState              *self);
+gchar     *sl_state_find_dependent     (SlState              *self,
+                                        const gchar * const  *argv,
+                                        const gchar          *path);
+void       sl_state_finish             (SlState              *self,
+                                        SlCallTable          *calls,
+                                        SlXrefBuilder        *xref);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SlState, sl_state_free)
+
+G_END_DECLS
+
+#endif /* SL_STATE_H */
@@ -0,0 +1,491 @@
+/* sl-stats.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-stats"
+
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "sl-stats.h"
+
+/* The number of translation units listed as the slowest */
+#define N_SLOWEST 10
+
+/*
+ * Counters and timings collected with --stats. Everything is recorded at
+ * the granularity of a phase of a translation unit or a chunk of a log,
+ * never per cursor or per line, so collecting them costs a few clock reads
+ * per translation unit.
+ */
+struct _SlStats
+{
+  GMutex        mutex;
+  gint64        begin;
+  SlStatsTime   phases[SL_STATS_N_PHASES];
+  guint64       counters[SL_STATS_N_COUNTERS];
+  GArray       *units;
+  GStringChunk *strings;
+
+  /* Kind of libclang memory to Memory, in the order first seen */
+  GHashTable   *memory;
+  GPtrArray    *memory_kinds;
+};
+
+typedef struct
+{
+  const gchar *filename;
+  SlStatsTime  parse;
+  SlStatsTime  visit;
+} Unit;
+
+typedef struct
+{
+  guint64 total;
+  guint64 max;
+} Memory;
+
+static const gchar *phase_names[] = {
+  "scan", "arguments", "pch", "cache", "parse", "visit", "aggregate",
+};
+
+static const gchar *counter_names[] = {
+  "bytes", "lines", "commands", "jobs", "duplicates", "unchanged", "cached", "parsed", "failed",
+  "held",
+};
+
+G_STATIC_ASSERT (G_N_ELEMENTS (phase_names) == SL_STATS_N_PHASES);
+G_STATIC_ASSERT (G_N_ELEMENTS (counter_names) == SL_STATS_N_COUNTERS);
+
+static gint64
+get_cpu_time (clockid_t clock)
+{
+  struct timespec ts;
+
+  if (clock_gettime (clock, &ts) != 0)
+    return 0;
+
+  return (gint64)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+static guint64
+get_peak_rss (void)
+{
+  struct rusage usage;
+
+  if (getrusage (RUSAGE_SELF, &usage) != 0)
+    return 0;
+
+  /* Linux reports kilobytes */
+  return (guint64)usage.ru_maxrss * 1024;
+}
+
+static gint
+compare_units (gconstpointer a,
+               gconstpointer b)
+{
+  const Unit *unit_a = a;
+  const Unit *unit_b = b;
+  gint64 total_a = unit_a->parse.wall + unit_a->visit.wall;
+  gint64 total_b = unit_b->parse.wall + unit_b->visit.wall;
+
+  if (total_a > total_b)
+    return -1;
+  else if (total_a < total_b)
+    return 1;
+
+  return strcmp (unit_a->filename, unit_b->filename);
+}
+
+static void
+append_json_string (GString     *str,
+                    const gchar *value)
+{
+  g_string_append_c (str, '"');
+
+  for (; *value != '\0'; value++)
+    {
+      guchar c = *value;
+
+      if (c == '"' || c == '\\')
+        {
+          g_string_append_c (str, '\\');
+          g_string_append_c (str, c);
+        }
+      else if (c < 0x20)
+        g_string_append_printf (str, "\\u%04x", c);
+      else
+        g_string_append_c (str, c);
+    }
+
+  g_string_append_c (str, '"');
+}
+
+static void
+append_json_time (GString           *str,
+                  const SlStatsTime *time)
+{
+  g_string_append_printf (str, "{ \"wall\": %.6f, \"cpu\": %.6f }",
+                          (gdouble)time->wall / G_USEC_PER_SEC,
+                          (gdouble)time->cpu / G_USEC_PER_SEC);
+}
+
+/**
+ * sl_stats_new:
+ *
+ * Creates a new #SlStats, which starts measuring the elapsed time.
+ *
+ * Returns: (transfer full): a new #SlStats
+ */
+SlStats *
+sl_stats_new (void)
+{
+  SlStats *self;
+
+  self = g_slice_new0 (SlStats);
+  g_mutex_init (&self->mutex);
+  self->begin = g_get_monotonic_time ();
+  self->units = g_array_new (FALSE, FALSE, sizeof (Unit));
+  self->strings = g_string_chunk_new (4096);
+  self->memory = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+  self->memory_kinds = g_ptr_array_new ();
+
+  return self;
+}
+
+void
+sl_stats_free (SlStats *self)
+{
+  if (self != NULL)
+    {
+      g_array_unref (self->units);
+      g_string_chunk_free (self->strings);
+      g_hash_table_unref (self->memory);
+      g_ptr_array_unref (self->memory_kinds);
+      g_mutex_clear (&self->mutex);
+      g_slice_free (SlStats, self);
+    }
+}
+
+/**
+ * sl_stats_add_time:
+ * @self: a #SlStats
+ * @phase: the phase the time was spent in
+ * @time: the time spent
+ *
+ * Adds @time to the total of @phase. This may be called from any thread.
+ */
+void
+sl_stats_add_time (SlStats           *self,
+                   SlStatsPhase       phase,
+                   const SlStatsTime *time)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (phase < SL_STATS_N_PHASES);
+  g_return_if_fail (time != NULL);
+
+  g_mutex_lock (&self->mutex);
+  self->phases[phase].wall += time->wall;
+  self->phases[phase].cpu += time->cpu;
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * sl_stats_add_count:
+ * @self: a #SlStats
+ * @counter: the counter to increase
+ * @count: the amount to add
+ *
+ * Adds @count to @counter. This may be called from any thread.
+ */
+void
+sl_stats_add_count (SlStats        *self,
+                    SlStatsCounter  counter,
+                    guint64         count)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (counter < SL_STATS_N_COUNTERS);
+
+  g_mutex_lock (&self->mutex);
+  self->counters[counter] += count;
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * sl_stats_add_unit:
+ * @self: a #SlStats
+ * @filename: the translation unit
+ * @parse: the time spent parsing it
+ * @visit: the time spent visiting its AST
+ *
+ * Records the time spent on a translation unit, which is added to the
+ * parse and visit phases. This may be called from any thread.
+ */
+void
+sl_stats_add_unit (SlStats           *self,
+                   const gchar       *filename,
+                   const SlStatsTime *parse,
+                   const SlStatsTime *visit)
+{
+  Unit unit;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (filename != NULL);
+  g_return_if_fail (parse != NULL);
+  g_return_if_fail (visit != NULL);
+
+  unit.parse = *parse;
+  unit.visit = *visit;
+
+  g_mutex_lock (&self->mutex);
+  unit.filename = g_string_chunk_insert_const (self->strings, filename);
+  g_array_append_val (self->units, unit);
+  self->phases[SL_STATS_PHASE_PARSE].wall += parse->wall;
+  self->phases[SL_STATS_PHASE_PARSE].cpu += parse->cpu;
+  self->phases[SL_STATS_PHASE_VISIT].wall += visit->wall;
+  self->phases[SL_STATS_PHASE_VISIT].cpu += visit->cpu;
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * sl_stats_add_memory:
+ * @self: a #SlStats
+ * @kind: the name of the kind of memory, which must outlive @self
+ * @bytes: the amount used by a translation unit
+ *
+ * Records memory libclang used for a translation unit, keeping the total
+ * and the largest amount of each kind. This may be called from any thread.
+ */
+void
+sl_stats_add_memory (SlStats     *self,
+                     const gchar *kind,
+                     guint64      bytes)
+{
+  Memory *memory;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (kind != NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  if (NULL == (memory = g_hash_table_lookup (self->memory, kind)))
+    {
+      memory = g_new0 (Memory, 1);
+      g_hash_table_insert (self->memory, (gchar *)kind, memory);
+      g_ptr_array_add (self->memory_kinds, (gchar *)kind);
+    }
+
+  memory->total += bytes;
+  memory->max = MAX (memory->max, bytes);
+
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * sl_stats_format:
+ * @self: a #SlStats
+ * @format: the format to use
+ *
+ * Formats everything recorded, along with the elapsed time, the CPU time
+ * of the process and its peak resident size.
+ *
+ * Returns: (transfer full): the formatted statistics
+ */
+GString *
+sl_stats_format (SlStats       *self,
+                 SlStatsFormat  format)
+{
+  g_autoptr(GArray) slowest = NULL;
+  SlStatsTime elapsed;
+  GString *str;
+  guint64 peak_rss;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  elapsed.wall = g_get_monotonic_time () - self->begin;
+  elapsed.cpu = get_cpu_time (CLOCK_PROCESS_CPUTIME_ID);
+  peak_rss = get_peak_rss ();
+
+  slowest = g_array_sized_new (FALSE, FALSE, sizeof (Unit), self->units->len);
+  g_array_append_vals (slowest, self->units->data, self->units->len);
+  g_array_sort (slowest, compare_units);
+  g_array_set_size (slowest, MIN (slowest->len, N_SLOWEST));
+
+  str = g_string_new (NULL);
+
+  if (format == SL_STATS_FORMAT_JSON)
+    {
+      g_string_append (str, "{\n  \"elapsed\": ");
+      append_json_time (str, &elapsed);
+      g_string_append_printf (str, ",\n  \"peak_rss\": %" G_GUINT64_FORMAT ",\n  \"phases\": {\n", peak_rss);
+
+      for (i = 0; i < SL_STATS_N_PHASES; i++)
+        {
+          g_string_append_printf (str, "    \"%s\": ", phase_names[i]);
+          append_json_time (str, &self->phases[i]);
+          g_string_append (str, i + 1 < SL_STATS_N_PHASES ? ",\n" : "\n");
+        }
+
+      g_string_append (str, "  },\n  \"counters\": {\n");
+
+      for (i = 0; i < SL_STATS_N_COUNTERS; i++)
+        g_string_append_printf (str, "    \"%s\": %" G_GUINT64_FORMAT "%s\n",
+                                counter_names[i], self->counters[i],
+                                i + 1 < SL_STATS_N_COUNTERS ? "," : "");
+
+      g_string_append (str, "  },\n  \"slowest_units\": [\n");
+
+      for (i = 0; i < slowest->len; i++)
+        {
+          const Unit *unit = &g_array_index (slowest, Unit, i);
+
+          g_string_append (str, "    { \"file\": ");
+          append_json_string (str, unit->filename);
+          g_string_append (str, ", \"parse\": ");
+          append_json_time (str, &unit->parse);
+          g_string_append (str, ", \"visit\": ");
+          append_json_time (str, &unit->visit);
+          g_string_append (str, i + 1 < slowest->len ? " },\n" : " }\n");
+        }
+
+      g_string_append (str, "  ],\n  \"libclang_memory\": {\n");
+
+      for (i = 0; i < self->memory_kinds->len; i++)
+        {
+          const gchar *kind = g_ptr_array_index (self->memory_kinds, i);
+          const Memory *memory = g_hash_table_lookup (self->memory, kind);
+
+          g_string_append (str, "    ");
+          append_json_string (str, kind);
+          g_string_append_printf (str, ": { \"total\": %" G_GUINT64_FORMAT ", \"max\": %" G_GUINT64_FORMAT " }%s\n",
+                                  memory->total, memory->max,
+                                  i + 1 < self->memory_kinds->len ? "," : "");
+        }
+
+      g_string_append (str, "  }\n}\n");
+    }
+  else
+    {
+      gdouble scan = (gdouble)self->phases[SL_STATS_PHASE_SCAN].wall / G_USEC_PER_SEC;
+
+      g_string_append_printf (str, "Elapsed %.3f s, %.3f s CPU, peak RSS %.1f MB\n\n",
+                              (gdouble)elapsed.wall / G_USEC_PER_SEC,
+                              (gdouble)elapsed.cpu / G_USEC_PER_SEC,
+                              peak_rss / (1024.0 * 1024.0));
+
+      g_string_append_printf (str, "%-12s %12s %12s\n", "Phase", "Wall (s)", "CPU (s)");
+      for (i = 0; i < SL_STATS_N_PHASES; i++)
+        g_string_append_printf (str, "%-12s %12.3f %12.3f\n",
+                                phase_names[i],
+                                (gdouble)self->phases[i].wall / G_USEC_PER_SEC,
+                                (gdouble)self->phases[i].cpu / G_USEC_PER_SEC);
+
+      g_string_append_printf (str, "\nScanned %" G_GUINT64_FORMAT " bytes, %" G_GUINT64_FORMAT " lines",
+                              self->counters[SL_STATS_BYTES], self->counters[SL_STATS_LINES]);
+      if (scan > 0)
+        g_string_append_printf (str, " (%.1f MB/s)",
+                                self->counters[SL_STATS_BYTES] / scan / (1024.0 * 1024.0));
+      g_string_append_c (str, '\n');
+
+      for (i = SL_STATS_COMMANDS; i < SL_STATS_N_COUNTERS; i++)
+        g_string_append_printf (str, "%-12s %12" G_GUINT64_FORMAT "\n", counter_names[i], self->counters[i]);
+
+      if (slowest->len > 0)
+        {
+          g_string_append_printf (str, "\n%12s %12s  %s\n", "Parse (ms)", "Visit (ms)", "Slowest units");
+
+          for (i = 0; i < slowest->len; i++)
+            {
+              const Unit *unit = &g_array_index (slowest, Unit, i);
+
+              g_string_append_printf (str, "%12.1f %12.1f  %s\n",
+                                      (gdouble)unit->parse.wall / 1000.0,
+                                      (gdouble)unit->visit.wall / 1000.0,
+                                      unit->filename);
+            }
+        }
+
+      if (self->memory_kinds->len > 0)
+        {
+          g_string_append_printf (str, "\n%-40s %12s %12s\n", "libclang memory", "Total (MB)", "Max (MB)");
+
+          for (i = 0; i < self->memory_kinds->len; i++)
+            {
+              const gchar *kind = g_ptr_array_index (self->memory_kinds, i);
+              const Memory *memory = g_hash_table_lookup (self->memory, kind);
+
+              g_string_append_printf (str, "%-40s %12.1f %12.1f\n",
+                                      kind,
+                                      memory->total / (1024.0 * 1024.0),
+                                      memory->max / (1024.0 * 1024.0));
+            }
+        }
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  return str;
+}
+
+/**
+ * sl_stats_timer_start:
+ * @timer: a #SlStatsTimer
+ *
+ * Starts measuring an interval of the calling thread.
+ */
+void
+sl_stats_timer_start (SlStatsTimer *timer)
+{
+  g_return_if_fail (timer != NULL);
+
+  timer->wall = g_get_monotonic_time ();
+  timer->cpu = get_cpu_time (CLOCK_THREAD_CPUTIME_ID);
+}
+
+/**
+ * sl_stats_timer_lap:
+ * @timer: a started #SlStatsTimer
+ * @time: (nullable): where to add the interval, or %NULL to discard it
+ *
+ * Adds the time elapsed since @timer was started or last lapped to @time,
+ * and starts the next interval. The CPU time is that of the calling thread.
+ */
+void
+sl_stats_timer_lap (SlStatsTimer *timer,
+                    SlStatsTime  *time)
+{
+  gint64 wall;
+  gint64 cpu;
+
+  g_return_if_fail (timer != NULL);
+
+  wall = g_get_monotonic_time ();
+  cpu = get_cpu_time (CLOCK_THREAD_CPUTIME_ID);
+
+  if (time != NULL)
+    {
+      time->wall += wall - timer->wall;
+      time->cpu += cpu - timer->cpu;
+    }
+
+  timer->wall = wall;
+  timer->cpu = cpu;
+}
@@ -0,0 +1,100 @@
+/* sl-stats.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_STATS_H
+#define SL_STATS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SlStats SlStats;
+
+typedef enum
+{
+  SL_STATS_PHASE_SCAN,      /* finding commands and directory changes in logs */
+  SL_STATS_PHASE_ARGUMENTS, /* parsing the arguments of commands */
+  SL_STATS_PHASE_PCH,       /* building precompiled headers */
+  SL_STATS_PHASE_CACHE,     /* looking up and storing cached results */
+  SL_STATS_PHASE_PARSE,     /* parsing translation units with libclang */
+  SL_STATS_PHASE_VISIT,     /* visiting the AST of translation units */
+  SL_STATS_PHASE_AGGREGATE, /* merging, saving and ranking the results */
+  SL_STATS_N_PHASES
+} SlStatsPhase;
+
+typedef enum
+{
+  SL_STATS_BYTES,      /* bytes of logs scanned */
+  SL_STATS_LINES,      /* lines of logs scanned */
+  SL_STATS_COMMANDS,   /* compiler invocations found */
+  SL_STATS_JOBS,       /* source files extracted from them */
+  SL_STATS_DUPLICATES, /* jobs skipped as already seen */
+  SL_STATS_UNCHANGED,  /* jobs skipped as unchanged with --state */
+  SL_STATS_CACHED,     /* translation units read from the cache */
+  SL_STATS_PARSED,     /* translation units parsed */
+  SL_STATS_FAILED,     /* translation units libclang failed to parse */
+  SL_STATS_HELD,       /* translation units held back by --memory-budget */
+  SL_STATS_N_COUNTERS
+} SlStatsCounter;
+
+typedef enum
+{
+  SL_STATS_FORMAT_TEXT,
+  SL_STATS_FORMAT_JSON,
+} SlStatsFormat;
+
+/* Time spent in a phase, summed over every thread */
+typedef struct
+{
+  gint64 wall;
+  gint64 cpu;
+} SlStatsTime;
+
+/* Measures consecutive intervals of the calling thread */
+typedef struct
+{
+  gint64 wall;
+  gint64 cpu;
+} SlStatsTimer;
+
+SlStats  *sl_stats_new            (void);
+void      sl_stats_free           (SlStats            *self);
+void      sl_stats_add_time       (SlStats            *self,
+                                   SlStatsPhase        phase,
+                                   const SlStatsTime  *time);
+void      sl_stats_add_count      (SlStats            *self,
+                                   SlStatsCounter      counter,
+                                   guint64             count);
+void      sl_stats_add_unit       (SlStats            *self,
+                                   const gchar        *filename,
+                                   const SlStatsTime  *parse,
+                                   const SlStatsTime  *visit);
+void      sl_stats_add_memory     (SlStats            *self,
+                                   const gchar        *kind,
+                                   guint64             bytes);
+GString  *sl_stats_format         (SlStats            *self,
+                                   SlStatsFormat       format);
+void      sl_stats_timer_start    (SlStatsTimer       *timer);
+void      sl_stats_timer_lap      (SlStatsTimer       *timer,
+                                   SlStatsTime        *time);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SlStats, sl_stats_free)
+
+G_END_DECLS
+
+#endif /* SL_STATS_H */
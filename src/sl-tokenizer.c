@@ -0,0 +1,380 @@
+/* sl-tokenizer.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-tokenizer"
+
+#include <string.h>
+
+#include "sl-tokenizer.h"
+
+/*
+ * A tokenizer for the compiler command lines found in build logs. It
+ * splits words like a POSIX shell would (quotes, backslash escapes and
+ * backslash-newline continuations), keeps `...`, $(...) and ${...} within
+ * a single word (only the text following the last expansion is used as the
+ * value), and stops at the end of the simple command (";", "|",
+ * "&&", "||"). Words are returned as slices of the buffer and classified
+ * in the same pass, so nothing is allocated unless a word contains quotes.
+ */
+
+static const gchar *
+skip_single_quote (const gchar *p,
+                   const gchar *end)
+{
+  const gchar *q;
+
+  g_assert (*p == '\'');
+
+  q = memchr (p + 1, '\'', end - p - 1);
+
+  return q ? q + 1 : end;
+}
+
+static const gchar *
+skip_double_quote (const gchar *p,
+                   const gchar *end)
+{
+  g_assert (*p == '"');
+
+  for (p++; p < end && *p != '"'; p++)
+    {
+      if (*p == '\\' && p + 1 < end)
+        p++;
+    }
+
+  return MIN (p + 1, end);
+}
+
+static const gchar *
+skip_backticks (const gchar *p,
+                const gchar *end)
+{
+  g_assert (*p == '`');
+
+  for (p++; p < end && *p != '`'; p++)
+    {
+      if (*p == '\\' && p + 1 < end)
+        p++;
+    }
+
+  return MIN (p + 1, end);
+}
+
+/* Skips $(...) or ${...}, with @p at the opening bracket */
+static const gchar *
+skip_group (const gchar *p,
+            const gchar *end)
+{
+  gchar open = *p;
+  gchar close = (open == '(') ? ')' : '}';
+  guint depth = 0;
+
+  while (p < end)
+    {
+      if (*p == '\\' && p + 1 < end)
+        p += 2;
+      else if (*p == '\'')
+        p = skip_single_quote (p, end);
+      else if (*p == '"')
+        p = skip_double_quote (p, end);
+      else if (*p == '`')
+        p = skip_backticks (p, end);
+      else if (*p == open)
+        depth++, p++;
+      else if (*p == close && --depth == 0)
+        return p + 1;
+      else
+        p++;
+    }
+
+  return end;
+}
+
+static inline gboolean
+is_continuation (const gchar *p,
+                 const gchar *end)
+{
+  return p + 1 < end && p[0] == '\\' &&
+         (p[1] == '\n' || (p[1] == '\r' && p + 2 < end && p[2] == '\n'));
+}
+
+static inline gboolean
+is_space (gchar c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/* Removes quoting from @len bytes at @p, appending to @out */
+static void
+unquote (const gchar *p,
+         gsize        len,
+         GString     *out)
+{
+  const gchar *end = p + len;
+
+  while (p < end)
+    {
+      if (*p == '\'')
+        {
+          const gchar *q = skip_single_quote (p, end);
+          const gchar *stop = (q > p + 1 && q[-1] == '\'') ? q - 1 : q;
+
+          g_string_append_len (out, p + 1, stop - p - 1);
+          p = q;
+        }
+      else if (*p == '"')
+        {
+          for (p++; p < end && *p != '"'; p++)
+            {
+              if (*p == '\\' && p + 1 < end && strchr ("\"\\$`\n", p[1]) != NULL)
+                p++;
+              g_string_append_c (out, *p);
+            }
+
+          p = MIN (p + 1, end);
+        }
+      else if (*p == '\\' && p + 1 < end)
+        {
+          if (p[1] != '\n')
+            g_string_append_c (out, p[1]);
+          p += 2;
+        }
+      else
+        g_string_append_c (out, *p++);
+    }
+}
+
+static gboolean
+has_source_extension (const gchar *value,
+                      gsize        len)
+{
+  static const struct {
+    const gchar *ext;
+    gsize        len;
+  } extensions[] = {
+    { ".c", 2 }, { ".h", 2 }, { ".cc", 3 }, { ".hh", 3 }, { ".cxx", 4 }, { ".cpp", 4 },
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (extensions); i++)
+    {
+      if (len >= extensions[i].len &&
+          memcmp (value + len - extensions[i].len, extensions[i].ext, extensions[i].len) == 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static inline gboolean
+has_prefix (const gchar *value,
+            gsize        len,
+            const gchar *prefix,
+            gsize        prefix_len)
+{
+  return len >= prefix_len && memcmp (value, prefix, prefix_len) == 0;
+}
+
+static SlTokenKind
+classify (const gchar *value,
+          gsize        len)
+{
+  if (len < 2)
+    return SL_TOKEN_OTHER;
+
+  if (has_source_extension (value, len))
+    return SL_TOKEN_SOURCE;
+
+  if (value[0] != '-')
+    return SL_TOKEN_OTHER;
+
+  switch (value[1])
+    {
+    case 'I':
+      return SL_TOKEN_INCLUDE;
+
+    case 'D':
+      return SL_TOKEN_DEFINE;
+
+    case 'x':
+      return SL_TOKEN_LANGUAGE;
+
+    case 'i':
+      if (has_prefix (value, len, "-isystem", 8) || has_prefix (value, len, "-idirafter", 10))
+        return SL_TOKEN_SYSTEM_INCLUDE;
+      return SL_TOKEN_OTHER;
+
+    case 'f':
+    case 'W':
+    case 'm':
+      return SL_TOKEN_FLAG;
+
+    default:
+      if (has_prefix (value, len, "-std=", 5))
+        return SL_TOKEN_STD;
+      if (has_prefix (value, len, "-pthread", 8))
+        return SL_TOKEN_FLAG;
+      return SL_TOKEN_OTHER;
+    }
+}
+
+/**
+ * sl_tokenizer_init:
+ * @tokenizer: an uninitialized #SlTokenizer
+ * @data: the command line
+ * @len: the length of @data in bytes
+ *
+ * Initializes @tokenizer to split @data, which is not copied. Call
+ * sl_tokenizer_clear() when done.
+ */
+void
+sl_tokenizer_init (SlTokenizer *tokenizer,
+                   const gchar *data,
+                   gsize        len)
+{
+  g_return_if_fail (tokenizer != NULL);
+  g_return_if_fail (data != NULL || len == 0);
+
+  tokenizer->data = data;
+  tokenizer->len = len;
+  tokenizer->pos = 0;
+  tokenizer->scratch = NULL;
+}
+
+void
+sl_tokenizer_clear (SlTokenizer *tokenizer)
+{
+  g_return_if_fail (tokenizer != NULL);
+
+  if (tokenizer->scratch != NULL)
+    {
+      g_string_free (tokenizer->scratch, TRUE);
+      tokenizer->scratch = NULL;
+    }
+}
+
+/**
+ * sl_tokenizer_next:
+ * @tokenizer: a #SlTokenizer
+ * @token: (out): a location for the token
+ *
+ * Reads the next word of the command.
+ *
+ * Returns: %TRUE if @token was set; %FALSE at the end of the command.
+ */
+gboolean
+sl_tokenizer_next (SlTokenizer *tokenizer,
+                   SlToken     *token)
+{
+  const gchar *end = tokenizer->data + tokenizer->len;
+  const gchar *p = tokenizer->data + tokenizer->pos;
+  const gchar *word;
+  const gchar *value;
+  gboolean quoted = FALSE;
+  gboolean expanded = FALSE;
+
+  g_return_val_if_fail (tokenizer != NULL, FALSE);
+  g_return_val_if_fail (token != NULL, FALSE);
+
+  for (;;)
+    {
+      if (p < end && is_space (*p))
+        p++;
+      else if (is_continuation (p, end))
+        p += (p[1] == '\r') ? 3 : 2;
+      else
+        break;
+    }
+
+  /* Anything after a command separator belongs to another command */
+  if (p == end || *p == ';' || *p == '|' || *p == '&')
+    {
+      tokenizer->pos = tokenizer->len;
+      return FALSE;
+    }
+
+  word = value = p;
+
+  while (p < end && !is_space (*p) && *p != ';' && *p != '|')
+    {
+      if (*p == '\\')
+        {
+          if (is_continuation (p, end))
+            break;
+          quoted = TRUE;
+          p = MIN (p + 2, end);
+        }
+      else if (*p == '\'')
+        {
+          quoted = TRUE;
+          p = skip_single_quote (p, end);
+        }
+      else if (*p == '"')
+        {
+          quoted = TRUE;
+          p = skip_double_quote (p, end);
+        }
+      else if (*p == '`' || (*p == '$' && p + 1 < end && (p[1] == '(' || p[1] == '{')))
+        {
+          /*
+           * We cannot evaluate command substitutions, so like automake's
+           * `test -f 'foo.c' || echo './'`foo.c we only keep what follows.
+           */
+          p = (*p == '`') ? skip_backticks (p, end) : skip_group (p + 1, end);
+
+          /* $(srcdir)/foo.c is our best guess at a path relative to the build directory */
+          while (p < end && *p == '/')
+            p++;
+
+          value = p;
+          quoted = FALSE;
+          expanded = TRUE;
+        }
+      else
+        p++;
+    }
+
+  tokenizer->pos = p - tokenizer->data;
+
+  token->offset = word - tokenizer->data;
+  token->length = p - word;
+
+  if (quoted)
+    {
+      if (tokenizer->scratch == NULL)
+        tokenizer->scratch = g_string_new (NULL);
+
+      g_string_truncate (tokenizer->scratch, 0);
+      unquote (value, p - value, tokenizer->scratch);
+
+      token->value = tokenizer->scratch->str;
+      token->value_len = tokenizer->scratch->len;
+    }
+  else
+    {
+      token->value = value;
+      token->value_len = p - value;
+    }
+
+  if (expanded && token->value_len == 0)
+    token->kind = SL_TOKEN_EXPANSION;
+  else
+    token->kind = classify (token->value, token->value_len);
+
+  return TRUE;
+}
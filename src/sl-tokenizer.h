@@ -0,0 +1,75 @@
+/* sl-tokenizer.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_TOKENIZER_H
+#define SL_TOKENIZER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  SL_TOKEN_OTHER,
+  SL_TOKEN_EXPANSION,       /* `...` or $(...) with nothing following it */
+  SL_TOKEN_SOURCE,          /* foo.c, `test -f foo.c || echo ./`foo.c */
+  SL_TOKEN_INCLUDE,         /* -Ifoo, -I (path follows) */
+  SL_TOKEN_SYSTEM_INCLUDE,  /* -isystemfoo, -idirafter (path follows) */
+  SL_TOKEN_DEFINE,          /* -DFOO, -D (name follows) */
+  SL_TOKEN_LANGUAGE,        /* -xc, -x (language follows) */
+  SL_TOKEN_STD,             /* -std=gnu11 */
+  SL_TOKEN_FLAG,            /* -f..., -W..., -m..., -pthread */
+} SlTokenKind;
+
+typedef struct
+{
+  SlTokenKind  kind;
+
+  /* The raw shell word within the buffer */
+  gsize        offset;
+  gsize        length;
+
+  /*
+   * The value of the word with quoting removed and any leading command
+   * substitution dropped. This points into the buffer unless the word
+   * required unquoting, in which case it is only valid until the next
+   * call to sl_tokenizer_next().
+   */
+  const gchar *value;
+  gsize        value_len;
+} SlToken;
+
+typedef struct
+{
+  /*< private >*/
+  const gchar *data;
+  gsize        len;
+  gsize        pos;
+  GString     *scratch;
+} SlTokenizer;
+
+void     sl_tokenizer_init  (SlTokenizer *tokenizer,
+                             const gchar *data,
+                             gsize        len);
+void     sl_tokenizer_clear (SlTokenizer *tokenizer);
+gboolean sl_tokenizer_next  (SlTokenizer *tokenizer,
+                             SlToken     *token);
+
+G_END_DECLS
+
+#endif /* SL_TOKENIZER_H */
@@ -0,0 +1,518 @@
+/* sl-toolchain.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-toolchain"
+
+#include <errno.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "sl-toolchain.h"
+
+/*
+ * libclang parses every translation unit as clang would, whichever
+ * compiler built it. To get closer to what GCC saw, the include search
+ * path and predefined macros of each compiler in the log are probed and
+ * whatever clang lacks is passed along with the flags of the command.
+ *
+ * Probing means running the compiler, so the results are kept for the
+ * whole process and on disk, keyed by the path, size and mtime of the
+ * compiler binary, and most runs never spawn anything.
+ */
+
+#define CACHE_VERSION 1
+
+typedef struct
+{
+  /* The include search path, in order */
+  gchar **includes;
+
+  /* Predefined macros, as NAME=VALUE */
+  gchar **macros;
+} Probe;
+
+struct _SlToolchain
+{
+  gchar **flags;
+};
+
+/*
+ * Guards the toolchains and the cache, but is never held while running a
+ * compiler. A toolchain being probed has no flags yet, and whoever looks
+ * it up meanwhile waits on toolchains_cond rather than probing it again.
+ */
+G_LOCK_DEFINE_STATIC (toolchains);
+static GCond toolchains_cond;
+static GHashTable *toolchains;
+static GKeyFile *cache;
+static gchar *cache_path;
+static gsize clang_include_probed;
+static gchar *clang_include;
+
+static void
+probe_clear (Probe *probe)
+{
+  g_clear_pointer (&probe->includes, g_strfreev);
+  g_clear_pointer (&probe->macros, g_strfreev);
+}
+
+static GKeyFile *
+get_cache (void)
+{
+  if (cache == NULL)
+    {
+      cache = g_key_file_new ();
+      cache_path = g_build_filename (g_get_user_cache_dir (), "sightline", "toolchains.ini", NULL);
+
+      if (!g_key_file_load_from_file (cache, cache_path, G_KEY_FILE_NONE, NULL) ||
+          g_key_file_get_integer (cache, "cache", "version", NULL) != CACHE_VERSION)
+        {
+          g_key_file_unref (cache);
+          cache = g_key_file_new ();
+          g_key_file_set_integer (cache, "cache", "version", CACHE_VERSION);
+        }
+    }
+
+  return cache;
+}
+
+static void
+save_cache (void)
+{
+  g_autofree gchar *dir = g_path_get_dirname (cache_path);
+  g_autoptr(GError) error = NULL;
+
+  if (g_mkdir_with_parents (dir, 0750) != 0 ||
+      !g_key_file_save_to_file (cache, cache_path, &error))
+    g_debug ("Failed to save toolchain cache: %s",
+             error ? error->message : g_strerror (errno));
+}
+
+/*
+ * Gets the cache group for @program, or %NULL if it was not cached for the
+ * current binary. Cached entries record the size and mtime of the binary,
+ * so upgrading the compiler invalidates them.
+ */
+static gchar *
+get_cache_group (const gchar *kind,
+                 const gchar *path,
+                 gchar      **stamp)
+{
+  GStatBuf st;
+
+  if (g_stat (path, &st) != 0)
+    return NULL;
+
+  *stamp = g_strdup_printf ("%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT,
+                            (gint64)st.st_size,
+                            (gint64)st.st_mtim.tv_sec * G_GINT64_CONSTANT (1000000000) + st.st_mtim.tv_nsec);
+
+  return g_strdup_printf ("%s %s", kind, path);
+}
+
+static gboolean
+run_compiler (const gchar  *path,
+              const gchar * const *argv,
+              gchar       **stdout_str,
+              gchar       **stderr_str)
+{
+  g_autoptr(GPtrArray) args = g_ptr_array_new ();
+  g_autoptr(GSubprocess) subprocess = NULL;
+  g_autoptr(GError) error = NULL;
+
+  g_ptr_array_add (args, (gchar *)path);
+  for (; *argv != NULL; argv++)
+    g_ptr_array_add (args, (gchar *)*argv);
+  g_ptr_array_add (args, NULL);
+
+  subprocess = g_subprocess_newv ((const gchar * const *)args->pdata,
+                                  (G_SUBPROCESS_FLAGS_STDIN_PIPE |
+                                   G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+                                   (stderr_str ? G_SUBPROCESS_FLAGS_STDERR_PIPE : G_SUBPROCESS_FLAGS_STDERR_SILENCE)),
+                                  &error);
+
+  if (subprocess == NULL ||
+      !g_subprocess_communicate_utf8 (subprocess, "", NULL, stdout_str, stderr_str, &error) ||
+      !g_subprocess_get_successful (subprocess))
+    {
+      g_debug ("Failed to probe %s: %s", path, error ? error->message : "exited with an error");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Parses the output of -E -dM, where function-like macros have no spaces before their body */
+static gchar **
+parse_macros (const gchar *output)
+{
+  g_auto(GStrv) lines = g_strsplit (output, "\n", -1);
+  g_autoptr(GPtrArray) macros = g_ptr_array_new ();
+  guint i;
+
+  for (i = 0; lines[i] != NULL; i++)
+    {
+      const gchar *name = lines[i];
+      const gchar *end;
+
+      if (!g_str_has_prefix (name, "#define "))
+        continue;
+
+      name += strlen ("#define ");
+
+      if (NULL == (end = strchr (name, ' ')))
+        g_ptr_array_add (macros, g_strdup (name));
+      else
+        g_ptr_array_add (macros, g_strdup_printf ("%.*s=%s", (gint)(end - name), name, end + 1));
+    }
+
+  g_ptr_array_add (macros, NULL);
+
+  return (gchar **)g_ptr_array_free (g_steal_pointer (&macros), FALSE);
+}
+
+/* Parses the search list from the output of -v */
+static gchar **
+parse_includes (const gchar *output)
+{
+  g_auto(GStrv) lines = g_strsplit (output, "\n", -1);
+  g_autoptr(GPtrArray) includes = g_ptr_array_new ();
+  gboolean in_list = FALSE;
+  guint i;
+
+  for (i = 0; lines[i] != NULL; i++)
+    {
+      if (g_str_has_prefix (lines[i], "#include <...> search starts here:"))
+        in_list = TRUE;
+      else if (g_str_has_prefix (lines[i], "End of search list."))
+        break;
+      else if (in_list && lines[i][0] == ' ')
+        g_ptr_array_add (includes, g_strdup (g_strstrip (lines[i])));
+    }
+
+  g_ptr_array_add (includes, NULL);
+
+  return (gchar **)g_ptr_array_free (g_steal_pointer (&includes), FALSE);
+}
+
+/* Probes the search path and macros of the compiler at @path for @language */
+static gboolean
+probe_compiler (const gchar *path,
+                const gchar *language,
+                Probe       *probe)
+{
+  const gchar *argv[] = { "-x", language, "-E", "-dM", "-v", "-", NULL };
+  g_autofree gchar *group = NULL;
+  g_autofree gchar *stamp = NULL;
+  g_autofree gchar *cached_stamp = NULL;
+  g_autofree gchar *kind = g_strdup_printf ("probe-%s", language);
+  g_autofree gchar *stdout_str = NULL;
+  g_autofree gchar *stderr_str = NULL;
+  GKeyFile *keyfile;
+
+  if (NULL == (group = get_cache_group (kind, path, &stamp)))
+    return FALSE;
+
+  G_LOCK (toolchains);
+
+  keyfile = get_cache ();
+
+  if (NULL != (cached_stamp = g_key_file_get_string (keyfile, group, "stamp", NULL)) &&
+      g_str_equal (cached_stamp, stamp))
+    {
+      probe->includes = g_key_file_get_string_list (keyfile, group, "includes", NULL, NULL);
+      probe->macros = g_key_file_get_string_list (keyfile, group, "macros", NULL, NULL);
+
+      if (probe->includes != NULL && probe->macros != NULL)
+        {
+          G_UNLOCK (toolchains);
+          return TRUE;
+        }
+
+      probe_clear (probe);
+    }
+
+  G_UNLOCK (toolchains);
+
+  if (!run_compiler (path, argv, &stdout_str, &stderr_str))
+    return FALSE;
+
+  probe->includes = parse_includes (stderr_str);
+  probe->macros = parse_macros (stdout_str);
+
+  G_LOCK (toolchains);
+
+  keyfile = get_cache ();
+  g_key_file_set_string (keyfile, group, "stamp", stamp);
+  g_key_file_set_string_list (keyfile, group, "includes",
+                              (const gchar * const *)probe->includes,
+                              g_strv_length (probe->includes));
+  g_key_file_set_string_list (keyfile, group, "macros",
+                              (const gchar * const *)probe->macros,
+                              g_strv_length (probe->macros));
+  save_cache ();
+
+  G_UNLOCK (toolchains);
+
+  return TRUE;
+}
+
+static gboolean
+is_clang (const gchar *name)
+{
+  g_autofree gchar *base = g_path_get_basename (name);
+
+  return strstr (base, "clang") != NULL;
+}
+
+static gsize
+get_macro_name_len (const gchar *macro)
+{
+  const gchar *end = strpbrk (macro, "=(");
+
+  return end ? (gsize)(end - macro) : strlen (macro);
+}
+
+static gboolean
+is_private_include (const gchar *dir)
+{
+  /*
+   * GCC's own headers (stddef.h, intrinsics, fixed headers) and libstdc++
+   * are found by clang from the GCC installation it picks, mixing them
+   * with those of another version breaks #include_next.
+   */
+  return strstr (dir, "/gcc/") != NULL ||
+         strstr (dir, "/gcc-cross/") != NULL ||
+         strstr (dir, "/c++/") != NULL;
+}
+
+/*
+ * The flags to make clang parse like @compiler_probe: the directories it
+ * searches which clang does not, and the macros it defines which clang
+ * does not. Macros both define are left alone, since clang's __GNUC__ and
+ * friends describe what clang itself supports.
+ */
+static gchar **
+build_flags (const Probe *compiler_probe,
+             const Probe *clang_probe)
+{
+  g_autoptr(GHashTable) clang_macros = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_autoptr(GPtrArray) flags = g_ptr_array_new ();
+  guint i;
+
+  for (i = 0; compiler_probe->includes[i] != NULL; i++)
+    {
+      const gchar *dir = compiler_probe->includes[i];
+
+      if (!is_private_include (dir) &&
+          !g_strv_contains ((const gchar * const *)clang_probe->includes, dir))
+        g_ptr_array_add (flags, g_strdup_printf ("-isystem%s", dir));
+    }
+
+  for (i = 0; clang_probe->macros[i] != NULL; i++)
+    {
+      const gchar *macro = clang_probe->macros[i];
+
+      g_hash_table_add (clang_macros, g_strndup (macro, get_macro_name_len (macro)));
+    }
+
+  for (i = 0; compiler_probe->macros[i] != NULL; i++)
+    {
+      const gchar *macro = compiler_probe->macros[i];
+      g_autofree gchar *name = g_strndup (macro, get_macro_name_len (macro));
+
+      if (!g_hash_table_contains (clang_macros, name))
+        g_ptr_array_add (flags, g_strdup_printf ("-D%s", macro));
+    }
+
+  g_ptr_array_add (flags, NULL);
+
+  return (gchar **)g_ptr_array_free (g_steal_pointer (&flags), FALSE);
+}
+
+/* Gets the flags for the compiler @name, probing it without the lock held */
+static gchar **
+toolchain_probe (const gchar *name)
+{
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *clang_path = NULL;
+  Probe compiler_probe = { 0 };
+  Probe clang_probe = { 0 };
+  const gchar *language;
+  gchar **flags;
+
+  /*
+   * libclang is clang, there is nothing to add. A relative path depends on
+   * the directory of the build, and probing whatever it names here could
+   * pass the flags of another compiler.
+   */
+  if (is_clang (name) ||
+      (strchr (name, '/') != NULL && !g_path_is_absolute (name)) ||
+      NULL == (path = g_find_program_in_path (name)) ||
+      NULL == (clang_path = g_find_program_in_path ("clang")))
+    return g_new0 (gchar *, 1);
+
+  language = strstr (name, "++") != NULL ? "c++" : "c";
+
+  if (probe_compiler (path, language, &compiler_probe) &&
+      probe_compiler (clang_path, language, &clang_probe))
+    flags = build_flags (&compiler_probe, &clang_probe);
+  else
+    flags = g_new0 (gchar *, 1);
+
+  probe_clear (&compiler_probe);
+  probe_clear (&clang_probe);
+
+  return flags;
+}
+
+/**
+ * sl_toolchain_get_clang_include:
+ *
+ * Gets the -I flag for the headers of clang's resource directory, which
+ * libclang may not find by itself. This only runs clang the first time it
+ * is installed or changed. This is safe to call from multiple threads.
+ *
+ * Returns: (nullable): the flag, or %NULL if clang could not be run
+ */
+const gchar *
+sl_toolchain_get_clang_include (void)
+{
+  const gchar *argv[] = { "-print-file-name=include", NULL };
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *group = NULL;
+  g_autofree gchar *stamp = NULL;
+  g_autofree gchar *cached_stamp = NULL;
+  g_autofree gchar *stdout_str = NULL;
+  gboolean cached;
+
+  /* Other callers wait for the first, which only locks to use the cache */
+  if (!g_once_init_enter (&clang_include_probed))
+    goto done;
+
+  if (NULL == (path = g_find_program_in_path ("clang")) ||
+      NULL == (group = get_cache_group ("resource", path, &stamp)))
+    {
+      g_warning ("Failed to discover clang include path");
+      goto probed;
+    }
+
+  G_LOCK (toolchains);
+  cached_stamp = g_key_file_get_string (get_cache (), group, "stamp", NULL);
+  if ((cached = (cached_stamp != NULL && g_str_equal (cached_stamp, stamp))))
+    clang_include = g_key_file_get_string (get_cache (), group, "include", NULL);
+  G_UNLOCK (toolchains);
+
+  if (cached)
+    goto probed;
+
+  if (!run_compiler (path, argv, &stdout_str, NULL))
+    {
+      g_warning ("Failed to discover clang include path");
+      goto probed;
+    }
+
+  g_strstrip (stdout_str);
+
+  /* clang prints the name back if it has no such file */
+  if (!g_str_equal (stdout_str, "include"))
+    clang_include = g_strdup_printf ("-I%s", stdout_str);
+
+  G_LOCK (toolchains);
+  g_key_file_set_string (get_cache (), group, "stamp", stamp);
+  g_key_file_set_string (get_cache (), group, "include", clang_include ? clang_include : "");
+  save_cache ();
+  G_UNLOCK (toolchains);
+
+probed:
+  g_once_init_leave (&clang_include_probed, 1);
+
+done:
+  return (clang_include && *clang_include) ? clang_include : NULL;
+}
+
+/**
+ * sl_toolchain_lookup:
+ * @compiler: the compiler of a command, as found in the log
+ * @len: the length of @compiler in bytes
+ *
+ * Looks up the toolchain for @compiler, probing it the first time it is
+ * installed or changed. This is safe to call from multiple threads.
+ *
+ * @compiler must be the whole first word of the command, such as
+ * "x86_64-linux-gnu-gcc" or "/usr/bin/gcc-12", since a cross or another
+ * version of a compiler searches other headers. A toolchain which cannot
+ * be found from it adds no flags.
+ *
+ * Returns: (transfer none): the toolchain, which lives as long as the process
+ */
+const SlToolchain *
+sl_toolchain_lookup (const gchar *compiler,
+                     gsize        len)
+{
+  g_autofree gchar *name = NULL;
+  SlToolchain *self;
+
+  g_return_val_if_fail (compiler != NULL, NULL);
+
+  name = g_strndup (compiler, len);
+
+  G_LOCK (toolchains);
+
+  if (toolchains == NULL)
+    toolchains = g_hash_table_new (g_str_hash, g_str_equal);
+
+  if (NULL == (self = g_hash_table_lookup (toolchains, name)))
+    {
+      gchar **flags;
+
+      self = g_slice_new0 (SlToolchain);
+      g_hash_table_insert (toolchains, g_strdup (name), self);
+
+      G_UNLOCK (toolchains);
+      flags = toolchain_probe (name);
+      G_LOCK (toolchains);
+
+      self->flags = flags;
+      g_cond_broadcast (&toolchains_cond);
+    }
+
+  while (self->flags == NULL)
+    g_cond_wait (&toolchains_cond, &G_LOCK_NAME (toolchains));
+
+  G_UNLOCK (toolchains);
+
+  return self;
+}
+
+/**
+ * sl_toolchain_get_flags:
+ * @self: a #SlToolchain
+ *
+ * Gets the flags making libclang parse like the compiler of @self.
+ *
+ * Returns: (array zero-terminated=1): the flags, which may be empty
+ */
+const gchar * const *
+sl_toolchain_get_flags (const SlToolchain *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  return (const gchar * const *)self->flags;
+}
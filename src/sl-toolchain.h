@@ -0,0 +1,35 @@
+/* sl-toolchain.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_TOOLCHAIN_H
+#define SL_TOOLCHAIN_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SlToolchain SlToolchain;
+
+const gchar         *sl_toolchain_get_clang_include (void);
+const SlToolchain   *sl_toolchain_lookup            (const gchar       *compiler,
+                                                     gsize              len);
+const gchar * const *sl_toolchain_get_flags         (const SlToolchain *self);
+
+G_END_DECLS
+
+#endif /* SL_TOOLCHAIN_H */
@@ -0,0 +1,401 @@
+/* sl-worker-process.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define G_LOG_DOMAIN "sl-worker-process"
+
+#include <errno.h>
+#include <gio/gunixinputstream.h>
+#include <gio/gunixoutputstream.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sl-worker-process.h"
+
+/*
+ * A child process answering requests one at a time over its stdin and
+ * stdout, so that whatever crashes or hangs while handling a request only
+ * takes the child down. Messages are framed by their length, as a 32-bit
+ * little-endian integer.
+ *
+ * The child is spawned on the first request, killed if it does not reply
+ * in time and spawned again on the next request after it died. It is also
+ * replaced after a number of requests, which bounds whatever it leaks or
+ * fragments along the way.
+ */
+
+/* Nothing sent between the processes comes near this */
+#define MAX_MESSAGE_SIZE (G_GUINT64_CONSTANT (1) << 30)
+
+struct _SlWorkerProcess
+{
+  gchar       **argv;
+  guint         max_requests;
+  guint         n_requests;
+  GSubprocess  *subprocess;
+  gint          stdin_fd;
+  gint          stdout_fd;
+};
+
+/**
+ * sl_worker_process_new:
+ * @argv: the command to run the child with
+ * @max_requests: how many requests a child handles before it is replaced,
+ *   or 0 to keep it for as long as it lives
+ *
+ * Creates a new #SlWorkerProcess. The child is not spawned until the first
+ * call to sl_worker_process_call().
+ *
+ * Returns: (transfer full): A newly allocated #SlWorkerProcess.
+ */
+SlWorkerProcess *
+sl_worker_process_new (const gchar * const *argv,
+                       guint                max_requests)
+{
+  SlWorkerProcess *self;
+
+  g_return_val_if_fail (argv != NULL, NULL);
+  g_return_val_if_fail (argv[0] != NULL, NULL);
+
+  self = g_new0 (SlWorkerProcess, 1);
+  self->argv = g_strdupv ((gchar **)argv);
+  self->max_requests = max_requests;
+  self->stdin_fd = -1;
+  self->stdout_fd = -1;
+
+  return self;
+}
+
+/*
+ * Stops the child, either by closing its stdin so it exits once done with
+ * its requests, or by killing it. Either way it is reaped.
+ */
+static void
+sl_worker_process_stop (SlWorkerProcess *self,
+                        gboolean         force)
+{
+  g_assert (self != NULL);
+
+  if (self->subprocess == NULL)
+    return;
+
+  if (force)
+    g_subprocess_force_exit (self->subprocess);
+  else
+    g_output_stream_close (g_subprocess_get_stdin_pipe (self->subprocess), NULL, NULL);
+
+  g_subprocess_wait (self->subprocess, NULL, NULL);
+}
+
+static void
+sl_worker_process_clear (SlWorkerProcess *self)
+{
+  g_assert (self != NULL);
+
+  g_clear_object (&self->subprocess);
+  self->stdin_fd = -1;
+  self->stdout_fd = -1;
+  self->n_requests = 0;
+}
+
+void
+sl_worker_process_free (SlWorkerProcess *self)
+{
+  if (self != NULL)
+    {
+      sl_worker_process_stop (self, FALSE);
+      sl_worker_process_clear (self);
+      g_strfreev (self->argv);
+      g_free (self);
+    }
+}
+
+static gboolean
+sl_worker_process_spawn (SlWorkerProcess  *self,
+                         GError          **error)
+{
+  g_assert (self != NULL);
+  g_assert (self->subprocess == NULL);
+
+  self->subprocess = g_subprocess_newv ((const gchar * const *)self->argv,
+                                        G_SUBPROCESS_FLAGS_STDIN_PIPE | G_SUBPROCESS_FLAGS_STDOUT_PIPE,
+                                        error);
+
+  if (self->subprocess == NULL)
+    return FALSE;
+
+  self->stdin_fd = g_unix_output_stream_get_fd (G_UNIX_OUTPUT_STREAM (g_subprocess_get_stdin_pipe (self->subprocess)));
+  self->stdout_fd = g_unix_input_stream_get_fd (G_UNIX_INPUT_STREAM (g_subprocess_get_stdout_pipe (self->subprocess)));
+
+  return TRUE;
+}
+
+/* Explains why a child which stopped answering is gone */
+static void
+set_exit_error (GSubprocess  *subprocess,
+                GError      **error)
+{
+  if (g_subprocess_get_if_signaled (subprocess))
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "Worker process killed by signal %d (%s)",
+                 g_subprocess_get_term_sig (subprocess),
+                 g_strsignal (g_subprocess_get_term_sig (subprocess)));
+  else if (g_subprocess_get_if_exited (subprocess))
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "Worker process exited with status %d",
+                 g_subprocess_get_exit_status (subprocess));
+  else
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                         "Worker process stopped responding");
+}
+
+/**
+ * sl_worker_process_call:
+ * @self: An #SlWorkerProcess
+ * @request: the request to send to the child
+ * @timeout: how long to wait for the reply in microseconds, or 0 to wait
+ *   for as long as it takes
+ * @error: A location for a #GError, or %NULL
+ *
+ * Sends @request to the child, spawning it if necessary, and waits for its
+ * reply. If the child crashes or does not reply within @timeout it is
+ * killed, @error is set, and the next call spawns a new one.
+ *
+ * Returns: (transfer full): the reply, or %NULL and @error is set.
+ */
+GBytes *
+sl_worker_process_call (SlWorkerProcess  *self,
+                        GBytes           *request,
+                        gint64            timeout,
+                        GError          **error)
+{
+  g_autoptr(GError) local_error = NULL;
+  g_autoptr(GBytes) reply = NULL;
+  gint64 deadline = -1;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (request != NULL, NULL);
+
+  if (self->subprocess == NULL && !sl_worker_process_spawn (self, error))
+    return NULL;
+
+  if (timeout > 0)
+    deadline = g_get_monotonic_time () + timeout;
+
+  if (!sl_worker_process_write_message (self->stdin_fd, request, &local_error) ||
+      NULL == (reply = sl_worker_process_read_message (self->stdout_fd, deadline, &local_error)))
+    {
+      sl_worker_process_stop (self, TRUE);
+
+      if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT))
+        g_propagate_error (error, g_steal_pointer (&local_error));
+      else
+        set_exit_error (self->subprocess, error);
+
+      sl_worker_process_clear (self);
+
+      return NULL;
+    }
+
+  if (self->max_requests > 0 && ++self->n_requests >= self->max_requests)
+    {
+      sl_worker_process_stop (self, FALSE);
+      sl_worker_process_clear (self);
+    }
+
+  return g_steal_pointer (&reply);
+}
+
+/*
+ * Reads exactly @len bytes from @fd, waiting until @deadline at most.
+ * Sets @eof if the stream ended before anything was read.
+ */
+static gboolean
+read_all (gint       fd,
+          guint8    *buf,
+          gsize      len,
+          gint64     deadline,
+          gboolean  *eof,
+          GError   **error)
+{
+  gsize pos = 0;
+
+  *eof = FALSE;
+
+  while (pos < len)
+    {
+      gssize n_read;
+
+      if (deadline >= 0)
+        {
+          GPollFD pfd = { fd, G_IO_IN, 0 };
+          gint64 remaining = deadline - g_get_monotonic_time ();
+          gint ret;
+
+          if (remaining <= 0 ||
+              (0 == (ret = g_poll (&pfd, 1, MAX (1, remaining / 1000)))))
+            {
+              g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT, "Timed out");
+              return FALSE;
+            }
+
+          if (ret < 0)
+            {
+              if (errno == EINTR)
+                continue;
+              break;
+            }
+        }
+
+      n_read = read (fd, buf + pos, len - pos);
+
+      if (n_read < 0 && errno == EINTR)
+        continue;
+
+      if (n_read <= 0)
+        break;
+
+      pos += n_read;
+    }
+
+  if (pos == len)
+    return TRUE;
+
+  if (pos == 0)
+    *eof = TRUE;
+
+  g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE, "Unexpected end of stream");
+
+  return FALSE;
+}
+
+/**
+ * sl_worker_process_read_message:
+ * @fd: the file descriptor to read from
+ * @deadline: the monotonic time to give up at, or -1 to wait forever
+ * @error: A location for a #GError, or %NULL
+ *
+ * Reads a message written with sl_worker_process_write_message().
+ *
+ * Returns: (transfer full): the message, or %NULL if the stream ended
+ *   between messages, or if an error occurred and @error is set.
+ */
+GBytes *
+sl_worker_process_read_message (gint     fd,
+                                gint64   deadline,
+                                GError **error)
+{
+  g_autoptr(GError) local_error = NULL;
+  guint8 header[4];
+  guint8 *data;
+  guint32 len;
+  gboolean eof;
+
+  g_return_val_if_fail (fd >= 0, NULL);
+
+  if (!read_all (fd, header, sizeof header, deadline, &eof, &local_error))
+    {
+      if (!eof)
+        g_propagate_error (error, g_steal_pointer (&local_error));
+      return NULL;
+    }
+
+  len = (guint32)header[0] | (guint32)header[1] << 8 | (guint32)header[2] << 16 | (guint32)header[3] << 24;
+
+  if (len > MAX_MESSAGE_SIZE)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Message of %u bytes is too large", len);
+      return NULL;
+    }
+
+  data = g_malloc (len);
+
+  if (!read_all (fd, data, len, deadline, &eof, error))
+    {
+      g_free (data);
+      return NULL;
+    }
+
+  return g_bytes_new_take (data, len);
+}
+
+/**
+ * sl_worker_process_write_message:
+ * @fd: the file descriptor to write to
+ * @message: the message
+ * @error: A location for a #GError, or %NULL
+ *
+ * Writes @message, framed so that sl_worker_process_read_message() reads
+ * it back whole.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+sl_worker_process_write_message (gint     fd,
+                                 GBytes  *message,
+                                 GError **error)
+{
+  const guint8 *data;
+  guint8 header[4];
+  gsize len;
+  guint i;
+
+  g_return_val_if_fail (fd >= 0, FALSE);
+  g_return_val_if_fail (message != NULL, FALSE);
+
+  data = g_bytes_get_data (message, &len);
+
+  if (len > MAX_MESSAGE_SIZE)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Message of %"G_GSIZE_FORMAT" bytes is too large", len);
+      return FALSE;
+    }
+
+  for (i = 0; i < sizeof header; i++)
+    header[i] = (len >> (8 * i)) & 0xff;
+
+  for (i = 0; i < 2; i++)
+    {
+      const guint8 *buf = i == 0 ? header : data;
+      gsize remaining = i == 0 ? sizeof header : len;
+
+      while (remaining > 0)
+        {
+          gssize n_written = write (fd, buf, remaining);
+
+          if (n_written < 0 && errno == EINTR)
+            continue;
+
+          if (n_written <= 0)
+            {
+              int errsv = errno;
+
+              g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                           "Failed to write message: %s", g_strerror (errsv));
+              return FALSE;
+            }
+
+          buf += n_written;
+          remaining -= n_written;
+        }
+    }
+
+  return TRUE;
+}
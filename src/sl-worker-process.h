@@ -0,0 +1,46 @@
+/* sl-worker-process.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_WORKER_PROCESS_H
+#define SL_WORKER_PROCESS_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SlWorkerProcess SlWorkerProcess;
+
+SlWorkerProcess *sl_worker_process_new           (const gchar * const  *argv,
+                                                  guint                 max_requests);
+void             sl_worker_process_free          (SlWorkerProcess      *self);
+GBytes          *sl_worker_process_call          (SlWorkerProcess      *self,
+                                                  GBytes               *request,
+                                                  gint64                timeout,
+                                                  GError              **error);
+GBytes          *sl_worker_process_read_message  (gint                  fd,
+                                                  gint64                deadline,
+                                                  GError              **error);
+gboolean         sl_worker_process_write_message (gint                  fd,
+                                                  GBytes               *message,
+                                                  GError              **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SlWorkerProcess, sl_worker_process_free)
+
+G_END_DECLS
+
+#endif /* SL_WORKER_PROCESS_H */
@@ -0,0 +1,1000 @@
+/* sl-xref.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-xref"
+
+#include <gio/gio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl-xref.h"
+
+/*
+ * Cross-reference information is collected with an #SlXrefBuilder while
+ * translation units are visited (one per thread, merged at the end) and
+ * written as an index which is queried straight from a mapping:
+ *
+ *   XrefHeader
+ *   XrefSymbol[n_symbols]         (sorted by name, then USR)
+ *   guint32 by_usr[n_symbols]     (symbol indexes sorted by USR)
+ *   XrefOccurrence[n_occurrences] (grouped by symbol, the posting lists)
+ *   gchar strings[strings_len]
+ *
+ * Each symbol points at a contiguous run of occurrences, sorted by kind
+ * and then location, so a query is a binary search followed by a scan of
+ * exactly the occurrences that are reported.
+ *
+ * The builder drops duplicate occurrences as they are added, since every
+ * translation unit including a header sees the same declarations. It does
+ * count how many translation units contributed each occurrence though, so
+ * that the contribution of a single unit can be subtracted again when it
+ * changes (see sl_xref_builder_subtract()).
+ */
+
+#define XREF_MAGIC   0x52584c53 /* "SLXR" */
+#define XREF_VERSION 1
+#define NO_CONTEXT   G_MAXUINT32
+#define MIN_SLOTS    1024
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint32 n_symbols;
+  guint32 n_occurrences;
+  guint32 strings_len;
+  guint32 reserved;
+} XrefHeader;
+
+typedef struct
+{
+  guint32 usr;
+  guint32 name;
+  guint32 first;
+  guint32 n_occurrences;
+} XrefSymbol;
+
+typedef struct
+{
+  guint32 file;
+  guint32 line;
+  guint32 column;
+  guint32 kind;
+  guint32 context;
+} XrefOccurrence;
+
+G_STATIC_ASSERT (sizeof (XrefHeader) == 24);
+G_STATIC_ASSERT (sizeof (XrefSymbol) == 16);
+G_STATIC_ASSERT (sizeof (XrefOccurrence) == 20);
+
+/* The serialized form of a builder, used for caching per-unit results */
+typedef struct
+{
+  guint32 n_records;
+  guint32 strings_len;
+} BlobHeader;
+
+typedef struct
+{
+  guint32 usr;
+  guint32 name;
+  guint32 file;
+  guint32 context; /* offset + 1, or 0 */
+  guint32 line;
+  guint32 column;
+  guint32 kind;
+  guint32 refs;
+} BlobRecord;
+
+G_STATIC_ASSERT (sizeof (BlobHeader) == 8);
+G_STATIC_ASSERT (sizeof (BlobRecord) == 32);
+
+/* Strings are interned in the builder, so they compare by pointer */
+typedef struct
+{
+  const gchar *usr;
+  const gchar *name;
+  const gchar *file;
+  const gchar *context;
+  guint32      line;
+  guint32      column;
+  guint32      kind;
+  guint32      hash;
+
+  /* The number of translation units contributing this, 0 once subtracted */
+  guint32      refs;
+} Record;
+
+struct _SlXrefBuilder
+{
+  GStringChunk *strings;
+  GArray       *records;
+  guint32      *slots; /* record index + 1, or 0 */
+  guint         mask;
+};
+
+struct _SlXref
+{
+  GMappedFile          *mf;
+  const XrefHeader     *header;
+  const XrefSymbol     *symbols;
+  const guint32        *by_usr;
+  const XrefOccurrence *occurrences;
+  const gchar          *strings;
+};
+
+SlXrefBuilder *
+sl_xref_builder_new (void)
+{
+  SlXrefBuilder *self;
+
+  self = g_slice_new0 (SlXrefBuilder);
+  self->strings = g_string_chunk_new (16 * 1024);
+  self->records = g_array_new (FALSE, FALSE, sizeof (Record));
+  self->slots = g_new0 (guint32, MIN_SLOTS);
+  self->mask = MIN_SLOTS - 1;
+
+  return self;
+}
+
+void
+sl_xref_builder_free (SlXrefBuilder *self)
+{
+  if (self != NULL)
+    {
+      g_string_chunk_free (self->strings);
+      g_array_unref (self->records);
+      g_free (self->slots);
+      g_slice_free (SlXrefBuilder, self);
+    }
+}
+
+void
+sl_xref_builder_clear (SlXrefBuilder *self)
+{
+  g_return_if_fail (self != NULL);
+
+  if (self->records->len == 0)
+    return;
+
+  g_string_chunk_clear (self->strings);
+  g_array_set_size (self->records, 0);
+  memset (self->slots, 0, sizeof (guint32) * (self->mask + 1));
+}
+
+static inline guint32
+mix (guint32 hash,
+     guint64 value)
+{
+  value *= G_GUINT64_CONSTANT (0x9E3779B97F4A7C15);
+  return (hash ^ (guint32)(value >> 32)) * 16777619u;
+}
+
+static guint32
+record_hash (const Record *record)
+{
+  guint32 hash = 2166136261u;
+
+  hash = mix (hash, GPOINTER_TO_SIZE (record->usr));
+  hash = mix (hash, GPOINTER_TO_SIZE (record->file));
+  hash = mix (hash, GPOINTER_TO_SIZE (record->context));
+  hash = mix (hash, ((guint64)record->line << 32) | record->column);
+  hash = mix (hash, record->kind);
+
+  return hash;
+}
+
+static inline gboolean
+record_equal (const Record *a,
+              const Record *b)
+{
+  return a->hash == b->hash &&
+         a->usr == b->usr &&
+         a->file == b->file &&
+         a->context == b->context &&
+         a->line == b->line &&
+         a->column == b->column &&
+         a->kind == b->kind;
+}
+
+static void
+sl_xref_builder_grow (SlXrefBuilder *self)
+{
+  guint mask = (self->mask << 1) | 1;
+  guint32 *slots = g_new0 (guint32, mask + 1);
+  guint i;
+
+  for (i = 0; i < self->records->len; i++)
+    {
+      const Record *record = &g_array_index (self->records, Record, i);
+      guint pos;
+
+      for (pos = record->hash & mask; slots[pos] != 0; pos = (pos + 1) & mask) { }
+
+      slots[pos] = i + 1;
+    }
+
+  g_free (self->slots);
+  self->slots = slots;
+  self->mask = mask;
+}
+
+static inline const gchar *
+intern (SlXrefBuilder *self,
+        const gchar   *str)
+{
+  return str ? g_string_chunk_insert_const (self->strings, str) : NULL;
+}
+
+/*
+ * Finds the record matching @record, which must have interned strings and
+ * its hash set, or the free slot where it belongs.
+ */
+static Record *
+sl_xref_builder_find (SlXrefBuilder *self,
+                      const Record  *record,
+                      guint         *slot)
+{
+  guint pos;
+
+  for (pos = record->hash & self->mask; self->slots[pos] != 0; pos = (pos + 1) & self->mask)
+    {
+      Record *found = &g_array_index (self->records, Record, self->slots[pos] - 1);
+
+      if (record_equal (record, found))
+        return found;
+    }
+
+  if (slot != NULL)
+    *slot = pos;
+
+  return NULL;
+}
+
+/*
+ * Inserts @record, which must have interned strings and its hash set. If
+ * it is already present, @refs is added to the existing record when
+ * @accumulate is set.
+ */
+static void
+sl_xref_builder_insert (SlXrefBuilder *self,
+                        Record        *record,
+                        const gchar   *name,
+                        guint          refs,
+                        gboolean       accumulate)
+{
+  Record *found;
+  guint pos;
+
+  if (NULL != (found = sl_xref_builder_find (self, record, &pos)))
+    {
+      if (accumulate)
+        found->refs += refs;
+      return;
+    }
+
+  record->name = intern (self, name);
+  record->refs = refs;
+
+  g_array_append_val (self->records, *record);
+  self->slots[pos] = self->records->len;
+
+  if (self->records->len * 2 > self->mask + 1)
+    sl_xref_builder_grow (self);
+}
+
+/* Interns the strings of @record, which may belong to another builder */
+static void
+sl_xref_builder_import (SlXrefBuilder *self,
+                        const Record  *record,
+                        Record        *imported)
+{
+  imported->usr = intern (self, record->usr);
+  imported->file = intern (self, record->file);
+  imported->context = intern (self, record->context);
+  imported->line = record->line;
+  imported->column = record->column;
+  imported->kind = record->kind;
+  imported->hash = record_hash (imported);
+}
+
+/**
+ * sl_xref_builder_add:
+ * @self: a #SlXrefBuilder
+ * @kind: the kind of occurrence
+ * @usr: the USR of the symbol
+ * @name: the name of the symbol
+ * @file: the file containing the occurrence
+ * @line: the line of the occurrence
+ * @column: the column of the occurrence
+ * @context_usr: (nullable): the USR of the enclosing function, if any
+ *
+ * Records an occurrence of a symbol within the translation unit being
+ * visited. Occurrences which have already been recorded are ignored.
+ */
+void
+sl_xref_builder_add (SlXrefBuilder *self,
+                     SlXrefKind     kind,
+                     const gchar   *usr,
+                     const gchar   *name,
+                     const gchar   *file,
+                     guint          line,
+                     guint          column,
+                     const gchar   *context_usr)
+{
+  Record record;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (usr != NULL);
+  g_return_if_fail (name != NULL);
+  g_return_if_fail (file != NULL);
+
+  record.usr = usr;
+  record.file = file;
+  record.context = context_usr;
+  record.line = line;
+  record.column = column;
+  record.kind = kind;
+
+  sl_xref_builder_import (self, &record, &record);
+  sl_xref_builder_insert (self, &record, name, 1, FALSE);
+}
+
+/**
+ * sl_xref_builder_merge:
+ * @self: a #SlXrefBuilder
+ * @other: a #SlXrefBuilder to merge into @self
+ *
+ * Adds the occurrences recorded in @other to @self and clears @other.
+ * Occurrences already in @self gain the contributors of @other.
+ */
+void
+sl_xref_builder_merge (SlXrefBuilder *self,
+                       SlXrefBuilder *other)
+{
+  guint i;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (other != NULL);
+  g_return_if_fail (self != other);
+
+  for (i = 0; i < other->records->len; i++)
+    {
+      const Record *record = &g_array_index (other->records, Record, i);
+
+      Record imported;
+
+      if (record->refs == 0)
+        continue;
+
+      sl_xref_builder_import (self, record, &imported);
+      sl_xref_builder_insert (self, &imported, record->name, record->refs, TRUE);
+    }
+
+  sl_xref_builder_clear (other);
+}
+
+/**
+ * sl_xref_builder_subtract:
+ * @self: a #SlXrefBuilder
+ * @other: a #SlXrefBuilder to subtract from @self
+ *
+ * Removes the contributions recorded in @other from @self and clears
+ * @other. This is the inverse of sl_xref_builder_merge(). An occurrence is
+ * dropped once no translation unit contributes it.
+ */
+void
+sl_xref_builder_subtract (SlXrefBuilder *self,
+                          SlXrefBuilder *other)
+{
+  guint i;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (other != NULL);
+  g_return_if_fail (self != other);
+
+  for (i = 0; i < other->records->len; i++)
+    {
+      const Record *record = &g_array_index (other->records, Record, i);
+      Record imported;
+      Record *found;
+
+      sl_xref_builder_import (self, record, &imported);
+
+      if (NULL != (found = sl_xref_builder_find (self, &imported, NULL)))
+        found->refs -= MIN (found->refs, record->refs);
+    }
+
+  sl_xref_builder_clear (other);
+}
+
+static guint32
+blob_intern (GHashTable  *offsets,
+             GString     *strings,
+             const gchar *str)
+{
+  gpointer value;
+
+  /* Strings are interned, so they can be keyed by pointer */
+  if (NULL == (value = g_hash_table_lookup (offsets, str)))
+    {
+      value = GUINT_TO_POINTER (strings->len + 1);
+      g_hash_table_insert (offsets, (gpointer)str, value);
+      g_string_append_len (strings, str, strlen (str) + 1);
+    }
+
+  return GPOINTER_TO_UINT (value) - 1;
+}
+
+/**
+ * sl_xref_builder_serialize:
+ * @self: a #SlXrefBuilder
+ *
+ * Serializes the occurrences in @self and their contributor counts, so
+ * they can be cached alongside the other results of a translation unit.
+ *
+ * Returns: (transfer full): a #GBytes to pass to
+ *   sl_xref_builder_deserialize()
+ */
+GBytes *
+sl_xref_builder_serialize (SlXrefBuilder *self)
+{
+  g_autoptr(GHashTable) offsets = NULL;
+  g_autoptr(GString) strings = NULL;
+  GByteArray *buf;
+  BlobHeader header;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  offsets = g_hash_table_new (NULL, NULL);
+  strings = g_string_new (NULL);
+  buf = g_byte_array_new ();
+
+  header.n_records = 0;
+  header.strings_len = 0;
+  g_byte_array_append (buf, (const guint8 *)&header, sizeof header);
+
+  for (i = 0; i < self->records->len; i++)
+    {
+      const Record *record = &g_array_index (self->records, Record, i);
+      BlobRecord blob;
+
+      if (record->refs == 0)
+        continue;
+
+      header.n_records++;
+
+      blob.usr = blob_intern (offsets, strings, record->usr);
+      blob.name = blob_intern (offsets, strings, record->name);
+      blob.file = blob_intern (offsets, strings, record->file);
+      blob.context = record->context ? blob_intern (offsets, strings, record->context) + 1 : 0;
+      blob.line = record->line;
+      blob.column = record->column;
+      blob.kind = record->kind;
+      blob.refs = record->refs;
+
+      g_byte_array_append (buf, (const guint8 *)&blob, sizeof blob);
+    }
+
+  /* Keep whatever follows aligned when this is embedded in another file */
+  do
+    g_string_append_c (strings, '\0');
+  while ((strings->len % 4) != 0);
+
+  header.strings_len = strings->len;
+  memcpy (buf->data, &header, sizeof header);
+  g_byte_array_append (buf, (const guint8 *)strings->str, strings->len);
+
+  return g_byte_array_free_to_bytes (buf);
+}
+
+/**
+ * sl_xref_builder_deserialize:
+ * @self: a #SlXrefBuilder
+ * @bytes: the result of sl_xref_builder_serialize()
+ *
+ * Adds the occurrences serialized in @bytes to @self, as if the builder
+ * they came from had been merged with sl_xref_builder_merge().
+ *
+ * Returns: %TRUE if @bytes was valid
+ */
+gboolean
+sl_xref_builder_deserialize (SlXrefBuilder *self,
+                             GBytes        *bytes)
+{
+  const BlobHeader *header;
+  const BlobRecord *records;
+  const gchar *strings;
+  const guint8 *data;
+  gsize len;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (bytes != NULL, FALSE);
+
+  data = g_bytes_get_data (bytes, &len);
+
+  if (len < sizeof *header)
+    return FALSE;
+
+  header = (const BlobHeader *)(gconstpointer)data;
+
+  if (header->strings_len == 0 ||
+      len < sizeof *header + (guint64)header->n_records * sizeof (BlobRecord) + header->strings_len)
+    return FALSE;
+
+  records = (const BlobRecord *)(gconstpointer)(data + sizeof *header);
+  strings = (const gchar *)&records[header->n_records];
+
+  if (strings[header->strings_len - 1] != '\0')
+    return FALSE;
+
+  for (i = 0; i < header->n_records; i++)
+    {
+      const BlobRecord *record = &records[i];
+
+      if (record->usr >= header->strings_len ||
+          record->name >= header->strings_len ||
+          record->file >= header->strings_len ||
+          record->context > header->strings_len ||
+          record->refs == 0)
+        return FALSE;
+    }
+
+  for (i = 0; i < header->n_records; i++)
+    {
+      const BlobRecord *record = &records[i];
+      Record imported;
+
+      imported.usr = &strings[record->usr];
+      imported.file = &strings[record->file];
+      imported.context = record->context ? &strings[record->context - 1] : NULL;
+      imported.line = record->line;
+      imported.column = record->column;
+      imported.kind = record->kind;
+
+      sl_xref_builder_import (self, &imported, &imported);
+      sl_xref_builder_insert (self, &imported, &strings[record->name], record->refs, TRUE);
+    }
+
+  return TRUE;
+}
+
+typedef struct
+{
+  const gchar *usr;
+  const gchar *name;
+  guint32      id;
+} Symbol;
+
+typedef struct
+{
+  SlXrefBuilder *self;
+  const guint32 *record_symbols;
+} SortContext;
+
+static gint
+compare_symbol (gconstpointer a,
+                gconstpointer b)
+{
+  const Symbol *syma = *(const Symbol * const *)a;
+  const Symbol *symb = *(const Symbol * const *)b;
+  gint ret;
+
+  if (0 == (ret = strcmp (syma->name, symb->name)))
+    ret = strcmp (syma->usr, symb->usr);
+
+  return ret;
+}
+
+static gint
+compare_record (gconstpointer a,
+                gconstpointer b,
+                gpointer      user_data)
+{
+  const SortContext *context = user_data;
+  guint32 ia = *(const guint32 *)a;
+  guint32 ib = *(const guint32 *)b;
+  const Record *ra = &g_array_index (context->self->records, Record, ia);
+  const Record *rb = &g_array_index (context->self->records, Record, ib);
+  gint ret;
+
+  if (context->record_symbols[ia] != context->record_symbols[ib])
+    return context->record_symbols[ia] < context->record_symbols[ib] ? -1 : 1;
+
+  if (ra->kind != rb->kind)
+    return ra->kind < rb->kind ? -1 : 1;
+
+  if (ra->file != rb->file && 0 != (ret = strcmp (ra->file, rb->file)))
+    return ret;
+
+  if (ra->line != rb->line)
+    return ra->line < rb->line ? -1 : 1;
+
+  if (ra->column != rb->column)
+    return ra->column < rb->column ? -1 : 1;
+
+  return 0;
+}
+
+static gint
+compare_usr (gconstpointer a,
+             gconstpointer b,
+             gpointer      user_data)
+{
+  Symbol * const *sorted = user_data;
+
+  return strcmp (sorted[*(const guint32 *)a]->usr, sorted[*(const guint32 *)b]->usr);
+}
+
+/**
+ * sl_xref_builder_write:
+ * @self: a #SlXrefBuilder
+ * @filename: the index to write
+ * @error: a location for a #GError or %NULL
+ *
+ * Writes the occurrences in @self as an index for sl_xref_new_from_file().
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+sl_xref_builder_write (SlXrefBuilder  *self,
+                       const gchar    *filename,
+                       GError        **error)
+{
+  g_autoptr(GHashTable) symbols = NULL;
+  g_autoptr(GHashTable) offsets = NULL;
+  g_autoptr(GPtrArray) sorted = NULL;
+  g_autoptr(GByteArray) buf = NULL;
+  g_autoptr(GString) strings = NULL;
+  g_autofree guint32 *record_symbols = NULL;
+  g_autofree guint32 *order = NULL;
+  g_autofree guint32 *by_usr = NULL;
+  g_autofree XrefSymbol *xsymbols = NULL;
+  XrefHeader header = { 0 };
+  SortContext context;
+  guint n_records;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  symbols = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  sorted = g_ptr_array_new ();
+
+  /* USRs are interned, so symbols can be keyed by pointer */
+  for (i = 0; i < self->records->len; i++)
+    {
+      const Record *record = &g_array_index (self->records, Record, i);
+      Symbol *symbol;
+
+      /* Subtracted, no translation unit contributes it anymore */
+      if (record->refs == 0)
+        continue;
+
+      if (NULL == (symbol = g_hash_table_lookup (symbols, record->usr)))
+        {
+          symbol = g_new0 (Symbol, 1);
+          symbol->usr = record->usr;
+          symbol->name = record->name;
+          g_hash_table_insert (symbols, (gpointer)record->usr, symbol);
+          g_ptr_array_add (sorted, symbol);
+        }
+    }
+
+  g_ptr_array_sort (sorted, compare_symbol);
+
+  for (i = 0; i < sorted->len; i++)
+    ((Symbol *)g_ptr_array_index (sorted, i))->id = i;
+
+  /* Group the occurrences into posting lists, in symbol order */
+  record_symbols = g_new (guint32, MAX (1, self->records->len));
+  order = g_new (guint32, MAX (1, self->records->len));
+  n_records = 0;
+
+  for (i = 0; i < self->records->len; i++)
+    {
+      const Record *record = &g_array_index (self->records, Record, i);
+      const Symbol *symbol;
+
+      if (record->refs == 0)
+        continue;
+
+      symbol = g_hash_table_lookup (symbols, record->usr);
+      record_symbols[i] = symbol->id;
+      order[n_records++] = i;
+    }
+
+  context.self = self;
+  context.record_symbols = record_symbols;
+  g_qsort_with_data (order, n_records, sizeof (guint32), compare_record, &context);
+
+  by_usr = g_new (guint32, MAX (1, sorted->len));
+  for (i = 0; i < sorted->len; i++)
+    by_usr[i] = i;
+  g_qsort_with_data (by_usr, sorted->len, sizeof (guint32), compare_usr, sorted->pdata);
+
+  offsets = g_hash_table_new (NULL, NULL);
+  strings = g_string_new (NULL);
+  xsymbols = g_new0 (XrefSymbol, MAX (1, sorted->len));
+
+  for (i = 0; i < sorted->len; i++)
+    {
+      const Symbol *symbol = g_ptr_array_index (sorted, i);
+
+      xsymbols[i].usr = blob_intern (offsets, strings, symbol->usr);
+      xsymbols[i].name = blob_intern (offsets, strings, symbol->name);
+    }
+
+  buf = g_byte_array_new ();
+
+  header.magic = XREF_MAGIC;
+  header.version = XREF_VERSION;
+  header.n_symbols = sorted->len;
+  header.n_occurrences = n_records;
+  g_byte_array_append (buf, (const guint8 *)&header, sizeof header);
+
+  /* Placeholders, filled in once the posting lists are known */
+  g_byte_array_append (buf, (const guint8 *)xsymbols, sizeof (XrefSymbol) * sorted->len);
+  g_byte_array_append (buf, (const guint8 *)by_usr, sizeof (guint32) * sorted->len);
+
+  for (i = 0; i < n_records; i++)
+    {
+      const Record *record = &g_array_index (self->records, Record, order[i]);
+      XrefSymbol *xsymbol = &xsymbols[record_symbols[order[i]]];
+      XrefOccurrence occurrence;
+
+      if (xsymbol->n_occurrences++ == 0)
+        xsymbol->first = i;
+
+      occurrence.file = blob_intern (offsets, strings, record->file);
+      occurrence.line = record->line;
+      occurrence.column = record->column;
+      occurrence.kind = record->kind;
+      occurrence.context = NO_CONTEXT;
+
+      if (record->context != NULL)
+        {
+          const Symbol *context_symbol = g_hash_table_lookup (symbols, record->context);
+
+          if (context_symbol != NULL)
+            occurrence.context = context_symbol->id;
+        }
+
+      g_byte_array_append (buf, (const guint8 *)&occurrence, sizeof occurrence);
+    }
+
+  memcpy (buf->data + sizeof header, xsymbols, sizeof (XrefSymbol) * sorted->len);
+
+  g_string_append_c (strings, '\0');
+  ((XrefHeader *)(gpointer)buf->data)->strings_len = strings->len;
+  g_byte_array_append (buf, (const guint8 *)strings->str, strings->len);
+
+  return g_file_set_contents (filename, (const gchar *)buf->data, buf->len, error);
+}
+
+static gboolean
+set_invalid (GError      **error,
+             const gchar  *filename)
+{
+  g_set_error (error,
+               G_IO_ERROR,
+               G_IO_ERROR_INVALID_DATA,
+               "%s is not a valid cross-reference index",
+               filename);
+  return FALSE;
+}
+
+/**
+ * sl_xref_new_from_file:
+ * @filename: an index written with sl_xref_builder_write()
+ * @error: a location for a #GError or %NULL
+ *
+ * Opens a cross-reference index. The index is mapped rather than read, so
+ * opening it does not depend on its size.
+ *
+ * Returns: (transfer full): a #SlXref or %NULL and @error is set.
+ */
+SlXref *
+sl_xref_new_from_file (const gchar  *filename,
+                       GError      **error)
+{
+  g_autoptr(SlXref) self = NULL;
+  const gchar *data;
+  guint64 required;
+  gsize len;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  self = g_slice_new0 (SlXref);
+
+  if (NULL == (self->mf = g_mapped_file_new (filename, FALSE, error)))
+    return NULL;
+
+  data = g_mapped_file_get_contents (self->mf);
+  len = g_mapped_file_get_length (self->mf);
+
+  if (len < sizeof (XrefHeader))
+    return set_invalid (error, filename), NULL;
+
+  self->header = (const XrefHeader *)(gconstpointer)data;
+
+  if (self->header->magic != XREF_MAGIC || self->header->version != XREF_VERSION)
+    return set_invalid (error, filename), NULL;
+
+  required = sizeof (XrefHeader)
+           + (guint64)self->header->n_symbols * (sizeof (XrefSymbol) + sizeof (guint32))
+           + (guint64)self->header->n_occurrences * sizeof (XrefOccurrence)
+           + self->header->strings_len;
+
+  if (len < required || self->header->strings_len == 0)
+    return set_invalid (error, filename), NULL;
+
+  self->symbols = (const XrefSymbol *)(gconstpointer)(data + sizeof (XrefHeader));
+  self->by_usr = (const guint32 *)&self->symbols[self->header->n_symbols];
+  self->occurrences = (const XrefOccurrence *)(gconstpointer)&self->by_usr[self->header->n_symbols];
+  self->strings = (const gchar *)&self->occurrences[self->header->n_occurrences];
+
+  if (self->strings[self->header->strings_len - 1] != '\0')
+    return set_invalid (error, filename), NULL;
+
+  return g_steal_pointer (&self);
+}
+
+void
+sl_xref_free (SlXref *self)
+{
+  if (self != NULL)
+    {
+      g_clear_pointer (&self->mf, g_mapped_file_unref);
+      g_slice_free (SlXref, self);
+    }
+}
+
+static inline const gchar *
+sl_xref_get_string (SlXref  *self,
+                    guint32  offset)
+{
+  return offset < self->header->strings_len ? &self->strings[offset] : "";
+}
+
+static guint
+sl_xref_report (SlXref           *self,
+                guint32           id,
+                SlXrefKind        kinds,
+                SlXrefFunc        func,
+                gpointer          user_data)
+{
+  const XrefSymbol *symbol = &self->symbols[id];
+  SlXrefOccurrence occurrence;
+  guint count = 0;
+  guint i;
+
+  if ((guint64)symbol->first + symbol->n_occurrences > self->header->n_occurrences)
+    return 0;
+
+  occurrence.usr = sl_xref_get_string (self, symbol->usr);
+  occurrence.name = sl_xref_get_string (self, symbol->name);
+
+  for (i = 0; i < symbol->n_occurrences; i++)
+    {
+      const XrefOccurrence *xocc = &self->occurrences[symbol->first + i];
+
+      if ((xocc->kind & kinds) == 0)
+        continue;
+
+      occurrence.kind = xocc->kind;
+      occurrence.file = sl_xref_get_string (self, xocc->file);
+      occurrence.line = xocc->line;
+      occurrence.column = xocc->column;
+      occurrence.context_usr = NULL;
+      occurrence.context_name = NULL;
+
+      if (xocc->context < self->header->n_symbols)
+        {
+          const XrefSymbol *context = &self->symbols[xocc->context];
+
+          occurrence.context_usr = sl_xref_get_string (self, context->usr);
+          occurrence.context_name = sl_xref_get_string (self, context->name);
+        }
+
+      func (&occurrence, user_data);
+      count++;
+    }
+
+  return count;
+}
+
+/**
+ * sl_xref_query:
+ * @self: a #SlXref
+ * @symbol: the name or USR of a symbol
+ * @kinds: the kinds of occurrences to report
+ * @func: a function to call for each occurrence
+ * @user_data: closure data for @func
+ *
+ * Reports the occurrences of @symbol, ordered by kind and then location.
+ * If @symbol is a USR (starting with "c:") only that symbol is reported,
+ * otherwise every symbol with that name (such as static functions of the
+ * same name in different files) is.
+ *
+ * Returns: the number of occurrences reported
+ */
+guint
+sl_xref_query (SlXref      *self,
+               const gchar *symbol,
+               SlXrefKind   kinds,
+               SlXrefFunc   func,
+               gpointer     user_data)
+{
+  guint32 lo = 0;
+  guint32 hi;
+  guint count = 0;
+
+  g_return_val_if_fail (self != NULL, 0);
+  g_return_val_if_fail (symbol != NULL, 0);
+  g_return_val_if_fail (func != NULL, 0);
+
+  hi = self->header->n_symbols;
+
+  if (g_str_has_prefix (symbol, "c:"))
+    {
+      while (lo < hi)
+        {
+          guint32 mid = lo + (hi - lo) / 2;
+          guint32 id = self->by_usr[mid];
+          gint cmp;
+
+          if (id >= self->header->n_symbols)
+            return 0;
+
+          cmp = strcmp (sl_xref_get_string (self, self->symbols[id].usr), symbol);
+
+          if (cmp == 0)
+            return sl_xref_report (self, id, kinds, func, user_data);
+          else if (cmp < 0)
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+
+      return 0;
+    }
+
+  /* Find the first symbol with the name, then report each one that follows */
+  while (lo < hi)
+    {
+      guint32 mid = lo + (hi - lo) / 2;
+
+      if (strcmp (sl_xref_get_string (self, self->symbols[mid].name), symbol) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  for (; lo < self->header->n_symbols; lo++)
+    {
+      if (!g_str_equal (sl_xref_get_string (self, self->symbols[lo].name), symbol))
+        break;
+
+      count += sl_xref_report (self, lo, kinds, func, user_data);
+    }
+
+  return count;
+}
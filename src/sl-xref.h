@@ -0,0 +1,91 @@
+/* sl-xref.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_XREF_H
+#define SL_XREF_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  SL_XREF_DECLARATION = 1 << 0,
+  SL_XREF_DEFINITION  = 1 << 1,
+  SL_XREF_REFERENCE   = 1 << 2,
+  SL_XREF_CALL        = 1 << 3,
+  SL_XREF_ALL         = 0xF,
+} SlXrefKind;
+
+typedef struct
+{
+  SlXrefKind   kind;
+  const gchar *usr;
+  const gchar *name;
+  const gchar *file;
+  guint        line;
+  guint        column;
+
+  /* The function containing the occurrence, if any */
+  const gchar *context_usr;
+  const gchar *context_name;
+} SlXrefOccurrence;
+
+typedef void (*SlXrefFunc) (const SlXrefOccurrence *occurrence,
+                            gpointer                user_data);
+
+typedef struct _SlXrefBuilder SlXrefBuilder;
+typedef struct _SlXref SlXref;
+
+SlXrefBuilder *sl_xref_builder_new         (void);
+void           sl_xref_builder_free        (SlXrefBuilder  *self);
+void           sl_xref_builder_clear       (SlXrefBuilder  *self);
+void           sl_xref_builder_add         (SlXrefBuilder  *self,
+                                            SlXrefKind      kind,
+                                            const gchar    *usr,
+                                            const gchar    *name,
+                                            const gchar    *file,
+                                            guint           line,
+                                            guint           column,
+                                            const gchar    *context_usr);
+void           sl_xref_builder_merge       (SlXrefBuilder  *self,
+                                            SlXrefBuilder  *other);
+void           sl_xref_builder_subtract    (SlXrefBuilder  *self,
+                                            SlXrefBuilder  *other);
+GBytes        *sl_xref_builder_serialize   (SlXrefBuilder  *self);
+gboolean       sl_xref_builder_deserialize (SlXrefBuilder  *self,
+                                            GBytes         *bytes);
+gboolean       sl_xref_builder_write       (SlXrefBuilder  *self,
+                                            const gchar    *filename,
+                                            GError        **error);
+
+SlXref        *sl_xref_new_from_file       (const gchar    *filename,
+                                            GError        **error);
+void           sl_xref_free                (SlXref         *self);
+guint          sl_xref_query               (SlXref         *self,
+                                            const gchar    *symbol,
+                                            SlXrefKind      kinds,
+                                            SlXrefFunc      func,
+                                            gpointer        user_data);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SlXrefBuilder, sl_xref_builder_free)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SlXref, sl_xref_free)
+
+G_END_DECLS
+
+#endif /* SL_XREF_H */
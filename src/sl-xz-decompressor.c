@@ -0,0 +1,188 @@
+/* sl-xz-decompressor.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "sl-xz-decompressor"
+
+#include "sl-xz-decompressor.h"
+
+#ifdef HAVE_LZMA
+
+#include <lzma.h>
+
+/*
+ * GIO can only decompress zlib and gzip, this does the same for xz so that
+ * compressed logs can be read through a GConverterInputStream.
+ */
+
+struct _SlXzDecompressor
+{
+  GObject     parent_instance;
+  lzma_stream stream;
+  lzma_ret    init_ret;
+};
+
+static void converter_iface_init (GConverterIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (SlXzDecompressor, sl_xz_decompressor, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_CONVERTER, converter_iface_init))
+
+static void
+sl_xz_decompressor_start (SlXzDecompressor *self)
+{
+  lzma_stream init = LZMA_STREAM_INIT;
+
+  g_assert (SL_IS_XZ_DECOMPRESSOR (self));
+
+  self->stream = init;
+
+  /* Logs compressed in pieces and concatenated are read as one */
+  self->init_ret = lzma_stream_decoder (&self->stream, UINT64_MAX, LZMA_CONCATENATED);
+}
+
+static GConverterResult
+sl_xz_decompressor_convert (GConverter      *converter,
+                            const void      *inbuf,
+                            gsize            inbuf_size,
+                            void            *outbuf,
+                            gsize            outbuf_size,
+                            GConverterFlags  flags,
+                            gsize           *bytes_read,
+                            gsize           *bytes_written,
+                            GError         **error)
+{
+  SlXzDecompressor *self = (SlXzDecompressor *)converter;
+  lzma_ret ret;
+
+  g_assert (SL_IS_XZ_DECOMPRESSOR (self));
+
+  if (self->init_ret != LZMA_OK)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "Failed to initialize the xz decoder (%d)", self->init_ret);
+      return G_CONVERTER_ERROR;
+    }
+
+  self->stream.next_in = inbuf;
+  self->stream.avail_in = inbuf_size;
+  self->stream.next_out = outbuf;
+  self->stream.avail_out = outbuf_size;
+
+  ret = lzma_code (&self->stream, (flags & G_CONVERTER_INPUT_AT_END) ? LZMA_FINISH : LZMA_RUN);
+
+  *bytes_read = inbuf_size - self->stream.avail_in;
+  *bytes_written = outbuf_size - self->stream.avail_out;
+
+  switch (ret)
+    {
+    case LZMA_OK:
+      if (*bytes_read == 0 && *bytes_written == 0)
+        {
+          if (self->stream.avail_out == 0)
+            g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                                 "Not enough space for the decompressed data");
+          else
+            g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                                 "Need more input");
+          return G_CONVERTER_ERROR;
+        }
+      return (flags & G_CONVERTER_FLUSH) ? G_CONVERTER_FLUSHED : G_CONVERTER_CONVERTED;
+
+    case LZMA_STREAM_END:
+      return G_CONVERTER_FINISHED;
+
+    case LZMA_BUF_ERROR:
+      if (self->stream.avail_out == 0)
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                             "Not enough space for the decompressed data");
+      else if (flags & G_CONVERTER_INPUT_AT_END)
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                             "Truncated xz data");
+      else
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                             "Need more input");
+      return G_CONVERTER_ERROR;
+
+    case LZMA_MEM_ERROR:
+    case LZMA_MEMLIMIT_ERROR:
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                           "Not enough memory to decompress xz data");
+      return G_CONVERTER_ERROR;
+
+    default:
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Invalid xz data (%d)", ret);
+      return G_CONVERTER_ERROR;
+    }
+}
+
+static void
+sl_xz_decompressor_reset (GConverter *converter)
+{
+  SlXzDecompressor *self = (SlXzDecompressor *)converter;
+
+  g_assert (SL_IS_XZ_DECOMPRESSOR (self));
+
+  lzma_end (&self->stream);
+  sl_xz_decompressor_start (self);
+}
+
+static void
+converter_iface_init (GConverterIface *iface)
+{
+  iface->convert = sl_xz_decompressor_convert;
+  iface->reset = sl_xz_decompressor_reset;
+}
+
+static void
+sl_xz_decompressor_finalize (GObject *object)
+{
+  SlXzDecompressor *self = (SlXzDecompressor *)object;
+
+  lzma_end (&self->stream);
+
+  G_OBJECT_CLASS (sl_xz_decompressor_parent_class)->finalize (object);
+}
+
+static void
+sl_xz_decompressor_class_init (SlXzDecompressorClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = sl_xz_decompressor_finalize;
+}
+
+static void
+sl_xz_decompressor_init (SlXzDecompressor *self)
+{
+  sl_xz_decompressor_start (self);
+}
+
+/**
+ * sl_xz_decompressor_new:
+ *
+ * Creates a #GConverter which decompresses xz data.
+ *
+ * Returns: (transfer full): a new #GConverter
+ */
+GConverter *
+sl_xz_decompressor_new (void)
+{
+  return g_object_new (SL_TYPE_XZ_DECOMPRESSOR, NULL);
+}
+
+#endif /* HAVE_LZMA */
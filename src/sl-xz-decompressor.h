@@ -0,0 +1,38 @@
+/* sl-xz-decompressor.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SL_XZ_DECOMPRESSOR_H
+#define SL_XZ_DECOMPRESSOR_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#ifdef HAVE_LZMA
+
+#define SL_TYPE_XZ_DECOMPRESSOR (sl_xz_decompressor_get_type())
+
+G_DECLARE_FINAL_TYPE (SlXzDecompressor, sl_xz_decompressor, SL, XZ_DECOMPRESSOR, GObject)
+
+GConverter *sl_xz_decompressor_new (void);
+
+#endif
+
+G_END_DECLS
+
+#endif /* SL_XZ_DECOMPRESSOR_H */
@@ -0,0 +1,56 @@
+#!/bin/sh
+#
+# Ingests a build log in a daemon, then changes one of its files twice.
+# Each reparse replaces what the unit adds to the totals, so the most
+# called functions must be the same before and after.
+
+set -e
+
+SIGHTLINE=${SIGHTLINE:-./sightline}
+FIXTURE=${FIXTURE:-../bench/fixture}
+
+tmp=$(mktemp -d)
+pid=
+trap '[ -n "$pid" ] && kill "$pid" 2>/dev/null; rm -rf "$tmp"' EXIT
+
+cp -R "$FIXTURE" "$tmp/fixture"
+
+{
+  echo "make[1]: Entering directory '$tmp/fixture'"
+  for source in "$tmp"/fixture/*.c; do
+    echo "gcc -DHAVE_CONFIG_H -I. -Wall -g -O2 -c -o x.o $(basename "$source")"
+  done
+  echo "make[1]: Leaving directory '$tmp/fixture'"
+} > "$tmp/build.log"
+
+"$SIGHTLINE" -j 2 --daemon "$tmp/socket" &
+pid=$!
+
+for i in 1 2 3 4 5 6 7 8 9 10; do
+  [ -S "$tmp/socket" ] && break
+  sleep 0.2
+done
+
+"$SIGHTLINE" --connect "$tmp/socket" ingest "$tmp/build.log" > /dev/null
+"$SIGHTLINE" --connect "$tmp/socket" top 20 > "$tmp/before"
+
+if [ ! -s "$tmp/before" ]; then
+  echo "No calls were counted after ingesting the log" >&2
+  exit 1
+fi
+
+for i in 1 2; do
+  touch "$tmp/fixture/list.c"
+  "$SIGHTLINE" --connect "$tmp/socket" reparse "$tmp/fixture/list.c" > /dev/null
+  "$SIGHTLINE" --connect "$tmp/socket" top 20 > "$tmp/after"
+
+  if ! cmp -s "$tmp/before" "$tmp/after"; then
+    echo "Reparsing an unchanged file changed the totals:" >&2
+    diff "$tmp/before" "$tmp/after" >&2
+    exit 1
+  fi
+done
+
+"$SIGHTLINE" --connect "$tmp/socket" quit > /dev/null
+wait "$pid"
+pid=
@@ -0,0 +1,36 @@
+#!/bin/sh
+#
+# Exports the compile commands of a build log as a compile_commands.json
+# and imports it again, which must give the same flags. This covers the
+# include directories and macros probed from gcc, which are only found in
+# the exported flags once the file is read back.
+
+set -e
+
+SIGHTLINE=${SIGHTLINE:-./sightline}
+FIXTURE=$(cd "${FIXTURE:-../bench/fixture}" && pwd)
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+{
+  echo "make[1]: Entering directory '$FIXTURE'"
+  for source in "$FIXTURE"/*.c; do
+    echo "gcc -DHAVE_CONFIG_H -I. -isystem include -Wall -g -O2 -c -o x.o $(basename "$source")"
+  done
+  echo "make[1]: Leaving directory '$FIXTURE'"
+} > "$tmp/build.log"
+
+"$SIGHTLINE" --export-json "$tmp/first.json" "$tmp/build.log" > /dev/null
+"$SIGHTLINE" --export-json "$tmp/second.json" "$tmp/first.json" > /dev/null
+
+if ! grep -q -- "-isystem$FIXTURE/include" "$tmp/first.json"; then
+  echo "The -isystem directory of the log was not exported" >&2
+  exit 1
+fi
+
+if ! cmp -s "$tmp/first.json" "$tmp/second.json"; then
+  echo "Importing the exported commands changed their flags:" >&2
+  diff "$tmp/first.json" "$tmp/second.json" >&2
+  exit 1
+fi